@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Sensor acquisition shared by both firmwares: one BME680 conversion plus
+ * one MQ2 ADC reading per sample, handed to a storage and a transport.
+ *
+ * Everything board-specific is a policy passed as a template parameter,
+ * so each firmware gets a fully inlined build with no virtual dispatch.
+ * The policies are plain classes with these non-virtual members:
+ *
+ *   Bme        begin(addr), setTemperatureOversampling() ... setGasHeater(),
+ *              beginReading() (ready time in ms, 0 on error), endReading(),
+ *              and the temperature, humidity, pressure, gas_resistance
+ *              results, i.e. Adafruit_BME680 or a host mock (which must
+ *              also provide the BME680_OS_* and BME680_FILTER_* constants)
+ *   Adc        float read()      MQ2 reading in ADC counts; fractional
+ *                                when oversampled
+ *   Clock      uint32_t now()        ms, the time base of beginReading()
+ *              uint32_t timestamp()  ms, stamped on the sample
+ *              uint32_t cycles()     CPU cycle counter, may wrap
+ *   Storage    void store(const AcqSample &)
+ *   Transport  void send(const AcqSample &)
+ *
+ * Storage and transport only see samples whose conversion succeeded, and
+ * report their own errors.
+ * AcqNullStorage and AcqNullTransport stand in when a firmware does its
+ * own thing with the samples. tools/acquisition_bench.cpp builds the same
+ * template on the host with mock policies and compares it with the
+ * hand-written equivalent.
+ */
+
+/** One raw sample, in the units the drivers report */
+struct AcqSample
+{
+    uint32_t timestamp;         // Clock::timestamp() at the start of the sample
+    float temperature;          // C
+    float humidity;             // %
+    uint32_t pressure;          // Pa
+    uint32_t gas_resistance;    // Ohms
+    float mq2_raw;              // ADC counts
+};
+
+struct AcqNullStorage
+{
+    void store(const AcqSample &) {}
+};
+
+struct AcqNullTransport
+{
+    void send(const AcqSample &) {}
+};
+
+/**
+ * BME680 settings used by both boards: 8x/2x/4x oversampling of
+ * temperature/humidity/pressure, IIR filter 3, gas heater 320 C for 150 ms
+ */
+template <class Bme>
+inline void ACQ_configureBme(Bme &bme)
+{
+    bme.setTemperatureOversampling(BME680_OS_8X);
+    bme.setHumidityOversampling(BME680_OS_2X);
+    bme.setPressureOversampling(BME680_OS_4X);
+    bme.setIIRFilterSize(BME680_FILTER_SIZE_3);
+    bme.setGasHeater(320, 150);
+}
+
+template <class Bme, class Adc, class Clock, class Storage, class Transport>
+class Acquisition
+{
+public:
+    Acquisition(Bme &bme, Adc &adc, Clock &clock, Storage &storage, Transport &transport)
+        : bme(bme), adc(adc), clock(clock), storage(storage), transport(transport),
+          pending(false), last_cycles(0), max_cycles(0), start_cycles(0)
+    {
+        sample = AcqSample();
+    }
+
+    /** Finds and configures the BME680; false if it does not respond */
+    bool begin(uint8_t bme_addr)
+    {
+        if (!bme.begin(bme_addr))
+            return false;
+        ACQ_configureBme(bme);
+        return true;
+    }
+
+    /**
+     * Starts a BME680 conversion and reads the MQ2 meanwhile. Returns the
+     * Clock::now() time the conversion can be collected, or 0 if it could
+     * not be started.
+     */
+    uint32_t start()
+    {
+        uint32_t c0 = clock.cycles();
+        uint32_t ready = bme.beginReading();
+        pending = ready != 0;
+        sample.timestamp = clock.timestamp();
+        sample.mq2_raw = adc.read();
+        start_cycles = clock.cycles() - c0;
+        return ready;
+    }
+
+    /**
+     * Collects the conversion and passes the sample on. On failure the
+     * sample keeps the driver's previous results and is not passed on.
+     */
+    bool finish()
+    {
+        uint32_t c0 = clock.cycles();
+        bool ok = pending && bme.endReading();
+        pending = false;
+        sample.temperature = bme.temperature;
+        sample.humidity = bme.humidity;
+        sample.pressure = bme.pressure;
+        sample.gas_resistance = bme.gas_resistance;
+        if (ok)
+        {
+            storage.store(sample);
+            transport.send(sample);
+        }
+
+        last_cycles = start_cycles + (clock.cycles() - c0);
+        if (last_cycles > max_cycles)
+            max_cycles = last_cycles;
+        return ok;
+    }
+
+    /** start() and finish(), busy-waiting for the conversion in between */
+    bool acquire()
+    {
+        uint32_t ready = start();
+        if (ready == 0)
+            return false;
+        while ((int32_t)(clock.now() - ready) < 0)
+        {
+        }
+        return finish();
+    }
+
+    const AcqSample &last() const { return sample; }
+
+    /** CPU cycles of the last sample, excluding the wait for the conversion */
+    uint32_t lastCycles() const { return last_cycles; }
+    uint32_t maxCycles() const { return max_cycles; }
+    void resetStats() { max_cycles = 0; }
+
+private:
+    Bme &bme;
+    Adc &adc;
+    Clock &clock;
+    Storage &storage;
+    Transport &transport;
+    AcqSample sample;
+    bool pending;
+    uint32_t last_cycles;
+    uint32_t max_cycles;
+    uint32_t start_cycles;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-point gas sensor math for targets where pow() is expensive (it is
+ * double precision in software on the ESP32, and the ATmega has no FPU at
+ * all). The tables go to flash on either.
+ *
+ * Units: resistances in ohms (uint32_t), Rs/R0 ratios in Q16.16, gas
+ * concentrations in ppm scaled by 2^FRAC_BITS of the curve. The caller
+ * forms the ratio; the M5 divides in single-precision float, which its FPU
+ * does in hardware, and rounds the result to Q16.16.
+ *
+ * Log-log datasheet curves (ppm = A * ratio^B) are evaluated from a table
+ * generated at compile time: ratio points are spaced 2^-LOG2_STEPS of an
+ * octave apart and linearly interpolated. For a power law the relative
+ * interpolation error is about |B (B - 1)| / 8 * 4^-LOG2_STEPS, plus one
+ * unit (2^-FRAC_BITS ppm) of rounding. For the MQ2 smoke curve below
+ * (B = -3.5, 32 steps per octave) that is about 0.2 %. Measured against
+ * 605 * pow(ratio, -3.5) over 0.125 <= ratio < 10 with
+ * tools/gasmath_bench.cpp, the error is 0.26 % worst case and 0.075 % on
+ * average.
+ */
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define GASMATH_PROGMEM PROGMEM
+#define GASMATH_READ32(p) pgm_read_dword(p)
+#else
+#define GASMATH_PROGMEM
+#define GASMATH_READ32(p) (*(p))
+#endif
+
+const uint32_t GAS_RATIO_ONE = 65536;   // 1.0 in Q16.16
+
+/**
+ * Sensor resistance from the load-resistor divider: Rs = RL * (Vc - Vrl) / Vrl.
+ * vrl and vc may be in any common unit (ADC counts, mV, ...) as long as
+ * rl_ohms * vc fits in 32 bits. Saturates for a zero reading.
+ */
+inline uint32_t GAS_rsOhms(uint32_t vrl, uint32_t vc, uint32_t rl_ohms)
+{
+    if (vrl == 0)
+        return 0xFFFFFFFFul;
+    if (vrl >= vc)
+        return 0;
+    return (rl_ohms * (vc - vrl) + vrl / 2) / vrl;
+}
+
+// Compile-time math for the tables (C++11 constexpr: one return statement,
+// recursion instead of loops). Only ever evaluated by the compiler.
+
+constexpr double GASMATH_LN2 = 0.69314718055994530942;
+
+constexpr double GASMATH_square(double x)
+{
+    return x * x;
+}
+
+constexpr double GASMATH_pow2(int e)
+{
+    return e > 0 ? 2 * GASMATH_pow2(e - 1) : e < 0 ? GASMATH_pow2(e + 1) / 2 : 1;
+}
+
+// sum of z^k / k over odd k <= n, i.e. atanh(z) truncated
+constexpr double GASMATH_atanhSeries(double z2, double term, int k, int n)
+{
+    return k > n ? 0 : term / k + GASMATH_atanhSeries(z2, term * z2, k + 2, n);
+}
+
+// ln(x) = k ln 2 + 2 atanh((m - 1) / (m + 1)) with m in [1, 2)
+constexpr double GASMATH_ln(double x)
+{
+    return x >= 2 ? GASMATH_ln(x / 2) + GASMATH_LN2
+         : x < 1 ? GASMATH_ln(x * 2) - GASMATH_LN2
+         : 2 * GASMATH_atanhSeries(GASMATH_square((x - 1) / (x + 1)), (x - 1) / (x + 1), 1, 49);
+}
+
+// Taylor series, terms n..N
+constexpr double GASMATH_expSeries(double x, double term, int n, int N)
+{
+    return n > N ? term : term + GASMATH_expSeries(x, term * x / n, n + 1, N);
+}
+
+// exp(x) = exp(x / 2)^2 until |x| <= 0.5
+constexpr double GASMATH_exp(double x)
+{
+    return x > 0.5 || x < -0.5 ? GASMATH_square(GASMATH_exp(x / 2)) : GASMATH_expSeries(x, 1, 1, 20);
+}
+
+template <unsigned... I>
+struct GasIndexList
+{
+};
+
+template <unsigned N, unsigned... I>
+struct GasMakeIndices : GasMakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <unsigned... I>
+struct GasMakeIndices<0, I...>
+{
+    typedef GasIndexList<I...> type;
+};
+
+template <typename Curve, int MIN_OCTAVE, unsigned LOG2_STEPS, unsigned FRAC_BITS, typename Indices>
+struct GasCurveTable;
+
+template <typename Curve, int MIN_OCTAVE, unsigned LOG2_STEPS, unsigned FRAC_BITS, unsigned... I>
+struct GasCurveTable<Curve, MIN_OCTAVE, LOG2_STEPS, FRAC_BITS, GasIndexList<I...> >
+{
+    // Ratio of table entry i: 2^(MIN_OCTAVE + octave) * (1 + step / STEPS)
+    static constexpr double ratio(unsigned i)
+    {
+        return GASMATH_pow2(MIN_OCTAVE + (int)(i >> LOG2_STEPS)) *
+               (1 + (double)(i & ((1u << LOG2_STEPS) - 1)) / (1u << LOG2_STEPS));
+    }
+
+    static constexpr uint32_t quantize(double ppm_scaled)
+    {
+        return ppm_scaled >= 4294967295.0 ? 0xFFFFFFFFul : (uint32_t)(ppm_scaled + 0.5);
+    }
+
+    static constexpr uint32_t entry(unsigned i)
+    {
+        return quantize(Curve::A * GASMATH_exp(Curve::B * GASMATH_ln(ratio(i))) * GASMATH_pow2(FRAC_BITS));
+    }
+
+    static constexpr uint32_t values[sizeof...(I)] GASMATH_PROGMEM = {entry(I)...};
+};
+
+template <typename Curve, int MIN_OCTAVE, unsigned LOG2_STEPS, unsigned FRAC_BITS, unsigned... I>
+constexpr uint32_t GasCurveTable<Curve, MIN_OCTAVE, LOG2_STEPS, FRAC_BITS, GasIndexList<I...> >::values[sizeof...(I)];
+
+/**
+ * Datasheet curve ppm = Curve::A * ratio^Curve::B, tabulated over OCTAVES
+ * octaves of ratio starting at 2^MIN_OCTAVE. Curve is a type with
+ * static constexpr double members A and B.
+ */
+template <typename Curve, int MIN_OCTAVE, unsigned OCTAVES, unsigned LOG2_STEPS, unsigned FRAC_BITS>
+class GasCurve
+{
+    static_assert(16 + MIN_OCTAVE >= (int)LOG2_STEPS, "GasCurve: table finer than the Q16 ratio");
+    static_assert(MIN_OCTAVE + (int)OCTAVES < 16, "GasCurve: table beyond the Q16 ratio range");
+
+public:
+    static const unsigned STEPS = 1u << LOG2_STEPS;
+    static const unsigned SIZE = OCTAVES * STEPS + 1;
+
+    typedef GasCurveTable<Curve, MIN_OCTAVE, LOG2_STEPS, FRAC_BITS,
+                          typename GasMakeIndices<SIZE>::type> Table;
+
+    /** Whether the ratio lies inside the table; outside, ppm() clamps */
+    static bool inRange(uint32_t ratio_q16)
+    {
+        return ratio_q16 >= (1ul << (16 + MIN_OCTAVE)) &&
+               ratio_q16 < (1ul << (16 + MIN_OCTAVE + OCTAVES));
+    }
+
+    /** Concentration in ppm * 2^FRAC_BITS */
+    static uint32_t ppm(uint32_t ratio_q16)
+    {
+        if (ratio_q16 < (1ul << (16 + MIN_OCTAVE)))
+            return GASMATH_READ32(&Table::values[0]);
+
+        int msb = 31 - __builtin_clzl(ratio_q16) + 8 * ((int)sizeof(unsigned long) - 4);
+        unsigned octave = msb - 16 - MIN_OCTAVE;
+        if (octave >= OCTAVES)
+            return GASMATH_READ32(&Table::values[SIZE - 1]);
+
+        // Below the leading one: LOG2_STEPS bits of step, the rest is the fraction
+        unsigned shift = msb - LOG2_STEPS;
+        unsigned i = octave * STEPS + ((ratio_q16 >> shift) & (STEPS - 1));
+        uint32_t frac = ratio_q16 & ((1ul << shift) - 1);
+        uint32_t f12 = shift >= 12 ? frac >> (shift - 12) : frac << (12 - shift);
+
+        uint32_t y0 = GASMATH_READ32(&Table::values[i]);
+        uint32_t y1 = GASMATH_READ32(&Table::values[i + 1]);
+        return y1 >= y0 ? y0 + mul12(y1 - y0, f12) : y0 - mul12(y0 - y1, f12);
+    }
+
+    static float ppmFloat(uint32_t ratio_q16)
+    {
+        return ppm(ratio_q16) * (1.0f / (1ul << FRAC_BITS));
+    }
+
+private:
+    // d * f / 4096 for f < 4096 without overflowing 32 bits
+    static uint32_t mul12(uint32_t d, uint32_t f)
+    {
+        return (d >> 12) * f + (((d & 0xFFF) * f) >> 12);
+    }
+};
+
+/** MQ2 smoke curve from the datasheet: ppm = 605 * (Rs/R0)^-3.5 */
+struct MQ2SmokeCurve
+{
+    static constexpr double A = 605.0;
+    static constexpr double B = -3.5;
+};
+
+// Rs/R0 from 1/8 (876k ppm, far beyond the sensor) to 16, 32 steps per
+// octave (900 bytes of flash), ppm in Q20.12
+typedef GasCurve<MQ2SmokeCurve, -3, 7, 5, 12> MQ2SmokePpm;
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * The few atomic operations LogQueue needs, on whatever the target offers.
+ *
+ * AVR has no <atomic>; there a 16-bit access is not atomic either, so each
+ * operation runs with interrupts masked for a handful of cycles. Elsewhere
+ * this is std::atomic with acquire/release ordering.
+ */
+#if defined(__AVR__)
+
+#include <util/atomic.h>
+
+typedef uint16_t LogIndex;
+typedef int16_t LogDiff;
+
+template <typename T>
+class LogAtomic
+{
+public:
+    LogAtomic(T v = 0) : value(v) {}
+
+    T load() const
+    {
+        T v;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = value; }
+        return v;
+    }
+
+    void store(T v)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { value = v; }
+    }
+
+    /** Sets desired if the value is expected, else loads the value into expected */
+    bool compareExchange(T &expected, T desired)
+    {
+        bool ok = false;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if (value == expected)
+            {
+                value = desired;
+                ok = true;
+            }
+            else
+            {
+                expected = value;
+            }
+        }
+        return ok;
+    }
+
+    T fetchAdd(T d)
+    {
+        T v;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            v = value;
+            value = v + d;
+        }
+        return v;
+    }
+
+private:
+    volatile T value;
+};
+
+#else
+
+#include <atomic>
+
+typedef uint32_t LogIndex;
+typedef int32_t LogDiff;
+
+template <typename T>
+class LogAtomic
+{
+public:
+    LogAtomic(T v = 0) : value(v) {}
+
+    T load() const { return value.load(std::memory_order_acquire); }
+
+    void store(T v) { value.store(v, std::memory_order_release); }
+
+    /** Sets desired if the value is expected, else loads the value into expected */
+    bool compareExchange(T &expected, T desired)
+    {
+        return value.compare_exchange_weak(expected, desired, std::memory_order_acq_rel,
+                                           std::memory_order_acquire);
+    }
+
+    T fetchAdd(T d) { return value.fetch_add(d, std::memory_order_relaxed); }
+
+private:
+    std::atomic<T> value;
+};
+
+#endif
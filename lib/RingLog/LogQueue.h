@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <LogAtomic.h>
+
+/**
+ * Bounded lock-free multi-producer/single-consumer queue of log messages.
+ *
+ * Each slot carries a sequence number (Vyukov's bounded queue): a producer
+ * claims a slot by advancing the enqueue counter with a CAS, fills it and
+ * publishes it by bumping the slot's sequence. The consumer frees a slot by
+ * setting its sequence one lap ahead. Producers never wait: when the queue
+ * is full the message is dropped and counted.
+ */
+template <size_t SLOTS, size_t MSG_LEN>
+class LogQueue
+{
+    static_assert(SLOTS >= 2 && (SLOTS & (SLOTS - 1)) == 0, "LogQueue slot count must be a power of two");
+
+public:
+    struct Slot
+    {
+        LogAtomic<LogIndex> seq;
+        uint8_t level;
+        char text[MSG_LEN];
+    };
+
+    LogQueue() : enqueue_pos(0), dequeue_pos(0), drop_count(0)
+    {
+        for (size_t i = 0; i < SLOTS; i++)
+            slots[i].seq.store((LogIndex)i);
+    }
+
+    /**
+     * Producer side: claims a free slot, or returns nullptr (and counts a
+     * drop) if the queue is full. The slot must be handed to commit().
+     */
+    Slot *claim()
+    {
+        LogIndex pos = enqueue_pos.load();
+        for (;;)
+        {
+            Slot &slot = slots[pos & (SLOTS - 1)];
+            LogIndex seq = slot.seq.load();
+            LogDiff diff = (LogDiff)(seq - pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos.compareExchange(pos, (LogIndex)(pos + 1)))
+                    return &slot;  // Claimed; pos is ours
+            }
+            else if (diff < 0)
+            {
+                drop_count.fetchAdd(1);
+                return nullptr;
+            }
+            else
+            {
+                pos = enqueue_pos.load();  // Another producer got there first
+            }
+        }
+    }
+
+    /** Publishes a claimed slot to the consumer */
+    void commit(Slot *slot)
+    {
+        // The slot's own sequence tells its position: claim() saw seq == pos
+        slot->seq.store((LogIndex)(slot->seq.load() + 1));
+    }
+
+    /** Consumer side: the oldest published message, or nullptr if there is none */
+    const Slot *front()
+    {
+        Slot &slot = slots[dequeue_pos & (SLOTS - 1)];
+        LogDiff diff = (LogDiff)(slot.seq.load() - (LogIndex)(dequeue_pos + 1));
+        return diff == 0 ? &slot : nullptr;
+    }
+
+    /** Consumer side: releases the slot returned by front() */
+    void pop()
+    {
+        Slot &slot = slots[dequeue_pos & (SLOTS - 1)];
+        slot.seq.store((LogIndex)(dequeue_pos + SLOTS));
+        dequeue_pos++;
+    }
+
+    /** Messages dropped because the queue was full */
+    LogIndex dropped() const { return drop_count.load(); }
+
+    static size_t capacity() { return SLOTS; }
+
+private:
+    Slot slots[SLOTS];
+    LogAtomic<LogIndex> enqueue_pos;
+    LogIndex dequeue_pos;               // Consumer only
+    LogAtomic<LogIndex> drop_count;
+};
@@ -0,0 +1,59 @@
+#include <RingLog.h>
+#include <LogQueue.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static LogQueue<LOG_SLOTS, LOG_MSG_LEN> log_queue;
+static LogIndex log_reported_drops = 0;    // Drop count at the last notice (consumer only)
+
+static const char LOG_LEVEL_TAGS[] = "?EWID";
+
+bool LOG_write(uint8_t level, const char *fmt, ...)
+{
+    LogQueue<LOG_SLOTS, LOG_MSG_LEN>::Slot *slot = log_queue.claim();
+    if (!slot)
+        return false;
+
+    slot->level = level;
+    va_list args;
+    va_start(args, fmt);
+#if defined(__AVR__)
+    vsnprintf_P(slot->text, sizeof(slot->text), fmt, args);
+#else
+    vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+#endif
+    va_end(args);
+
+    log_queue.commit(slot);
+    return true;
+}
+
+size_t LOG_drain(Print &out, size_t max_messages)
+{
+    LogIndex drops = log_queue.dropped();
+    if (drops != log_reported_drops)
+    {
+        out.print(F("[log] dropped "));
+        out.print((unsigned long)(LogIndex)(drops - log_reported_drops));
+        out.println(F(" messages"));
+        log_reported_drops = drops;
+    }
+
+    size_t n = 0;
+    const LogQueue<LOG_SLOTS, LOG_MSG_LEN>::Slot *slot;
+    while (n < max_messages && (slot = log_queue.front()) != nullptr)
+    {
+        out.write(LOG_LEVEL_TAGS[slot->level < sizeof(LOG_LEVEL_TAGS) - 1 ? slot->level : 0]);
+        out.write(' ');
+        out.println(slot->text);
+        log_queue.pop();
+        n++;
+    }
+    return n;
+}
+
+uint32_t LOG_dropped()
+{
+    return log_queue.dropped();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Asynchronous logger shared by both firmwares.
+ *
+ * LOG_E/LOG_W/LOG_I/LOG_D format a printf-style message into a RAM ring
+ * (LogQueue.h) and return immediately; the UART is only touched by
+ * LOG_drain(), which runs in a low-priority task on the ESP32 and in idle
+ * time on the AVR. Levels above LOG_LEVEL are compiled out entirely, so
+ * their arguments are not even evaluated. On AVR the format string lives
+ * in flash, and avr-libc's printf has no %f.
+ *
+ * Build flags: LOG_LEVEL (default LOG_LEVEL_INFO), LOG_SLOTS (power of two)
+ * and LOG_MSG_LEN (bytes per message including the terminator).
+ */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if defined(__AVR__)
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 8
+#endif
+#ifndef LOG_MSG_LEN
+#define LOG_MSG_LEN 48
+#endif
+#define LOG_FMT(s) PSTR(s)
+#else
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 64
+#endif
+#ifndef LOG_MSG_LEN
+#define LOG_MSG_LEN 128
+#endif
+#define LOG_FMT(s) (s)
+#endif
+
+/** Queues one message; false if it was dropped because the ring was full */
+bool LOG_write(uint8_t level, const char *fmt, ...);
+
+/**
+ * Writes up to max_messages queued messages to out, preceded by a notice
+ * when messages were dropped since the last drain. Returns the number written.
+ */
+size_t LOG_drain(Print &out, size_t max_messages);
+
+/** Total messages dropped since boot */
+uint32_t LOG_dropped();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(fmt, ...) LOG_write(LOG_LEVEL_ERROR, LOG_FMT(fmt), ##__VA_ARGS__)
+#else
+#define LOG_E(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(fmt, ...) LOG_write(LOG_LEVEL_WARN, LOG_FMT(fmt), ##__VA_ARGS__)
+#else
+#define LOG_W(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(fmt, ...) LOG_write(LOG_LEVEL_INFO, LOG_FMT(fmt), ##__VA_ARGS__)
+#else
+#define LOG_I(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(fmt, ...) LOG_write(LOG_LEVEL_DEBUG, LOG_FMT(fmt), ##__VA_ARGS__)
+#else
+#define LOG_D(fmt, ...) ((void)0)
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decimation filter for a block of raw ADC conversions.
+ *
+ * Each input sample first goes through a sliding 3-tap median, which removes
+ * isolated spikes without smearing them into the average, and the medians
+ * are then summed by a boxcar (first-order CIC) integrator. output() is the
+ * decimated value: the mean of the medians, in fractional ADC counts. The
+ * first two samples of a block only fill the median's history, so a spike
+ * there is rejected too; a block of fewer than three is averaged as is.
+ */
+class DecimationFilter
+{
+public:
+    DecimationFilter() { reset(); }
+
+    void reset()
+    {
+        n = 0;
+        sum = 0;
+        head = 0;
+        prev1 = prev2 = 0;
+    }
+
+    void add(uint16_t x)
+    {
+        if (n >= 2)
+        {
+            sum += median3(prev2, prev1, x);
+        }
+        else
+        {
+            head += x;  // Not enough history for a median yet
+        }
+        prev2 = prev1;
+        prev1 = x;
+        n++;
+    }
+
+    void add(const uint16_t *xs, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            add(xs[i]);
+    }
+
+    uint32_t count() const { return n; }
+
+    float output() const
+    {
+        if (n >= 3)
+            return (float)sum / (n - 2);
+        return n ? (float)head / n : 0;
+    }
+
+    static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+    {
+        if (a > b)
+        {
+            uint16_t t = a;
+            a = b;
+            b = t;
+        }
+        // Now a <= b, so the median is c clamped to [a, b]
+        if (c <= a)
+            return a;
+        if (c >= b)
+            return b;
+        return c;
+    }
+
+private:
+    uint32_t n;
+    uint64_t sum;       // Of the medians; 12-bit samples: no overflow for any practical block
+    uint32_t head;      // Of the first two samples
+    uint16_t prev1;
+    uint16_t prev2;
+};
+
+/**
+ * Piecewise-linear ADC transfer curve: maps a fractional raw reading to
+ * millivolts by interpolating between calibrated integer codes. The lookup
+ * is a callable taking an integer code and returning millivolts, e.g. a
+ * wrapper around esp_adc_cal_raw_to_voltage().
+ */
+template <typename CodeToMv>
+float ADC_rawToMillivolts(float raw, CodeToMv lookup, uint16_t max_code)
+{
+    if (raw <= 0)
+        return lookup(0);
+    if (raw >= max_code)
+        return lookup(max_code);
+    uint16_t lo = (uint16_t)raw;
+    float frac = raw - lo;
+    float v0 = lookup(lo);
+    float v1 = lookup(lo + 1);
+    return v0 + frac * (v1 - v0);
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SensorData.h>
+
+/**
+ * On-device change filter for the averaged record stream: a record is only
+ * uploaded when it carries news.
+ *
+ * A record is sent when
+ *   - a field left its deadband around the last sent value
+ *     (|x - sent| > abs + rel * |sent|),
+ *   - a change detector fired: EWMA mean and mean absolute deviation per
+ *     watched field, with a two-sided CUSUM on the standardized residual,
+ *   - it falls within the burst of burst_records records after an event,
+ *   - or heartbeat_ms passed since the last sent record.
+ * On an event the last PRE_EVENT held-back records are sent as well, so the
+ * server gets full-rate data on both sides of the change.
+ *
+ * There is deliberately no constructor: a zero-initialised object is a valid
+ * filter that has sent nothing yet, so it can live in RTC memory.
+ */
+
+/** Deadband of one field */
+struct EdgeDeadband
+{
+    float SensorData::*member;
+    float abs;
+    float rel;      // Fraction of the last sent value
+};
+
+/** Change detector on one field */
+struct EdgeDetectorConfig
+{
+    float SensorData::*member;
+    float alpha;        // EWMA gain of mean and deviation
+    float k;            // CUSUM slack, in deviations
+    float h;            // CUSUM threshold, in deviations
+    float min_dev;      // Floor of the deviation, in the field's unit
+};
+
+struct EdgeConfig
+{
+    const EdgeDeadband *deadbands;
+    size_t deadband_count;
+    const EdgeDetectorConfig *detectors;
+    size_t detector_count;          // At most EDGE_MAX_DETECTORS
+    unsigned long heartbeat_ms;
+    uint8_t burst_records;
+};
+
+const size_t EDGE_MAX_DETECTORS = 4;
+
+// Why the last record was sent (bit mask)
+const uint8_t EDGE_FIRST = 0x01;
+const uint8_t EDGE_DEADBAND = 0x02;
+const uint8_t EDGE_EVENT = 0x04;
+const uint8_t EDGE_BURST = 0x08;
+const uint8_t EDGE_HEARTBEAT = 0x10;
+
+template <size_t PRE_EVENT>
+class EdgeFilter
+{
+    static_assert(PRE_EVENT >= 1, "EdgeFilter needs room for at least one pre-event record");
+
+public:
+    static const size_t MAX_OUT = PRE_EVENT + 1;
+
+    void reset()
+    {
+        have_sent = false;
+        held_head = 0;
+        held_count = 0;
+        burst_left = 0;
+        reasons = 0;
+        offered_count = 0;
+        sent_count = 0;
+        event_count = 0;
+        for (size_t i = 0; i < EDGE_MAX_DETECTORS; i++)
+            detectors[i] = Detector();
+    }
+
+    /**
+     * Feeds one record. Writes the records to upload into out (oldest
+     * first, at most MAX_OUT) and returns how many there are.
+     */
+    size_t offer(const EdgeConfig &cfg, const SensorData &record, SensorData *out)
+    {
+        offered_count++;
+
+        // Every detector sees every record, sent or not
+        bool event = false;
+        for (size_t i = 0; i < cfg.detector_count && i < EDGE_MAX_DETECTORS; i++)
+        {
+            if (detect(cfg.detectors[i], detectors[i], record.*cfg.detectors[i].member))
+                event = true;
+        }
+
+        reasons = 0;
+        if (!have_sent)
+        {
+            reasons |= EDGE_FIRST;
+        }
+        if (event)
+        {
+            reasons |= EDGE_EVENT;
+            event_count++;
+            burst_left = cfg.burst_records;
+        }
+        else if (burst_left > 0)
+        {
+            reasons |= EDGE_BURST;
+            burst_left--;
+        }
+        if (have_sent && record.timestamp - last_sent.timestamp >= cfg.heartbeat_ms)
+        {
+            reasons |= EDGE_HEARTBEAT;
+        }
+        if (have_sent && outsideDeadband(cfg, record))
+        {
+            reasons |= EDGE_DEADBAND;
+        }
+
+        if (!reasons)
+        {
+            hold(record);
+            return 0;
+        }
+
+        size_t n = 0;
+        if (event)
+        {
+            for (size_t i = 0; i < held_count; i++)
+                out[n++] = held[(held_head + PRE_EVENT - held_count + i) % PRE_EVENT];
+        }
+        held_count = 0;  // Anything still held is older than what is sent now
+        out[n++] = record;
+
+        last_sent = record;
+        have_sent = true;
+        sent_count += n;
+        return n;
+    }
+
+    /** EDGE_* reasons the last offered record was sent for, 0 if it was held back */
+    uint8_t lastReasons() const { return reasons; }
+
+    uint32_t offered() const { return offered_count; }
+    uint32_t sent() const { return sent_count; }
+    uint32_t events() const { return event_count; }
+
+private:
+    struct Detector
+    {
+        float mean;
+        float dev;      // EWMA of |x - mean|
+        float pos;      // CUSUM of upward residuals
+        float neg;      // CUSUM of downward residuals
+        bool primed;
+    };
+
+    static bool detect(const EdgeDetectorConfig &cfg, Detector &d, float x)
+    {
+        if (x != x)
+            return false;
+        if (!d.primed)
+        {
+            d.mean = x;
+            d.dev = 0;
+            d.pos = 0;
+            d.neg = 0;
+            d.primed = true;
+            return false;
+        }
+
+        float dev = d.dev > cfg.min_dev ? d.dev : cfg.min_dev;
+        float z = (x - d.mean) / dev;
+        d.pos = d.pos + z - cfg.k > 0 ? d.pos + z - cfg.k : 0;
+        d.neg = d.neg - z - cfg.k > 0 ? d.neg - z - cfg.k : 0;
+        if (d.pos > cfg.h || d.neg > cfg.h)
+        {
+            // Restart around the new level
+            d.mean = x;
+            d.pos = 0;
+            d.neg = 0;
+            return true;
+        }
+
+        float residual = x - d.mean;
+        d.mean += cfg.alpha * residual;
+        d.dev += cfg.alpha * (fabsf(residual) - d.dev);
+        return false;
+    }
+
+    bool outsideDeadband(const EdgeConfig &cfg, const SensorData &record) const
+    {
+        for (size_t i = 0; i < cfg.deadband_count; i++)
+        {
+            const EdgeDeadband &b = cfg.deadbands[i];
+            float sent = last_sent.*b.member;
+            if (fabsf(record.*b.member - sent) > b.abs + b.rel * fabsf(sent))
+                return true;
+        }
+        return false;
+    }
+
+    void hold(const SensorData &record)
+    {
+        held[held_head] = record;
+        held_head = (held_head + 1) % PRE_EVENT;
+        if (held_count < PRE_EVENT)
+            held_count++;
+    }
+
+    SensorData last_sent;
+    bool have_sent;
+    SensorData held[PRE_EVENT];     // Ring of records not sent since last_sent
+    size_t held_head;
+    size_t held_count;
+    Detector detectors[EDGE_MAX_DETECTORS];
+    uint8_t burst_left;
+    uint8_t reasons;
+    uint32_t offered_count;
+    uint32_t sent_count;
+    uint32_t event_count;
+};
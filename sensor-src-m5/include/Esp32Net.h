@@ -0,0 +1,106 @@
+#pragma once
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+/**
+ * HttpSession transport over a single WiFiClient
+ */
+class Esp32Net
+{
+public:
+    typedef IPAddress Address;
+
+    bool resolve(const char *host, Address &addr)
+    {
+        return WiFi.hostByName(host, addr) == 1;
+    }
+
+    bool connect(const Address &addr, uint16_t port, uint32_t timeout_ms)
+    {
+        if (!client.connect(addr, port, timeout_ms))
+            return false;
+        client.setNoDelay(true);
+        return true;
+    }
+
+    bool connected() { return client.connected(); }
+
+    bool write(const uint8_t *data, size_t len)
+    {
+        return client.write(data, len) == len;
+    }
+
+    int read(uint8_t *buf, size_t len, uint32_t timeout_ms)
+    {
+        uint32_t start = millis();
+        for (;;)
+        {
+            int avail = client.available();
+            if (avail > 0)
+                return client.read(buf, (size_t)avail < len ? avail : len);
+            if (!client.connected())
+                return -1;
+            if (millis() - start >= timeout_ms)
+                return 0;
+            delay(1);
+        }
+    }
+
+    void close() { client.stop(); }
+
+    uint32_t now() { return millis(); }
+
+private:
+    WiFiClient client;
+};
+
+/**
+ * UdpUplink socket over WiFiUDP. The local port is opened on first use and
+ * has to be closed when WiFi goes down.
+ */
+class Esp32Udp
+{
+public:
+    typedef IPAddress Address;
+
+    Esp32Udp() : open(false) {}
+
+    bool resolve(const char *host, Address &addr)
+    {
+        return WiFi.hostByName(host, addr) == 1;
+    }
+
+    bool send(const Address &addr, uint16_t port, const uint8_t *data, size_t len)
+    {
+        if (!open)
+            open = udp.begin(0) == 1;  // Any free local port
+        return open && udp.beginPacket(addr, port) == 1 && udp.write(data, len) == len &&
+               udp.endPacket() == 1;
+    }
+
+    int receive(uint8_t *buf, size_t len, uint32_t timeout_ms)
+    {
+        uint32_t start = millis();
+        for (;;)
+        {
+            if (udp.parsePacket() > 0)
+                return udp.read(buf, len);
+            if (millis() - start >= timeout_ms)
+                return 0;
+            delay(1);
+        }
+    }
+
+    void close()
+    {
+        udp.stop();
+        open = false;
+    }
+
+    uint32_t now() { return millis(); }
+
+private:
+    WiFiUDP udp;
+    bool open;
+};
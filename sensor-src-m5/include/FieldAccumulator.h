@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The compensation term is algebraically zero, so -ffast-math would fold it away
+#ifdef __FAST_MATH__
+#error "FieldAccumulator: Kahan summation needs IEEE float semantics, build without -ffast-math"
+#endif
+
+/**
+ * Running sum, minimum and maximum of N float fields, one sample at a time.
+ * Samples are contiguous float arrays (SensorPipeline.h gathers a record
+ * into one with the field tables of SensorData.h), so add() is a single
+ * pass with no branches and no dependencies between fields, which the
+ * compiler can vectorize where the target has SIMD.
+ *
+ * Sums are Kahan-compensated: the low-order bits lost by each addition are
+ * carried into the next, so the mean of a long window (up to 600 samples,
+ * RateControl.h) is as accurate as the samples rather than drifting with
+ * the count. A zero-initialised object is empty, so it can live in RTC
+ * memory.
+ */
+template <size_t N>
+struct FieldAccumulator
+{
+    float sum[N];
+    float carry[N];         // Kahan compensation, the negated error of sum
+    float minimum[N];
+    float maximum[N];
+    uint32_t count;
+
+    void add(const float *x)
+    {
+        const bool first = count == 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            float y = x[i] - carry[i];
+            float t = sum[i] + y;
+            carry[i] = (t - sum[i]) - y;
+            sum[i] = t;
+            minimum[i] = first || x[i] < minimum[i] ? x[i] : minimum[i];
+            maximum[i] = first || x[i] > maximum[i] ? x[i] : maximum[i];
+        }
+        count++;
+    }
+
+    /** Writes the mean of every field into out; needs count > 0 */
+    void mean(float *out) const
+    {
+        for (size_t i = 0; i < N; i++)
+            out[i] = (sum[i] - carry[i]) / count;
+    }
+
+    void reset()
+    {
+        *this = FieldAccumulator();
+    }
+};
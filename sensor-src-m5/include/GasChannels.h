@@ -0,0 +1,384 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GasMath.h>
+#include <SensorData.h>
+
+/**
+ * Registry of MQ-series gas channels. A board declares its sensors as a
+ * table of GasChannelConfig (uplink key, model, pin, load resistor, default
+ * R0, window length) and GasChannels runs the per-sample processing for
+ * all of them: Rs from the load-resistor voltage, Rs/R0, the model's ppm
+ * curve, the rolling features and the background R0 refinement.
+ *
+ * State is kept structure-of-arrays, one array per quantity indexed by
+ * channel, so a sample updates every channel in one pass and the cost
+ * grows linearly with the channel count (tools/gas_channels_bench.cpp).
+ * Like the other sampling state, GasChannelState has no constructor and a
+ * zero-initialised object is valid, so it can live in RTC memory.
+ *
+ * Channel 0 fills the mq2_* fields of SensorData, which the edge filter,
+ * the display and the server key on; channel c > 0 fills gas[c - 1] and is
+ * uplinked as <key>_rs, <key>_ratio, ... (SensorJson.h).
+ */
+
+// Load circuit of the MQ modules
+const float VCC = 3.3;                  // Supply voltage for ESP32
+const uint32_t GAS_RL_OHMS = 5000;      // Load resistor of the common breakout boards
+
+/**
+ * Sensor resistance (Rs) in K ohms from the load-resistor voltage in mV
+ */
+inline float GAS_rsFromMillivolts(float vrl, uint32_t rl_ohms)
+{
+    // Rs = RL * (VCC - VRL) / VRL, in integer ohms with VRL in 1/16 mV so
+    // the oversampled resolution is kept
+    uint32_t rs_ohms = GAS_rsOhms((uint32_t)(vrl * 16 + 0.5f), (uint32_t)(VCC * 1000 * 16 + 0.5f), rl_ohms);
+    return rs_ohms / 1000.0f;
+}
+
+// Datasheet sensitivity curves of the other MQ models as power-law fits
+// ppm = A * (Rs/R0)^B, tabulated like MQ2SmokePpm (GasMath.h). Sensors
+// whose clean-air ratio is far above 10 get a table reaching 128.
+
+struct MQ3AlcoholCurve { static constexpr double A = 0.3934; static constexpr double B = -1.504; };
+struct MQ4MethaneCurve { static constexpr double A = 1012.7; static constexpr double B = -2.786; };
+struct MQ5LpgCurve { static constexpr double A = 80.897; static constexpr double B = -2.431; };
+struct MQ7CoCurve { static constexpr double A = 99.042; static constexpr double B = -1.518; };
+struct MQ8HydrogenCurve { static constexpr double A = 976.97; static constexpr double B = -0.688; };
+struct MQ9LpgCurve { static constexpr double A = 1000.5; static constexpr double B = -2.186; };
+struct MQ135Co2Curve { static constexpr double A = 110.47; static constexpr double B = -2.862; };
+
+typedef GasCurve<MQ3AlcoholCurve, -3, 10, 5, 16> MQ3AlcoholPpm;   // mg/L, Q16.16
+typedef GasCurve<MQ4MethaneCurve, -3, 7, 5, 12> MQ4MethanePpm;
+typedef GasCurve<MQ5LpgCurve, -3, 7, 5, 12> MQ5LpgPpm;
+typedef GasCurve<MQ7CoCurve, -3, 10, 5, 12> MQ7CoPpm;
+typedef GasCurve<MQ8HydrogenCurve, -3, 10, 5, 12> MQ8HydrogenPpm;
+typedef GasCurve<MQ9LpgCurve, -3, 7, 5, 12> MQ9LpgPpm;
+typedef GasCurve<MQ135Co2Curve, -3, 7, 5, 12> MQ135Co2Ppm;
+
+/**
+ * One MQ sensor type: its clean-air Rs/R0, used for calibration, and the
+ * curve its concentration is estimated from
+ */
+struct GasModel
+{
+    const char *name;               // e.g. "MQ-135"
+    const char *gas;                // What ppm() estimates
+    float clean_air_factor;         // Rs/R0 in clean air, from the datasheet
+    float max_ratio;                // Above this Rs/R0 the curve is not reliable and ppm is 0
+    float (*ppm)(uint32_t ratio_q16);
+};
+
+const GasModel GAS_MODEL_MQ2 = {"MQ-2", "smoke", 9.83f, 10, MQ2SmokePpm::ppmFloat};
+const GasModel GAS_MODEL_MQ3 = {"MQ-3", "alcohol (mg/L)", 60.0f, 128, MQ3AlcoholPpm::ppmFloat};
+const GasModel GAS_MODEL_MQ4 = {"MQ-4", "methane", 4.4f, 16, MQ4MethanePpm::ppmFloat};
+const GasModel GAS_MODEL_MQ5 = {"MQ-5", "LPG", 6.5f, 16, MQ5LpgPpm::ppmFloat};
+const GasModel GAS_MODEL_MQ7 = {"MQ-7", "CO", 27.5f, 128, MQ7CoPpm::ppmFloat};
+const GasModel GAS_MODEL_MQ8 = {"MQ-8", "hydrogen", 70.0f, 128, MQ8HydrogenPpm::ppmFloat};
+const GasModel GAS_MODEL_MQ9 = {"MQ-9", "LPG", 9.6f, 16, MQ9LpgPpm::ppmFloat};
+const GasModel GAS_MODEL_MQ135 = {"MQ-135", "CO2", 3.6f, 16, MQ135Co2Ppm::ppmFloat};
+
+/**
+ * One gas channel of a board
+ */
+struct GasChannelConfig
+{
+    const char *key;                // Uplink key prefix and NVS namespace, e.g. "mq2"
+    const GasModel *model;
+    uint8_t pin;                    // Analog input
+    uint32_t rl_ohms;               // Load resistor
+    float r0;                       // K ohms, used until the channel is calibrated
+    uint16_t window;                // Samples in the rolling statistics, at most WINDOW
+};
+
+template <size_t CHANNELS, size_t WINDOW>
+struct GasChannelState
+{
+    // Calibration
+    float r0[CHANNELS];             // K ohms
+    float clean_rs[CHANNELS];       // Tracked clean-air Rs, 0 until the first sample
+
+    // Readings since the last sample
+    float rs_sum[CHANNELS];
+    uint16_t readings;
+
+    // Latest sample
+    float rs[CHANNELS];
+    float ratio[CHANNELS];          // -1 while R0 is unknown
+    float ppm[CHANNELS];
+    float delta[CHANNELS];
+    float variance[CHANNELS];
+    float baseline[CHANNELS];
+
+    // Rolling statistics over the ratio. All channels push together, so they
+    // share one ring of the last WINDOW samples: ring[s % WINDOW][c] is
+    // sample s of channel c. Mean and variance follow a Welford add/evict
+    // update; the minimum is the front of a monotonic deque of sample
+    // numbers, amortised O(1).
+    float ring[WINDOW][CHANNELS];
+    uint32_t seq;                   // Samples pushed
+    double mean[CHANNELS];
+    double m2[CHANNELS];            // Sum of squared deviations from the mean
+    uint32_t min_queue[CHANNELS][WINDOW];
+    uint16_t min_head[CHANNELS];
+    uint16_t min_size[CHANNELS];
+};
+
+template <size_t CHANNELS, size_t WINDOW>
+class GasChannels
+{
+    static_assert(CHANNELS >= 1, "GasChannels: no channels");
+    static_assert(WINDOW >= 1 && WINDOW <= 0xFFFF, "GasChannels: window out of range");
+
+public:
+    typedef GasChannelState<CHANNELS, WINDOW> State;
+
+    /** Channels beyond CHANNELS are ignored; the state may be in RTC memory */
+    GasChannels(const GasChannelConfig *config, size_t count, State &state)
+        : cfg(config), n(count < CHANNELS ? count : CHANNELS), st(state)
+    {
+        for (size_t c = 0; c < n; c++)
+        {
+            keys[c] = cfg[c].key;
+            rl_ohms[c] = cfg[c].rl_ohms;
+            clean_air[c] = cfg[c].model->clean_air_factor;
+            max_ratio[c] = cfg[c].model->max_ratio;
+            ppm_fn[c] = cfg[c].model->ppm;
+            window[c] = cfg[c].window == 0 ? 1 : cfg[c].window < WINDOW ? cfg[c].window : WINDOW;
+        }
+    }
+
+    size_t count() const { return n; }
+    const GasChannelConfig &config(size_t c) const { return cfg[c]; }
+
+    /** The channels records carry beyond channel 0 */
+    GasSchema schema() const
+    {
+        GasSchema s = {keys + 1, extraCount()};
+        return s;
+    }
+
+    /** Cold start: configured R0, no readings, empty windows */
+    void reset()
+    {
+        st = State();
+        for (size_t c = 0; c < n; c++)
+            st.r0[c] = cfg[c].r0;
+    }
+
+    /** Adds one reading of every channel, as load-resistor voltages in mV */
+    void add(const float *millivolts)
+    {
+        for (size_t c = 0; c < n; c++)
+            st.rs_sum[c] += GAS_rsFromMillivolts(millivolts[c], rl_ohms[c]);
+        st.readings++;
+    }
+
+    uint16_t readings() const { return st.readings; }
+
+    /** Mean Rs of the readings since the last sample, or the last sample's */
+    float meanRs(size_t c) const { return st.readings ? st.rs_sum[c] / st.readings : st.rs[c]; }
+
+    void clearReadings()
+    {
+        for (size_t c = 0; c < n; c++)
+            st.rs_sum[c] = 0;
+        st.readings = 0;
+    }
+
+    /**
+     * Turns the readings since the last sample into one sample of every
+     * channel: mean Rs, Rs/R0, ppm and the rolling features. Without new
+     * readings the last Rs is used again.
+     */
+    void sample()
+    {
+        uint32_t s = st.seq;
+        float *slot = st.ring[s % WINDOW];
+        for (size_t c = 0; c < n; c++)
+        {
+            if (st.readings)
+                st.rs[c] = st.rs_sum[c] / st.readings;
+            st.rs_sum[c] = 0;
+
+            float ratio = st.r0[c] > 0 ? st.rs[c] / st.r0[c] : -1;
+            st.ppm[c] = ratio > 0 && ratio < max_ratio[c]
+                            ? ppm_fn[c]((uint32_t)(ratio * GAS_RATIO_ONE + 0.5f))
+                            : 0;  // Out of reliable range
+            st.delta[c] = ratio - st.ratio[c];
+            st.ratio[c] = ratio;
+
+            push(c, s, ratio, slot);
+        }
+        st.readings = 0;
+        st.seq = s + 1;
+    }
+
+    /**
+     * Refines every R0 from the clean-air envelope of Rs. Reducing gases
+     * lower Rs, so clean air is the upper envelope: the estimate follows
+     * rises with gain rise and falls with gain decay, per sample.
+     */
+    void trackR0(float rise, float decay)
+    {
+        for (size_t c = 0; c < n; c++)
+        {
+            float rs = st.rs[c];
+            if (rs <= 0)
+                continue;
+            if (st.clean_rs[c] <= 0)
+                st.clean_rs[c] = st.r0[c] * clean_air[c];
+            float gain = rs > st.clean_rs[c] ? rise : decay;
+            st.clean_rs[c] += gain * (rs - st.clean_rs[c]);
+            st.r0[c] = st.clean_rs[c] / clean_air[c];
+        }
+    }
+
+    /** Sets R0 from the readings since the last sample, taken in clean air */
+    void calibrate(size_t c) { setR0(c, meanRs(c) / clean_air[c]); }
+
+    void setR0(size_t c, float r0)
+    {
+        st.r0[c] = r0;
+        st.clean_rs[c] = 0;
+    }
+
+    float r0(size_t c) const { return st.r0[c]; }
+
+    /**
+     * Changes the window of every channel, clamped to 1 .. WINDOW. The ring
+     * keeps the last WINDOW samples of all channels, so the statistics are
+     * rebuilt from it and a longer window starts out as full as the history
+     * allows. Nothing is reallocated.
+     */
+    void setWindow(uint16_t w)
+    {
+        w = w == 0 ? 1 : w < WINDOW ? w : WINDOW;
+        for (size_t c = 0; c < n; c++)
+        {
+            window[c] = w;
+            rebuild(c);
+        }
+    }
+
+    /** Writes the latest sample of every channel into data, except R0 */
+    void store(SensorData &data) const
+    {
+        data.mq2_rs = st.rs[0];
+        data.mq2_ratio = st.ratio[0];
+        data.mq2_smoke_ppm = st.ppm[0];
+        data.mq2_delta = st.delta[0];
+        data.mq2_variance = st.variance[0];
+        data.mq2_baseline = st.baseline[0];
+        for (size_t c = 1; c <= extraCount(); c++)
+        {
+            GasFeatures &g = data.gas[c - 1];
+            g.rs = st.rs[c];
+            g.ratio = st.ratio[c];
+            g.ppm = st.ppm[c];
+            g.delta = st.delta[c];
+            g.variance = st.variance[c];
+            g.baseline = st.baseline[c];
+        }
+    }
+
+    /** Writes the R0 in effect into data, for a finished record */
+    void storeR0(SensorData &data) const
+    {
+        data.mq2_r0 = st.r0[0];
+        for (size_t c = 1; c <= extraCount(); c++)
+            data.gas[c - 1].r0 = st.r0[c];
+    }
+
+private:
+    size_t extraCount() const { return n <= 1 ? 0 : n - 1 < GAS_EXTRA_CHANNELS ? n - 1 : GAS_EXTRA_CHANNELS; }
+
+    /** Pushes sample s of channel c into its window and updates the features */
+    void push(size_t c, uint32_t s, float x, float *slot)
+    {
+        uint16_t w = window[c];
+        if (s < w)
+        {
+            // Growing window: plain Welford update
+            uint32_t count = s + 1;
+            double d = x - st.mean[c];
+            st.mean[c] += d / count;
+            st.m2[c] += d * (x - st.mean[c]);
+        }
+        else
+        {
+            // Full window: replace the oldest sample in one step. With
+            // w == WINDOW it shares the slot x goes to, so read it first.
+            double old_x = st.ring[(s - w) % WINDOW][c];
+            double old_mean = st.mean[c];
+            double d = x - old_x;
+            st.mean[c] += d / w;
+            st.m2[c] += d * (x - st.mean[c] + old_x - old_mean);
+            if (st.m2[c] < 0)
+                st.m2[c] = 0;  // Guard against rounding drift
+        }
+        slot[c] = x;
+
+        // Drop the front of the min deque once it has left the window;
+        // anything not smaller than x can never be the minimum again
+        uint32_t *q = st.min_queue[c];
+        uint16_t head = st.min_head[c];
+        uint16_t size = st.min_size[c];
+        if (size > 0 && s - q[head] >= w)
+        {
+            head = (head + 1) % WINDOW;
+            size--;
+        }
+        while (size > 0 && st.ring[q[(head + size - 1) % WINDOW] % WINDOW][c] >= x)
+            size--;
+        q[(head + size) % WINDOW] = s;
+        size++;
+        st.min_head[c] = head;
+        st.min_size[c] = size;
+
+        st.baseline[c] = st.ring[q[head] % WINDOW][c];
+        st.variance[c] = (float)(st.m2[c] / (s < w ? s + 1 : w));
+    }
+
+    /** Recomputes the statistics of channel c over its window from the ring */
+    void rebuild(size_t c)
+    {
+        uint32_t s = st.seq;
+        uint32_t first = s > window[c] ? s - window[c] : 0;
+        uint32_t *q = st.min_queue[c];
+        uint16_t size = 0;
+        double mean = 0, m2 = 0;
+        for (uint32_t i = first; i < s; i++)
+        {
+            double x = st.ring[i % WINDOW][c];
+            double d = x - mean;
+            mean += d / (i - first + 1);
+            m2 += d * (x - mean);
+            while (size > 0 && st.ring[q[size - 1] % WINDOW][c] >= x)
+                size--;
+            q[size++] = i;
+        }
+        st.mean[c] = mean;
+        st.m2[c] = m2;
+        st.min_head[c] = 0;
+        st.min_size[c] = size;
+        if (s > first)
+        {
+            st.baseline[c] = st.ring[q[0] % WINDOW][c];
+            st.variance[c] = (float)(m2 / (s - first));
+        }
+    }
+
+    const GasChannelConfig *cfg;
+    size_t n;
+    State &st;
+    const char *keys[CHANNELS];
+    uint32_t rl_ohms[CHANNELS];
+    float clean_air[CHANNELS];
+    float max_ratio[CHANNELS];
+    float (*ppm_fn[CHANNELS])(uint32_t ratio_q16);
+    uint16_t window[CHANNELS];
+};
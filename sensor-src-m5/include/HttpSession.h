@@ -0,0 +1,324 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Negative results of HttpSession::post(); positive values are HTTP status codes
+const int HTTP_SESSION_BACKOFF = -100;    // Still backing off after a failure, nothing sent
+const int HTTP_SESSION_DNS = -101;        // Host name did not resolve
+const int HTTP_SESSION_CONNECT = -102;    // TCP connect failed or timed out
+const int HTTP_SESSION_SEND = -103;       // Writing the request failed
+const int HTTP_SESSION_TIMEOUT = -104;    // No complete response in time
+const int HTTP_SESSION_PROTOCOL = -105;   // Malformed response
+
+/** Timing of the last request in ms; connect is 0 when the connection was reused */
+struct HttpTiming
+{
+    uint32_t connect_ms;
+    uint32_t send_ms;
+    uint32_t response_ms;
+    bool reused;
+};
+
+/**
+ * Long-lived HTTP/1.1 client session to a single host.
+ *
+ * One keep-alive connection is reused across requests, the resolved address
+ * is cached for dns_ttl_ms, and every network step has a bounded timeout.
+ * After a failure, requests are refused with HTTP_SESSION_BACKOFF for an
+ * exponentially growing interval so a dead link is not hammered.
+ *
+ * Net is the transport policy, so the session runs over WiFiClient on the
+ * device and over plain sockets on a host. It must provide:
+ *
+ *   typedef ... Address;
+ *   bool resolve(const char *host, Address &addr);
+ *   bool connect(const Address &addr, uint16_t port, uint32_t timeout_ms);
+ *   bool connected();
+ *   bool write(const uint8_t *data, size_t len);
+ *   int  read(uint8_t *buf, size_t len, uint32_t timeout_ms);  // >0 bytes, 0 timeout, <0 closed
+ *   void close();
+ *   uint32_t now();                                             // ms
+ */
+template <typename Net>
+class HttpSession
+{
+public:
+    struct Config
+    {
+        const char *host;
+        uint16_t port;
+        uint32_t dns_ttl_ms;
+        uint32_t connect_timeout_ms;
+        uint32_t response_timeout_ms;
+        uint32_t backoff_min_ms;
+        uint32_t backoff_max_ms;
+    };
+
+    HttpSession(Net &net, const Config &config)
+        : net(net), cfg(config), resolved(false), resolved_at(0),
+          backoff_ms(0), retry_at(0), rpos(0), rlen(0), received(0), peer_closed(false)
+    {
+        memset(&timing, 0, sizeof(timing));
+    }
+
+    /**
+     * POSTs body to path. The response body (truncated to resp_cap - 1 and
+     * NUL-terminated) is copied to resp if given. Returns the HTTP status
+     * or one of the HTTP_SESSION_* errors.
+     */
+    int post(const char *path, const char *content_type, const uint8_t *body, size_t len,
+             char *resp = NULL, size_t resp_cap = 0)
+    {
+        uint32_t start = net.now();
+        if (backoff_ms && (int32_t)(start - retry_at) < 0)
+            return HTTP_SESSION_BACKOFF;
+
+        memset(&timing, 0, sizeof(timing));
+        if (resp && resp_cap)
+            resp[0] = '\0';
+
+        // A reused connection may have been closed by the server meanwhile;
+        // in that case retry once on a fresh one
+        int result = HTTP_SESSION_SEND;
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            timing.reused = net.connected();
+            if (!timing.reused)
+            {
+                int err = open();
+                if (err)
+                    return fail(err);
+            }
+
+            uint32_t t0 = net.now();
+            if (!sendRequest(path, content_type, body, len))
+            {
+                close();
+                if (timing.reused)
+                    continue;
+                return fail(HTTP_SESSION_SEND);
+            }
+            uint32_t t1 = net.now();
+            timing.send_ms = t1 - t0;
+
+            result = readResponse(resp, resp_cap);
+            timing.response_ms = net.now() - t1;
+            if (result < 0 && timing.reused && received == 0 && peer_closed)
+            {
+                close();
+                continue;  // Stale connection closed before answering
+            }
+            break;
+        }
+
+        if (result < 0)
+        {
+            close();
+            return fail(result);
+        }
+        backoff_ms = 0;
+        return result;
+    }
+
+    const HttpTiming &lastTiming() const { return timing; }
+
+    /** Current backoff interval, 0 when the link is considered healthy */
+    uint32_t backoff() const { return backoff_ms; }
+
+    void close()
+    {
+        net.close();
+        rpos = rlen = 0;
+    }
+
+private:
+    int open()
+    {
+        uint32_t now = net.now();
+        if (!resolved || now - resolved_at >= cfg.dns_ttl_ms)
+        {
+            if (!net.resolve(cfg.host, address))
+            {
+                resolved = false;
+                return HTTP_SESSION_DNS;
+            }
+            resolved = true;
+            resolved_at = now;
+        }
+
+        uint32_t t0 = net.now();
+        if (!net.connect(address, cfg.port, cfg.connect_timeout_ms))
+        {
+            resolved = false;  // The address may have changed
+            return HTTP_SESSION_CONNECT;
+        }
+        timing.connect_ms = net.now() - t0;
+        rpos = rlen = 0;
+        return 0;
+    }
+
+    int fail(int err)
+    {
+        backoff_ms = backoff_ms ? backoff_ms * 2 : cfg.backoff_min_ms;
+        if (backoff_ms > cfg.backoff_max_ms)
+            backoff_ms = cfg.backoff_max_ms;
+        retry_at = net.now() + backoff_ms;
+        return err;
+    }
+
+    bool sendRequest(const char *path, const char *content_type, const uint8_t *body, size_t len)
+    {
+        char head[256];
+        int n = snprintf(head, sizeof(head),
+                         "POST %s HTTP/1.1\r\n"
+                         "Host: %s:%u\r\n"
+                         "Connection: keep-alive\r\n"
+                         "Content-Type: %s\r\n"
+                         "Content-Length: %u\r\n"
+                         "\r\n",
+                         path, cfg.host, (unsigned)cfg.port, content_type, (unsigned)len);
+        if (n <= 0 || n >= (int)sizeof(head))
+            return false;
+        return net.write((const uint8_t *)head, n) && (len == 0 || net.write(body, len));
+    }
+
+    // Buffered byte read with the response deadline; -1 on timeout/close
+    int nextByte(uint32_t deadline)
+    {
+        while (rpos == rlen)
+        {
+            uint32_t now = net.now();
+            if ((int32_t)(deadline - now) <= 0)
+                return -1;
+            int n = net.read(rbuf, sizeof(rbuf), deadline - now);
+            if (n < 0)
+            {
+                peer_closed = true;
+                return -1;
+            }
+            rpos = 0;
+            rlen = n;
+            received += n;
+        }
+        return rbuf[rpos++];
+    }
+
+    // Reads one CRLF-terminated line without the terminator; false on timeout
+    bool getLine(char *line, size_t cap, uint32_t deadline)
+    {
+        size_t n = 0;
+        for (;;)
+        {
+            int c = nextByte(deadline);
+            if (c < 0)
+                return false;
+            if (c == '\n')
+                break;
+            if (c != '\r' && n + 1 < cap)
+                line[n++] = (char)c;
+        }
+        line[n] = '\0';
+        return true;
+    }
+
+    int readResponse(char *resp, size_t resp_cap)
+    {
+        uint32_t deadline = net.now() + cfg.response_timeout_ms;
+        char line[128];
+
+        received = rlen - rpos;  // Bytes already buffered count as received
+        peer_closed = false;
+        if (!getLine(line, sizeof(line), deadline))
+            return HTTP_SESSION_TIMEOUT;
+        if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12)
+            return HTTP_SESSION_PROTOCOL;
+        int status = atoi(line + 9);
+        bool keep_alive = line[7] == '1';   // HTTP/1.1 defaults to keep-alive
+
+        long content_length = -1;
+        bool chunked = false;
+        for (;;)
+        {
+            if (!getLine(line, sizeof(line), deadline))
+                return HTTP_SESSION_TIMEOUT;
+            if (line[0] == '\0')
+                break;
+            if (strncasecmp(line, "Content-Length:", 15) == 0)
+                content_length = atol(line + 15);
+            else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked"))
+                chunked = true;
+            else if (strncasecmp(line, "Connection:", 11) == 0)
+                keep_alive = strstr(line, "close") == NULL && strstr(line, "Close") == NULL;
+        }
+
+        size_t stored = 0;
+        if (chunked)
+        {
+            for (;;)
+            {
+                if (!getLine(line, sizeof(line), deadline))
+                    return HTTP_SESSION_TIMEOUT;
+                long size = strtol(line, NULL, 16);
+                if (size <= 0)
+                {
+                    getLine(line, sizeof(line), deadline);  // Trailing CRLF
+                    break;
+                }
+                if (!readBody(size, resp, resp_cap, stored, deadline) ||
+                    !getLine(line, sizeof(line), deadline))
+                    return HTTP_SESSION_TIMEOUT;
+            }
+        }
+        else if (content_length >= 0)
+        {
+            if (!readBody(content_length, resp, resp_cap, stored, deadline))
+                return HTTP_SESSION_TIMEOUT;
+        }
+        else
+        {
+            // No framing: the body ends when the server closes
+            readBody(-1, resp, resp_cap, stored, deadline);
+            keep_alive = false;
+        }
+
+        if (!keep_alive)
+            close();
+        return status;
+    }
+
+    // Consumes len body bytes (or until close if len < 0), keeping what fits in resp
+    bool readBody(long len, char *resp, size_t resp_cap, size_t &stored, uint32_t deadline)
+    {
+        for (long i = 0; len < 0 || i < len; i++)
+        {
+            int c = nextByte(deadline);
+            if (c < 0)
+                return len < 0;
+            if (resp && stored + 1 < resp_cap)
+            {
+                resp[stored++] = (char)c;
+                resp[stored] = '\0';
+            }
+        }
+        return true;
+    }
+
+    Net &net;
+    Config cfg;
+    typename Net::Address address;
+    bool resolved;
+    uint32_t resolved_at;
+    uint32_t backoff_ms;
+    uint32_t retry_at;
+    HttpTiming timing;
+    uint8_t rbuf[256];
+    size_t rpos;
+    size_t rlen;
+    uint32_t received;      // Bytes read for the current response
+    bool peer_closed;       // The server closed the connection during the response
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Minimal JSON writer into a caller-provided buffer. Never allocates.
+ *
+ * Commas are inserted automatically between object members and array
+ * elements. If the buffer runs out, further output is discarded and ok()
+ * turns false; the buffer is always kept NUL-terminated.
+ */
+class JsonWriter
+{
+public:
+    JsonWriter(char *buf, size_t cap) : buf(buf), cap(cap) { reset(); }
+
+    void reset()
+    {
+        len = 0;
+        depth = 0;
+        first = 1;
+        after_key = false;
+        overflow = false;
+        if (cap)
+            buf[0] = '\0';
+    }
+
+    void beginObject() { separate(); put('{'); push(); }
+    void endObject() { put('}'); pop(); }
+    void beginArray() { separate(); put('['); push(); }
+    void endArray() { put(']'); pop(); }
+
+    void key(const char *k)
+    {
+        separate();
+        putString(k);
+        put(':');
+        after_key = true;
+    }
+
+    void value(const char *s)
+    {
+        separate();
+        putString(s);
+    }
+
+    void value(unsigned long v)
+    {
+        separate();
+        putUnsigned(v);
+    }
+
+    /**
+     * Writes v rounded to a fixed number of decimals, like printf("%.*f")
+     * except that exact halfway cases round up rather than to even.
+     * NaN, infinities and values too large for the scaled integer become null.
+     */
+    void value(float v, uint8_t decimals)
+    {
+        separate();
+        if (decimals > MAX_DECIMALS)
+            decimals = MAX_DECIMALS;
+
+        double scaled = v < 0 ? -(double)v : (double)v;
+        scaled = scaled * decimalScale(decimals) + 0.5;
+        if (v != v || scaled >= 1e18)
+        {
+            putRaw("null");
+            return;
+        }
+
+        uint64_t n = (uint64_t)scaled;
+        if (v < 0 && n != 0)
+            put('-');
+
+        // Format all digits right to left, inserting the decimal point
+        char tmp[24];
+        int i = 0;
+        for (uint8_t d = 0; d < decimals; d++)
+        {
+            tmp[i++] = '0' + n % 10;
+            n /= 10;
+        }
+        if (decimals)
+            tmp[i++] = '.';
+        do
+        {
+            tmp[i++] = '0' + n % 10;
+            n /= 10;
+        } while (n);
+        while (i)
+            put(tmp[--i]);
+    }
+
+    /** Inserts pre-formatted text verbatim, e.g. a nested JSON fragment */
+    void raw(const char *s) { putRaw(s); }
+
+    bool ok() const { return !overflow; }
+    size_t length() const { return len; }
+    const char *c_str() const { return buf; }
+
+private:
+    static const uint8_t MAX_DECIMALS = 9;
+
+    static double decimalScale(uint8_t n)
+    {
+        static const double table[MAX_DECIMALS + 1] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+        };
+        return table[n];
+    }
+
+    // Emits the comma before a member/element if one is needed
+    void separate()
+    {
+        if (after_key)
+        {
+            after_key = false;
+            return;
+        }
+        if (first & 1)
+            first &= ~(uint32_t)1;
+        else
+            put(',');
+    }
+
+    void push()
+    {
+        first = (first << 1) | 1;
+        depth++;
+    }
+
+    void pop()
+    {
+        if (depth)
+        {
+            first >>= 1;
+            depth--;
+        }
+    }
+
+    void put(char c)
+    {
+        if (len + 1 >= cap)
+        {
+            overflow = true;
+            return;
+        }
+        buf[len++] = c;
+        buf[len] = '\0';
+    }
+
+    void putRaw(const char *s)
+    {
+        while (*s)
+            put(*s++);
+    }
+
+    void putString(const char *s)
+    {
+        put('"');
+        for (; *s; s++)
+        {
+            char c = *s;
+            if (c == '"' || c == '\\')
+            {
+                put('\\');
+                put(c);
+            }
+            else if ((uint8_t)c < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                putRaw("\\u00");
+                put(hex[(uint8_t)c >> 4]);
+                put(hex[c & 0xF]);
+            }
+            else
+            {
+                put(c);
+            }
+        }
+        put('"');
+    }
+
+    void putUnsigned(unsigned long v)
+    {
+        char tmp[21];
+        int i = 0;
+        do
+        {
+            tmp[i++] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        while (i)
+            put(tmp[--i]);
+    }
+
+    char *buf;
+    size_t cap;
+    size_t len;
+    uint8_t depth;
+    uint32_t first;     // Bit per nesting level: set while no value written yet
+    bool after_key;
+    bool overflow;
+};
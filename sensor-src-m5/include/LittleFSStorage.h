@@ -0,0 +1,56 @@
+#pragma once
+
+#include <LittleFS.h>
+
+#include <RecordStorage.h>
+
+/**
+ * RecordStorage backed by a single file on LittleFS.
+ * The file is kept open for the lifetime of the object.
+ */
+class LittleFSStorage : public RecordStorage
+{
+public:
+    explicit LittleFSStorage(const char *path) : path(path) {}
+
+    bool begin()
+    {
+        if (!LittleFS.begin(true))  // Format on first use
+            return false;
+        if (!LittleFS.exists(path))
+        {
+            File f = LittleFS.open(path, "w");
+            if (!f)
+                return false;
+            f.close();
+        }
+        file = LittleFS.open(path, "r+");
+        return (bool)file;
+    }
+
+    bool read(uint32_t offset, void *buf, size_t len) override
+    {
+        if (!file || offset + len > file.size() || !file.seek(offset))
+            return false;
+        return file.read((uint8_t *)buf, len) == len;
+    }
+
+    bool write(uint32_t offset, const void *buf, size_t len) override
+    {
+        if (!file || !file.seek(offset))
+            return false;
+        return file.write((const uint8_t *)buf, len) == len;
+    }
+
+    bool flush() override
+    {
+        if (!file)
+            return false;
+        file.flush();
+        return true;
+    }
+
+private:
+    const char *path;
+    File file;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Sampling and reporting rates the server can change at runtime. Responses
+ * to /update and /update_bin may carry any of these fields; the others keep
+ * their values:
+ *
+ *   "sample_period_ms"     ms between samples
+ *   "samples_to_average"   samples per record
+ *   "report_interval_ms"   minimum ms between uploads, 0 = every record
+ *   "baseline_window"      samples in the rolling statistics
+ *
+ * A value outside its bounds is ignored, so a bad setting cannot stall
+ * sampling or let records pile up. Nothing is reallocated when a rate
+ * changes: the accumulator is a running sum whose count is checked against
+ * samples_to_average, and the rolling windows are views of a ring sized
+ * for the largest window (GasChannels::setWindow()).
+ */
+struct RateConfig
+{
+    uint32_t sample_period_ms;
+    uint32_t samples_to_average;
+    uint32_t report_interval_ms;
+    uint32_t baseline_window;
+};
+
+// Bits of RATE_parse() results, one per field
+const uint8_t RATE_SAMPLE_PERIOD = 0x01;
+const uint8_t RATE_SAMPLES_TO_AVERAGE = 0x02;
+const uint8_t RATE_REPORT_INTERVAL = 0x04;
+const uint8_t RATE_BASELINE_WINDOW = 0x08;
+
+struct RateField
+{
+    const char *key;
+    uint32_t RateConfig::*member;
+    uint32_t min;
+    uint32_t max;
+    uint8_t bit;
+};
+
+/**
+ * Bounds of every field. max_window is the ring capacity of the rolling
+ * statistics, which the caller knows; the table holds a placeholder.
+ */
+const RateField RATE_FIELDS[] = {
+    {"sample_period_ms", &RateConfig::sample_period_ms, 500, 600000, RATE_SAMPLE_PERIOD},
+    {"samples_to_average", &RateConfig::samples_to_average, 1, 600, RATE_SAMPLES_TO_AVERAGE},
+    {"report_interval_ms", &RateConfig::report_interval_ms, 0, 3600000, RATE_REPORT_INTERVAL},
+    {"baseline_window", &RateConfig::baseline_window, 2, 0, RATE_BASELINE_WINDOW},
+};
+const size_t RATE_FIELD_COUNT = sizeof(RATE_FIELDS) / sizeof(RATE_FIELDS[0]);
+
+inline uint32_t RATE_max(const RateField &f, uint32_t max_window)
+{
+    return f.bit == RATE_BASELINE_WINDOW ? max_window : f.max;
+}
+
+/** True if every field of config is within its bounds */
+inline bool RATE_valid(const RateConfig &config, uint32_t max_window)
+{
+    for (size_t i = 0; i < RATE_FIELD_COUNT; i++)
+    {
+        const RateField &f = RATE_FIELDS[i];
+        uint32_t v = config.*f.member;
+        if (v < f.min || v > RATE_max(f, max_window))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Applies the control fields of a server response to config. Returns the
+ * RATE_* bits of the fields that changed; rejected gets the bits of the
+ * fields that were present but malformed or out of bounds.
+ */
+inline uint8_t RATE_parse(const char *resp, RateConfig &config, uint32_t max_window, uint8_t &rejected)
+{
+    uint8_t changed = 0;
+    rejected = 0;
+    if (!resp)
+        return 0;
+
+    char pattern[32];
+    for (size_t i = 0; i < RATE_FIELD_COUNT; i++)
+    {
+        const RateField &f = RATE_FIELDS[i];
+        size_t len = strlen(f.key);
+        pattern[0] = '"';
+        memcpy(pattern + 1, f.key, len);
+        memcpy(pattern + 1 + len, "\":", 3);
+
+        const char *at = strstr(resp, pattern);
+        if (!at)
+            continue;
+        at += len + 3;
+        while (*at == ' ')
+            at++;
+
+        // A number cut off by a truncated response has no terminator
+        char *end;
+        unsigned long v = *at >= '0' && *at <= '9' ? strtoul(at, &end, 10) : 0;
+        if (*at < '0' || *at > '9' || !strchr(",} \r\n", *end) || *end == '\0' || v < f.min ||
+            v > RATE_max(f, max_window))
+        {
+            rejected |= f.bit;
+            continue;
+        }
+        if (config.*f.member != v)
+        {
+            config.*f.member = (uint32_t)v;
+            changed |= f.bit;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <RecordStorage.h>
+
+/**
+ * Persistent FIFO ring of fixed-size records on top of a RecordStorage.
+ *
+ * Layout: two copies of a small header at offset 0 followed by CAPACITY
+ * record slots. The header is rewritten after every push/pop so the queue
+ * survives a reboot. When the ring is full the oldest record is overwritten
+ * and counted in dropped().
+ *
+ * A power cut in the middle of a write loses at most the push or pop in
+ * progress: header saves alternate between the copies, each with a sequence
+ * number and checksum, so a torn one leaves the previous one to load; a
+ * record is only written to a slot the current header does not count.
+ */
+template <typename Record, uint32_t CAPACITY>
+class RecordQueue
+{
+public:
+    explicit RecordQueue(RecordStorage &storage) : store(storage)
+    {
+        hdr.head = 0;
+        hdr.count = 0;
+        hdr.dropped = 0;
+        hdr.seq = 0;
+    }
+
+    /**
+     * Loads the queue state, formatting the store if it holds no queue
+     * or one written with a different record layout.
+     */
+    bool begin()
+    {
+        Header a, b;
+        bool a_ok = loadHeader(0, a);
+        bool b_ok = loadHeader(1, b);
+        if (a_ok || b_ok)
+        {
+            // The later of the two; sequence numbers may wrap
+            hdr = a_ok && (!b_ok || (int32_t)(a.seq - b.seq) > 0) ? a : b;
+            return true;
+        }
+        hdr.head = 0;
+        hdr.count = 0;
+        hdr.dropped = 0;
+        hdr.seq = 0;
+        return writeHeader();
+    }
+
+    bool push(const Record &rec)
+    {
+        if (hdr.count == CAPACITY)
+        {
+            // Drop the oldest record before its slot is overwritten
+            hdr.head = (hdr.head + 1) % CAPACITY;
+            hdr.count--;
+            hdr.dropped++;
+            if (!saveHeader())
+                return false;
+        }
+
+        uint32_t slot = (hdr.head + hdr.count) % CAPACITY;
+        if (!store.write(slotOffset(slot), &rec, sizeof(Record)))
+            return false;
+        hdr.count++;
+        return saveHeader();
+    }
+
+    /** Reads the i-th oldest record without removing it */
+    bool peek(uint32_t i, Record &rec)
+    {
+        if (i >= hdr.count)
+            return false;
+        return store.read(slotOffset((hdr.head + i) % CAPACITY), &rec, sizeof(Record));
+    }
+
+    /** Removes the n oldest records, e.g. after they were acknowledged */
+    bool pop(uint32_t n)
+    {
+        if (n > hdr.count)
+            n = hdr.count;
+        hdr.head = (hdr.head + n) % CAPACITY;
+        hdr.count -= n;
+        return saveHeader();
+    }
+
+    uint32_t size() const { return hdr.count; }
+    bool empty() const { return hdr.count == 0; }
+    uint32_t dropped() const { return hdr.dropped; }
+    static uint32_t capacity() { return CAPACITY; }
+
+private:
+    static const uint32_t MAGIC = 0x51524543;  // "CERQ"
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t record_size;
+        uint32_t capacity;
+        uint32_t head;      // Slot of the oldest record
+        uint32_t count;
+        uint32_t dropped;   // Records lost to overwrite since format
+        uint32_t seq;       // Saves since format; copy seq % 2 holds it
+        uint32_t check;     // FNV-1a of the fields above
+    };
+
+    static uint32_t slotOffset(uint32_t slot)
+    {
+        return 2 * sizeof(Header) + slot * sizeof(Record);
+    }
+
+    static uint32_t checksum(const Header &h)
+    {
+        const uint8_t *p = (const uint8_t *)&h;
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < offsetof(Header, check); i++)
+            hash = (hash ^ p[i]) * 16777619u;
+        return hash;
+    }
+
+    bool loadHeader(uint32_t copy, Header &h)
+    {
+        return store.read(copy * sizeof(Header), &h, sizeof(h)) && h.check == checksum(h) &&
+               h.magic == MAGIC && h.record_size == sizeof(Record) && h.capacity == CAPACITY &&
+               h.head < CAPACITY && h.count <= CAPACITY && h.seq % 2 == copy;
+    }
+
+    bool writeHeader()
+    {
+        hdr.magic = MAGIC;
+        hdr.record_size = sizeof(Record);
+        hdr.capacity = CAPACITY;
+        hdr.check = checksum(hdr);
+        return store.write((hdr.seq % 2) * sizeof(Header), &hdr, sizeof(hdr)) && store.flush();
+    }
+
+    // Into the copy the current state is not in
+    bool saveHeader()
+    {
+        hdr.seq++;
+        return writeHeader();
+    }
+
+    RecordStorage &store;
+    Header hdr;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Byte-addressed backing store for RecordQueue.
+ *
+ * On the device this is a file on LittleFS; on a host it can be any
+ * file-backed or in-memory stand-in. Reads past the current end of the
+ * store must fail rather than return garbage, and writes must reach it in
+ * the order they are made (a power cut keeps a prefix of them).
+ */
+class RecordStorage
+{
+public:
+    virtual ~RecordStorage() {}
+
+    virtual bool read(uint32_t offset, void *buf, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void *buf, size_t len) = 0;
+    virtual bool flush() = 0;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Deadline-based cooperative scheduler.
+ *
+ * Periodic tasks are released on a fixed grid (next = previous deadline +
+ * period), so lateness of one run does not accumulate as drift. If a run is
+ * so late that whole periods were missed, those releases are skipped and
+ * counted as overruns rather than run back to back. One-shot tasks are armed
+ * with at() and run once.
+ *
+ * The clock is injected so the scheduler can be driven by a simulated time
+ * source on the host. All times are in the clock's unit and wrap-around safe.
+ */
+template <size_t MAX_TASKS>
+class Scheduler
+{
+public:
+    typedef unsigned long (*Clock)();
+    typedef void (*TaskFn)(unsigned long due);
+
+    explicit Scheduler(Clock clock) : clock(clock), count(0) {}
+
+    /** Adds a periodic task, first released at now + offset. Returns its id or -1. */
+    int every(unsigned long period, TaskFn fn, unsigned long offset = 0)
+    {
+        if (count >= (int)MAX_TASKS || period == 0)
+            return -1;
+        Task &t = tasks[count];
+        t.fn = fn;
+        t.period = period;
+        t.due = clock() + offset;
+        t.armed = true;
+        t.runs = 0;
+        t.overruns = 0;
+        t.max_lateness = 0;
+        return count++;
+    }
+
+    /** Adds a one-shot task, initially disarmed. Returns its id or -1. */
+    int oneShot(TaskFn fn)
+    {
+        if (count >= (int)MAX_TASKS)
+            return -1;
+        Task &t = tasks[count];
+        t.fn = fn;
+        t.period = 0;
+        t.due = 0;
+        t.armed = false;
+        t.runs = 0;
+        t.overruns = 0;
+        t.max_lateness = 0;
+        return count++;
+    }
+
+    /** Arms a one-shot task (or moves a periodic one) to run at the given time */
+    void at(int id, unsigned long when)
+    {
+        tasks[id].due = when;
+        tasks[id].armed = true;
+    }
+
+    /**
+     * Changes the period of a periodic task. The release already scheduled
+     * moves with it, so the next run is one new period after the last one.
+     */
+    void setPeriod(int id, unsigned long period)
+    {
+        Task &t = tasks[id];
+        if (t.period == 0 || period == 0)
+            return;
+        t.due += period - t.period;
+        t.period = period;
+    }
+
+    /** Runs every task whose deadline has passed, earliest deadline first */
+    void runDue()
+    {
+        for (;;)
+        {
+            unsigned long now = clock();
+            int next = -1;
+            for (int i = 0; i < count; i++)
+            {
+                const Task &t = tasks[i];
+                if (t.armed && (long)(now - t.due) >= 0 &&
+                    (next < 0 || (long)(t.due - tasks[next].due) < 0))
+                {
+                    next = i;
+                }
+            }
+            if (next < 0)
+                return;
+
+            Task &t = tasks[next];
+            unsigned long due = t.due;
+            unsigned long lateness = now - due;
+            if (lateness > t.max_lateness)
+                t.max_lateness = lateness;
+            t.runs++;
+
+            if (t.period)
+            {
+                t.due += t.period;
+                if ((long)(now - t.due) >= 0)
+                {
+                    // Missed whole periods: skip to the next release after now
+                    unsigned long missed = (now - t.due) / t.period + 1;
+                    t.due += missed * t.period;
+                    t.overruns += missed;
+                }
+            }
+            else
+            {
+                t.armed = false;
+            }
+
+            t.fn(due);
+        }
+    }
+
+    /** Time until the next armed deadline (0 if one is already due) */
+    unsigned long untilNext(unsigned long limit) const
+    {
+        unsigned long now = clock();
+        unsigned long wait = limit;
+        for (int i = 0; i < count; i++)
+        {
+            const Task &t = tasks[i];
+            if (!t.armed)
+                continue;
+            if ((long)(t.due - now) <= 0)
+                return 0;
+            if (t.due - now < wait)
+                wait = t.due - now;
+        }
+        return wait;
+    }
+
+    uint32_t runs(int id) const { return tasks[id].runs; }
+    uint32_t overruns(int id) const { return tasks[id].overruns; }
+
+    /** Worst release lateness seen, i.e. the timing jitter of the task */
+    unsigned long maxLateness(int id) const { return tasks[id].max_lateness; }
+
+    void resetStats(int id)
+    {
+        tasks[id].runs = 0;
+        tasks[id].overruns = 0;
+        tasks[id].max_lateness = 0;
+    }
+
+private:
+    struct Task
+    {
+        TaskFn fn;
+        unsigned long period;   // 0 for one-shot tasks
+        unsigned long due;
+        bool armed;
+        uint32_t runs;
+        uint32_t overruns;      // Releases skipped because the task ran too late
+        unsigned long max_lateness;
+    };
+
+    Clock clock;
+    Task tasks[MAX_TASKS];
+    int count;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+
+// Gas channels a record has room for: channel 0 in the mq2_* fields, the
+// others in gas[] (GasChannels.h). Boards with more than the MQ2 build
+// with -DGAS_MAX_CHANNELS=n.
+#ifndef GAS_MAX_CHANNELS
+#define GAS_MAX_CHANNELS 1
+#endif
+const size_t GAS_EXTRA_CHANNELS = GAS_MAX_CHANNELS - 1;
+const size_t GAS_EXTRA_SLOTS = GAS_EXTRA_CHANNELS ? GAS_EXTRA_CHANNELS : 1;  // No zero-length arrays
+
+/**
+ * Features of one additional gas channel, the same as the mq2_* fields
+ * hold for channel 0
+ */
+struct GasFeatures
+{
+    float rs;               // Sensor resistance in K ohms
+    float ratio;            // Rs/R0 ratio
+    float ppm;              // Concentration from the model's curve (not uplinked)
+    float delta;            // Change from previous reading
+    float variance;         // Rolling variance over the channel's window
+    float baseline;         // Minimum Rs/R0 over the channel's window
+    float r0;               // R0 in effect when the record was taken
+};
+
+struct SensorData
+{
+    float temperature;
+    float humidity;
+    float pressure;
+    float gasResistance;
+    float mq2_rs;           // MQ2 sensor resistance in K ohms
+    float mq2_ratio;        // Rs/R0 ratio
+    float mq2_smoke_ppm;    // Estimated smoke concentration in PPM (not used for VOC analysis)
+
+    // Temporal features for VOC analysis
+    float mq2_delta;        // Change from previous reading
+    float mq2_variance;     // Rolling variance over BASELINE_WINDOW
+    float mq2_baseline;     // Minimum Rs/R0 over BASELINE_WINDOW
+    float mq2_r0;           // R0 in effect when the record was taken
+
+    GasFeatures gas[GAS_EXTRA_SLOTS];  // Gas channels 1 .. GAS_MAX_CHANNELS - 1
+
+    unsigned long timestamp;
+};
+
+/**
+ * Field tables of the float members of SensorData and GasFeatures. Whatever
+ * handles the fields one by one is generated from them: the JSON and bin1
+ * schemas and CSV headers (SensorJson.h) and the averaging into records
+ * (SensorPipeline.h), so a new field is its member above and one line here.
+ *
+ *   X(member, decimals, averaged, header)
+ *
+ * The UPLINK tables list the fields that are sent, in wire order; decimals
+ * is their JSON precision and header their CSV column (server-src/app.py
+ * has the same). LOCAL fields stay on the device. averaged is 1 if a record
+ * holds the mean over its samples and 0 if it holds the latest value.
+ */
+#define SENSOR_UPLINK_FIELDS(X)                                             \
+    X(temperature,   2, 1, "Temperature (\xC2\xB0" "C)")                    \
+    X(humidity,      2, 1, "Humidity (%)")                                  \
+    X(pressure,      3, 1, "Pressure (kPa)")                                \
+    X(gasResistance, 2, 1, "Gas Resistance (KOhm)")                         \
+    X(mq2_rs,        2, 1, "MQ2 Rs (Ohm)")                                  \
+    X(mq2_ratio,     4, 1, "MQ2 Ratio")                                     \
+    X(mq2_r0,        2, 0, "MQ2 R0 (Ohm)")                                  \
+    X(mq2_delta,     4, 1, "MQ2 Delta")                                     \
+    X(mq2_variance,  6, 1, "MQ2 Variance")                                  \
+    X(mq2_baseline,  4, 1, "MQ2 Baseline")
+
+#define SENSOR_LOCAL_FIELDS(X)                                              \
+    X(mq2_smoke_ppm, 2, 1, "MQ2 Smoke (ppm)")
+
+// Extra gas channels, uplinked as <channel key>_<member>; the CSV column is
+// "<KEY> <header>"
+#define GAS_FEATURE_UPLINK_FIELDS(X)                                        \
+    X(rs,            2, 1, "Rs (Ohm)")                                      \
+    X(ratio,         4, 1, "Ratio")                                         \
+    X(r0,            2, 0, "R0 (Ohm)")                                      \
+    X(delta,         4, 1, "Delta")                                         \
+    X(variance,      6, 1, "Variance")                                      \
+    X(baseline,      4, 1, "Baseline")
+
+#define GAS_FEATURE_LOCAL_FIELDS(X)                                         \
+    X(ppm,           2, 1, "PPM")
+
+#define SENSOR_FIELD_ONE(member, decimals, averaged, header) +1
+#define SENSOR_FIELD_AVERAGED(member, decimals, averaged, header) +(averaged)
+
+// Every float member must be in a table, or it would silently stop being averaged
+static_assert(offsetof(SensorData, gas) ==
+                  (SENSOR_UPLINK_FIELDS(SENSOR_FIELD_ONE) SENSOR_LOCAL_FIELDS(SENSOR_FIELD_ONE)) * sizeof(float),
+              "SensorData: a float member is missing from the field tables");
+static_assert(sizeof(GasFeatures) ==
+                  (GAS_FEATURE_UPLINK_FIELDS(SENSOR_FIELD_ONE) GAS_FEATURE_LOCAL_FIELDS(SENSOR_FIELD_ONE)) * sizeof(float),
+              "GasFeatures: a member is missing from the field tables");
+
+/**
+ * Static identity of the device, sent with registration and every record
+ */
+struct DeviceIdentity
+{
+    const char *name;
+    const char *location;
+    const char *plant_id;           // Track which plant is being monitored
+    const char *disease_status;     // Status: healthy/diseased/unknown
+};
+
+/**
+ * Keys of the gas channels beyond channel 0 that records carry; their
+ * fields are uplinked as <key>_rs, <key>_ratio, ... (SensorJson.h)
+ */
+struct GasSchema
+{
+    const char *const *keys;
+    size_t count;                   // At most GAS_EXTRA_CHANNELS
+};
+
+static const GasSchema GAS_SCHEMA_NONE = {NULL, 0};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <JsonWriter.h>
+#include <SensorData.h>
+
+/**
+ * JSON schema of an uploaded record: key, SensorData member, the number of
+ * decimals it is sent with and its CSV column. The order is the wire order.
+ */
+struct SensorJsonField
+{
+    const char *key;
+    float SensorData::*member;
+    uint8_t decimals;
+    const char *header;
+};
+
+#define SENSOR_JSON_FIELD(member, decimals, averaged, header) {#member, &SensorData::member, decimals, header},
+
+static const SensorJsonField SENSOR_JSON_FIELDS[] = {SENSOR_UPLINK_FIELDS(SENSOR_JSON_FIELD)};
+
+/**
+ * Fields of each gas channel beyond channel 0, uplinked after the fixed
+ * fields as <channel key>_<suffix>, channel by channel. They mirror the
+ * mq2_* fields of channel 0.
+ */
+struct GasFeatureField
+{
+    const char *suffix;
+    float GasFeatures::*member;
+    uint8_t decimals;
+    const char *header;
+};
+
+#define GAS_FEATURE_FIELD(member, decimals, averaged, header) {#member, &GasFeatures::member, decimals, header},
+
+static const GasFeatureField GAS_FEATURE_FIELDS[] = {GAS_FEATURE_UPLINK_FIELDS(GAS_FEATURE_FIELD)};
+
+const size_t GAS_FEATURE_FIELD_COUNT = sizeof(GAS_FEATURE_FIELDS) / sizeof(GAS_FEATURE_FIELDS[0]);
+const size_t GAS_KEY_MAX_LEN = 15;      // Also the NVS namespace limit
+
+/**
+ * Writes "<channel key>_<suffix>" into buf (cap bytes, truncated to fit)
+ * and returns buf
+ */
+inline const char *JSON_gasKey(char *buf, size_t cap, const char *key, const char *suffix)
+{
+    size_t len = 0;
+    for (const char *p = key; *p && len + 1 < cap; p++)
+        buf[len++] = *p;
+    if (len + 1 < cap)
+        buf[len++] = '_';
+    for (const char *p = suffix; *p && len + 1 < cap; p++)
+        buf[len++] = *p;
+    buf[len] = '\0';
+    return buf;
+}
+
+// Upper bound for one serialized record, with generous room for the identity strings
+const size_t SENSOR_JSON_MAX_LEN = 512 + GAS_EXTRA_CHANNELS * GAS_FEATURE_FIELD_COUNT * 40;
+
+/**
+ * Writes one record object in the /update schema, with the fields of the
+ * gas channels in schema after the fixed ones
+ */
+inline void JSON_writeSensorData(JsonWriter &w, const DeviceIdentity &id, const SensorData &data,
+                                 const GasSchema &schema = GAS_SCHEMA_NONE)
+{
+    w.beginObject();
+    w.key("name");
+    w.value(id.name);
+    w.key("timestamp");
+    w.value(data.timestamp);
+    w.key("plant_id");
+    w.value(id.plant_id);
+    w.key("disease_status");
+    w.value(id.disease_status);
+    for (size_t i = 0; i < sizeof(SENSOR_JSON_FIELDS) / sizeof(SENSOR_JSON_FIELDS[0]); i++)
+    {
+        const SensorJsonField &f = SENSOR_JSON_FIELDS[i];
+        w.key(f.key);
+        w.value(data.*f.member, f.decimals);
+    }
+    for (size_t c = 0; c < schema.count; c++)
+    {
+        for (size_t i = 0; i < GAS_FEATURE_FIELD_COUNT; i++)
+        {
+            const GasFeatureField &f = GAS_FEATURE_FIELDS[i];
+            char key[GAS_KEY_MAX_LEN + 16];
+            w.key(JSON_gasKey(key, sizeof(key), schema.keys[c], f.suffix));
+            w.value(data.gas[c].*f.member, f.decimals);
+        }
+    }
+    w.endObject();
+}
+
+/**
+ * Writes the /register request body. The identity fields that /update
+ * repeats are included so a binary session can omit them; boot_ms is the
+ * time from reset to the first sample. Boards with more than one gas
+ * channel list the keys of the others, so the server knows their columns.
+ */
+inline void JSON_writeRegistration(JsonWriter &w, const DeviceIdentity &id, bool offer_binary,
+                                   unsigned long boot_ms, const GasSchema &schema = GAS_SCHEMA_NONE)
+{
+    w.beginObject();
+    w.key("name");
+    w.value(id.name);
+    w.key("location");
+    w.value(id.location);
+    w.key("plant_id");
+    w.value(id.plant_id);
+    w.key("disease_status");
+    w.value(id.disease_status);
+    w.key("time_to_first_sample_ms");
+    w.value(boot_ms);
+    if (schema.count)
+    {
+        w.key("gas_channels");
+        w.beginArray();
+        for (size_t c = 0; c < schema.count; c++)
+            w.value(schema.keys[c]);
+        w.endArray();
+    }
+    if (offer_binary)
+    {
+        w.key("encodings");
+        w.beginArray();
+        w.value("bin1");
+        w.endArray();
+    }
+    w.endObject();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <EdgeFilter.h>
+#include <FieldAccumulator.h>
+#include <GasChannels.h>
+#include <SensorData.h>
+
+/**
+ * Per-sample processing: the gas channels (GasChannels.h), the averaging
+ * of samples into records and the edge filter. Nothing here touches
+ * hardware, so the native replay harness (replay/) builds the same code
+ * the firmware runs.
+ */
+
+// Averaging and temporal analysis configuration. These are the defaults;
+// the server can change both at runtime (RateControl.h).
+const int SAMPLES_TO_AVERAGE = 15;  // Take 15 samples before averaging and sending
+const int BASELINE_WINDOW = 50;     // Number of samples for rolling statistics
+const int BASELINE_WINDOW_MAX = 120;  // Ring capacity, the longest window that can be set
+
+// Background R0 refinement of every gas channel (GasChannels::trackR0), once
+// per sample after its features are stored; applies from the next sample on
+const float R0_TRACK_RISE = 0.05;       // Per-sample gain when Rs is above the estimate
+const float R0_TRACK_DECAY = 0.0002;    // Per-sample gain otherwise (~1.4 h at 1 Hz)
+
+// Fields averaged into a record, the ones with averaged = 1 in the field
+// tables (SensorData.h): channel 0's, then those of each extra channel
+const size_t ACC_SENSOR_FIELDS = 0 SENSOR_UPLINK_FIELDS(SENSOR_FIELD_AVERAGED) SENSOR_LOCAL_FIELDS(SENSOR_FIELD_AVERAGED);
+const size_t ACC_GAS_FIELDS = 0 GAS_FEATURE_UPLINK_FIELDS(SENSOR_FIELD_AVERAGED) GAS_FEATURE_LOCAL_FIELDS(SENSOR_FIELD_AVERAGED);
+const size_t ACC_FIELDS = ACC_SENSOR_FIELDS + GAS_EXTRA_CHANNELS * ACC_GAS_FIELDS;
+
+// Accumulated sensor values for averaging (FieldAccumulator.h). A
+// zero-initialised object is empty, so it can live in RTC memory.
+typedef FieldAccumulator<ACC_FIELDS> AccumulatedData;
+
+// Field table callbacks between a record (f) and the flat array x
+#define ACC_GATHER(member, decimals, averaged, header) \
+    if (averaged)                                      \
+        x[n++] = f.member;
+#define ACC_SCATTER(member, decimals, averaged, header) \
+    if (averaged)                                       \
+        f.member = x[n++];
+
+/** Copies the averaged fields of reading into x (ACC_FIELDS floats) */
+inline void ACC_gather(const SensorData &reading, float *x)
+{
+    size_t n = 0;
+    {
+        const SensorData &f = reading;
+        SENSOR_UPLINK_FIELDS(ACC_GATHER)
+        SENSOR_LOCAL_FIELDS(ACC_GATHER)
+    }
+    for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+    {
+        const GasFeatures &f = reading.gas[c];
+        GAS_FEATURE_UPLINK_FIELDS(ACC_GATHER)
+        GAS_FEATURE_LOCAL_FIELDS(ACC_GATHER)
+    }
+}
+
+/** The reverse of ACC_gather(); the other fields of out are left alone */
+inline void ACC_scatter(const float *x, SensorData &out)
+{
+    size_t n = 0;
+    {
+        SensorData &f = out;
+        SENSOR_UPLINK_FIELDS(ACC_SCATTER)
+        SENSOR_LOCAL_FIELDS(ACC_SCATTER)
+    }
+    for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+    {
+        GasFeatures &f = out.gas[c];
+        GAS_FEATURE_UPLINK_FIELDS(ACC_SCATTER)
+        GAS_FEATURE_LOCAL_FIELDS(ACC_SCATTER)
+    }
+}
+
+inline void ACC_add(AccumulatedData &acc, const SensorData &reading)
+{
+    float x[ACC_FIELDS];
+    ACC_gather(reading, x);
+    acc.add(x);
+}
+
+/**
+ * Writes the averages of the accumulated samples into the averaged fields
+ * of out; R0 and timestamp are left to the caller
+ */
+inline void ACC_average(const AccumulatedData &acc, SensorData &out)
+{
+    float x[ACC_FIELDS];
+    acc.mean(x);
+    ACC_scatter(x, out);
+}
+
+/** Writes the smallest and largest accumulated sample of every averaged field into lo and hi */
+inline void ACC_range(const AccumulatedData &acc, SensorData &lo, SensorData &hi)
+{
+    ACC_scatter(acc.minimum, lo);
+    ACC_scatter(acc.maximum, hi);
+}
+
+inline void ACC_reset(AccumulatedData &acc)
+{
+    acc.reset();
+}
+
+// Edge filter over the averaged records (EdgeFilter.h)
+const size_t EDGE_PRE_EVENT = 4;    // Held-back records sent ahead of an event (1 min)
+
+static const EdgeDeadband EDGE_DEADBANDS[] = {
+    // member                      abs     rel
+    {&SensorData::temperature,     0.6f,   0},
+    {&SensorData::humidity,        3.0f,   0},
+    {&SensorData::pressure,        0.2f,   0},
+    {&SensorData::gasResistance,   0,      0.1f},
+    {&SensorData::mq2_ratio,       0,      0.1f},
+    {&SensorData::mq2_baseline,    0,      0.1f},
+    {&SensorData::mq2_r0,          0,      0.04f},
+};
+
+static const EdgeDetectorConfig EDGE_DETECTORS[] = {
+    // member                      alpha   k      h      min_dev
+    {&SensorData::mq2_ratio,       0.05f,  1.0f,  12.0f, 0.02f},
+    {&SensorData::mq2_variance,    0.05f,  1.0f,  12.0f, 0.005f},
+};
+
+static const EdgeConfig EDGE_CONFIG = {
+    EDGE_DEADBANDS,
+    sizeof(EDGE_DEADBANDS) / sizeof(EDGE_DEADBANDS[0]),
+    EDGE_DETECTORS,
+    sizeof(EDGE_DETECTORS) / sizeof(EDGE_DETECTORS[0]),
+    300000,     // heartbeat_ms: at least one record per 5 min
+    2,          // burst_records: every record for 30 s after an event
+};
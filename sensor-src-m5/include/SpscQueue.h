@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Bounded lock-free single-producer/single-consumer queue.
+ *
+ * push() may only be called from one thread/task and pop() from one other.
+ * Indices are free-running counters of type Index (wrap-around safe since N
+ * is a power of two); the producer publishes a slot with a release store of
+ * head and the consumer frees it with a release store of tail. A push into a
+ * full queue fails and is counted in overflows(); nothing is ever
+ * overwritten. A narrow Index only serves to make the counters wrap quickly
+ * in tests.
+ */
+template <typename T, size_t N, typename Index = size_t>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+    static_assert(Index(-1) > 0 && N <= (size_t)Index(-1) / 2 + 1, "SpscQueue index must be unsigned and count N");
+
+public:
+    SpscQueue() : head(0), tail(0), overflow_count(0), high_water(0) {}
+
+    /** Producer side. Returns false (and counts an overflow) if the queue is full. */
+    bool push(const T &item)
+    {
+        Index h = head.load(std::memory_order_relaxed);
+        size_t used = (Index)(h - tail.load(std::memory_order_acquire));
+        if (used == N)
+        {
+            overflow_count.store(overflow_count.load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store((Index)(h + 1), std::memory_order_release);
+
+        if (used + 1 > high_water.load(std::memory_order_relaxed))
+            high_water.store(used + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Consumer side. Returns false if the queue is empty. */
+    bool pop(T &item)
+    {
+        Index t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        item = items[t & (N - 1)];
+        tail.store((Index)(t + 1), std::memory_order_release);
+        return true;
+    }
+
+    /** Approximate when called concurrently with push/pop */
+    size_t size() const
+    {
+        return (Index)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+    static size_t capacity() { return N; }
+
+    /** Pushes rejected because the queue was full */
+    uint32_t overflows() const { return overflow_count.load(std::memory_order_relaxed); }
+
+    /** Highest fill level seen by the producer */
+    size_t highWater() const { return high_water.load(std::memory_order_relaxed); }
+
+private:
+    T items[N];
+    std::atomic<Index> head;        // Written by the producer only
+    std::atomic<Index> tail;        // Written by the consumer only
+    std::atomic<uint32_t> overflow_count;
+    std::atomic<size_t> high_water;
+};
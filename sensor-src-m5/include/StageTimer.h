@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <JsonWriter.h>
+
+/**
+ * Scoped per-stage timers: STAGE_TIME(stats) at the top of a block adds
+ * the time until the end of that block to stats, which keeps count, min,
+ * max, mean and a log2 histogram of the durations.
+ *
+ * Durations are in ticks: CPU cycles on the ESP32 (ESP.getCycleCount(),
+ * per core, so a stage must not migrate between cores; every task here is
+ * pinned), micros() on other Arduino boards and nanoseconds on the host.
+ * STAGE_ticksPerUs() converts. The 32 bit counter wraps, so a stage must
+ * take less than 2^32 ticks (17 s at 240 MHz).
+ *
+ * Build with -DSTAGE_TIMING=0 to compile the timers out: STAGE_TIME()
+ * expands to nothing and does not evaluate its argument, so the statistics
+ * themselves can be left out of the build as well.
+ */
+#ifndef STAGE_TIMING
+#define STAGE_TIMING 1
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Arduino.h>
+inline uint32_t STAGE_ticks() { return ESP.getCycleCount(); }
+inline uint32_t STAGE_ticksPerUs() { return getCpuFrequencyMhz(); }
+#elif defined(ARDUINO)
+#include <Arduino.h>
+inline uint32_t STAGE_ticks() { return micros(); }
+inline uint32_t STAGE_ticksPerUs() { return 1; }
+#else
+#include <chrono>
+inline uint32_t STAGE_ticks()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline uint32_t STAGE_ticksPerUs() { return 1000; }
+#endif
+
+const size_t STAGE_HIST_BINS = 32;
+
+/**
+ * Duration statistics of one stage. There is deliberately no constructor:
+ * {"name"} is a valid empty instance.
+ */
+struct StageStats
+{
+    const char *name;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[STAGE_HIST_BINS];     // hist[i]: durations of [2^i, 2^(i+1)) ticks, 0 counts as 1
+
+    void add(uint32_t ticks)
+    {
+        if (count == 0 || ticks < min)
+            min = ticks;
+        if (ticks > max)
+            max = ticks;
+        count++;
+        sum += ticks;
+        hist[31 - __builtin_clz(ticks | 1)]++;
+    }
+
+    uint32_t mean() const { return count ? (uint32_t)(sum / count) : 0; }
+};
+
+/** Adds the lifetime of the object to a stage */
+class StageScope
+{
+public:
+    explicit StageScope(StageStats &stats) : stats(stats), start(STAGE_ticks()) {}
+    ~StageScope() { stats.add(STAGE_ticks() - start); }
+
+private:
+    StageScope(const StageScope &);
+    StageScope &operator=(const StageScope &);
+
+    StageStats &stats;
+    uint32_t start;
+};
+
+#define STAGE_CONCAT2(a, b) a##b
+#define STAGE_CONCAT(a, b) STAGE_CONCAT2(a, b)
+#if STAGE_TIMING
+#define STAGE_TIME(stats) StageScope STAGE_CONCAT(stage_scope_, __LINE__)(stats)
+#else
+#define STAGE_TIME(stats) ((void)0)
+#endif
+
+/**
+ * Writes the stages as a JSON array of {stage, count, min, max, mean, hist},
+ * in ticks. The histogram is cut after its last non-empty bin.
+ */
+inline void STAGE_writeJson(JsonWriter &w, const StageStats *stages, size_t n)
+{
+    w.beginArray();
+    for (size_t i = 0; i < n; i++)
+    {
+        const StageStats &s = stages[i];
+        w.beginObject();
+        w.key("stage");
+        w.value(s.name);
+        w.key("count");
+        w.value((unsigned long)s.count);
+        w.key("min");
+        w.value((unsigned long)s.min);
+        w.key("max");
+        w.value((unsigned long)s.max);
+        w.key("mean");
+        w.value((unsigned long)s.mean());
+        w.key("hist");
+        w.beginArray();
+        size_t used = STAGE_HIST_BINS;
+        while (used > 0 && s.hist[used - 1] == 0)
+            used--;
+        for (size_t b = 0; b < used; b++)
+            w.value((unsigned long)s.hist[b]);
+        w.endArray();
+        w.endObject();
+    }
+    w.endArray();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <M5StickCPlus.h>
+
+/** Cost of the last StatusScreen::render() */
+struct RenderStats
+{
+    uint8_t rows;       // Rows redrawn
+    uint32_t bytes;     // Pixel bytes pushed over SPI
+    uint32_t us;        // Time spent drawing and pushing
+};
+
+/**
+ * Retained-mode text status screen.
+ *
+ * The screen is a fixed grid of text rows. printf() only records a row's
+ * new text; render() redraws the rows whose text changed, each into a
+ * one-row off-screen sprite that is then pushed as a single window, so an
+ * unchanged row costs nothing and nothing flickers. If the sprite cannot be
+ * allocated the rows are drawn straight to the panel instead.
+ */
+class StatusScreen
+{
+public:
+    static const int ROWS = 6;
+    static const int ROW_LEN = 24;
+
+    StatusScreen(TFT_eSPI &tft, uint8_t text_size = 1)
+        : tft(tft), sprite(&tft), text_size(text_size), use_sprite(false), cleared(false), dirty(0)
+    {
+        memset(text, 0, sizeof(text));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    /** Sets the text of a row; it is redrawn on the next render() only if it changed */
+    void printf(int row, const char *fmt, ...)
+    {
+        if (row < 0 || row >= ROWS)
+            return;
+        char buf[ROW_LEN];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (strcmp(buf, text[row]) != 0)
+        {
+            memcpy(text[row], buf, sizeof(buf));
+            dirty |= 1u << row;
+        }
+    }
+
+    void clear(int row) { printf(row, "%s", ""); }
+
+    const RenderStats &render()
+    {
+        uint32_t start = micros();
+        stats.rows = 0;
+        stats.bytes = 0;
+
+        if (!cleared)
+        {
+            // First frame: wipe whatever the boot messages left behind
+            tft.fillScreen(TFT_BLACK);
+            stats.bytes += (uint32_t)tft.width() * tft.height() * 2;
+            use_sprite = sprite.createSprite(tft.width(), rowHeight()) != NULL;
+            if (use_sprite)
+            {
+                sprite.setTextSize(text_size);
+                sprite.setTextColor(TFT_WHITE, TFT_BLACK);
+            }
+            cleared = true;
+            dirty = (1u << ROWS) - 1;
+        }
+
+        for (int row = 0; row < ROWS; row++)
+        {
+            if (!(dirty & (1u << row)))
+                continue;
+            drawRow(row);
+            stats.rows++;
+            stats.bytes += (uint32_t)tft.width() * rowHeight() * 2;
+        }
+        dirty = 0;
+
+        stats.us = micros() - start;
+        return stats;
+    }
+
+    const RenderStats &lastRender() const { return stats; }
+
+private:
+    int rowHeight() const { return 8 * text_size; }  // GLCD font is 8 px tall per size step
+
+    void drawRow(int row)
+    {
+        int y = row * rowHeight();
+        if (use_sprite)
+        {
+            sprite.fillSprite(TFT_BLACK);
+            sprite.setCursor(0, 0);
+            sprite.print(text[row]);
+            sprite.pushSprite(0, y);
+        }
+        else
+        {
+            tft.fillRect(0, y, tft.width(), rowHeight(), TFT_BLACK);
+            tft.setTextSize(text_size);
+            tft.setTextColor(TFT_WHITE, TFT_BLACK);
+            tft.setCursor(0, y);
+            tft.print(text[row]);
+        }
+    }
+
+    TFT_eSPI &tft;
+    TFT_eSprite sprite;
+    uint8_t text_size;
+    bool use_sprite;
+    bool cleared;
+    uint32_t dirty;             // Bit per row whose text changed since the last render
+    char text[ROWS][ROW_LEN];
+    RenderStats stats;
+};
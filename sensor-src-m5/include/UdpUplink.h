@@ -0,0 +1,288 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SensorData.h>
+#include <WireCodec.h>
+
+/**
+ * Datagram uplink, the alternative to an HTTP POST per batch: no
+ * handshake, no headers, and one short ack instead of a response.
+ *
+ * Datagrams:
+ *
+ *   device -> server  registration  the /register JSON body
+ *   device -> server  data          bin1 frame (WireCodec.h), always
+ *                                   WIRE_FLAG_ABSOLUTE, base_seq = sequence
+ *                                   number of the record before the first
+ *   server -> device  ack           u8 UDP_ACK_MAGIC, u8 UDP_ACK_VERSION,
+ *                                   varint session, varint seq
+ *
+ * Data frames are self-contained so a lost datagram never breaks the delta
+ * chain of the next one. An ack carries the sequence number of the last
+ * record the server holds without a gap. The reply to a registration is an
+ * ack of a new session with seq 0; session 0 means the server does not know
+ * the session and the device has to register again.
+ *
+ * Sending is go-back-N: up to window frames of batch records go out back
+ * to back, then acks are collected until all are covered or ack_timeout_ms
+ * passes, and whatever is not acknowledged is resent from the first gap.
+ * The server drops frames that start beyond the next record it expects and
+ * repeats its ack, so a lost frame costs one timeout and one resend.
+ *
+ * Udp is the socket policy, so the uplink runs over WiFiUDP on the device
+ * and over BSD sockets on a host. It must provide:
+ *
+ *   typedef ... Address;
+ *   bool resolve(const char *host, Address &addr);
+ *   bool send(const Address &addr, uint16_t port, const uint8_t *data, size_t len);
+ *   int  receive(uint8_t *buf, size_t len, uint32_t timeout_ms);  // >0 bytes, 0 timeout, <0 error
+ *   uint32_t now();                                                // ms
+ */
+
+const uint8_t UDP_ACK_MAGIC = 0xC6;
+const uint8_t UDP_ACK_VERSION = 1;
+const size_t UDP_MAX_DATAGRAM = 1400;   // Stays below the path MTU, no IP fragmentation
+const size_t UDP_MAX_ACK = 12;
+
+// Results of UdpUplink calls
+const int UDP_UPLINK_OK = 0;
+const int UDP_UPLINK_DNS = -1;          // Host name did not resolve
+const int UDP_UPLINK_SEND = -2;         // The socket refused a datagram
+const int UDP_UPLINK_TIMEOUT = -3;      // Not everything was acknowledged after max_rounds
+const int UDP_UPLINK_SESSION = -4;      // The server does not know the session; register again
+const int UDP_UPLINK_ENCODE = -5;       // A batch does not fit in one datagram
+
+/** Writes an ack datagram into buf (at least UDP_MAX_ACK bytes); returns its length */
+inline size_t UDP_encodeAck(uint8_t *buf, uint32_t session, uint32_t seq)
+{
+    size_t len = 0;
+    buf[len++] = UDP_ACK_MAGIC;
+    buf[len++] = UDP_ACK_VERSION;
+    uint32_t fields[2] = {session, seq};
+    for (int i = 0; i < 2; i++)
+    {
+        uint32_t n = fields[i];
+        while (n >= 0x80)
+        {
+            buf[len++] = (uint8_t)(n | 0x80);
+            n >>= 7;
+        }
+        buf[len++] = (uint8_t)n;
+    }
+    return len;
+}
+
+/** Parses an ack datagram; false if it is not one */
+inline bool UDP_decodeAck(const uint8_t *buf, size_t len, uint32_t &session, uint32_t &seq)
+{
+    if (len < 4 || buf[0] != UDP_ACK_MAGIC || buf[1] != UDP_ACK_VERSION)
+        return false;
+    size_t pos = 2;
+    uint32_t *fields[2] = {&session, &seq};
+    for (int i = 0; i < 2; i++)
+    {
+        uint32_t n = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (pos >= len || shift > 28)
+                return false;
+            uint8_t b = buf[pos++];
+            n |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        *fields[i] = n;
+    }
+    return true;
+}
+
+/** What the last UdpUplink call cost */
+struct UdpUplinkStats
+{
+    uint32_t datagrams;     // Sent, resends included
+    uint32_t resent;
+    uint32_t acks;          // Received
+    uint32_t rounds;
+    uint32_t elapsed_ms;
+};
+
+template <typename Udp>
+class UdpUplink
+{
+public:
+    struct Config
+    {
+        const char *host;
+        uint16_t port;
+        uint32_t dns_ttl_ms;
+        uint32_t ack_timeout_ms;
+        uint8_t max_rounds;         // Sends of the same records before giving up
+        uint8_t window;             // Frames in flight
+        uint8_t batch;              // Records per frame
+        uint8_t gas_channels;       // Extra gas channels per record (GasSchema::count)
+    };
+
+    UdpUplink(Udp &udp, const Config &config) : udp(udp), cfg(config), resolved(false), resolved_at(0)
+    {
+        stats = UdpUplinkStats();
+    }
+
+    /**
+     * Sends a registration (the /register JSON body) until it is answered.
+     * On success session is the new session id, whose sequence starts at 0.
+     */
+    int registerDevice(const char *json, size_t len, uint32_t &session)
+    {
+        start();
+        if (!resolve())
+            return UDP_UPLINK_DNS;
+
+        for (stats.rounds = 1; stats.rounds <= cfg.max_rounds; stats.rounds++)
+        {
+            if (!sendDatagram((const uint8_t *)json, len, stats.rounds > 1))
+                return finish(UDP_UPLINK_SEND);
+
+            uint32_t ack_session, ack_seq;
+            uint32_t deadline = udp.now() + cfg.ack_timeout_ms;
+            while (receiveAck(deadline, ack_session, ack_seq))
+            {
+                if (ack_session != 0 && ack_seq == 0)
+                {
+                    session = ack_session;
+                    return finish(UDP_UPLINK_OK);
+                }
+            }
+        }
+        return finish(UDP_UPLINK_TIMEOUT);
+    }
+
+    /**
+     * Sends up to window * batch records from the head of queue and pops
+     * the ones the server acknowledged. seq is the sequence number of the
+     * last acknowledged record and advances with the acks. Queue is any
+     * record queue with peek(i, record), pop(n) and size().
+     */
+    template <typename Queue>
+    int send(Queue &queue, uint32_t session, uint32_t &seq)
+    {
+        start();
+        uint32_t total = queue.size();
+        if (total > (uint32_t)cfg.window * cfg.batch)
+            total = (uint32_t)cfg.window * cfg.batch;
+        if (total == 0)
+            return finish(UDP_UPLINK_OK);
+        if (!resolve())
+            return finish(UDP_UPLINK_DNS);
+
+        uint32_t end = seq + total;
+        for (stats.rounds = 1; stats.rounds <= cfg.max_rounds && seq != end; stats.rounds++)
+        {
+            // (Re)send everything not acknowledged yet
+            for (uint32_t first = seq; first != end;)
+            {
+                uint32_t n = end - first < cfg.batch ? end - first : cfg.batch;
+                size_t len = encodeFrame(queue, first - seq, n, session, first);
+                if (len == 0)
+                    return finish(UDP_UPLINK_ENCODE);
+                if (!sendDatagram(frame, len, stats.rounds > 1))
+                    return finish(UDP_UPLINK_SEND);
+                first += n;
+            }
+
+            uint32_t ack_session, ack_seq;
+            uint32_t deadline = udp.now() + cfg.ack_timeout_ms;
+            while (seq != end && receiveAck(deadline, ack_session, ack_seq))
+            {
+                if (ack_session == 0)
+                    return finish(UDP_UPLINK_SESSION);
+                // Stale and duplicate acks fall outside (seq, end]
+                if (ack_session == session && (int32_t)(ack_seq - seq) > 0 && (int32_t)(ack_seq - end) <= 0)
+                {
+                    queue.pop(ack_seq - seq);
+                    seq = ack_seq;
+                }
+            }
+        }
+        return finish(seq == end ? UDP_UPLINK_OK : UDP_UPLINK_TIMEOUT);
+    }
+
+    const UdpUplinkStats &lastStats() const { return stats; }
+
+private:
+    void start()
+    {
+        stats = UdpUplinkStats();
+        started_at = udp.now();
+    }
+
+    int finish(int result)
+    {
+        stats.elapsed_ms = udp.now() - started_at;
+        return result;
+    }
+
+    bool resolve()
+    {
+        uint32_t now = udp.now();
+        if (resolved && now - resolved_at < cfg.dns_ttl_ms)
+            return true;
+        resolved = udp.resolve(cfg.host, addr);
+        resolved_at = now;
+        return resolved;
+    }
+
+    bool sendDatagram(const uint8_t *data, size_t len, bool resend)
+    {
+        stats.datagrams++;
+        if (resend)
+            stats.resent++;
+        return udp.send(addr, cfg.port, data, len);
+    }
+
+    /** Waits for the next ack until deadline; false on timeout */
+    bool receiveAck(uint32_t deadline, uint32_t &session, uint32_t &seq)
+    {
+        for (;;)
+        {
+            int32_t left = (int32_t)(deadline - udp.now());
+            if (left <= 0)
+                return false;
+            uint8_t buf[UDP_MAX_ACK];
+            int n = udp.receive(buf, sizeof(buf), left);
+            if (n <= 0)
+                return false;
+            if (UDP_decodeAck(buf, n, session, seq))
+            {
+                stats.acks++;
+                return true;
+            }
+        }
+    }
+
+    /** Encodes queue entries [index, index + n) as one absolute frame; 0 on failure */
+    template <typename Queue>
+    size_t encodeFrame(Queue &queue, uint32_t index, uint32_t n, uint32_t session, uint32_t base_seq)
+    {
+        WireEncoder wire(frame, sizeof(frame));
+        wire.begin(session, base_seq, NULL, cfg.gas_channels);
+        SensorData record;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (!queue.peek(index + i, record))
+                return 0;
+            wire.add(record);
+        }
+        return wire.ok() ? wire.length() : 0;
+    }
+
+    Udp &udp;
+    Config cfg;
+    typename Udp::Address addr;
+    bool resolved;
+    uint32_t resolved_at;
+    uint32_t started_at;
+    UdpUplinkStats stats;
+    uint8_t frame[UDP_MAX_DATAGRAM];
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SensorData.h>
+#include <SensorJson.h>
+
+/**
+ * Compact binary uplink format ("bin1"), negotiated at /register.
+ *
+ * Frame layout (all integers are LEB128 varints, deltas zigzag-encoded):
+ *
+ *   u8      WIRE_MAGIC
+ *   u8      WIRE_VERSION
+ *   u8      flags            WIRE_FLAG_ABSOLUTE: first record is relative to zero
+ *                            WIRE_FLAG_CHANNELS: gas channel count follows
+ *   varint  session          Assigned by the server at /register
+ *   varint  base_seq         Sequence number of the record the deltas start from
+ *   [varint channels]        Gas channels beyond channel 0, if WIRE_FLAG_CHANNELS
+ *   record* until end of frame, record i has sequence base_seq + 1 + i
+ *
+ * A record is the timestamp followed by every SENSOR_JSON_FIELDS entry and
+ * then, channel by channel, every GAS_FEATURE_FIELDS entry of the extra gas
+ * channels, as fixed-point integers at their JSON precision, each as a
+ * delta against the same field of the previous record. Identity strings
+ * and channel keys are not repeated; the server knows them from the session.
+ */
+
+const uint8_t WIRE_MAGIC = 0xC5;
+const uint8_t WIRE_VERSION = 1;
+const uint8_t WIRE_FLAG_ABSOLUTE = 0x01;
+const uint8_t WIRE_FLAG_CHANNELS = 0x02;
+
+// Fields of a record without extra gas channels, and with as many as a record holds
+const size_t WIRE_FIELD_COUNT = 1 + sizeof(SENSOR_JSON_FIELDS) / sizeof(SENSOR_JSON_FIELDS[0]);
+const size_t WIRE_MAX_FIELDS = WIRE_FIELD_COUNT + GAS_EXTRA_CHANNELS * GAS_FEATURE_FIELD_COUNT;
+
+/**
+ * Fixed-point values of one record: [0] is the timestamp, then the JSON
+ * fields, then the fields of the extra gas channels
+ */
+struct WireValues
+{
+    int64_t v[WIRE_MAX_FIELDS];
+};
+
+inline size_t WIRE_fieldCount(size_t channels)
+{
+    return WIRE_FIELD_COUNT + channels * GAS_FEATURE_FIELD_COUNT;
+}
+
+/** Decimals of field i of a record, counting the timestamp as field 0 */
+inline uint8_t WIRE_decimals(size_t i)
+{
+    if (i == 0)
+        return 0;
+    if (i < WIRE_FIELD_COUNT)
+        return SENSOR_JSON_FIELDS[i - 1].decimals;
+    return GAS_FEATURE_FIELDS[(i - WIRE_FIELD_COUNT) % GAS_FEATURE_FIELD_COUNT].decimals;
+}
+
+inline int64_t WIRE_scale(float x, uint8_t decimals)
+{
+    if (x != x)
+        return 0;  // NaN has no fixed-point form
+    double s = x;
+    for (uint8_t i = 0; i < decimals; i++)
+        s *= 10;
+    return (int64_t)(s < 0 ? s - 0.5 : s + 0.5);
+}
+
+inline float WIRE_unscale(int64_t n, uint8_t decimals)
+{
+    double s = (double)n;
+    for (uint8_t i = 0; i < decimals; i++)
+        s /= 10;
+    return (float)s;
+}
+
+inline void WIRE_toValues(const SensorData &data, WireValues &out, size_t channels = 0)
+{
+    out.v[0] = (int64_t)data.timestamp;
+    for (size_t i = 1; i < WIRE_FIELD_COUNT; i++)
+    {
+        const SensorJsonField &f = SENSOR_JSON_FIELDS[i - 1];
+        out.v[i] = WIRE_scale(data.*f.member, f.decimals);
+    }
+    int64_t *v = out.v + WIRE_FIELD_COUNT;
+    for (size_t c = 0; c < channels; c++)
+    {
+        for (size_t i = 0; i < GAS_FEATURE_FIELD_COUNT; i++)
+        {
+            const GasFeatureField &f = GAS_FEATURE_FIELDS[i];
+            *v++ = WIRE_scale(data.gas[c].*f.member, f.decimals);
+        }
+    }
+}
+
+inline void WIRE_fromValues(const WireValues &in, SensorData &data, size_t channels = 0)
+{
+    data = SensorData();
+    data.timestamp = (unsigned long)in.v[0];
+    for (size_t i = 1; i < WIRE_FIELD_COUNT; i++)
+    {
+        const SensorJsonField &f = SENSOR_JSON_FIELDS[i - 1];
+        data.*f.member = WIRE_unscale(in.v[i], f.decimals);
+    }
+    const int64_t *v = in.v + WIRE_FIELD_COUNT;
+    for (size_t c = 0; c < channels; c++)
+    {
+        for (size_t i = 0; i < GAS_FEATURE_FIELD_COUNT; i++)
+        {
+            const GasFeatureField &f = GAS_FEATURE_FIELDS[i];
+            data.gas[c].*f.member = WIRE_unscale(*v++, f.decimals);
+        }
+    }
+}
+
+class WireEncoder
+{
+public:
+    WireEncoder(uint8_t *buf, size_t cap) : buf(buf), cap(cap), len(0), overflow(false), channels(0), fields(0) {}
+
+    /**
+     * Starts a frame. With base == nullptr the frame is self-contained,
+     * otherwise deltas start from the record the server acknowledged as
+     * base_seq. Records carry the first gas_channels extra gas channels.
+     */
+    void begin(uint32_t session, uint32_t base_seq, const WireValues *base, size_t gas_channels = 0)
+    {
+        len = 0;
+        overflow = false;
+        channels = gas_channels < GAS_EXTRA_CHANNELS ? gas_channels : GAS_EXTRA_CHANNELS;
+        fields = WIRE_fieldCount(channels);
+        put(WIRE_MAGIC);
+        put(WIRE_VERSION);
+        put((base ? 0 : WIRE_FLAG_ABSOLUTE) | (channels ? WIRE_FLAG_CHANNELS : 0));
+        putVarint(session);
+        putVarint(base_seq);
+        if (channels)
+            putVarint(channels);
+        for (size_t i = 0; i < fields; i++)
+            prev.v[i] = base ? base->v[i] : 0;
+    }
+
+    void add(const SensorData &data)
+    {
+        WireValues cur;
+        WIRE_toValues(data, cur, channels);
+        for (size_t i = 0; i < fields; i++)
+        {
+            putVarint(zigzag(cur.v[i] - prev.v[i]));
+        }
+        prev = cur;
+    }
+
+    /** Fixed-point values of the last record added, the next base once acknowledged */
+    const WireValues &last() const { return prev; }
+
+    bool ok() const { return !overflow; }
+    size_t length() const { return len; }
+
+private:
+    static uint64_t zigzag(int64_t n) { return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63); }
+
+    void put(uint8_t b)
+    {
+        if (len >= cap)
+        {
+            overflow = true;
+            return;
+        }
+        buf[len++] = b;
+    }
+
+    void putVarint(uint64_t n)
+    {
+        while (n >= 0x80)
+        {
+            put((uint8_t)(n | 0x80));
+            n >>= 7;
+        }
+        put((uint8_t)n);
+    }
+
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+    size_t channels;
+    size_t fields;
+    WireValues prev;
+};
+
+class WireDecoder
+{
+public:
+    WireDecoder(const uint8_t *buf, size_t len) : buf(buf), len(len), pos(0), error(false), channels(0), fields(0) {}
+
+    /**
+     * Parses the frame header; returns false if this is not a bin1 frame
+     * or it has more gas channels than a record here holds
+     */
+    bool begin(uint32_t &session, uint32_t &base_seq, bool &absolute)
+    {
+        pos = 0;
+        error = false;
+        if (getByte() != WIRE_MAGIC || getByte() != WIRE_VERSION)
+            return false;
+        uint8_t flags = getByte();
+        absolute = (flags & WIRE_FLAG_ABSOLUTE) != 0;
+        session = (uint32_t)getVarint();
+        base_seq = (uint32_t)getVarint();
+        uint64_t n = (flags & WIRE_FLAG_CHANNELS) ? getVarint() : 0;
+        if (n > GAS_EXTRA_CHANNELS)
+            return false;
+        channels = (size_t)n;
+        fields = WIRE_fieldCount(channels);
+        return !error;
+    }
+
+    /** Sets the values the first delta applies to (all zero for absolute frames) */
+    void setBase(const WireValues *base)
+    {
+        for (size_t i = 0; i < fields; i++)
+            prev.v[i] = base ? base->v[i] : 0;
+    }
+
+    /** Decodes the next record; returns false at the end of the frame or on error */
+    bool next(SensorData &data)
+    {
+        if (error || pos >= len)
+            return false;
+        for (size_t i = 0; i < fields; i++)
+        {
+            prev.v[i] += unzigzag(getVarint());
+        }
+        if (error)
+            return false;
+        WIRE_fromValues(prev, data, channels);
+        return true;
+    }
+
+    const WireValues &last() const { return prev; }
+    bool failed() const { return error; }
+
+    /** Extra gas channels per record, and fields of a record in last() */
+    size_t gasChannels() const { return channels; }
+    size_t fieldCount() const { return fields; }
+
+private:
+    static int64_t unzigzag(uint64_t n) { return (int64_t)(n >> 1) ^ -(int64_t)(n & 1); }
+
+    uint8_t getByte()
+    {
+        if (pos >= len)
+        {
+            error = true;
+            return 0;
+        }
+        return buf[pos++];
+    }
+
+    uint64_t getVarint()
+    {
+        uint64_t n = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = getByte();
+            n |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return n;
+        }
+        error = true;
+        return 0;
+    }
+
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool error;
+    size_t channels;
+    size_t fields;
+    WireValues prev;
+};
@@ -0,0 +1,554 @@
+// Native replay of recorded traces through the sample pipeline
+// (SensorPipeline.h), the edge filter and the uplink serializers, for
+// regression and performance checks without hardware.
+//
+// The BME680 and MQ2 ADC are stubbed from the trace: each CSV row is one
+// sample. The MQ2 Rs column, where the trace has one, is turned back into
+// the load-resistor voltage the ADC would have measured; traces without
+// MQ2 data use the BME680 gas resistance as a stand-in signal. R0 starts at
+// the trace's first MQ2 R0, or a clean-air calibration on the first sample,
+// and is then refined every sample as on the device (GasChannels::trackR0),
+// so the goldens follow the ratio, ppm and features the device uploads.
+//
+// Build: pio run -e native
+// Usage: .pio/build/native/program TRACE.csv [GOLDEN.csv] [--update] [--repeat N]
+//                                   [--step SAMPLE:FACTOR]
+//
+// With GOLDEN.csv the averaged records are compared against it (exit
+// status 1 on mismatch); --update rewrites it instead. The edge filter's
+// compression is reported for every run. --step multiplies the MQ2 Rs by
+// FACTOR from sample SAMPLE on, and reports how long the edge filter took
+// to flag it.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <SensorPipeline.h>
+#include <SensorJson.h>
+#include <WireCodec.h>
+
+const int REPLAY_BATCH = 20;                    // Records per POST, as MAX_BATCH in main.cpp
+const double REPLAY_SAMPLE_RATE_HZ = 1.0;       // Firmware sampling rate, for the real-time factor
+
+const DeviceIdentity replay_device = {
+    "replay",       // name
+    "host",         // location
+    "replay",       // plant_id
+    "unknown",      // disease_status
+};
+
+/**
+ * One trace row, i.e. what the stubbed sensors return for one sample
+ */
+struct TraceSample
+{
+    float temperature;
+    float humidity;
+    float pressure;         // kPa
+    float gasResistance;    // K ohms
+    float mq2_rs;           // K ohms, from the trace
+    float mq2_mv;           // Load-resistor voltage that gives mq2_rs
+};
+
+struct Trace
+{
+    std::vector<TraceSample> samples;
+    float r0;
+    bool has_mq2;
+};
+
+static int TRACE_column(const std::vector<std::string> &header, const char *prefix)
+{
+    for (size_t i = 0; i < header.size(); i++)
+    {
+        if (header[i].compare(0, strlen(prefix), prefix) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+static void TRACE_split(const char *line, std::vector<std::string> &out)
+{
+    out.clear();
+    std::string cur;
+    for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+    {
+        if (*p == ',')
+        {
+            out.push_back(cur);
+            cur.clear();
+        }
+        else
+        {
+            cur += *p;
+        }
+    }
+    out.push_back(cur);
+}
+
+/** analogRead() stub: the voltage across RL for a sensor resistance in K ohms */
+static float ADC_millivoltsForRs(float rs)
+{
+    const float rl = GAS_RL_OHMS / 1000.0f;
+    return VCC * 1000 * rl / (rl + rs);
+}
+
+static bool TRACE_load(const char *path, Trace &trace)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[1024];
+    std::vector<std::string> cols;
+    if (!fgets(line, sizeof(line), f))
+    {
+        fprintf(stderr, "%s: empty file\n", path);
+        fclose(f);
+        return false;
+    }
+    TRACE_split(line, cols);
+    int c_temp = TRACE_column(cols, "Temperature");
+    int c_hum = TRACE_column(cols, "Humidity");
+    int c_pres = TRACE_column(cols, "Pressure");
+    int c_gas = TRACE_column(cols, "Gas Resistance");
+    int c_rs = TRACE_column(cols, "MQ2 Rs");
+    int c_r0 = TRACE_column(cols, "MQ2 R0");
+    if (c_temp < 0 || c_hum < 0 || c_pres < 0 || c_gas < 0)
+    {
+        fprintf(stderr, "%s: missing BME680 columns\n", path);
+        fclose(f);
+        return false;
+    }
+
+    trace.samples.clear();
+    trace.has_mq2 = c_rs >= 0;
+    trace.r0 = 0;
+    size_t width = cols.size();
+    while (fgets(line, sizeof(line), f))
+    {
+        TRACE_split(line, cols);
+        if (cols.size() != width)
+            continue;  // Blank or truncated row
+
+        TraceSample s;
+        s.temperature = strtof(cols[c_temp].c_str(), NULL);
+        s.humidity = strtof(cols[c_hum].c_str(), NULL);
+        s.pressure = strtof(cols[c_pres].c_str(), NULL);
+        s.gasResistance = strtof(cols[c_gas].c_str(), NULL);
+        float rs = trace.has_mq2 ? strtof(cols[c_rs].c_str(), NULL) : s.gasResistance;
+        s.mq2_rs = rs;
+        s.mq2_mv = ADC_millivoltsForRs(rs);
+        if (trace.r0 == 0)
+        {
+            trace.r0 = c_r0 >= 0 ? strtof(cols[c_r0].c_str(), NULL) : rs / GAS_MODEL_MQ2.clean_air_factor;
+        }
+        trace.samples.push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+/** Injects a step change of the MQ2 signal, for detection latency */
+static void TRACE_step(Trace &trace, size_t from, float factor)
+{
+    for (size_t i = from; i < trace.samples.size(); i++)
+    {
+        TraceSample &s = trace.samples[i];
+        s.mq2_rs *= factor;
+        s.mq2_mv = ADC_millivoltsForRs(s.mq2_rs);
+    }
+}
+
+/**
+ * Output of every stage, kept whole so each stage can be timed on its own
+ */
+struct ReplayBuffers
+{
+    std::vector<SensorData> readings;
+    std::vector<SensorData> records;
+    std::vector<uint8_t> edge_reasons;  // Per record, EDGE_* or 0 if held back
+    size_t edge_sent;
+    size_t json_bytes;
+    size_t wire_bytes;
+};
+
+// The device's gas channel 0, with one reading per sample
+static const GasChannelConfig replay_gas[] = {{"mq2", &GAS_MODEL_MQ2, 0, GAS_RL_OHMS, 10.0f, BASELINE_WINDOW}};
+
+// Stage 1: sensor stubs, then Rs, ratio, smoke PPM, temporal features and
+// the R0 refinement, as SAMPLE_process does (GasChannels::add(), sample()
+// and trackR0()). Each reading keeps the R0 in effect after it.
+static void STAGE_gas(const Trace &trace, ReplayBuffers &buf)
+{
+    static GasChannelState<1, BASELINE_WINDOW> state;
+    GasChannels<1, BASELINE_WINDOW> gas(replay_gas, 1, state);
+    gas.reset();
+    gas.setR0(0, trace.r0);
+    const size_t n = trace.samples.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        const TraceSample &s = trace.samples[i];
+        SensorData &d = buf.readings[i];
+        d.temperature = s.temperature;
+        d.humidity = s.humidity;
+        d.pressure = s.pressure;
+        d.gasResistance = s.gasResistance;
+        d.timestamp = (unsigned long)(i * (1000 / REPLAY_SAMPLE_RATE_HZ));
+        gas.add(&s.mq2_mv);
+        gas.sample();
+        gas.store(d);
+        gas.trackR0(R0_TRACK_RISE, R0_TRACK_DECAY);
+        gas.storeR0(d);
+    }
+}
+
+// Stage 2: averaging into records, as SAMPLE_process does
+static void STAGE_average(ReplayBuffers &buf)
+{
+    AccumulatedData acc = AccumulatedData();
+    buf.records.clear();
+    for (size_t i = 0; i < buf.readings.size(); i++)
+    {
+        ACC_add(acc, buf.readings[i]);
+        if (acc.count >= (uint32_t)SAMPLES_TO_AVERAGE)
+        {
+            SensorData record = SensorData();
+            ACC_average(acc, record);
+            record.mq2_r0 = buf.readings[i].mq2_r0;
+            record.timestamp = buf.readings[i].timestamp;
+            buf.records.push_back(record);
+            ACC_reset(acc);
+        }
+    }
+}
+
+// Stage 3: edge filter, deciding which records are uploaded
+static void STAGE_edge(ReplayBuffers &buf)
+{
+    static EdgeFilter<EDGE_PRE_EVENT> filter;
+    SensorData out[EdgeFilter<EDGE_PRE_EVENT>::MAX_OUT];
+    filter.reset();
+    buf.edge_reasons.resize(buf.records.size());
+    buf.edge_sent = 0;
+    for (size_t i = 0; i < buf.records.size(); i++)
+    {
+        buf.edge_sent += filter.offer(EDGE_CONFIG, buf.records[i], out);
+        buf.edge_reasons[i] = filter.lastReasons();
+    }
+}
+
+// Stage 4: uplink payloads, a JSON batch and a bin1 frame per REPLAY_BATCH records
+static void STAGE_payload(ReplayBuffers &buf)
+{
+    static char json[REPLAY_BATCH * SENSOR_JSON_MAX_LEN + 2];
+    static uint8_t wire[REPLAY_BATCH * WIRE_MAX_FIELDS * 10 + 16];
+    buf.json_bytes = 0;
+    buf.wire_bytes = 0;
+    for (size_t first = 0; first < buf.records.size(); first += REPLAY_BATCH)
+    {
+        size_t last = first + REPLAY_BATCH < buf.records.size() ? first + REPLAY_BATCH : buf.records.size();
+
+        JsonWriter w(json, sizeof(json));
+        w.beginArray();
+        for (size_t i = first; i < last; i++)
+            JSON_writeSensorData(w, replay_device, buf.records[i]);
+        w.endArray();
+        buf.json_bytes += w.length();
+
+        WireEncoder enc(wire, sizeof(wire));
+        enc.begin(1, (uint32_t)first, NULL);
+        for (size_t i = first; i < last; i++)
+            enc.add(buf.records[i]);
+        buf.wire_bytes += enc.length();
+    }
+}
+
+/**
+ * Prints the edge filter's compression and, with an injected step, the
+ * detection latency: from the step to the first record flagged as an event
+ */
+static void EDGE_report(const ReplayBuffers &buf, long step_at)
+{
+    size_t count[5] = {0, 0, 0, 0, 0};
+    for (size_t i = 0; i < buf.edge_reasons.size(); i++)
+    {
+        for (int b = 0; b < 5; b++)
+        {
+            if (buf.edge_reasons[i] & (1 << b))
+                count[b]++;
+        }
+    }
+    printf("edge filter: %zu of %zu records sent (%.2fx), %zu events\n", buf.edge_sent,
+           buf.records.size(), buf.edge_sent ? (double)buf.records.size() / buf.edge_sent : 0.0,
+           count[2]);
+    printf("  sent for: deadband %zu, event %zu, burst %zu, heartbeat %zu\n", count[1], count[2],
+           count[3], count[4]);
+
+    if (step_at < 0)
+        return;
+    size_t first = step_at / SAMPLES_TO_AVERAGE;  // Record the step falls into
+    for (size_t i = first; i < buf.edge_reasons.size(); i++)
+    {
+        if (buf.edge_reasons[i] & EDGE_EVENT)
+        {
+            unsigned long step_ms = (unsigned long)(step_at * (1000 / REPLAY_SAMPLE_RATE_HZ));
+            printf("step at sample %ld: detected %zu records later, %.0f s after the step\n", step_at,
+                   i - first, (buf.records[i].timestamp - step_ms) / 1000.0);
+            return;
+        }
+    }
+    printf("step at sample %ld: not detected\n", step_at);
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Golden files: one line per record, the uplinked fields at their JSON
+// precision followed by the ones that stay on the device
+static const SensorJsonField GOLDEN_LOCAL_FIELDS[] = {SENSOR_LOCAL_FIELDS(SENSOR_JSON_FIELD)};
+const size_t GOLDEN_UPLINK_COUNT = sizeof(SENSOR_JSON_FIELDS) / sizeof(SENSOR_JSON_FIELDS[0]);
+const size_t GOLDEN_FIELD_COUNT = GOLDEN_UPLINK_COUNT + sizeof(GOLDEN_LOCAL_FIELDS) / sizeof(GOLDEN_LOCAL_FIELDS[0]);
+
+static const SensorJsonField &GOLDEN_field(size_t i)
+{
+    return i < GOLDEN_UPLINK_COUNT ? SENSOR_JSON_FIELDS[i] : GOLDEN_LOCAL_FIELDS[i - GOLDEN_UPLINK_COUNT];
+}
+
+static void GOLDEN_format(const SensorData &r, std::string &out)
+{
+    char num[48];
+    snprintf(num, sizeof(num), "%lu", r.timestamp);
+    out = num;
+    for (size_t i = 0; i < GOLDEN_FIELD_COUNT; i++)
+    {
+        const SensorJsonField &f = GOLDEN_field(i);
+        snprintf(num, sizeof(num), ",%.*f", f.decimals, r.*f.member);
+        out += num;
+    }
+}
+
+static void GOLDEN_header(std::string &out)
+{
+    out = "timestamp";
+    for (size_t i = 0; i < GOLDEN_FIELD_COUNT; i++)
+    {
+        out += ',';
+        out += GOLDEN_field(i).key;
+    }
+}
+
+static bool GOLDEN_write(const char *path, const std::vector<SensorData> &records)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    std::string line;
+    GOLDEN_header(line);
+    fprintf(f, "%s\n", line.c_str());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        GOLDEN_format(records[i], line);
+        fprintf(f, "%s\n", line.c_str());
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Compares records against a golden file. Values may differ by one unit in
+ * the last printed decimal, so float rounding differences between host
+ * compilers don't fail the check.
+ */
+static bool GOLDEN_check(const char *path, const std::vector<SensorData> &records)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[1024];
+    std::string expect_header;
+    GOLDEN_header(expect_header);
+    if (!fgets(line, sizeof(line), f) || strncmp(line, expect_header.c_str(), expect_header.size()) != 0)
+    {
+        fprintf(stderr, "%s: header does not match the record schema\n", path);
+        fclose(f);
+        return false;
+    }
+
+    std::vector<std::string> want, got;
+    std::string mine;
+    size_t row = 0, mismatches = 0;
+    while (fgets(line, sizeof(line), f) && row < records.size())
+    {
+        TRACE_split(line, want);
+        GOLDEN_format(records[row], mine);
+        TRACE_split(mine.c_str(), got);
+        bool same = want.size() == got.size() && want[0] == got[0];
+        for (size_t i = 1; same && i < got.size(); i++)
+        {
+            int decimals = GOLDEN_field(i - 1).decimals;
+            double a = strtod(want[i].c_str(), NULL);
+            double b = strtod(got[i].c_str(), NULL);
+            same = fabs(a - b) <= 1.01 * pow(10.0, -decimals);
+        }
+        if (!same && mismatches++ < 5)
+        {
+            fprintf(stderr, "%s: record %zu differs\n  golden: %s  replay: %s\n", path, row,
+                    line, mine.c_str());
+        }
+        row++;
+    }
+    bool extra = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+
+    if (row != records.size() || extra)
+    {
+        fprintf(stderr, "%s: %zu records replayed, golden file has %s\n", path, records.size(),
+                extra ? "more" : "fewer");
+        return false;
+    }
+    if (mismatches)
+    {
+        fprintf(stderr, "%s: %zu of %zu records differ\n", path, mismatches, row);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace_path = NULL;
+    const char *golden_path = NULL;
+    bool update = false;
+    int repeat = 5;
+    long step_at = -1;
+    float step_factor = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--step") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%ld:%f", &step_at, &step_factor) != 2 || step_at < 0)
+                step_at = -2;
+        }
+        else if (!trace_path)
+            trace_path = argv[i];
+        else if (!golden_path)
+            golden_path = argv[i];
+    }
+    if (!trace_path || repeat < 1 || (update && !golden_path) || step_at == -2)
+    {
+        fprintf(stderr, "usage: %s TRACE.csv [GOLDEN.csv] [--update] [--repeat N] [--step SAMPLE:FACTOR]\n",
+                argv[0]);
+        return 2;
+    }
+
+    Trace trace;
+    if (!TRACE_load(trace_path, trace))
+        return 2;
+    const size_t n = trace.samples.size();
+    if (n == 0)
+    {
+        fprintf(stderr, "%s: no samples\n", trace_path);
+        return 2;
+    }
+    if (step_at >= 0)
+    {
+        if ((size_t)step_at >= n)
+        {
+            fprintf(stderr, "%s: step at sample %ld is past the end\n", trace_path, step_at);
+            return 2;
+        }
+        if (golden_path)
+        {
+            fprintf(stderr, "--step changes the records, it cannot be checked against a golden file\n");
+            return 2;
+        }
+        TRACE_step(trace, (size_t)step_at, step_factor);
+    }
+
+    ReplayBuffers buf;
+    buf.readings.resize(n);
+    buf.records.reserve(n / SAMPLES_TO_AVERAGE);
+
+    // Best of `repeat` runs per stage
+    const char *names[] = {"gas", "average", "edge", "payload"};
+    const int STAGES = sizeof(names) / sizeof(names[0]);
+    double best[STAGES];
+    for (int i = 0; i < STAGES; i++)
+        best[i] = INFINITY;
+    for (int r = 0; r < repeat; r++)
+    {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        STAGE_gas(trace, buf);
+        best[0] = fmin(best[0], elapsedNs(t0));
+
+        t0 = std::chrono::steady_clock::now();
+        STAGE_average(buf);
+        best[1] = fmin(best[1], elapsedNs(t0));
+
+        t0 = std::chrono::steady_clock::now();
+        STAGE_edge(buf);
+        best[2] = fmin(best[2], elapsedNs(t0));
+
+        t0 = std::chrono::steady_clock::now();
+        STAGE_payload(buf);
+        best[3] = fmin(best[3], elapsedNs(t0));
+    }
+
+    printf("%s: %zu samples, %zu records, R0 %.2f K refined to %.2f K%s\n", trace_path, n, buf.records.size(),
+           trace.r0, n ? buf.readings[n - 1].mq2_r0 : trace.r0,
+           trace.has_mq2 ? "" : " (no MQ2 column, gas resistance stands in)");
+    printf("stage       ns/sample\n");
+    double total = 0;
+    for (int i = 0; i < STAGES; i++)
+    {
+        printf("%-10s %10.1f\n", names[i], best[i] / n);
+        total += best[i];
+    }
+    double rate = n / (total * 1e-9);
+    printf("%-10s %10.1f   %.3g samples/s, %.3g x real time\n", "total", total / n, rate,
+           rate / REPLAY_SAMPLE_RATE_HZ);
+    if (!buf.records.empty())
+    {
+        printf("payload: %.1f B/record JSON, %.1f B/record bin1\n",
+               (double)buf.json_bytes / buf.records.size(), (double)buf.wire_bytes / buf.records.size());
+        EDGE_report(buf, step_at);
+    }
+
+    if (!golden_path)
+        return 0;
+    if (update)
+    {
+        if (!GOLDEN_write(golden_path, buf.records))
+            return 2;
+        printf("golden: wrote %zu records to %s\n", buf.records.size(), golden_path);
+        return 0;
+    }
+    if (!GOLDEN_check(golden_path, buf.records))
+        return 1;
+    printf("golden: %zu records match %s\n", buf.records.size(), golden_path);
+    return 0;
+}
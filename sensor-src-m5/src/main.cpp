@@ -1,512 +1,1653 @@
 #include <config.h>
+#include <RingLog.h>
+#include <GasChannels.h>
+#include <RecordQueue.h>
+#include <LittleFSStorage.h>
+#include <SensorData.h>
+#include <SensorJson.h>
+#include <WireCodec.h>
+#include <Scheduler.h>
+#include <SpscQueue.h>
+#include <AdcFilter.h>
+#include <GasMath.h>
+#include <SensorPipeline.h>
+#include <RateControl.h>
+#include <Acquisition.h>
+#include <HttpSession.h>
+#include <Esp32Net.h>
+#include <UdpUplink.h>
+#include <StatusScreen.h>
+#include <StageTimer.h>
 
 #include <M5StickCPlus.h>
 #include <Wire.h>
 
+#include <driver/i2s.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <esp_sleep.h>
+
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME680.h>
 Adafruit_BME680 bme;
 
+#include <Preferences.h>
+#include <time.h>
+Preferences prefs;
+
 #include <WiFi.h>
 #include <WiFiMulti.h>
-#include <HTTPClient.h>
 WiFiMulti wifiMulti;
-HTTPClient http;
-const char *server_ip = "http://tahar.duckdns.org:67/";
-const String dev_name = "plant_003";
-const String location = "39.042388, -77.550108";
-const String plant_id = "plant_003";              // Track which plant is being monitored
-const String disease_status = "healthy";          // Status: healthy/diseased/unknown
-bool is_registered = false;
-unsigned long lastUpdate = 0;
-unsigned long lastSample = 0;
 
-// Averaging configuration
-const int SAMPLES_TO_AVERAGE = 15;  // Take 15 samples before averaging and sending
-int sampleCount = 0;
+// Low-power mode (build with -DLOW_POWER_MODE=1): the device deep sleeps
+// between samples and only powers the radio when a record is ready to send.
+// RAM is lost in deep sleep, so state that spans samples is kept in RTC
+// memory; RTC_STATE marks it and is empty in the always-on build.
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE 0
+#endif
+#if LOW_POWER_MODE
+#define RTC_STATE RTC_DATA_ATTR
+#else
+#define RTC_STATE
+#endif
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 8000;  // Low-power mode gives up on the upload after this
+
+// One keep-alive session to the server, reused for every request
+Esp32Net uplink_net;
+const HttpSession<Esp32Net>::Config uplink_config = {
+    "tahar.duckdns.org",    // host
+    67,                     // port
+    600000,                 // dns_ttl_ms
+    3000,                   // connect_timeout_ms
+    5000,                   // response_timeout_ms
+    2000,                   // backoff_min_ms
+    300000,                 // backoff_max_ms
+};
+HttpSession<Esp32Net> uplink(uplink_net, uplink_config);
+const DeviceIdentity device = {
+    "plant_003",                // name
+    "39.042388, -77.550108",    // location
+    "plant_003",                // plant_id
+    "healthy",                  // disease_status
+};
+RTC_STATE bool is_registered = false;
+
+// Gas sensors of this board (GasChannels.h). Channel 0 is the MQ2 behind the
+// mq2_* record fields and is sampled through I2S DMA. All channels must be
+// on ADC1 pins, since WiFi takes ADC2. A board with more sensors adds rows
+// here and builds with -DGAS_MAX_CHANNELS=<rows>.
+const GasChannelConfig gas_channels[] = {
+    // key      model            pin  rl (ohm)      r0 (K)  window
+    {"mq2",     &GAS_MODEL_MQ2,  36,  GAS_RL_OHMS,  10.0f,  BASELINE_WINDOW},
+};
+const size_t GAS_CHANNEL_COUNT = sizeof(gas_channels) / sizeof(gas_channels[0]);
+static_assert(GAS_CHANNEL_COUNT <= GAS_MAX_CHANNELS, "gas_channels: build with -DGAS_MAX_CHANNELS=<rows>");
+
+// Store-and-forward configuration
+const uint32_t QUEUE_CAPACITY = 2880;   // Records kept on flash (12 h at one record per 15 s)
+const int MAX_BATCH = 20;               // Records per batched POST
+const int MAX_BATCHES_PER_DRAIN = 5;    // Bounds the time spent catching up after an outage
+
+// Uplink transport: HTTP POSTs to the Flask server (default), or one UDP
+// datagram per batch with acks and resends (build with -DUPLINK_UDP=1,
+// see UdpUplink.h; tools/udp_receiver.cpp is the server side)
+#ifndef UPLINK_UDP
+#define UPLINK_UDP 0
+#endif
+#if UPLINK_UDP
+Esp32Udp udp_net;
+const UdpUplink<Esp32Udp>::Config udp_config = {
+    "tahar.duckdns.org",    // host
+    6767,                   // port
+    600000,                 // dns_ttl_ms
+    300,                    // ack_timeout_ms
+    4,                      // max_rounds
+    MAX_BATCHES_PER_DRAIN,  // window
+    MAX_BATCH,              // batch
+    GAS_CHANNEL_COUNT - 1,  // gas_channels
+};
+UdpUplink<Esp32Udp> udp_uplink(udp_net, udp_config);
+#endif
+
+// Static payload buffer so serializing a batch never touches the heap
+char payload_buf[MAX_BATCH * SENSOR_JSON_MAX_LEN + 2];
+
+// Binary uplink (WireCodec.h), used when the server accepts it at /register
+const bool OFFER_BINARY_UPLINK = true;
+RTC_STATE uint32_t wire_session = 0;    // Session id from /register, 0 = JSON uplink
+RTC_STATE uint32_t wire_seq = 0;        // Sequence number of the last acknowledged record
+RTC_STATE bool wire_have_base = false;  // Whether the server holds wire_base as delta base
+RTC_STATE WireValues wire_base;
+unsigned long lastUpdate = 0;
 
-// Temporal analysis configuration
-const int BASELINE_WINDOW = 50;                    // Number of samples for rolling statistics
-float recent_ratios[BASELINE_WINDOW];              // Rolling window of Rs/R0 ratios
-int baseline_index = 0;                            // Current position in rolling window
-bool baseline_initialized = false;                 // Track if window is filled
+// Per-stage timing (StageTimer.h), posted to /metrics every METRICS_PERIOD_MS.
+// Counters run from boot and are never reset, so the network task can read
+// the stages the sampling task writes without a lock; the server diffs them.
+#if STAGE_TIMING
+enum Stage
+{
+    STAGE_BME_START,        // Start of a BME680 conversion
+    STAGE_BME_COLLECT,      // Reading its result
+    STAGE_GAS_READ,         // One read of every gas channel and Rs conversion
+    STAGE_FEATURES,         // GasChannels::sample(): ratios, ppm and features
+    STAGE_SAMPLE,           // All per-sample processing, features included
+    STAGE_LCD,              // Pushing changed rows to the LCD
+    STAGE_SERIALIZE,        // Building one upload batch
+    STAGE_UPLINK,           // One uplink POST with connect, or one UDP send with its acks
+    STAGE_COUNT
+};
+StageStats stage_stats[STAGE_COUNT] = {
+    {"bme_start"}, {"bme_collect"}, {"gas_read"}, {"features"},
+    {"sample"}, {"lcd"}, {"serialize"}, {"uplink"},
+};
+const unsigned long METRICS_PERIOD_MS = 300000;
+unsigned long metrics_sent_ms = 0;
+#endif
+
+// Sampling schedule. In the always-on build each sensor runs at its own
+// rate: the cheap gas sensor reads every GAS_PERIOD_MS, a BME680 conversion (with
+// its 150 ms gas heater) every BME_PERIOD_MS, and on a fixed 1 s grid the
+// latest results are combined into one sample for features and averaging.
+// Low-power mode wakes once per sample and reads both sensors in lockstep.
+// The sample period is the default of `rates` below.
+const unsigned long SAMPLE_PERIOD_MS = 1000;
+const unsigned long GAS_PERIOD_MS = 100;    // MQ2 DMA drained each period, so every conversion is used
+const unsigned long BME_PERIOD_MS = 3000;
+Scheduler<4> scheduler(millis);
+int sample_task = -1;               // Periodic: one sample for features and averaging
+
+// Sampling and reporting rates the server can change (RateControl.h),
+// starting from the compile-time defaults and kept in NVS. The sampling
+// side owns `rates`; the network task parses responses into its own copy
+// and passes changes over rate_queue, applied between samples.
+const unsigned long REPORT_INTERVAL_MS = 0;  // Upload every record
+RTC_STATE RateConfig rates = {SAMPLE_PERIOD_MS, SAMPLES_TO_AVERAGE, REPORT_INTERVAL_MS, BASELINE_WINDOW};
+RateConfig net_rates;
+SpscQueue<RateConfig, 2> rate_queue;
+RTC_STATE unsigned long last_report_ms = 0;  // When the uplink queue was last emptied
+int collect_task = -1;              // One-shot: collects the BME680 result
+int gas_task = -1;                  // Periodic: reads the gas sensors (always-on build)
+int bme_task = -1;                  // Periodic: starts a BME680 conversion (always-on build)
+bool bme_pending = false;           // A BME680 conversion is in flight
+unsigned long rate_stats_since = 0; // Start of the scheduler statistics window
+
+// The latest BME680 result with the time it was taken; a sample combines
+// it with the gas readings since the last sample, which are summed in
+// gas_state. The acquisition picks up channel 0's latest reading.
+float gas_last_raw = 0;
+SensorData bme_latest;
+unsigned long bme_latest_ms = 0;
+
+// Gas sensor calibration and temporal analysis state (BASELINE_WINDOW is in SensorPipeline.h)
+RTC_STATE GasChannelState<GAS_MAX_CHANNELS, BASELINE_WINDOW_MAX> gas_state;
+GasChannels<GAS_MAX_CHANNELS, BASELINE_WINDOW_MAX> gas_sensors(gas_channels, GAS_CHANNEL_COUNT, gas_state);
 
 // Accumulated sensor values for averaging
-struct AccumulatedData {
-    float temperature;
-    float humidity;
-    float pressure;
-    float gasResistance;
-    float mq2_rs;
-    float mq2_ratio;
-    float mq2_smoke_ppm;
-    float mq2_delta;
-    float mq2_variance;
-    float mq2_baseline;
-} accumulated;
-
-// MQ2 Gas Sensor Configuration
-const int MQ2_PIN = 36;              // GPIO36 (ADC1_CH0)
-const float RL_VALUE = 5.0;          // Load resistance in K ohms
-const float VCC = 3.3;               // Supply voltage for ESP32
+RTC_STATE AccumulatedData accumulated;
+
+// Edge filter: averaged records are only uploaded on a significant change,
+// around detected events and as a heartbeat (EDGE_CONFIG in SensorPipeline.h)
+const bool EDGE_FILTER_ENABLED = true;
+RTC_STATE EdgeFilter<EDGE_PRE_EVENT> edge_filter;
+
+// Gas Sensor ADC Configuration
 const int ADC_RESOLUTION = 4095;     // 12-bit ADC
 const int CALIBRATION_SAMPLES = 50;  // Number of samples for R0 calibration
-const float RO_CLEAN_AIR_FACTOR = 9.83; // Rs/R0 ratio in clean air from datasheet
+esp_adc_cal_characteristics_t adc_chars;
+
+// Oversampled MQ2 (gas channel 0) acquisition: ADC1 runs continuously
+// through I2S DMA and each Rs value is decimated from the DMA buffers
+// completed since the previous read, taken without waiting for more. Read
+// every GAS_PERIOD_MS, the readings cover the signal end to end, each
+// conversion once, and the loop is never held up by the ADC. The ring holds
+// two periods, so a read up to a period late loses nothing. (In low-power
+// mode the DMA starts at each wake and the one read waits for the first
+// period after it.) I2S samples a single channel, so the other gas channels
+// are oversampled with GAS_ANALOG_OVERSAMPLE analogRead() calls instead.
+const uint32_t MQ2_ADC_RATE = 20000;                                    // Conversions per second
+const size_t MQ2_READ_SAMPLES = MQ2_ADC_RATE * GAS_PERIOD_MS / 1000;    // One gas period
+const int MQ2_DMA_BUF_LEN = 500;                                        // Samples per DMA buffer (25 ms)
+const int MQ2_DMA_BUF_COUNT = 2 * MQ2_READ_SAMPLES / MQ2_DMA_BUF_LEN;    // Two gas periods
+static_assert(MQ2_READ_SAMPLES % MQ2_DMA_BUF_LEN == 0, "MQ2 read is not whole DMA buffers");
+uint16_t mq2_adc_block[MQ2_READ_SAMPLES];
+bool mq2_dma_ready = false;                            // Falls back to analogRead() if I2S setup failed
+float mq2_last_raw = -1;                               // Latest MQ2 reading, -1 before the first
+const int GAS_ANALOG_OVERSAMPLE = 16;
+
+// Persistence of the refined R0 (R0_TRACK_* in SensorPipeline.h)
+const unsigned long R0_SAVE_INTERVAL_MS = 3600000;  // Persist the refined R0 hourly (flash wear)
+RTC_STATE unsigned long lastR0Save = 0;
+
+// Boot time metric, sent with the registration
+volatile unsigned long time_to_first_sample = 0;
+
+SensorData currentReading;
 
-// MQ2 Calibration and Runtime Variables
-float MQ2_R0 = 10.0;                 // Sensor resistance in clean air (will be calibrated)
-bool MQ2_calibrated = false;
+// Sampling runs in loop() on the APP core; upload and display run in
+// net_task on the PRO core next to the WiFi stack. They only share these
+// two lock-free queues, so a slow POST can no longer delay a sample.
+const int NET_CORE = 0;
+const uint32_t NET_TASK_STACK = 8192;
+SpscQueue<SensorData, 32> record_queue;     // Averaged records to upload
+SpscQueue<SensorData, 4> display_queue;     // Latest samples for the LCD
+TaskHandle_t net_task = NULL;
+
+// Log output: messages are queued in RAM and written out by log_task,
+// which runs below every other task so the UART never blocks sampling
+const UBaseType_t LOG_TASK_PRIORITY = tskIDLE_PRIORITY;
+const uint32_t LOG_TASK_STACK = 3072;
+const uint32_t LOG_DRAIN_PERIOD_MS = 20;
+
+// Status screen, drawn by net_task only; unchanged rows are not redrawn
+StatusScreen status_screen(M5.Lcd);
+
+// Averaged records waiting to be uploaded, persisted across reboots
+LittleFSStorage queue_storage("/uplink.q");
+RecordQueue<SensorData, QUEUE_CAPACITY> uplink_queue(queue_storage);
+
+// Low-power bookkeeping: millis() restarts on every wake, so the time of all
+// earlier cycles (awake + asleep) is carried over to keep timestamps monotonic
+RTC_STATE unsigned long clock_base_ms = 0;
+RTC_STATE unsigned long record_awake_ms = 0;    // Awake time spent on the record being averaged
+RTC_STATE unsigned long record_elapsed_ms = 0;  // Awake + asleep time spent on it
+RTC_STATE int record_cycles = 0;                // Wake cycles that went into it
 
-struct SensorData
+/**
+ * Milliseconds since power-on, continuous across deep sleep
+ */
+unsigned long CLOCK_ms()
 {
-    float temperature;
-    float humidity;
-    float pressure;
-    float gasResistance;
-    float mq2_rs;           // MQ2 sensor resistance in K ohms
-    float mq2_ratio;        // Rs/R0 ratio
-    float mq2_smoke_ppm;    // Estimated smoke concentration in PPM (not used for VOC analysis)
-    
-    // Temporal features for VOC analysis
-    float mq2_delta;        // Change from previous reading
-    float mq2_variance;     // Rolling variance over BASELINE_WINDOW
-    float mq2_baseline;     // Minimum Rs/R0 over BASELINE_WINDOW
-    
-    unsigned long timestamp;
-};
+    return clock_base_ms + millis();
+}
 
-SensorData currentReading;
-SensorData previousReading;  // Track previous for delta calculation
+/**
+ * Logs the result and per-phase latency of the last uplink request
+ */
+void API_logTiming(const char *what, int httpCode)
+{
+    const HttpTiming &t = uplink.lastTiming();
+    LOG_I("%s: HTTP %d, connect %u ms%s, send %u ms, response %u ms",
+          what, httpCode, t.connect_ms, t.reused ? " (reused)" : "", t.send_ms, t.response_ms);
+}
 
-void API_register()
+/**
+ * Logs heap state after a send: free heap, its low-water mark and the
+ * largest allocatable block (falls as the heap fragments)
+ */
+void HEAP_report()
+{
+    LOG_I("Heap: free %u, min free %u, largest block %u",
+          ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
+}
+
+/**
+ * Logs the rates in effect
+ */
+void RATE_log(const char *what, const RateConfig &r)
+{
+    LOG_I("%s: sample %u ms, %u samples per record, report every %u ms, window %u",
+          what, r.sample_period_ms, r.samples_to_average, r.report_interval_ms, r.baseline_window);
+}
+
+/**
+ * Loads the rates the server set last over the defaults; a stored set out
+ * of bounds (e.g. after the bounds changed in a firmware update) is ignored
+ */
+void RATE_load()
+{
+    prefs.begin("rates", true);
+    bool found = prefs.isKey("period");
+    RateConfig stored = rates;
+    stored.sample_period_ms = prefs.getULong("period", rates.sample_period_ms);
+    stored.samples_to_average = prefs.getULong("average", rates.samples_to_average);
+    stored.report_interval_ms = prefs.getULong("report", rates.report_interval_ms);
+    stored.baseline_window = prefs.getULong("window", rates.baseline_window);
+    prefs.end();
+    if (!found)
+    {
+        return;
+    }
+    if (!RATE_valid(stored, BASELINE_WINDOW_MAX))
+    {
+        LOG_W("Stored rates out of bounds, using the defaults");
+        return;
+    }
+    rates = stored;
+    RATE_log("Stored rates", rates);
+}
+
+void RATE_save()
+{
+    prefs.begin("rates", false);
+    prefs.putULong("period", rates.sample_period_ms);
+    prefs.putULong("average", rates.samples_to_average);
+    prefs.putULong("report", rates.report_interval_ms);
+    prefs.putULong("window", rates.baseline_window);
+    prefs.end();
+}
+
+/**
+ * Network side: picks up the control fields of a server response and hands
+ * a changed set of rates to the sampling side
+ */
+void RATE_receive(const char *resp)
+{
+    uint8_t rejected;
+    uint8_t changed = RATE_parse(resp, net_rates, BASELINE_WINDOW_MAX, rejected);
+    if (rejected)
+    {
+        LOG_W("Ignored rate fields out of bounds (0x%02x)", rejected);
+    }
+    if (!changed)
+    {
+        return;
+    }
+    RATE_log("Rates from server", net_rates);
+    if (!rate_queue.push(net_rates))
+    {
+        LOG_E("Rate change dropped");
+    }
+}
+
+/**
+ * Sampling side: applies rate changes from the network task between
+ * samples. The sample task keeps its grid with the new period, the rolling
+ * windows are rebuilt from their ring and the record in progress closes
+ * once it has the new number of samples.
+ */
+void RATE_apply()
 {
-    Serial.println("Registering with OR WITHOUT server...");
-    String callpoint = server_ip;
-    callpoint += "register";
+    RateConfig next;
+    bool changed = false;
+    while (rate_queue.pop(next))
+    {
+        changed = true;
+    }
+    if (!changed)
+    {
+        return;
+    }
+
+    if (next.sample_period_ms != rates.sample_period_ms && sample_task >= 0)
+    {
+        scheduler.setPeriod(sample_task, next.sample_period_ms);
+    }
+    if (next.baseline_window != rates.baseline_window)
+    {
+        gas_sensors.setWindow(next.baseline_window);
+    }
+    rates = next;
+    RATE_save();
+    RATE_log("Rates applied", rates);
+}
 
-    http.begin(callpoint);
-    http.addHeader("Content-Type", "application/json");
+void API_register()
+{
+    LOG_I("Registering with OR WITHOUT server...");
 
-    String postData = "{\"name\":\"" + dev_name + "\", \"location\":\"" + location + "\"}";
+    JsonWriter json(payload_buf, sizeof(payload_buf));
+    JSON_writeRegistration(json, device, OFFER_BINARY_UPLINK, time_to_first_sample, gas_sensors.schema());
 
-    int httpCode = http.POST(postData);
+    char resp[256];
+    int httpCode = uplink.post("/register", "application/json", (const uint8_t *)payload_buf,
+                               json.length(), resp, sizeof(resp));
+    API_logTiming("Register", httpCode);
     if (httpCode == 200)
     {
         is_registered = true;
-        Serial.println("Registration successful");
+        LOG_I("Registration successful");
+
+        // A server that supports the binary uplink answers with "encoding":"bin1" and a session id
+        const char *session = strstr(resp, "\"session\":");
+        wire_session = 0;
+        if (OFFER_BINARY_UPLINK && session && strstr(resp, "\"bin1\""))
+        {
+            wire_session = strtoul(session + 10, NULL, 10);
+        }
+        wire_seq = 0;
+        wire_have_base = false;
+        LOG_I("Uplink encoding: %s", wire_session ? "bin1" : "json");
+        RATE_receive(resp);
     }
     else
     {
-        Serial.printf("Registration failed: HTTP %d\n", httpCode);
+        LOG_E("Registration failed: HTTP %d", httpCode);
     }
+}
+
+/**
+ * Serializes up to MAX_BATCH queued records as a JSON array into payload_buf.
+ * Returns the payload length, 0 on failure.
+ */
+size_t API_buildJsonBatch(int &batch)
+{
+    batch = 0;
+    JsonWriter json(payload_buf, sizeof(payload_buf));
+    json.beginArray();
+
+    SensorData record;
+    while (batch < MAX_BATCH && uplink_queue.peek(batch, record))
+    {
+        JSON_writeSensorData(json, device, record, gas_sensors.schema());
+        batch++;
+    }
+    json.endArray();
 
-    http.end();
+    return json.ok() ? json.length() : 0;
 }
 
+/**
+ * Encodes up to MAX_BATCH queued records as one bin1 frame into payload_buf,
+ * delta-encoded against the last record the server acknowledged.
+ * Returns the frame length, 0 on failure.
+ */
+size_t API_buildWireBatch(int &batch, WireValues &last)
+{
+    batch = 0;
+    WireEncoder wire((uint8_t *)payload_buf, sizeof(payload_buf));
+    wire.begin(wire_session, wire_seq, wire_have_base ? &wire_base : NULL, gas_sensors.schema().count);
+
+    SensorData record;
+    while (batch < MAX_BATCH && uplink_queue.peek(batch, record))
+    {
+        wire.add(record);
+        batch++;
+    }
+
+    last = wire.last();
+    return wire.ok() ? wire.length() : 0;
+}
+
+/**
+ * Drains queued records to the server, one batch per POST: a JSON array
+ * to /update, or a bin1 frame to /update_bin when a binary session is open.
+ * Records are only removed from the queue once the server accepted them.
+ */
 void API_update()
 {
     static int fail_count = 0;
-    String callpoint = server_ip;
-    callpoint += "update";
-
-    http.begin(callpoint);
-    http.addHeader("Content-Type", "application/json");
-
-    String postData = "{\"name\":\"" + dev_name + 
-                      "\", \"timestamp\":" + String(currentReading.timestamp) +
-                      ", \"plant_id\":\"" + plant_id + "\"" +
-                      ", \"disease_status\":\"" + disease_status + "\"" +
-                      ", \"temperature\":" + String(currentReading.temperature, 2) +
-                      ", \"humidity\":" + String(currentReading.humidity, 2) +
-                      ", \"pressure\":" + String(currentReading.pressure, 3) +
-                      ", \"gasResistance\":" + String(currentReading.gasResistance, 2) +
-                      ", \"mq2_rs\":" + String(currentReading.mq2_rs, 2) +
-                      ", \"mq2_ratio\":" + String(currentReading.mq2_ratio, 4) +
-                      ", \"mq2_r0\":" + String(MQ2_R0, 2) +
-                      ", \"mq2_delta\":" + String(currentReading.mq2_delta, 4) +
-                      ", \"mq2_variance\":" + String(currentReading.mq2_variance, 6) +
-                      ", \"mq2_baseline\":" + String(currentReading.mq2_baseline, 4) + "}";
-
-    int httpCode = http.POST(postData);
-    if (httpCode != 200)
-    {
-        Serial.printf("API update failed: HTTP %d\n", httpCode);
+
+    for (int n = 0; n < MAX_BATCHES_PER_DRAIN && !uplink_queue.empty(); n++)
+    {
+        int batch = 0;
+        WireValues last;
+        size_t length;
+        {
+            STAGE_TIME(stage_stats[STAGE_SERIALIZE]);
+            length = wire_session ? API_buildWireBatch(batch, last) : API_buildJsonBatch(batch);
+        }
+
+        if (batch == 0 || length == 0)
+        {
+            LOG_E("Queue read or serialization failed");
+            return;
+        }
+
+        // The response may carry new rates (RateControl.h)
+        char resp[256];
+        int httpCode;
+        {
+            STAGE_TIME(stage_stats[STAGE_UPLINK]);
+            httpCode = uplink.post(wire_session ? "/update_bin" : "/update",
+                                   wire_session ? "application/octet-stream" : "application/json",
+                                   (const uint8_t *)payload_buf, length, resp, sizeof(resp));
+        }
+        API_logTiming("Update", httpCode);
+
+        if (httpCode == HTTP_SESSION_BACKOFF)
+        {
+            LOG_W("Uplink backing off (%u ms), %u records queued", uplink.backoff(), uplink_queue.size());
+            return;
+        }
+
+        if (httpCode == 409 && wire_session)
+        {
+            // Server lost our delta base (e.g. restarted); resend self-contained
+            LOG_W("Delta base rejected, resending absolute");
+            wire_have_base = false;
+            continue;
+        }
+
+        if (httpCode == 410 && wire_session)
+        {
+            // Server no longer knows the session (restarted); open a new one and go on
+            LOG_W("Session %u unknown to the server, re-registering", wire_session);
+            is_registered = false;
+            API_register();
+            if (!is_registered)
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (httpCode != 200)
+        {
+            LOG_E("API update failed: HTTP %d (%u queued)", httpCode, uplink_queue.size());
+            fail_count++;
+            if (fail_count > 5)
+            {
+                is_registered = false;
+                fail_count = 0;
+                LOG_W("Too many failures, re-registering...");
+            }
+            return;
+        }
+
+        if (wire_session)
+        {
+            wire_seq += batch;
+            wire_base = last;
+            wire_have_base = true;
+        }
+
+        uplink_queue.pop(batch);
+        fail_count = 0;
+        LOG_I("Sent %d records, %u bytes (%u left)", batch, length, uplink_queue.size());
+        RATE_receive(resp);
+    }
+}
+
+#if UPLINK_UDP
+/**
+ * Logs the result and cost of the last UDP uplink call
+ */
+void UDP_logStats(const char *what, int result)
+{
+    const UdpUplinkStats &s = udp_uplink.lastStats();
+    LOG_I("%s: UDP %d, %u datagrams (%u resent), %u acks, %u rounds, %u ms",
+          what, result, s.datagrams, s.resent, s.acks, s.rounds, s.elapsed_ms);
+}
+
+void API_registerUdp()
+{
+    LOG_I("Registering over UDP...");
+
+    JsonWriter json(payload_buf, sizeof(payload_buf));
+    JSON_writeRegistration(json, device, true, time_to_first_sample, gas_sensors.schema());
+
+    uint32_t session = 0;
+    int result = udp_uplink.registerDevice(payload_buf, json.length(), session);
+    UDP_logStats("Register", result);
+    if (result == UDP_UPLINK_OK)
+    {
+        is_registered = true;
+        wire_session = session;
+        wire_seq = 0;
+        LOG_I("Registration successful, session %u", session);
+    }
+    else
+    {
+        LOG_E("Registration failed: UDP %d", result);
+    }
+}
+
+/**
+ * Sends up to MAX_BATCHES_PER_DRAIN batches of queued records as UDP
+ * datagrams. Records are only removed from the queue once acknowledged.
+ */
+void API_updateUdp()
+{
+    static int fail_count = 0;
+
+    uint32_t queued = uplink_queue.size();
+    int result;
+    {
+        STAGE_TIME(stage_stats[STAGE_UPLINK]);
+        result = udp_uplink.send(uplink_queue, wire_session, wire_seq);
+    }
+    UDP_logStats("Update", result);
+    LOG_I("Sent %u records (%u left)", queued - uplink_queue.size(), uplink_queue.size());
+
+    if (result == UDP_UPLINK_SESSION)
+    {
+        LOG_W("Session unknown to the server, re-registering...");
+        is_registered = false;
+        return;
+    }
+    if (result != UDP_UPLINK_OK)
+    {
+        LOG_E("API update failed: UDP %d (%u queued)", result, uplink_queue.size());
         fail_count++;
         if (fail_count > 5)
         {
             is_registered = false;
             fail_count = 0;
-            Serial.println("Too many failures, re-registering...");
+            LOG_W("Too many failures, re-registering...");
         }
+        return;
     }
-    else
+    fail_count = 0;
+}
+#endif
+
+#if STAGE_TIMING
+/**
+ * Posts the stage timing summaries to /metrics, in CPU cycles
+ */
+void API_sendMetrics()
+{
+    JsonWriter json(payload_buf, sizeof(payload_buf));
+    json.beginObject();
+    json.key("name");
+    json.value(device.name);
+    json.key("uptime_ms");
+    json.value(CLOCK_ms());
+    json.key("ticks_per_us");
+    json.value((unsigned long)STAGE_ticksPerUs());
+    json.key("stages");
+    STAGE_writeJson(json, stage_stats, STAGE_COUNT);
+    json.endObject();
+    if (!json.ok())
     {
-        Serial.println("Data sent successfully");
-        fail_count = 0;
+        LOG_E("Metrics serialization failed");
+        return;
     }
 
-    http.end();
+    int httpCode = uplink.post("/metrics", "application/json", (const uint8_t *)payload_buf, json.length());
+    API_logTiming("Metrics", httpCode);
 }
+#endif
+
+// Gas Sensor Helper Functions
 
-// MQ2 Helper Functions
+uint32_t ADC_codeToMillivolts(uint16_t code)
+{
+    return esp_adc_cal_raw_to_voltage(code, &adc_chars);
+}
 
 /**
- * Reads the MQ2 sensor resistance (Rs) in K ohms
+ * Sets up the gas sensor inputs, loads the eFuse calibration curve used to
+ * linearize the readings and starts continuous ADC1 sampling of the MQ2
+ * (gas channel 0) through I2S DMA
  */
-float MQ2_readRs()
+void MQ2_adcBegin()
 {
-    int rawADC = analogRead(MQ2_PIN);
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &adc_chars);
+    for (size_t c = 0; c < gas_sensors.count(); c++)
+    {
+        pinMode(gas_channels[c].pin, INPUT);
+    }
 
-    // Debug output
-    Serial.printf("[MQ2 DEBUG] Raw ADC: %d\n", rawADC);
+    int8_t channel = digitalPinToAnalogChannel(gas_channels[0].pin);
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX)
+    {
+        LOG_E("MQ2 on GPIO%u is not an ADC1 input", gas_channels[0].pin);
+        return;
+    }
+    adc1_config_channel_atten((adc1_channel_t)channel, ADC_ATTEN_DB_11);
+
+    i2s_config_t config = {};
+    config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    config.sample_rate = MQ2_ADC_RATE;
+    config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    config.intr_alloc_flags = 0;
+    config.dma_buf_count = MQ2_DMA_BUF_COUNT;
+    config.dma_buf_len = MQ2_DMA_BUF_LEN;
+    config.use_apll = false;
+
+    mq2_dma_ready = i2s_driver_install(I2S_NUM_0, &config, 0, NULL) == ESP_OK &&
+                    i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channel) == ESP_OK &&
+                    i2s_adc_enable(I2S_NUM_0) == ESP_OK;
+
+    LOG_I("MQ2 ADC: %s", mq2_dma_ready ? "I2S DMA, oversampled" : "analogRead fallback");
+}
+
+/**
+ * Returns the MQ2 reading in ADC counts, decimated (median-3 spike
+ * rejection + boxcar) from the DMA buffers completed since the previous
+ * read. Only the first read after the DMA starts waits, for one period;
+ * later ones take what is there, and if nothing is (a read less than a
+ * DMA buffer after the last) repeat the previous reading.
+ */
+float MQ2_readRaw()
+{
+    if (!mq2_dma_ready)
+    {
+        return analogRead(gas_channels[0].pin);
+    }
+
+    // In ADC mode each word carries the channel in the top 4 bits
+    DecimationFilter filter;
+    TickType_t wait = mq2_last_raw < 0 ? pdMS_TO_TICKS(2 * GAS_PERIOD_MS) : 0;
+    size_t bytes;
+    do
+    {
+        bytes = 0;
+        i2s_read(I2S_NUM_0, mq2_adc_block, sizeof(mq2_adc_block), &bytes, wait);
+        wait = 0;
+        size_t count = bytes / sizeof(mq2_adc_block[0]);
+        for (size_t i = 0; i < count; i++)
+        {
+            filter.add(mq2_adc_block[i] & 0x0FFF);
+        }
+    } while (bytes == sizeof(mq2_adc_block));  // A late read finds more than one block
+
+    if (filter.count() > 0)
+    {
+        mq2_last_raw = filter.output();
+    }
+    LOG_D("[MQ2 DEBUG] Raw ADC: %.2f (n=%u)", mq2_last_raw, filter.count());
+
+    return mq2_last_raw < 0 ? 0 : mq2_last_raw;
+}
+
+/**
+ * Returns the reading of a gas channel other than the MQ2 in ADC counts,
+ * from GAS_ANALOG_OVERSAMPLE conversions (median-3 spike rejection + boxcar)
+ */
+float GAS_readAnalog(uint8_t pin)
+{
+    DecimationFilter filter;
+    for (int i = 0; i < GAS_ANALOG_OVERSAMPLE; i++)
+    {
+        filter.add(analogRead(pin));
+    }
+    return filter.output();
+}
+
+/**
+ * Converts a gas sensor reading in ADC counts to the load-resistor voltage
+ * in mV, corrected with the ADC calibration curve
+ */
+float GAS_rawToMillivolts(float raw)
+{
+    float vrl = ADC_rawToMillivolts(raw, ADC_codeToMillivolts, ADC_RESOLUTION);
 
     // Prevent division by zero
-    if (rawADC == 0)
+    if (vrl <= 0)
     {
-        Serial.println("[MQ2 DEBUG] ADC is 0 - sensor not connected or no voltage");
-        rawADC = 1;
+        LOG_D("[GAS DEBUG] ADC is 0 - sensor not connected or no voltage");
+        vrl = 1;
     }
+    return vrl;
+}
+
+/**
+ * Reads every gas channel once and adds the readings to the current
+ * sample. Returns the MQ2 reading in ADC counts.
+ */
+float GAS_read()
+{
+    float millivolts[GAS_MAX_CHANNELS];
+    float raw = MQ2_readRaw();
+    millivolts[0] = GAS_rawToMillivolts(raw);
 
-    // Calculate sensor resistance: Rs = RL * (VCC/VRL - 1)
-    // VRL = rawADC * VCC / ADC_RESOLUTION
-    // Simplifies to: Rs = RL * (ADC_RESOLUTION / rawADC - 1)
-    float rs = RL_VALUE * ((float)ADC_RESOLUTION / rawADC - 1.0);
+    if (gas_sensors.count() > 1)
+    {
+        // I2S holds ADC1 while it samples, so it pauses for the other channels
+        if (mq2_dma_ready)
+        {
+            i2s_adc_disable(I2S_NUM_0);
+        }
+        for (size_t c = 1; c < gas_sensors.count(); c++)
+        {
+            millivolts[c] = GAS_rawToMillivolts(GAS_readAnalog(gas_channels[c].pin));
+        }
+        if (mq2_dma_ready)
+        {
+            i2s_adc_enable(I2S_NUM_0);
+        }
+    }
 
-    Serial.printf("[MQ2 DEBUG] Calculated Rs: %.2f KOhm\n", rs);
+    gas_sensors.add(millivolts);
+    gas_last_raw = raw;
+    return raw;
+}
 
-    return rs;
+/**
+ * Persists the R0 of a gas channel with the wall-clock time (0 if NTP has
+ * not synced yet) and the temperature/humidity it was determined at
+ */
+void GAS_saveCalibration(size_t c, float temperature, float humidity)
+{
+    time_t now = time(NULL);
+    prefs.begin(gas_channels[c].key, false);
+    prefs.putFloat("r0", gas_sensors.r0(c));
+    prefs.putULong("epoch", now > 1000000000 ? (uint32_t)now : 0);
+    prefs.putFloat("temp", temperature);
+    prefs.putFloat("hum", humidity);
+    prefs.end();
 }
 
 /**
- * Calibrates the MQ2 sensor by calculating R0 (resistance in clean air)
+ * Calibrates the gas channels without a stored R0 by calculating R0
+ * (resistance in clean air); loaded[c] is true for the others.
  * Should be called in clean air environment during setup
  */
-void MQ2_calibrate()
+void GAS_calibrate(const bool *loaded)
 {
-    Serial.println("\n=== MQ2 CALIBRATION START ===");
-    Serial.println("Ensure sensor is in clean air!");
-    Serial.println("Warming up sensor (10 seconds)...");
-    M5.Lcd.println("MQ2 Warmup...");
+    LOG_I("=== GAS CALIBRATION START ===");
+    LOG_I("Ensure sensors are in clean air!");
+    LOG_I("Warming up sensors (10 seconds)...");
+    M5.Lcd.println("Gas Warmup...");
 
-    // Wait for sensor to warm up
+    // Wait for sensors to warm up
     delay(10000);
 
-    Serial.printf("Taking %d samples...\n", CALIBRATION_SAMPLES);
-    M5.Lcd.println("MQ2 Calibrating...");
+    LOG_I("Taking %d samples...", CALIBRATION_SAMPLES);
+    M5.Lcd.println("Gas Calibrating...");
 
-    float rsSum = 0;
+    gas_sensors.clearReadings();
     for (int i = 0; i < CALIBRATION_SAMPLES; i++)
     {
-        float rs = MQ2_readRs();
-        rsSum += rs;
+        GAS_read();
         delay(100);
 
         // Progress indicator
         if ((i + 1) % 10 == 0)
         {
-            Serial.printf("  Sample %d/%d: Rs = %.2f K\n", i + 1, CALIBRATION_SAMPLES, rs);
+            LOG_D("  Sample %d/%d: mean MQ2 Rs = %.2f K", i + 1, CALIBRATION_SAMPLES, gas_sensors.meanRs(0));
         }
     }
 
-    float avgRs = rsSum / CALIBRATION_SAMPLES;
-    MQ2_R0 = avgRs / RO_CLEAN_AIR_FACTOR;
+    // The air the R0 was taken in, stored with it like the drift updates
+    float temperature = NAN, humidity = NAN;
+    if (bme.performReading())
+    {
+        temperature = bme.temperature;
+        humidity = bme.humidity;
+    }
+    else
+    {
+        LOG_E("BME680 read failed, R0 stored without temperature/humidity");
+    }
 
-    Serial.printf("Calibration complete!\n");
-    Serial.printf("  Average Rs = %.2f K\n", avgRs);
-    Serial.printf("  Calculated R0 = %.2f K\n", MQ2_R0);
-    Serial.println("=== MQ2 CALIBRATION END ===\n");
+    LOG_I("Calibration complete!");
+    for (size_t c = 0; c < gas_sensors.count(); c++)
+    {
+        if (loaded[c])
+        {
+            continue;
+        }
+        float avgRs = gas_sensors.meanRs(c);
+        gas_sensors.calibrate(c);
+        GAS_saveCalibration(c, temperature, humidity);
+        LOG_I("  %s: average Rs = %.2f K, calculated R0 = %.2f K (T=%.1fC H=%.1f%%)", gas_channels[c].key, avgRs,
+              gas_sensors.r0(c), temperature, humidity);
+    }
+    gas_sensors.clearReadings();
+    lastR0Save = CLOCK_ms();
+    LOG_I("=== GAS CALIBRATION END ===");
 
-    M5.Lcd.println("MQ2 OK");
-    MQ2_calibrated = true;
+    M5.Lcd.println("Gas OK");
 }
 
 /**
- * Computes temporal features for VOC analysis
- * Calculates delta, variance, and baseline from rolling window
+ * Loads the R0 of a gas channel and its context from NVS so boot does not
+ * need the blocking calibration. Returns false if nothing was stored yet.
  */
-void MQ2_computeFeatures(SensorData &current, SensorData &previous)
+bool GAS_loadCalibration(size_t c)
 {
-    // Calculate rate of change from previous reading
-    current.mq2_delta = current.mq2_ratio - previous.mq2_ratio;
-    
-    // Update rolling window
-    recent_ratios[baseline_index] = current.mq2_ratio;
-    baseline_index = (baseline_index + 1) % BASELINE_WINDOW;
-    
-    // Mark as initialized after first full window
-    if (baseline_index == 0) {
-        baseline_initialized = true;
+    prefs.begin(gas_channels[c].key, true);
+    bool found = prefs.isKey("r0");
+    if (found)
+    {
+        gas_sensors.setR0(c, prefs.getFloat("r0", gas_channels[c].r0));
+        uint32_t epoch = prefs.getULong("epoch", 0);
+        float temperature = prefs.getFloat("temp", NAN);
+        float humidity = prefs.getFloat("hum", NAN);
+        LOG_I("Stored %s R0 = %.2f K (epoch %u, T=%.1fC H=%.1f%%)",
+              gas_channels[c].key, gas_sensors.r0(c), epoch, temperature, humidity);
     }
-    
-    // Compute baseline (minimum) and variance
-    float min_ratio = recent_ratios[0];
-    float sum = 0;
-    int samples_to_use = baseline_initialized ? BASELINE_WINDOW : baseline_index;
-    
-    if (samples_to_use == 0) samples_to_use = 1;  // Prevent division by zero
-    
-    for (int i = 0; i < samples_to_use; i++) {
-        if (recent_ratios[i] < min_ratio) {
-            min_ratio = recent_ratios[i];
+    prefs.end();
+    return found;
+}
+
+/**
+ * Refines every R0 from the clean-air envelope of Rs, one sample at a
+ * time, and persists them periodically
+ */
+void GAS_trackR0(const SensorData &reading)
+{
+    gas_sensors.trackR0(R0_TRACK_RISE, R0_TRACK_DECAY);
+
+    if (CLOCK_ms() - lastR0Save >= R0_SAVE_INTERVAL_MS)
+    {
+        for (size_t c = 0; c < gas_sensors.count(); c++)
+        {
+            GAS_saveCalibration(c, reading.temperature, reading.humidity);
         }
-        sum += recent_ratios[i];
+        lastR0Save = CLOCK_ms();
+        LOG_I("Saved refined R0 = %.2f K", gas_sensors.r0(0));
     }
-    
-    current.mq2_baseline = min_ratio;
-    
-    // Compute variance
-    float mean = sum / samples_to_use;
-    float variance_sum = 0;
-    for (int i = 0; i < samples_to_use; i++) {
-        float diff = recent_ratios[i] - mean;
-        variance_sum += diff * diff;
+}
+
+/**
+ * Writes queued log messages to the serial port
+ */
+void LOG_task(void *arg)
+{
+    for (;;)
+    {
+        LOG_drain(Serial, LOG_SLOTS);
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_PERIOD_MS));
     }
-    current.mq2_variance = variance_sum / samples_to_use;
 }
 
 /**
- * Reads MQ2 sensor and calculates Rs, Rs/R0 ratio, and smoke PPM
+ * Pushes the changed rows of the status screen and logs what the frame cost
  */
-void MQ2_read(SensorData &data)
+void DISPLAY_render()
 {
-    // Read sensor resistance
-    data.mq2_rs = MQ2_readRs();
+    STAGE_TIME(stage_stats[STAGE_LCD]);
+    const RenderStats &frame = status_screen.render();
+    LOG_D("LCD: %u rows, %u bytes, %u us", frame.rows, frame.bytes, frame.us);
+}
 
-    // Calculate Rs/R0 ratio
-    if (MQ2_R0 > 0)
+/**
+ * Shows the latest sample on the LCD
+ */
+void DISPLAY_sample(const SensorData &reading, int n)
+{
+    status_screen.printf(0, "Sample %d/%u", n, net_rates.samples_to_average);
+    status_screen.printf(1, "T:%.1fC H:%.0f%%", reading.temperature, reading.humidity);
+    status_screen.printf(2, "Rs/R0:%.3f", reading.mq2_ratio);
+    status_screen.printf(3, "D:%.3f V:%.4f", reading.mq2_delta, reading.mq2_variance);
+    if (gas_sensors.count() > 1)
     {
-        data.mq2_ratio = data.mq2_rs / MQ2_R0;
+        status_screen.printf(4, "%s:%.3f", gas_channels[1].key, reading.gas[0].ratio);
     }
     else
     {
-        data.mq2_ratio = -1;  // Invalid
+        status_screen.clear(4);
     }
+    DISPLAY_render();
+}
+
+/**
+ * Shows the last averaged record after an upload attempt
+ */
+void DISPLAY_sent(const SensorData &record)
+{
+    status_screen.printf(0, "SENT (n=%u)", net_rates.samples_to_average);
+    status_screen.printf(1, "%s", device.plant_id);
+    status_screen.printf(2, "Rs/R0:%.3f", record.mq2_ratio);
+    status_screen.printf(3, "Var:%.4f", record.mq2_variance);
+    status_screen.printf(4, "T:%.1fC H:%.0f%%", record.temperature, record.humidity);
+    DISPLAY_render();
+}
 
-    // Calculate smoke concentration in PPM using empirical formula
-    // Smoke curve from MQ2 datasheet: PPM = 605.0 * pow(Rs/R0, -3.5)
-    // This is an approximation and may vary with actual conditions
-    if (data.mq2_ratio > 0 && data.mq2_ratio < 10)
+/**
+ * Moves finished records to the flash queue. Returns false if there was no
+ * new record; last is set to the newest one.
+ */
+bool NET_queueRecords(SensorData &last)
+{
+    bool have_record = false;
+    while (record_queue.pop(last))
     {
-        data.mq2_smoke_ppm = 605.0 * pow(data.mq2_ratio, -3.5);
+        if (!uplink_queue.push(last))
+        {
+            LOG_E("Failed to queue record");
+        }
+        have_record = true;
+    }
+    return have_record;
+}
+
+/**
+ * Whether the queued records should go out now: with every record when
+ * there is no report interval, otherwise once it has passed or a full
+ * drain's worth of records is waiting
+ */
+bool REPORT_due()
+{
+    return net_rates.report_interval_ms == 0 ||
+           CLOCK_ms() - last_report_ms >= net_rates.report_interval_ms ||
+           uplink_queue.size() >= (uint32_t)(MAX_BATCH * MAX_BATCHES_PER_DRAIN);
+}
+
+/**
+ * Uploads what is pending, registering first if needed
+ */
+void NET_upload()
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        LOG_W("WiFi down, %u records queued", uplink_queue.size());
     }
     else
     {
-        data.mq2_smoke_ppm = 0;  // Out of reliable range
+#if UPLINK_UDP
+        if (!is_registered)
+        {
+            API_registerUdp();
+        }
+        if (is_registered)
+        {
+            API_updateUdp();
+        }
+#else
+        if (!is_registered)
+        {
+            API_register();
+        }
+        if (is_registered)
+        {
+            API_update();
+        }
+#endif
+#if STAGE_TIMING && !LOW_POWER_MODE && !UPLINK_UDP
+        // Low-power mode loses the counters in every deep sleep, so it only
+        // times; the UDP build has no HTTP session to post them with
+        if (is_registered && millis() - metrics_sent_ms >= METRICS_PERIOD_MS)
+        {
+            API_sendMetrics();
+            metrics_sent_ms = millis();
+        }
+#endif
+        HEAP_report();
+        if (uplink_queue.empty())
+        {
+            last_report_ms = CLOCK_ms();
+        }
+    }
+}
+
+/**
+ * Moves finished records to the flash queue and uploads what is pending
+ * once a report is due. Returns false if nothing was uploaded; last is set
+ * to the newest record.
+ */
+bool NET_sendRecords(SensorData &last)
+{
+    if (!NET_queueRecords(last))
+    {
+        return false;
+    }
+    if (!REPORT_due())
+    {
+        LOG_D("Report in %lu ms, %u records queued",
+              net_rates.report_interval_ms - (CLOCK_ms() - last_report_ms), uplink_queue.size());
+        return false;
+    }
+    NET_upload();
+    return true;
+}
+
+/**
+ * Network/display task: persists averaged records to the flash queue,
+ * drains it to the server and keeps the LCD up to date. Woken by the
+ * sampling side through a task notification.
+ */
+void NET_task(void *arg)
+{
+    int samples_shown = 0;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        SensorData data;
+        while (display_queue.pop(data))
+        {
+            samples_shown = samples_shown % net_rates.samples_to_average + 1;
+            DISPLAY_sample(data, samples_shown);
+        }
+
+        if (NET_sendRecords(data))
+        {
+            DISPLAY_sent(data);
+            samples_shown = 0;
+        }
+    }
+}
+
+// Acquisition policies (lib/Acquisition). Records are stored and sent
+// after averaging, so the per-sample storage and transport are empty. In
+// low-power mode the acquisition reads every gas channel into the sample;
+// in the always-on build they have their own task, and a BME680
+// conversion only picks up the latest MQ2 reading.
+struct GasAdc
+{
+#if LOW_POWER_MODE
+    float read() { return GAS_read(); }
+#else
+    float read() { return gas_last_raw; }
+#endif
+};
+
+struct DeviceClock
+{
+    uint32_t now() { return millis(); }
+    uint32_t timestamp() { return CLOCK_ms(); }
+    uint32_t cycles() { return ESP.getCycleCount(); }
+};
+
+GasAdc gas_adc;
+DeviceClock device_clock;
+AcqNullStorage sample_storage;
+AcqNullTransport sample_transport;
+Acquisition<Adafruit_BME680, GasAdc, DeviceClock, AcqNullStorage, AcqNullTransport>
+    acquisition(bme, gas_adc, device_clock, sample_storage, sample_transport);
+
+/**
+ * Logs achieved against configured rate, overruns and worst lateness of
+ * every sampling task since the last call
+ */
+void SCHED_logRates()
+{
+    struct TaskInfo
+    {
+        const char *name;
+        int id;
+        unsigned long period_ms;
+    };
+    const TaskInfo tasks[] = {
+        {"sample", sample_task, rates.sample_period_ms},
+        {"gas", gas_task, GAS_PERIOD_MS},
+        {"bme680", bme_task, BME_PERIOD_MS},
+    };
+
+    unsigned long now = millis();
+    unsigned long elapsed = now - rate_stats_since;
+    for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++)
+    {
+        const TaskInfo &t = tasks[i];
+        if (t.id < 0 || elapsed == 0)
+            continue;
+        LOG_I("Rate %s: %.2f Hz of %.2f Hz, %u overruns, max lateness %lu ms", t.name,
+              scheduler.runs(t.id) * 1000.0 / elapsed, 1000.0 / t.period_ms,
+              scheduler.overruns(t.id), scheduler.maxLateness(t.id));
+        scheduler.resetStats(t.id);
+    }
+    rate_stats_since = now;
+}
+
+void SAMPLE_process(SensorData &reading);
+
+#if LOW_POWER_MODE
+/**
+ * Starts a sample: kicks off the BME680 conversion without waiting for it
+ * and reads the gas sensors while the gas heater runs. Returns the time the
+ * conversion result can be collected.
+ */
+unsigned long SAMPLE_begin()
+{
+    LOG_D("--- Sample %u/%u ---", accumulated.count + 1, rates.samples_to_average);
+
+    unsigned long ready;
+    {
+        STAGE_TIME(stage_stats[STAGE_BME_START]);
+        ready = acquisition.start();
+    }
+    bme_pending = ready != 0;
+    if (!bme_pending)
+    {
+        LOG_E("BME680 read failed");
+    }
+
+    return bme_pending ? ready : millis();
+}
+
+/**
+ * Completes a lockstep sample once the BME680 result is ready
+ */
+void SAMPLE_collect(unsigned long due)
+{
+    bool ok;
+    {
+        STAGE_TIME(stage_stats[STAGE_BME_COLLECT]);
+        ok = acquisition.finish();
+    }
+    if (!ok && bme_pending)
+    {
+        LOG_E("BME680 read failed");
+    }
+    bme_pending = false;
+
+    const AcqSample &sample = acquisition.last();
+    SensorData reading = SensorData();
+    reading.timestamp = sample.timestamp;
+    reading.temperature = sample.temperature;
+    reading.humidity = sample.humidity;
+    reading.pressure = sample.pressure / 1000.0;
+    reading.gasResistance = sample.gas_resistance / 1000.0;
+
+    SAMPLE_process(reading);
+}
+#else
+/**
+ * Reads every gas channel into the running sums of the current sample
+ */
+void GAS_sampleTask(unsigned long due)
+{
+    STAGE_TIME(stage_stats[STAGE_GAS_READ]);
+    GAS_read();
+}
+
+/**
+ * Starts a BME680 conversion and schedules its collection
+ */
+void BME_startTask(unsigned long due)
+{
+    if (bme_pending)
+    {
+        return;  // The previous conversion has not been collected yet
+    }
+    unsigned long ready;
+    {
+        STAGE_TIME(stage_stats[STAGE_BME_START]);
+        ready = acquisition.start();
+    }
+    bme_pending = ready != 0;
+    if (!bme_pending)
+    {
+        LOG_E("BME680 read failed");
+        return;
+    }
+    scheduler.at(collect_task, ready);
+}
+
+/**
+ * Keeps the finished BME680 conversion as the latest environment reading
+ */
+void BME_collectTask(unsigned long due)
+{
+    bme_pending = false;
+    bool ok;
+    {
+        STAGE_TIME(stage_stats[STAGE_BME_COLLECT]);
+        ok = acquisition.finish();
+    }
+    if (!ok)
+    {
+        LOG_E("BME680 read failed");
+        return;
     }
+
+    const AcqSample &sample = acquisition.last();
+    bme_latest.temperature = sample.temperature;
+    bme_latest.humidity = sample.humidity;
+    bme_latest.pressure = sample.pressure / 1000.0;
+    bme_latest.gasResistance = sample.gas_resistance / 1000.0;
+    bme_latest_ms = sample.timestamp;
 }
 
+/**
+ * Combines the gas readings since the last sample (mean Rs) with the
+ * latest BME680 result into one sample on the 1 s grid
+ */
+void SAMPLE_tick(unsigned long due)
+{
+    LOG_D("--- Sample %u/%u ---", accumulated.count + 1, rates.samples_to_average);
+
+    SensorData reading = SensorData();
+    reading.timestamp = CLOCK_ms();
+
+    if (gas_sensors.readings() == 0)
+    {
+        GAS_sampleTask(due);  // The gas task fell behind; read once here
+    }
+    LOG_D("Gas: %u readings", gas_sensors.readings());
+
+    reading.temperature = bme_latest.temperature;
+    reading.humidity = bme_latest.humidity;
+    reading.pressure = bme_latest.pressure;
+    reading.gasResistance = bme_latest.gasResistance;
+    if (reading.timestamp - bme_latest_ms > 2 * BME_PERIOD_MS)
+    {
+        LOG_W("BME680 result is %lu ms old", reading.timestamp - bme_latest_ms);
+    }
+
+    SAMPLE_process(reading);
+}
+#endif
+
+/**
+ * Processes one sample: features, accumulation, display and, every
+ * rates.samples_to_average samples, the upload
+ */
+void SAMPLE_process(SensorData &reading)
+{
+    STAGE_TIME(stage_stats[STAGE_SAMPLE]);
+
+    // Rates from the server take effect from this sample on
+    RATE_apply();
+
+    // Mean Rs, ratio and ppm of every gas channel, and their temporal
+    // features for VOC analysis
+    {
+        STAGE_TIME(stage_stats[STAGE_FEATURES]);
+        gas_sensors.sample();
+    }
+    gas_sensors.store(reading);
+
+    // Refine R0 in the background; applies from the next sample on
+    GAS_trackR0(reading);
+
+    if (time_to_first_sample == 0)
+    {
+        time_to_first_sample = millis();
+        LOG_I("Time to first sample: %lu ms", time_to_first_sample);
+    }
+
+    // Accumulate the readings
+    ACC_add(accumulated, reading);
+
+    LOG_D("T:%.1fC H:%.1f%% P:%.2fkPa G:%.2fK",
+          reading.temperature, reading.humidity, reading.pressure, reading.gasResistance);
+    LOG_D("MQ2 Rs:%.2fK Ratio:%.4f",
+          reading.mq2_rs, reading.mq2_ratio);
+    LOG_D("VOC - Delta:%.4f Var:%.6f Base:%.4f",
+          reading.mq2_delta, reading.mq2_variance, reading.mq2_baseline);
+
+    // Hand the sample to the display; dropping one when the LCD lags is harmless.
+    // In low-power mode there is no net task and the LCD stays dark.
+    if (net_task)
+    {
+        display_queue.push(reading);
+        xTaskNotifyGive(net_task);
+    }
+
+    // Check if we have enough samples to average and send
+    if (accumulated.count >= rates.samples_to_average)
+    {
+        LOG_I("=== AVERAGING & SENDING ===");
+
+        // Calculate averages
+        ACC_average(accumulated, currentReading);
+        gas_sensors.storeR0(currentReading);
+        currentReading.timestamp = reading.timestamp;
+        SensorData lowest, highest;
+        ACC_range(accumulated, lowest, highest);
+
+        LOG_I("AVERAGED VALUES (n=%u):", accumulated.count);
+        LOG_I("Environment: T=%.1fC H=%.1f%% P=%.2fkPa",
+             currentReading.temperature, currentReading.humidity, currentReading.pressure);
+        LOG_I("Range: T %.1f..%.1fC, MQ2 Rs/R0 %.4f..%.4f",
+             lowest.temperature, highest.temperature, lowest.mq2_ratio, highest.mq2_ratio);
+        LOG_I("BME680 Gas: %.2f KOhm", currentReading.gasResistance);
+        LOG_I("MQ2 Rs: %.2f KOhm", currentReading.mq2_rs);
+        LOG_I("MQ2 Rs/R0: %.4f (R0=%.2f)", currentReading.mq2_ratio, currentReading.mq2_r0);
+        LOG_I("VOC Features - Delta:%.4f Var:%.6f Base:%.4f",
+             currentReading.mq2_delta, currentReading.mq2_variance, currentReading.mq2_baseline);
+        for (size_t c = 1; c < gas_sensors.count(); c++)
+        {
+            const GasFeatures &g = currentReading.gas[c - 1];
+            LOG_I("%s Rs: %.2f KOhm, Rs/R0: %.4f (R0=%.2f), %s: %.1f",
+                 gas_channels[c].key, g.rs, g.ratio, g.r0, gas_channels[c].model->gas, g.ppm);
+        }
+        LOG_I("Plant: %s (%s)", device.plant_id, device.disease_status);
+        SCHED_logRates();
+        LOG_I("Acquisition: %u cycles, max %u", acquisition.lastCycles(), acquisition.maxCycles());
+        acquisition.resetStats();
+
+        LOG_I("Pipeline: record queue %u/%u (high %u, %u overflows), display %u overflows",
+             record_queue.size(), record_queue.capacity(), record_queue.highWater(),
+             record_queue.overflows(), display_queue.overflows());
+
+        // Hand the records that pass the edge filter to the network task
+        SensorData outgoing[EdgeFilter<EDGE_PRE_EVENT>::MAX_OUT];
+        size_t outgoing_count = 1;
+        outgoing[0] = currentReading;
+        if (EDGE_FILTER_ENABLED)
+        {
+            outgoing_count = edge_filter.offer(EDGE_CONFIG, currentReading, outgoing);
+            LOG_I("Edge filter: %s (0x%02x), %u of %u records sent, %u events",
+                 outgoing_count ? "send" : "hold", edge_filter.lastReasons(),
+                 edge_filter.sent(), edge_filter.offered(), edge_filter.events());
+        }
+        for (size_t i = 0; i < outgoing_count; i++)
+        {
+            if (!record_queue.push(outgoing[i]))
+            {
+                LOG_E("Record queue full, record dropped");
+            }
+        }
+        if (net_task && outgoing_count)
+        {
+            xTaskNotifyGive(net_task);
+        }
+
+        // Reset accumulator
+        ACC_reset(accumulated);
+
+        lastUpdate = millis();
+    }
+}
+
+#if LOW_POWER_MODE
+/**
+ * Moves a finished record to the flash queue. RAM does not survive sleep,
+ * so the queue is reopened per record. Returns whether a report is due.
+ */
+bool LOWPOWER_queueRecords()
+{
+    SensorData last;
+    if (!queue_storage.begin() || !uplink_queue.begin())
+    {
+        LOG_E("Uplink queue unavailable!");
+        return false;
+    }
+    NET_queueRecords(last);
+    return REPORT_due();
+}
+
+/**
+ * Powers the radio up for one upload of the queued records and back down
+ */
+void LOWPOWER_upload()
+{
+    unsigned long t0 = millis();
+    WiFi.mode(WIFI_STA);
+    bool online = wifiMulti.run(WIFI_CONNECT_TIMEOUT_MS) == WL_CONNECTED;
+    LOG_I("WiFi %s after %lu ms", online ? "up" : "failed", millis() - t0);
+    if (online && time(NULL) < 1000000000)
+    {
+        configTime(0, 0, "pool.ntp.org");  // System time survives deep sleep once set
+    }
+
+    NET_upload();
+
+    uplink.close();
+#if UPLINK_UDP
+    udp_net.close();
+#endif
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+}
+
+/**
+ * One low-power cycle: takes a single sample, uploads if that completed a
+ * record and a report is due, then deep sleeps until the next sample is
+ * due. Never returns.
+ *
+ * Awake time is measured with millis(), i.e. from application start; the
+ * ROM and bootloader stages of the wake are not included.
+ */
+void LOWPOWER_cycle()
+{
+    unsigned long ready = SAMPLE_begin();
+    long wait = (long)(ready - millis());
+    if (wait > 0)
+    {
+        delay(wait);
+    }
+    SAMPLE_collect(ready);
+
+    bool sending = record_queue.size() > 0 && LOWPOWER_queueRecords();
+    if (sending)
+    {
+        LOWPOWER_upload();
+        RATE_apply();  // The next sleep already uses new rates
+    }
+
+    unsigned long awake = millis();
+    unsigned long period = rates.sample_period_ms;
+    unsigned long sleep_ms = awake + 10 < period ? period - awake : 10;
+    record_awake_ms += awake;
+    record_elapsed_ms += awake + sleep_ms;
+    record_cycles++;
+    LOG_I("Awake %lu ms, sleeping %lu ms", awake, sleep_ms);
+
+    if (sending)
+    {
+        // Energy per report is roughly proportional to the awake time behind it
+        LOG_I("Report cost: %lu ms awake over %d cycles (%.1f%% duty)",
+              record_awake_ms, record_cycles, 100.0 * record_awake_ms / record_elapsed_ms);
+        record_awake_ms = 0;
+        record_elapsed_ms = 0;
+        record_cycles = 0;
+    }
+
+    clock_base_ms += awake + sleep_ms;
+    LOG_drain(Serial, LOG_SLOTS);
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000);
+    esp_deep_sleep_start();
+}
+#endif
+
 void setup()
 {
     M5.begin();
     Serial.begin(115200);
+    xTaskCreate(LOG_task, "log", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, NULL);
+
+#if LOW_POWER_MODE
+    M5.Axp.SetLDO2(false);  // LCD backlight off, nobody watches a battery unit
+    bool cold_boot = esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER;
+#else
+    bool cold_boot = true;
+#endif
 
     M5.Lcd.fillScreen(TFT_BLACK);
     M5.Lcd.setTextSize(1);
     M5.Lcd.setCursor(0, 0);
 
-    Serial.println("\n=== CROPSENSE INIT ===");
+    LOG_I("=== CROPSENSE INIT ===");
     M5.Lcd.println("CROPSENSE");
 
-    Serial.println("Connecting to WiFi...");
-    M5.Lcd.println("WiFi...");
     wifiMulti.addAP(WIFI_SSID, WIFI_PASSWD);
 
+    // In low-power mode the radio stays off until a record is ready
+#if !LOW_POWER_MODE
+    LOG_I("Connecting to WiFi...");
+    M5.Lcd.println("WiFi...");
+
     if (wifiMulti.run() == WL_CONNECTED)
     {
-        Serial.println("WiFi connected");
+        LOG_I("WiFi connected");
         M5.Lcd.println("WiFi OK");
+        configTime(0, 0, "pool.ntp.org");  // Wall-clock time for the stored R0
     }
     else
     {
-        Serial.println("WiFi failed");
+        LOG_W("WiFi failed");
         M5.Lcd.println("WiFi FAIL");
     }
+#endif
 
     Wire.begin(32, 33);
 
-    Serial.println("Initializing BME680...");
+    LOG_I("Initializing BME680...");
     M5.Lcd.println("BME680...");
-    if (!bme.begin(0x77))
+    if (!acquisition.begin(0x77))
     {
-        Serial.println("BME680 ERROR!");
+        LOG_E("BME680 ERROR!");
         M5.Lcd.println("BME680 ERR");
     }
 
-    bme.setTemperatureOversampling(BME680_OS_8X);
-    bme.setHumidityOversampling(BME680_OS_2X);
-    bme.setPressureOversampling(BME680_OS_4X);
-    bme.setIIRFilterSize(BME680_FILTER_SIZE_3);
-    bme.setGasHeater(320, 150);
-
-    Serial.println("BME680 ready");
+    LOG_I("BME680 ready");
     M5.Lcd.println("BME680 OK");
 
-    // Initialize and calibrate MQ2 sensor
-    Serial.println("Initializing MQ2...");
-    M5.Lcd.println("MQ2 Init...");
+    // Initialize and calibrate the gas sensors
+    LOG_I("Initializing %u gas sensors...", gas_sensors.count());
+    M5.Lcd.println("Gas Init...");
 
-    // Configure ADC for MQ2 sensor
+    // Configure ADC for the gas sensors
     analogReadResolution(12);  // Set 12-bit resolution (0-4095)
     analogSetAttenuation(ADC_11db);  // Set attenuation for 0-3.3V range
 
-    pinMode(MQ2_PIN, INPUT);
-    MQ2_calibrate();
+    MQ2_adcBegin();
 
-    Serial.println("=== INIT COMPLETE ===\n");
+    // Boot straight into sampling with the stored R0s; only channels that
+    // have never been calibrated pay for the blocking calibration. After a
+    // wake from deep sleep the gas state is still in RTC memory.
+    if (!cold_boot)
+    {
+        LOG_I("Woken from sleep, R0 = %.2f K", gas_sensors.r0(0));
+    }
+    else
+    {
+        gas_sensors.reset();
+        bool loaded[GAS_MAX_CHANNELS];
+        bool all_loaded = true;
+        for (size_t c = 0; c < gas_sensors.count(); c++)
+        {
+            loaded[c] = GAS_loadCalibration(c);
+            all_loaded = all_loaded && loaded[c];
+        }
+        if (!all_loaded)
+        {
+            GAS_calibrate(loaded);
+        }
+        else
+        {
+            M5.Lcd.println("Gas R0 loaded");
+        }
+    }
+
+    // Rates the server set last; after a wake from deep sleep they are still
+    // in RTC memory. The window lengths are not, so they are set again.
+    if (cold_boot)
+    {
+        RATE_load();
+    }
+    net_rates = rates;
+    gas_sensors.setWindow(rates.baseline_window);
+
+    // Open the on-flash uplink queue; records left from before a reboot are kept
+#if !LOW_POWER_MODE
+    if (!queue_storage.begin() || !uplink_queue.begin())
+    {
+        LOG_E("Uplink queue unavailable!");
+        M5.Lcd.println("QUEUE ERR");
+    }
+    else
+    {
+        LOG_I("Uplink queue: %u records pending", uplink_queue.size());
+    }
+#endif
+
+    LOG_I("=== INIT COMPLETE ===");
 
     lastUpdate = millis();
-    lastSample = millis();
-    
-    // Initialize accumulated data
-    accumulated.temperature = 0;
-    accumulated.humidity = 0;
-    accumulated.pressure = 0;
-    accumulated.gasResistance = 0;
-    accumulated.mq2_rs = 0;
-    accumulated.mq2_ratio = 0;
-    accumulated.mq2_smoke_ppm = 0;
-    accumulated.mq2_delta = 0;
-    accumulated.mq2_variance = 0;
-    accumulated.mq2_baseline = 0;
-    sampleCount = 0;
-    
-    // Initialize previous reading
-    previousReading.mq2_ratio = 0;
-    previousReading.mq2_delta = 0;
-    previousReading.mq2_variance = 0;
-    previousReading.mq2_baseline = 0;
     
-    // Initialize rolling window for temporal analysis
-    for (int i = 0; i < BASELINE_WINDOW; i++) {
-        recent_ratios[i] = 0;
+    // Temporal state is kept in RTC memory in low-power mode, so only a
+    // cold boot starts it from scratch
+    if (cold_boot)
+    {
+        // Initialize accumulated data; the gas channels' temporal state
+        // was reset before their calibration
+        ACC_reset(accumulated);
+        edge_filter.reset();
     }
-    baseline_index = 0;
-    baseline_initialized = false;
+
+#if LOW_POWER_MODE
+    LOWPOWER_cycle();
+#else
+    xTaskCreatePinnedToCore(NET_task, "net", NET_TASK_STACK, NULL, 1, &net_task, NET_CORE);
+
+    // The first BME680 result is in before the first sample is taken
+    gas_task = scheduler.every(GAS_PERIOD_MS, GAS_sampleTask);
+    bme_task = scheduler.every(BME_PERIOD_MS, BME_startTask);
+    collect_task = scheduler.oneShot(BME_collectTask);
+    sample_task = scheduler.every(rates.sample_period_ms, SAMPLE_tick, rates.sample_period_ms);
+    rate_stats_since = millis();
+#endif
 }
 
 void loop()
 {
-    unsigned long currentTime = millis();
-
-    // Take a sample every second
-    if (currentTime - lastSample >= 1000)
-    {
-        Serial.printf("\n--- Sample %d/%d ---\n", sampleCount + 1, SAMPLES_TO_AVERAGE);
-
-        if (!bme.performReading())
-        {
-            Serial.println("ERROR: BME680 read failed");
-        }
-
-        SensorData reading;
-        reading.temperature = bme.temperature;
-        reading.humidity = bme.humidity;
-        reading.pressure = bme.pressure / 1000.0;
-        reading.gasResistance = bme.gas_resistance / 1000.0;
-
-        // Read MQ2 sensor
-        MQ2_read(reading);
-        
-        // Compute temporal features for VOC analysis
-        MQ2_computeFeatures(reading, previousReading);
-
-        // Accumulate the readings
-        accumulated.temperature += reading.temperature;
-        accumulated.humidity += reading.humidity;
-        accumulated.pressure += reading.pressure;
-        accumulated.gasResistance += reading.gasResistance;
-        accumulated.mq2_rs += reading.mq2_rs;
-        accumulated.mq2_ratio += reading.mq2_ratio;
-        accumulated.mq2_smoke_ppm += reading.mq2_smoke_ppm;
-        accumulated.mq2_delta += reading.mq2_delta;
-        accumulated.mq2_variance += reading.mq2_variance;
-        accumulated.mq2_baseline += reading.mq2_baseline;
-        
-        // Store current reading for next delta calculation
-        previousReading = reading;
-
-        sampleCount++;
-
-        Serial.printf("T:%.1fC H:%.1f%% P:%.2fkPa G:%.2fK\n", 
-                      reading.temperature, reading.humidity, reading.pressure, reading.gasResistance);
-        Serial.printf("MQ2 Rs:%.2fK Ratio:%.4f\n",
-                      reading.mq2_rs, reading.mq2_ratio);
-        Serial.printf("VOC - Delta:%.4f Var:%.6f Base:%.4f\n",
-                      reading.mq2_delta, reading.mq2_variance, reading.mq2_baseline);
-
-        // Update display with current sample
-        M5.Lcd.fillScreen(TFT_BLACK);
-        M5.Lcd.setCursor(0, 0);
-        M5.Lcd.printf("Sample %d/%d\n", sampleCount, SAMPLES_TO_AVERAGE);
-        M5.Lcd.printf("T:%.1fC H:%.0f%%\n", reading.temperature, reading.humidity);
-        M5.Lcd.printf("Rs/R0:%.3f\n", reading.mq2_ratio);
-        M5.Lcd.printf("D:%.3f V:%.4f\n", reading.mq2_delta, reading.mq2_variance);
-
-        lastSample = currentTime;
-
-        // Check if we have enough samples to average and send
-        if (sampleCount >= SAMPLES_TO_AVERAGE)
-        {
-            Serial.println("\n=== AVERAGING & SENDING ===");
-
-            // Calculate averages
-            currentReading.temperature = accumulated.temperature / sampleCount;
-            currentReading.humidity = accumulated.humidity / sampleCount;
-            currentReading.pressure = accumulated.pressure / sampleCount;
-            currentReading.gasResistance = accumulated.gasResistance / sampleCount;
-            currentReading.mq2_rs = accumulated.mq2_rs / sampleCount;
-            currentReading.mq2_ratio = accumulated.mq2_ratio / sampleCount;
-            currentReading.mq2_smoke_ppm = accumulated.mq2_smoke_ppm / sampleCount;
-            currentReading.mq2_delta = accumulated.mq2_delta / sampleCount;
-            currentReading.mq2_variance = accumulated.mq2_variance / sampleCount;
-            currentReading.mq2_baseline = accumulated.mq2_baseline / sampleCount;
-            currentReading.timestamp = currentTime;
-
-            Serial.printf("AVERAGED VALUES (n=%d):\n", sampleCount);
-            Serial.printf("Environment: T=%.1fC H=%.1f%% P=%.2fkPa\n", 
-                         currentReading.temperature, currentReading.humidity, currentReading.pressure);
-            Serial.printf("BME680 Gas: %.2f KOhm\n", currentReading.gasResistance);
-            Serial.printf("MQ2 Rs: %.2f KOhm\n", currentReading.mq2_rs);
-            Serial.printf("MQ2 Rs/R0: %.4f (R0=%.2f)\n", currentReading.mq2_ratio, MQ2_R0);
-            Serial.printf("VOC Features - Delta:%.4f Var:%.6f Base:%.4f\n", 
-                         currentReading.mq2_delta, currentReading.mq2_variance, currentReading.mq2_baseline);
-            Serial.printf("Plant: %s (%s)\n", plant_id.c_str(), disease_status.c_str());
-
-            // Send to server
-            if (!is_registered)
-            {
-                API_register();
-            }
-            else
-            {
-                API_update();
-            }
+    scheduler.runDue();
 
-            // Update display with averaged values
-            M5.Lcd.fillScreen(TFT_BLACK);
-            M5.Lcd.setCursor(0, 0);
-            M5.Lcd.printf("SENT (n=%d)\n", sampleCount);
-            M5.Lcd.printf("%s\n", plant_id.c_str());
-            M5.Lcd.printf("Rs/R0:%.3f\n", currentReading.mq2_ratio);
-            M5.Lcd.printf("Var:%.4f\n", currentReading.mq2_variance);
-            M5.Lcd.printf("T:%.1fC H:%.0f%%\n", currentReading.temperature, currentReading.humidity);
-
-            // Reset accumulator
-            accumulated.temperature = 0;
-            accumulated.humidity = 0;
-            accumulated.pressure = 0;
-            accumulated.gasResistance = 0;
-            accumulated.mq2_rs = 0;
-            accumulated.mq2_ratio = 0;
-            accumulated.mq2_smoke_ppm = 0;
-            accumulated.mq2_delta = 0;
-            accumulated.mq2_variance = 0;
-            accumulated.mq2_baseline = 0;
-            sampleCount = 0;
-
-            lastUpdate = currentTime;
-        }
-    }
-
-    delay(50);  // Small delay to prevent tight looping
+    // Sleep until the next deadline instead of polling
+    delay(scheduler.untilNext(rates.sample_period_ms));
 }
\ No newline at end of file
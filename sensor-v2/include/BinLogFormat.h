@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// On-card layout of the binary data log (BINLOG builds). Shared with the
+// host converter in tools/binlog2csv.cpp, so it must not depend on Arduino.
+//
+// A log file is a pre-allocated run of 512-byte sectors. Each sector is
+//
+//   offset 0  u16  BINLOG_MAGIC
+//          2  u8   BINLOG_VERSION
+//          3  u8   number of records in this sector
+//          4  u16  file number, so stale sectors of an older file don't match
+//          6  u16  index of this sector within the file
+//          8  records, BINLOG_RECORD_SIZE bytes each
+//
+// and a record is
+//
+//          0  u32  timestamp (ms since boot)
+//          4  f32  temperature (C)
+//          8  f32  pressure (hPa)
+//         12  f32  humidity (%)
+//         16  f32  gas resistance (KOhms)
+//         20  u16  MQ2 ADC value in 2^-BINLOG_MQ2_FRACTION_BITS counts
+//                  (whole counts in version 1 logs)
+//
+// All values little-endian. The log ends at the first sector whose header
+// does not match; only the last sector may hold fewer than
+// BINLOG_RECORDS_PER_SECTOR records.
+
+const uint16_t BINLOG_SECTOR_SIZE = 512;
+const uint16_t BINLOG_MAGIC = 0xB10C;
+const uint8_t BINLOG_VERSION = 2;
+const uint8_t BINLOG_VERSION_WHOLE_MQ2 = 1;   // Still read: MQ2 in whole counts
+const uint8_t BINLOG_MQ2_FRACTION_BITS = 4;
+const uint8_t BINLOG_HEADER_SIZE = 8;
+const uint8_t BINLOG_RECORD_SIZE = 22;
+const uint8_t BINLOG_RECORDS_PER_SECTOR = (BINLOG_SECTOR_SIZE - BINLOG_HEADER_SIZE) / BINLOG_RECORD_SIZE;
+
+struct BinLogRecord {
+  uint32_t timestamp;
+  float temperature;
+  float pressure;
+  float humidity;
+  float gas;
+  uint16_t mq2_raw;
+};
+
+inline void BINLOG_put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline void BINLOG_put32(uint8_t *p, uint32_t v) {
+  BINLOG_put16(p, (uint16_t)v);
+  BINLOG_put16(p + 2, (uint16_t)(v >> 16));
+}
+
+inline uint16_t BINLOG_get16(const uint8_t *p) {
+  return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+inline uint32_t BINLOG_get32(const uint8_t *p) {
+  return BINLOG_get16(p) | ((uint32_t)BINLOG_get16(p + 2) << 16);
+}
+
+inline void BINLOG_putFloat(uint8_t *p, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  BINLOG_put32(p, bits);
+}
+
+inline float BINLOG_getFloat(const uint8_t *p) {
+  uint32_t bits = BINLOG_get32(p);
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+inline void BINLOG_putHeader(uint8_t *sector, uint16_t file_no, uint16_t index, uint8_t count) {
+  BINLOG_put16(sector, BINLOG_MAGIC);
+  sector[2] = BINLOG_VERSION;
+  sector[3] = count;
+  BINLOG_put16(sector + 4, file_no);
+  BINLOG_put16(sector + 6, index);
+}
+
+// Returns the record count if the sector belongs to file_no at position
+// index, or -1 if it does not (end of log). The version is sector[2].
+inline int BINLOG_checkHeader(const uint8_t *sector, uint16_t file_no, uint16_t index) {
+  if (BINLOG_get16(sector) != BINLOG_MAGIC ||
+      (sector[2] != BINLOG_VERSION && sector[2] != BINLOG_VERSION_WHOLE_MQ2) ||
+      BINLOG_get16(sector + 4) != file_no || BINLOG_get16(sector + 6) != index ||
+      sector[3] == 0 || sector[3] > BINLOG_RECORDS_PER_SECTOR) {
+    return -1;
+  }
+  return sector[3];
+}
+
+inline uint8_t *BINLOG_recordAt(uint8_t *sector, uint8_t i) {
+  return sector + BINLOG_HEADER_SIZE + (uint16_t)i * BINLOG_RECORD_SIZE;
+}
+
+inline void BINLOG_putRecord(uint8_t *p, const BinLogRecord &r) {
+  BINLOG_put32(p, r.timestamp);
+  BINLOG_putFloat(p + 4, r.temperature);
+  BINLOG_putFloat(p + 8, r.pressure);
+  BINLOG_putFloat(p + 12, r.humidity);
+  BINLOG_putFloat(p + 16, r.gas);
+  BINLOG_put16(p + 20, r.mq2_raw);
+}
+
+inline void BINLOG_getRecord(const uint8_t *p, BinLogRecord &r) {
+  r.timestamp = BINLOG_get32(p);
+  r.temperature = BINLOG_getFloat(p + 4);
+  r.pressure = BINLOG_getFloat(p + 8);
+  r.humidity = BINLOG_getFloat(p + 12);
+  r.gas = BINLOG_getFloat(p + 16);
+  r.mq2_raw = BINLOG_get16(p + 20);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <SdFat.h>
+
+#include "BinLogFormat.h"
+
+// Sector-buffered binary logger (BINLOG builds).
+//
+// Records are packed into a 512-byte RAM sector. Each log file is created
+// contiguous and pre-erased, so a full sector is written straight to its
+// place on the card with one raw write: no FAT lookup, no directory update
+// and no read-modify-write. A partly filled sector is also written every
+// sync_records records, which bounds how much a power cut can lose. Later
+// writes replace it in place. When a file is full, logging moves on to the
+// next LOGnnn.BIN.
+class BinLogger {
+public:
+  BinLogger(SdFat &sd, uint16_t file_sectors, uint8_t sync_records)
+    : sd(sd), file_sectors(file_sectors), sync_records(sync_records),
+      file_no(0), first_sector(0), index(0), count(0), unsynced(0), write_errors(0) {}
+
+  // Creates the first free LOGnnn.BIN; call after sd.begin()
+  bool begin() {
+    return openNext();
+  }
+
+  bool append(const BinLogRecord &record) {
+    if (first_sector == 0) {
+      return false;
+    }
+    BINLOG_putRecord(BINLOG_recordAt(sector, count), record);
+    count++;
+    unsynced++;
+
+    if (count == BINLOG_RECORDS_PER_SECTOR) {
+      bool ok = writeSector();
+      index++;
+      count = 0;
+      if (index == file_sectors) {
+        openNext();
+      }
+      return ok;
+    }
+    if (sync_records && unsynced >= sync_records) {
+      return writeSector();
+    }
+    return true;
+  }
+
+  // Writes the partly filled sector now
+  bool sync() {
+    return count == 0 || writeSector();
+  }
+
+  uint16_t fileNumber() const { return file_no; }
+  uint32_t recordsLogged() const { return (uint32_t)index * BINLOG_RECORDS_PER_SECTOR + count; }
+  uint16_t writeErrors() const { return write_errors; }
+
+private:
+  bool writeSector() {
+    BINLOG_putHeader(sector, file_no, index, count);
+    unsynced = 0;
+    if (!sd.card()->writeSector(first_sector + index, sector)) {
+      write_errors++;
+      return false;
+    }
+    return true;
+  }
+
+  bool openNext() {
+    first_sector = 0;
+    index = 0;
+    count = 0;
+    unsynced = 0;
+
+    char name[13];
+    for (uint16_t n = file_no + 1; n < 1000; n++) {
+      snprintf_P(name, sizeof(name), PSTR("LOG%03u.BIN"), n);
+      if (sd.exists(name)) {
+        continue;
+      }
+
+      SdFile file;
+      uint32_t last_sector;
+      if (!file.createContiguous(name, (uint32_t)file_sectors * BINLOG_SECTOR_SIZE) ||
+          !file.contiguousRange(&first_sector, &last_sector)) {
+        first_sector = 0;
+        return false;
+      }
+      file.close();
+
+      // Erased sectors never match a header, so the log end is unambiguous
+      sd.card()->erase(first_sector, last_sector);
+      file_no = n;
+      return true;
+    }
+    return false;
+  }
+
+  SdFat &sd;
+  uint16_t file_sectors;
+  uint8_t sync_records;
+  uint16_t file_no;
+  uint32_t first_sector;    // 0 while no file is open
+  uint16_t index;           // Sector being filled
+  uint8_t count;            // Records in it
+  uint8_t unsynced;         // Records appended since the sector was last written
+  uint16_t write_errors;
+  uint8_t sector[BINLOG_SECTOR_SIZE];
+};
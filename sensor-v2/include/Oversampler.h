@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// Oversampling and decimation of a free-running ADC. Shared with the host
+// check in tools/oversample_check.cpp, so it must not depend on Arduino.
+//
+// Summing 4^EXTRA_BITS conversions and shifting the sum right by
+// EXTRA_BITS gains EXTRA_BITS bits of resolution, provided the input
+// carries at least about 1 LSB of noise to dither the quantization (the
+// MQ2 output does). The decimated value is in units of 2^-EXTRA_BITS ADC
+// counts, i.e. a 10-bit ADC with EXTRA_BITS = 4 gives a 14-bit value.
+//
+// add() runs in the ADC interrupt; start() and the result accessors run in
+// the main loop while the ADC interrupt is off or masked. The first
+// `discard` conversions after start() are dropped, as the first ones after
+// enabling the ADC or switching the reference are off.
+template <uint8_t EXTRA_BITS>
+class Oversampler {
+  static_assert(EXTRA_BITS >= 1 && EXTRA_BITS <= 6, "the decimated value must fit 16 bits");
+
+public:
+  static const uint16_t CONVERSIONS = (uint16_t)1 << (2 * EXTRA_BITS);
+  static const uint8_t BITS = EXTRA_BITS;
+
+  void start(uint8_t discard) {
+    sum = 0;
+    count = 0;
+    skip = discard;
+    done = false;
+  }
+
+  // Takes one conversion; returns true when the block is complete and
+  // the ADC can be stopped. Conversions after that are ignored.
+  bool add(uint16_t conversion) {
+    if (done) {
+      return true;
+    }
+    if (skip) {
+      skip--;
+      return false;
+    }
+    sum += conversion;
+    if (++count == CONVERSIONS) {
+      done = true;
+    }
+    return done;
+  }
+
+  bool ready() const { return done; }
+
+  // Decimated value in 2^-EXTRA_BITS counts, rounded to nearest
+  uint16_t value() const {
+    return (uint16_t)((sum + ((uint32_t)1 << (EXTRA_BITS - 1))) >> EXTRA_BITS);
+  }
+
+  // Decimated value in ADC counts, with the extra bits as fraction
+  float counts() const { return value() / (float)((uint16_t)1 << EXTRA_BITS); }
+
+private:
+  volatile uint32_t sum;
+  volatile uint16_t count;
+  volatile uint8_t skip;
+  volatile bool done;
+};
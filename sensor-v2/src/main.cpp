@@ -1,24 +1,218 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <SPI.h>
-#include <SD.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 #include <Adafruit_Sensor.h>
 #include "Adafruit_BME680.h"
+#include <RingLog.h>
+#include <Acquisition.h>
+#include "Oversampler.h"
+
+// Storage mode: BINLOG=1 packs records into 512-byte sectors of a
+// pre-allocated file (SdFat); otherwise one CSV line per reading (SD)
+#ifndef BINLOG
+#define BINLOG 0
+#endif
+
+#if BINLOG
+#include <SdFat.h>
+#include "BinLogger.h"
+#else
+#include <SD.h>
+#endif
 
 // Pin definitions
 #define MQ2_PIN A0          // MQ2 analog output pin
+const uint8_t MQ2_ADC_CHANNEL = 0;  // ADC0 = A0
 #define SD_CS_PIN 53        // SD card chip select pin (default for Mega)
 
 // BME680 sensor
 Adafruit_BME680 bme;
 
+#if BINLOG
+#ifndef BINLOG_FILE_SECTORS
+#define BINLOG_FILE_SECTORS 8192    // 4 MB per file, ~62 days at one record per 30 s
+#endif
+#ifndef BINLOG_SYNC_RECORDS
+#define BINLOG_SYNC_RECORDS 4       // Write the partial sector every N records (0 = full sectors only)
+#endif
+
+SdFat sd;
+BinLogger binLog(sd, BINLOG_FILE_SECTORS, BINLOG_SYNC_RECORDS);
+#else
 // SD card file
 File dataFile;
+#endif
+
+// MQ2 oversampling: 4^4 = 256 conversions per reading, decimated to 14
+// bits (about 12-13 effective). At a 125 kHz ADC clock a reading takes
+// about 27 ms, which overlaps the BME680 conversion.
+const uint8_t MQ2_EXTRA_BITS = 4;
+const uint8_t MQ2_DISCARD = 2;      // Conversions dropped after enabling the ADC
+Oversampler<MQ2_EXTRA_BITS> mq2Oversampler;
+
+// Free-running ADC: sums conversions until the block is complete, then
+// switches the ADC off so it draws nothing while the MCU sleeps
+ISR(ADC_vect) {
+  if (mq2Oversampler.add(ADC)) {
+    ADCSRA = 0;
+  }
+}
 
-// Timing
+// Power-down stops Timer 0, so millis() does not advance while asleep;
+// the nominal watchdog time slept is added here. The watchdog oscillator
+// is only accurate to about 10%, which the timestamps inherit.
+uint32_t sleptMs = 0;
+
+uint32_t nowMs() {
+  return millis() + sleptMs;
+}
+
+// Only wakes the CPU; the watchdog runs in interrupt mode, never resets
+ISR(WDT_vect) {
+}
+
+// Powers down for one watchdog period of 16 ms << wdp (wdp 0..9)
+void powerDown(uint8_t wdp) {
+  uint8_t prescaler = (wdp & 0x07) | ((wdp & 0x08) ? _BV(WDP3) : 0);
+  cli();
+  MCUSR &= ~_BV(WDRF);
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDIE) | prescaler;
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  wdt_disable();
+}
+
+// Sleeps for ms: power-down in the longest watchdog periods that fit,
+// then idle (Timer 0 keeps running) for the last few ms
+void sleepFor(uint32_t ms) {
+  while (ms >= 16) {
+    uint8_t wdp = 9;  // 8 s
+    while ((16UL << wdp) > ms) {
+      wdp--;
+    }
+    powerDown(wdp);
+    sleptMs += 16UL << wdp;
+    ms -= 16UL << wdp;
+  }
+  uint32_t start = millis();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while (millis() - start < ms) {
+    sleep_mode();
+  }
+}
+
+// Acquisition policies (lib/Acquisition)
+
+// MQ2 on the 10-bit AVR ADC, free running under interrupt and oversampled;
+// the CPU idles between conversions. Returns ADC counts with a fraction.
+struct AvrAdc {
+  float read() {
+    mq2Oversampler.start(MQ2_DISCARD);
+    ADMUX = _BV(REFS0) | (MQ2_ADC_CHANNEL & 0x07);        // AVcc reference
+    ADCSRB = (MQ2_ADC_CHANNEL & 0x08) ? _BV(MUX5) : 0;    // Free-running trigger
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) |
+             _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);        // 16 MHz / 128 = 125 kHz
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (!mq2Oversampler.ready()) {
+      sleep_mode();
+    }
+    return mq2Oversampler.counts();
+  }
+};
+
+struct AvrClock {
+  uint32_t now() { return millis(); }
+  uint32_t timestamp() { return nowMs(); }
+  // micros() counts in steps of 4 us, i.e. 64 cycles at 16 MHz
+  uint32_t cycles() { return micros() * (F_CPU / 1000000UL); }
+};
+
+#if BINLOG
+// Appends to the sector buffer; the card is only written per sector or sync
+struct BinLogStorage {
+  void store(const AcqSample &s) {
+    BinLogRecord record;
+    record.timestamp = s.timestamp;
+    record.temperature = s.temperature;
+    record.pressure = s.pressure / 100.0;
+    record.humidity = s.humidity;
+    record.gas = s.gas_resistance / 1000.0;
+    record.mq2_raw = (uint16_t)(s.mq2_raw * (1 << BINLOG_MQ2_FRACTION_BITS) + 0.5f);
+    if (!binLog.append(record)) {
+      LOG_E("Binary log write failed (%u errors)", binLog.writeErrors());
+    }
+  }
+};
+static_assert(MQ2_EXTRA_BITS <= BINLOG_MQ2_FRACTION_BITS, "the binary log would round the MQ2 value");
+typedef BinLogStorage LoggerStorage;
+#else
+// One CSV line per reading, appended to datalog.csv
+struct CsvStorage {
+  void store(const AcqSample &s) {
+    dataFile = SD.open("datalog.csv", FILE_WRITE);
+    if (dataFile) {
+      dataFile.print(s.timestamp);
+      dataFile.print(",");
+      dataFile.print(s.temperature, 2);
+      dataFile.print(",");
+      dataFile.print(s.pressure / 100.0, 2);
+      dataFile.print(",");
+      dataFile.print(s.humidity, 2);
+      dataFile.print(",");
+      dataFile.print(s.gas_resistance / 1000.0, 2);
+      dataFile.print(",");
+      dataFile.println(s.mq2_raw, 4);
+      dataFile.close();
+
+      LOG_D("Data written to SD card");
+    } else {
+      LOG_E("Error opening datalog.csv for writing");
+    }
+  }
+};
+typedef CsvStorage LoggerStorage;
+#endif
+
+// Reports each reading on the serial log
+struct SerialLogTransport {
+  void send(const AcqSample &s) {
+    // avr-libc printf has no %f, so floats are preformatted
+    char t[12], p[12], h[12], g[12], m[12];
+    dtostrf(s.temperature, 1, 2, t);
+    dtostrf(s.pressure / 100.0, 1, 2, p);        // hPa
+    dtostrf(s.humidity, 1, 2, h);
+    dtostrf(s.gas_resistance / 1000.0, 1, 2, g); // KOhms
+    dtostrf(s.mq2_raw, 1, 2, m);
+    LOG_I("%lu ms: T=%s C P=%s hPa", s.timestamp, t, p);
+    LOG_I("H=%s %% G=%s KOhm MQ2=%s", h, g, m);
+  }
+};
+
+AvrAdc mq2Adc;
+AvrClock sysClock;
+LoggerStorage logStorage;
+SerialLogTransport serialTransport;
+Acquisition<Adafruit_BME680, AvrAdc, AvrClock, LoggerStorage, SerialLogTransport>
+  acquisition(bme, mq2Adc, sysClock, logStorage, serialTransport);
+
+// Timing, on the nowMs() clock
 unsigned long lastReadTime = 0;
 const unsigned long READ_INTERVAL = 30000; // 30 seconds in milliseconds
 
+// Stops after a fatal error, still writing out the queued log
+void halt() {
+  for (;;) {
+    LOG_drain(Serial, LOG_SLOTS);
+  }
+}
+
 void setup() {
   // Initialize serial communication
   Serial.begin(9600);
@@ -26,35 +220,43 @@ void setup() {
     ; // Wait for serial port to connect
   }
 
-  Serial.println(F("BME680 + MQ2 Data Logger"));
-  Serial.println(F("========================"));
+  LOG_I("BME680 + MQ2 Data Logger");
+  LOG_I("========================");
 
-  // Initialize BME680
-  if (!bme.begin()) {
-    Serial.println(F("Could not find a valid BME680 sensor, check wiring!"));
-    while (1); // Halt
+  // Initialize BME680 with the shared oversampling, filter and heater settings
+  if (!acquisition.begin(BME68X_DEFAULT_ADDRESS)) {
+    LOG_E("Could not find a valid BME680 sensor, check wiring!");
+    halt();
   }
 
-  // Set up BME680 oversampling and filter
-  bme.setTemperatureOversampling(BME680_OS_8X);
-  bme.setHumidityOversampling(BME680_OS_2X);
-  bme.setPressureOversampling(BME680_OS_4X);
-  bme.setIIRFilterSize(BME680_FILTER_SIZE_3);
-  bme.setGasHeater(320, 150); // 320°C for 150 ms
-
-  Serial.println(F("BME680 initialized successfully"));
+  LOG_I("BME680 initialized successfully");
 
-  // Initialize MQ2 pin
+  // Initialize MQ2 pin; its digital input buffer only wastes power
   pinMode(MQ2_PIN, INPUT);
-  Serial.println(F("MQ2 sensor initialized"));
+  DIDR0 |= _BV(MQ2_ADC_CHANNEL);
+  LOG_I("MQ2 sensor initialized");
 
   // Initialize SD card
-  Serial.print(F("Initializing SD card..."));
+  LOG_I("Initializing SD card...");
+#if BINLOG
+  if (!sd.begin(SD_CS_PIN)) {
+#else
   if (!SD.begin(SD_CS_PIN)) {
-    Serial.println(F("SD card initialization failed!"));
-    while (1); // Halt
+#endif
+    LOG_E("SD card initialization failed!");
+    halt();
   }
-  Serial.println(F("SD card initialized"));
+  LOG_I("SD card initialized");
+
+#if BINLOG
+  // Create the next pre-allocated binary log
+  if (binLog.begin()) {
+    LOG_I("Logging to LOG%03u.BIN", binLog.fileNumber());
+  } else {
+    LOG_E("Error creating binary log");
+    halt();
+  }
+#else
 
   // Create/open log file and write header
   dataFile = SD.open("datalog.csv", FILE_WRITE);
@@ -64,68 +266,42 @@ void setup() {
       dataFile.println(F("Timestamp(ms),Temperature(C),Pressure(hPa),Humidity(%),Gas(Ohms),MQ2_Raw"));
     }
     dataFile.close();
-    Serial.println(F("Log file ready"));
+    LOG_I("Log file ready");
   } else {
-    Serial.println(F("Error opening datalog.csv"));
-    while (1); // Halt
+    LOG_E("Error opening datalog.csv");
+    halt();
   }
+#endif
 
-  Serial.println(F("Setup complete. Starting data logging..."));
-  Serial.println();
+  LOG_I("Setup complete. Starting data logging...");
+  LOG_drain(Serial, LOG_SLOTS);
 }
 
 void loop() {
-  unsigned long currentTime = millis();
-
-  // Check if it's time to read sensors
-  if (currentTime - lastReadTime >= READ_INTERVAL) {
-    lastReadTime = currentTime;
-
-    // Read BME680 sensor
-    if (!bme.performReading()) {
-      Serial.println(F("Failed to perform BME680 reading"));
-      return;
-    }
-
-    // Read MQ2 sensor (analog value)
-    int mq2Value = analogRead(MQ2_PIN);
-
-    // Get sensor values
-    float temperature = bme.temperature;
-    float pressure = bme.pressure / 100.0; // Convert to hPa
-    float humidity = bme.humidity;
-    float gasResistance = bme.gas_resistance / 1000.0; // Convert to KOhms
-
-    // Print to Serial Monitor
-    Serial.println(F("--- Sensor Reading ---"));
-    Serial.print(F("Timestamp: ")); Serial.print(currentTime); Serial.println(F(" ms"));
-    Serial.print(F("Temperature: ")); Serial.print(temperature); Serial.println(F(" °C"));
-    Serial.print(F("Pressure: ")); Serial.print(pressure); Serial.println(F(" hPa"));
-    Serial.print(F("Humidity: ")); Serial.print(humidity); Serial.println(F(" %"));
-    Serial.print(F("Gas Resistance: ")); Serial.print(gasResistance); Serial.println(F(" KOhms"));
-    Serial.print(F("MQ2 Raw Value: ")); Serial.println(mq2Value);
-
-    // Write to SD card
-    dataFile = SD.open("datalog.csv", FILE_WRITE);
-    if (dataFile) {
-      dataFile.print(currentTime);
-      dataFile.print(",");
-      dataFile.print(temperature, 2);
-      dataFile.print(",");
-      dataFile.print(pressure, 2);
-      dataFile.print(",");
-      dataFile.print(humidity, 2);
-      dataFile.print(",");
-      dataFile.print(gasResistance, 2);
-      dataFile.print(",");
-      dataFile.println(mq2Value);
-      dataFile.close();
-
-      Serial.println(F("Data written to SD card"));
-    } else {
-      Serial.println(F("Error opening datalog.csv for writing"));
-    }
+  // Sleep until the next reading is due, with the log written out first:
+  // the UART stops in power-down
+  uint32_t elapsed = nowMs() - lastReadTime;
+  if (elapsed < READ_INTERVAL) {
+    LOG_drain(Serial, LOG_SLOTS);
+    Serial.flush();
+    sleepFor(READ_INTERVAL - elapsed);
+  }
+  lastReadTime = nowMs();
 
-    Serial.println();
+  // Read both sensors; storage and transport get the sample. The MQ2 is
+  // read while the BME680 converts, then the CPU idles until it is done.
+  uint32_t ready = acquisition.start();
+  if (ready == 0) {
+    LOG_E("Failed to perform BME680 reading");
+    return;
+  }
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while ((int32_t)(millis() - ready) < 0) {
+    sleep_mode();
+  }
+  if (!acquisition.finish()) {
+    LOG_E("Failed to perform BME680 reading");
+    return;
   }
+  LOG_D("Acquisition: %lu cycles (max %lu)", acquisition.lastCycles(), acquisition.maxCycles());
 }
@@ -1,69 +1,281 @@
 from flask import Flask, render_template, request, jsonify, send_from_directory
 import os
 import csv
+import struct
 from datetime import datetime
 
 app = Flask(__name__)
 values = dict()
 
-sensor_data_labels = [
-    'temperature', 'humidity', 'pressure', 'gasResistance',
-    'mq2_rs', 'mq2_ratio', 'mq2_r0', 'mq2_delta', 'mq2_variance', 'mq2_baseline'
+# Record schema: key, decimals on the wire and CSV column, in wire order.
+# Must match SENSOR_UPLINK_FIELDS in sensor-src-m5/include/SensorData.h.
+sensor_fields = [
+    ('temperature', 2, 'Temperature (°C)'),
+    ('humidity', 2, 'Humidity (%)'),
+    ('pressure', 3, 'Pressure (kPa)'),
+    ('gasResistance', 2, 'Gas Resistance (KOhm)'),
+    ('mq2_rs', 2, 'MQ2 Rs (Ohm)'),
+    ('mq2_ratio', 4, 'MQ2 Ratio'),
+    ('mq2_r0', 2, 'MQ2 R0 (Ohm)'),
+    ('mq2_delta', 4, 'MQ2 Delta'),
+    ('mq2_variance', 6, 'MQ2 Variance'),
+    ('mq2_baseline', 4, 'MQ2 Baseline'),
 ]
-# deg C, %, kPa, KOhm, Ohm, ratio, Ohm, ratio, ratio^2, ratio
+sensor_data_labels = [key for key, _, _ in sensor_fields]
+
+# Gas channels beyond the MQ2 (sensor-src-m5/include/GasChannels.h), which the
+# device announces at registration as 'gas_channels': their fields are
+# <key>_rs, <key>_ratio, ... and their columns '<KEY> Rs (Ohm)', ... in this
+# order. Must match GAS_FEATURE_UPLINK_FIELDS on the device.
+gas_feature_fields = [
+    ('rs', 2, 'Rs (Ohm)'),
+    ('ratio', 4, 'Ratio'),
+    ('r0', 2, 'R0 (Ohm)'),
+    ('delta', 4, 'Delta'),
+    ('variance', 6, 'Variance'),
+    ('baseline', 4, 'Baseline'),
+]
+
+
+def gas_fields(gas_channels):
+    return [(f'{key}_{suffix}', decimals) for key in gas_channels for suffix, decimals, _ in gas_feature_fields]
+
+
+def csv_header(gas_channels):
+    return ['Timestamp', 'Sensor Timestamp', 'Plant ID', 'Disease Status'] + \
+        [header for _, _, header in sensor_fields] + \
+        [f'{key.upper()} {header}' for key in gas_channels for _, _, header in gas_feature_fields]
+
+# Binary uplink "bin1" (see sensor-src-m5/include/WireCodec.h).
+WIRE_MAGIC = 0xC5
+WIRE_VERSION = 1
+WIRE_FLAG_ABSOLUTE = 0x01
+WIRE_FLAG_CHANNELS = 0x02
+wire_fields = [(key, decimals) for key, decimals, _ in sensor_fields]
+# session id -> {'name', 'last_seq', 'last'}: delta base per binary session
+sessions = dict()
+next_session = 1
+
+# Rates the devices apply at runtime (sensor-src-m5/include/RateControl.h),
+# set per device through /control and sent with every /register, /update and
+# /update_bin response. Bounds must match RATE_FIELDS on the device; the
+# device ignores values outside them.
+control_bounds = {
+    'sample_period_ms': (500, 600000),
+    'samples_to_average': (1, 600),
+    'report_interval_ms': (0, 3600000),
+    'baseline_window': (2, 120)
+}
+# device name -> {field: value}
+controls = dict()
+
+def with_control(name, response):
+    """Adds the device's control fields to a response body."""
+    response.update(controls.get(name, {}))
+    return response
+
 
 def log(msg):
     timestamp = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
     print(f"[{timestamp}] {msg}")
 
 
+def record_labels(name):
+    """Value fields a record of the device must have."""
+    return sensor_data_labels + [label for label, _ in gas_fields(values[name]['gas_channels'])]
+
+
+def record_error(recieved_sensor_data):
+    """Returns why a sensor record cannot be stored, or None if it can."""
+    if 'name' not in recieved_sensor_data:
+        return 'No name provided'
+    for data_name in record_labels(recieved_sensor_data['name']):
+        if data_name not in recieved_sensor_data:
+            return f'No value provided for {data_name}'
+    return None
+
+
+def store_record(recieved_sensor_data):
+    """Validates one sensor record, updates the live values and appends it to the device CSV.
+    Returns an error message, or None on success."""
+    error = record_error(recieved_sensor_data)
+    if error is not None:
+        return error
+
+    # Extract additional metadata fields
+    plant_id = recieved_sensor_data.get('plant_id', 'unknown')
+    disease_status = recieved_sensor_data.get('disease_status', 'unknown')
+    sensor_timestamp = recieved_sensor_data.get('timestamp', '')
+    gas_channels = values[recieved_sensor_data['name']]['gas_channels']
+    labels = record_labels(recieved_sensor_data['name'])
+
+    for data_name in labels:
+        values[recieved_sensor_data['name']]['data'][data_name] = recieved_sensor_data[data_name]
+
+    values[recieved_sensor_data['name']]['last_upd'] = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+    values[recieved_sensor_data['name']]['plant_id'] = plant_id
+    values[recieved_sensor_data['name']]['disease_status'] = disease_status
+    log(f"Updated data for {recieved_sensor_data['name']}: {values[recieved_sensor_data['name']]['data']}")
+
+    # Append the new data to the CSV file
+    file_present = os.path.exists(f'data/data_{recieved_sensor_data['name']}.csv')
+
+    with open(f'data/data_{recieved_sensor_data['name']}.csv', mode='a', newline='') as file:
+        if not file_present:
+            writer = csv.writer(file)
+            writer.writerow(csv_header(gas_channels))
+        writer = csv.writer(file)
+        row = [
+            values[recieved_sensor_data['name']]['last_upd'],
+            sensor_timestamp,
+            plant_id,
+            disease_status
+        ] + [values[recieved_sensor_data['name']]['data'][name] for name in labels]
+        writer.writerow(row)
+
+    return None
+
+
 @app.route('/update', methods=['POST'])
 def update_data():
     try:
         # Get the new value from the request JSON body
         recieved_sensor_data = request.get_json()
-        if 'name' not in recieved_sensor_data:
-            return jsonify({'error': 'No name provided'}), 400
 
-        # Extract additional metadata fields
-        plant_id = recieved_sensor_data.get('plant_id', 'unknown')
-        disease_status = recieved_sensor_data.get('disease_status', 'unknown')
-        sensor_timestamp = recieved_sensor_data.get('timestamp', '')
+        # Batched upload from the device queue: a JSON array of records
+        if isinstance(recieved_sensor_data, list):
+            rejected = 0
+            for record in recieved_sensor_data:
+                error = store_record(record)
+                if error is not None:
+                    # Drop bad records instead of failing the batch, otherwise the device retries it forever
+                    log(f'Rejected record in batch: {error}')
+                    rejected += 1
+            stored = len(recieved_sensor_data) - rejected
+            name = recieved_sensor_data[0].get('name') if recieved_sensor_data else None
+            return jsonify(with_control(name, {'message': f'Data updated successfully', 'stored': stored,
+                                               'rejected': rejected})), 200
 
-        for data_name in sensor_data_labels:
-            if data_name not in recieved_sensor_data:
-                return jsonify({'error': f'No value provided for {data_name}'}), 400
-            values[recieved_sensor_data['name']]['data'][data_name] = recieved_sensor_data[data_name]
+        error = store_record(recieved_sensor_data)
+        if error is not None:
+            return jsonify({'error': error}), 400
 
-        values[recieved_sensor_data['name']]['last_upd'] = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
-        values[recieved_sensor_data['name']]['plant_id'] = plant_id
-        values[recieved_sensor_data['name']]['disease_status'] = disease_status
-        log(f"Updated data for {recieved_sensor_data['name']}: {values[recieved_sensor_data['name']]['data']}")
+        return jsonify(with_control(recieved_sensor_data['name'], {'message': f'Data updated successfully'})), 200
+    except Exception as e:
+        log(f'Error in update_data: {e}')
+        return jsonify({'error': 'Invalid Query'}), 400
 
-        # Append the new data to the CSV file
-        file_present = os.path.exists(f'data/data_{recieved_sensor_data['name']}.csv')
 
-        with open(f'data/data_{recieved_sensor_data['name']}.csv', mode='a', newline='') as file:
-            if not file_present:
-                writer = csv.writer(file)
-                header = [
-                    'Timestamp', 'Sensor Timestamp', 'Plant ID', 'Disease Status',
-                    'Temperature (°C)', 'Humidity (%)', 'Pressure (kPa)', 'Gas Resistance (KOhm)',
-                    'MQ2 Rs (Ohm)', 'MQ2 Ratio', 'MQ2 R0 (Ohm)', 'MQ2 Delta', 'MQ2 Variance', 'MQ2 Baseline'
-                ]
-                writer.writerow(header)
+def read_varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(n):
+    return (n >> 1) ^ -(n & 1)
+
+
+@app.route('/update_bin', methods=['POST'])
+def update_bin():
+    try:
+        buf = request.get_data()
+        magic, version, flags = struct.unpack_from('BBB', buf, 0)
+        if magic != WIRE_MAGIC or version != WIRE_VERSION:
+            return jsonify({'error': 'Unsupported encoding'}), 400
+        session_id, pos = read_varint(buf, 3)
+        base_seq, pos = read_varint(buf, pos)
+        channels = 0
+        if flags & WIRE_FLAG_CHANNELS:
+            channels, pos = read_varint(buf, pos)
+
+        session = sessions.get(session_id)
+        if session is None:
+            # Gone, e.g. after a restart: tells the device to register again instead of retrying
+            return jsonify({'error': 'Unknown session'}), 410
+        gas_channels = values[session['name']]['gas_channels']
+        if channels != len(gas_channels):
+            return jsonify({'error': 'Gas channels do not match the registration'}), 400
+        fields = wire_fields + gas_fields(gas_channels)
+
+        if flags & WIRE_FLAG_ABSOLUTE:
+            prev = [0] * (1 + len(fields))
+        elif session['last_seq'] == base_seq and session['last'] is not None:
+            prev = list(session['last'])
+        else:
+            # Device must resend without deltas
+            return jsonify({'error': 'Delta base mismatch'}), 409
+
+        # Decode and validate the whole frame before storing any of it: a frame rejected
+        # halfway would leave records stored that the device sends again
+        name = session['name']
+        records = []
+        while pos < len(buf):
+            for i in range(len(prev)):
+                delta, pos = read_varint(buf, pos)
+                prev[i] += unzigzag(delta)
+
+            record = {
+                'name': name,
+                'timestamp': prev[0],
+                'plant_id': values[name]['plant_id'],
+                'disease_status': values[name]['disease_status']
+            }
+            for (field, decimals), scaled in zip(fields, prev[1:]):
+                record[field] = round(scaled / 10 ** decimals, decimals)
+
+            error = record_error(record)
+            if error is not None:
+                return jsonify({'error': error}), 400
+            records.append(record)
+
+        for record in records:
+            store_record(record)
+        count = len(records)
+
+        session['last_seq'] = (base_seq + count) & 0xFFFFFFFF  # uint32 on the device
+        session['last'] = prev
+        return jsonify(with_control(name, {'message': f'Data updated successfully', 'stored': count})), 200
+    except Exception as e:
+        log(f'Error in update_bin: {e}')
+        return jsonify({'error': 'Invalid Query'}), 400
+
+
+@app.route('/metrics', methods=['POST'])
+def metrics():
+    """Per-stage timing summaries from the device (StageTimer.h), appended to data/metrics_<name>.csv.
+    Counters run from device boot, so consecutive rows of a stage diff to the interval in between."""
+    try:
+        data = request.get_json()
+        name = str(data['name'])
+        ticks_per_us = float(data['ticks_per_us'])
+        path = f'data/metrics_{name}.csv'
+        file_present = os.path.exists(path)
+        with open(path, mode='a', newline='') as file:
             writer = csv.writer(file)
-            row = [
-                values[recieved_sensor_data['name']]['last_upd'],
-                sensor_timestamp,
-                plant_id,
-                disease_status
-            ] + [values[recieved_sensor_data['name']]['data'][name] for name in sensor_data_labels]
-            writer.writerow(row)
-
-        return jsonify({'message': f'Data updated successfully'}), 200
+            if not file_present:
+                writer.writerow([
+                    'Timestamp', 'Uptime (ms)', 'Stage', 'Count',
+                    'Min (us)', 'Max (us)', 'Mean (us)', 'Log2 Histogram (ticks)'
+                ])
+            now = datetime.now().strftime('%Y-%m-%d %H:%M:%S')
+            for stage in data['stages']:
+                writer.writerow([
+                    now, data.get('uptime_ms', ''), stage['stage'], stage['count'],
+                    round(stage['min'] / ticks_per_us, 1), round(stage['max'] / ticks_per_us, 1),
+                    round(stage['mean'] / ticks_per_us, 1), ' '.join(str(n) for n in stage['hist'])
+                ])
+        log(f"Metrics from {name}: " + ', '.join(
+            f"{stage['stage']} {stage['mean'] / ticks_per_us:.0f} us" for stage in data['stages']))
+        return jsonify({'message': 'Metrics stored'}), 200
     except Exception as e:
-        log(f'Error in update_data: {e}')
+        log(f'Error in metrics: {e}')
         return jsonify({'error': 'Invalid Query'}), 400
 
 
@@ -74,6 +286,8 @@ def register_sensor():
         data = request.get_json()
         dev_name = str(data.get('name'))
         dev_loc = str(data.get('location'))
+        if 'time_to_first_sample_ms' in data:
+            log(f"{dev_name} registered, first sample {data['time_to_first_sample_ms']} ms after boot")
         values[dev_name] = {
             'name' : dev_name,
             'data' : {
@@ -89,17 +303,54 @@ def register_sensor():
                 'mq2_baseline' : 0.0
             },
             'location' : dev_loc,
-            'plant_id' : 'unknown',
-            'disease_status' : 'unknown',
-            'last_upd' : datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+            'plant_id' : str(data.get('plant_id', 'unknown')),
+            'disease_status' : str(data.get('disease_status', 'unknown')),
+            'last_upd' : datetime.now().strftime("%Y-%m-%d %H:%M:%S"),
+            'gas_channels' : [str(key) for key in data.get('gas_channels', [])]
         }
+        for label, _ in gas_fields(values[dev_name]['gas_channels']):
+            values[dev_name]['data'][label] = 0.0
+
+        # Offer the binary uplink to devices that support it
+        if 'bin1' in data.get('encodings', []):
+            global next_session
+            session_id = next_session
+            next_session = next_session % 0xFFFFFFFF + 1  # A uint32 on the device, where 0 means JSON
+            sessions[session_id] = {'name': dev_name, 'last_seq': None, 'last': None}
+            return jsonify(with_control(dev_name, {'message': 'Sensor Registered Successfully', 'encoding': 'bin1',
+                                                   'session': session_id})), 200
 
-        return jsonify({'message': 'Sensor Registered Successfully'}), 200
+        return jsonify(with_control(dev_name, {'message': 'Sensor Registered Successfully'})), 200
     except Exception as e:
         log(f'Error in register_sensor: {e}')
         return jsonify({'error': 'Invalid Query'}), 400
 
 
+@app.route('/control', methods=['POST'])
+def set_control():
+    """Sets the rates of one device, e.g. {"name": "plant_001", "sample_period_ms": 5000}.
+    A field set to null is no longer sent; the device keeps the last value it received."""
+    try:
+        data = request.get_json()
+        name = str(data['name'])
+        control = controls.setdefault(name, {})
+        for field, (low, high) in control_bounds.items():
+            if field not in data:
+                continue
+            if data[field] is None:
+                control.pop(field, None)
+                continue
+            value = int(data[field])
+            if value < low or value > high:
+                return jsonify({'error': f'{field} must be within {low} .. {high}'}), 400
+            control[field] = value
+        log(f'Control for {name}: {control}')
+        return jsonify({'message': 'Control updated', 'control': control}), 200
+    except Exception as e:
+        log(f'Error in set_control: {e}')
+        return jsonify({'error': 'Invalid Query'}), 400
+
+
 @app.route('/unregister', methods=['POST'])
 def unregister():
     try:
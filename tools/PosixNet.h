@@ -0,0 +1,117 @@
+// Transport policy for HttpSession (sensor-src-m5/include/HttpSession.h)
+// over BSD sockets, shared by the host checks that talk to a stub server.
+// Hosts are dotted IPv4 addresses; there is no DNS on the host side.
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+
+struct PosixNet
+{
+    typedef sockaddr_in Address;
+
+    PosixNet() : fd(-1) {}
+    ~PosixNet() { close(); }
+
+    bool resolve(const char *host, Address &addr)
+    {
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        return inet_pton(AF_INET, host, &addr.sin_addr) == 1;
+    }
+
+    /** Non-blocking connect, waited on for at most timeout_ms */
+    bool connect(const Address &addr, uint16_t port, uint32_t timeout_ms)
+    {
+        close();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        Address a = addr;
+        a.sin_port = htons(port);
+        if (::connect(fd, (const sockaddr *)&a, sizeof(a)) != 0)
+        {
+            pollfd p = {fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (errno != EINPROGRESS || poll(&p, 1, (int)timeout_ms) <= 0 ||
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0)
+            {
+                close();
+                return false;
+            }
+        }
+        fcntl(fd, F_SETFL, flags);
+        return true;
+    }
+
+    bool connected() { return fd >= 0; }
+
+    bool write(const uint8_t *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    int read(uint8_t *buf, size_t len, uint32_t timeout_ms)
+    {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, (int)timeout_ms) <= 0)
+            return 0;
+        ssize_t n = recv(fd, buf, len, 0);
+        return n > 0 ? (int)n : -1;
+    }
+
+    void close()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+    uint32_t now()
+    {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    int fd;
+};
+
+/** Listening socket on 127.0.0.1:port, or -1 */
+static inline int POSIX_listen(int port)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (listener < 0 || bind(listener, (const sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0)
+    {
+        if (listener >= 0)
+            ::close(listener);
+        return -1;
+    }
+    return listener;
+}
@@ -0,0 +1,332 @@
+// Host benchmark and accuracy check of the record accumulator
+// (sensor-src-m5/include/FieldAccumulator.h and ACC_* in SensorPipeline.h):
+// times one sample and one record against the hand-written accumulator it
+// replaced, compares the means of short and long windows with a double
+// reference, and checks the minimum and maximum and that the fields the
+// accumulator does not own (R0, timestamp) are left alone.
+//
+// Build: g++ -std=c++11 -O2 -DGAS_MAX_CHANNELS=4 -I../sensor-src-m5/include -I../lib/GasMath accumulator_bench.cpp -o accumulator_bench
+// Usage: accumulator_bench [samples]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "SensorPipeline.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+#else
+static uint64_t cycles() { return 0; }
+#endif
+
+// The accumulator before the field tables: plain float sums, one line per
+// field in each of add, average and reset
+struct LegacyAccumulated
+{
+    float temperature;
+    float humidity;
+    float pressure;
+    float gasResistance;
+    float mq2_rs;
+    float mq2_ratio;
+    float mq2_smoke_ppm;
+    float mq2_delta;
+    float mq2_variance;
+    float mq2_baseline;
+    GasFeatures gas[GAS_EXTRA_SLOTS];
+};
+
+static void LEGACY_add(LegacyAccumulated &acc, const SensorData &reading)
+{
+    acc.temperature += reading.temperature;
+    acc.humidity += reading.humidity;
+    acc.pressure += reading.pressure;
+    acc.gasResistance += reading.gasResistance;
+    acc.mq2_rs += reading.mq2_rs;
+    acc.mq2_ratio += reading.mq2_ratio;
+    acc.mq2_smoke_ppm += reading.mq2_smoke_ppm;
+    acc.mq2_delta += reading.mq2_delta;
+    acc.mq2_variance += reading.mq2_variance;
+    acc.mq2_baseline += reading.mq2_baseline;
+    for (size_t i = 0; i < GAS_EXTRA_CHANNELS; i++)
+    {
+        acc.gas[i].rs += reading.gas[i].rs;
+        acc.gas[i].ratio += reading.gas[i].ratio;
+        acc.gas[i].ppm += reading.gas[i].ppm;
+        acc.gas[i].delta += reading.gas[i].delta;
+        acc.gas[i].variance += reading.gas[i].variance;
+        acc.gas[i].baseline += reading.gas[i].baseline;
+    }
+}
+
+static void LEGACY_average(const LegacyAccumulated &acc, int count, SensorData &out)
+{
+    out.temperature = acc.temperature / count;
+    out.humidity = acc.humidity / count;
+    out.pressure = acc.pressure / count;
+    out.gasResistance = acc.gasResistance / count;
+    out.mq2_rs = acc.mq2_rs / count;
+    out.mq2_ratio = acc.mq2_ratio / count;
+    out.mq2_smoke_ppm = acc.mq2_smoke_ppm / count;
+    out.mq2_delta = acc.mq2_delta / count;
+    out.mq2_variance = acc.mq2_variance / count;
+    out.mq2_baseline = acc.mq2_baseline / count;
+    for (size_t i = 0; i < GAS_EXTRA_CHANNELS; i++)
+    {
+        out.gas[i].rs = acc.gas[i].rs / count;
+        out.gas[i].ratio = acc.gas[i].ratio / count;
+        out.gas[i].ppm = acc.gas[i].ppm / count;
+        out.gas[i].delta = acc.gas[i].delta / count;
+        out.gas[i].variance = acc.gas[i].variance / count;
+        out.gas[i].baseline = acc.gas[i].baseline / count;
+    }
+}
+
+// Keeps the optimizer from dropping the loops
+static volatile float sink_f;
+
+struct Timing
+{
+    double ns;
+    double cycles;
+};
+
+template <typename Fn>
+static Timing measure(const std::vector<SensorData> &in, Fn fn)
+{
+    fn(in);  // Warm up
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    fn(in);
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+    Timing t;
+    t.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / in.size();
+    t.cycles = (double)(c1 - c0) / in.size();
+    return t;
+}
+
+// Readings in the ranges the M5 sees: sea-level pressure, humidity and
+// temperature with noise, gas resistances in K ohms and rolling variances
+// that span decades, so some fields carry far more integer digits than others
+static std::vector<SensorData> makeReadings(size_t samples, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 1);
+    std::uniform_real_distribution<float> u(0, 1);
+    std::vector<SensorData> out(samples);
+    float gas = 100;
+    for (size_t s = 0; s < samples; s++)
+    {
+        SensorData &d = out[s];
+        d = SensorData();
+        gas += noise(rng) * 0.5f + (100 - gas) * 0.01f;
+        d.temperature = 24.0f + 0.3f * noise(rng);
+        d.humidity = 50.0f + 2.0f * noise(rng);
+        d.pressure = 101.325f + 0.01f * noise(rng);
+        d.gasResistance = gas;
+        d.mq2_rs = 10 + noise(rng);
+        d.mq2_ratio = d.mq2_rs / 9.5f;
+        d.mq2_smoke_ppm = 0.2f + 0.05f * u(rng);
+        d.mq2_delta = 0.01f * noise(rng);
+        d.mq2_variance = powf(10, 6 * u(rng) - 3);
+        d.mq2_baseline = 1.0f + 0.01f * u(rng);
+        d.mq2_r0 = 9.5f;
+        for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+        {
+            GasFeatures &g = d.gas[c];
+            g.rs = 5 + 5 * c + noise(rng);
+            g.ratio = g.rs / (5 + 5 * c);
+            g.ppm = 50 + 10 * noise(rng);
+            g.delta = 0.01f * noise(rng);
+            g.variance = powf(10, 4 * u(rng) - 2);
+            g.baseline = 0.9f + 0.01f * u(rng);
+            g.r0 = 5.0f + 5 * c;
+        }
+        d.timestamp = (unsigned long)s * 1000;
+    }
+    return out;
+}
+
+static void legacyRecords(const std::vector<SensorData> &in)
+{
+    LegacyAccumulated acc = LegacyAccumulated();
+    int count = 0;
+    SensorData record = SensorData();
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        LEGACY_add(acc, in[i]);
+        if (++count >= SAMPLES_TO_AVERAGE)
+        {
+            LEGACY_average(acc, count, record);
+            acc = LegacyAccumulated();
+            count = 0;
+        }
+    }
+    sink_f = record.temperature;
+}
+
+static void tableRecords(const std::vector<SensorData> &in)
+{
+    AccumulatedData acc = AccumulatedData();
+    SensorData record = SensorData();
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        ACC_add(acc, in[i]);
+        if (acc.count >= (uint32_t)SAMPLES_TO_AVERAGE)
+        {
+            ACC_average(acc, record);
+            ACC_reset(acc);
+        }
+    }
+    sink_f = record.temperature;
+}
+
+// The accumulator core alone, on samples that are already flat arrays
+static void flatSamples(const std::vector<float> &flat, size_t samples)
+{
+    AccumulatedData acc = AccumulatedData();
+    for (size_t i = 0; i < samples; i++)
+        acc.add(&flat[i * ACC_FIELDS]);
+    sink_f = acc.sum[0] + acc.maximum[ACC_FIELDS - 1];
+}
+
+struct WindowError
+{
+    double legacy;      // Worst error of a mean relative to the mean magnitude, over all fields and windows
+    double table;
+    bool range_exact;   // Minimum and maximum equal to the reference's
+};
+
+// Means of consecutive windows of `window` samples against double sums
+static WindowError compare(const std::vector<SensorData> &in, size_t window)
+{
+    WindowError e = {0, 0, true};
+    for (size_t first = 0; first + window <= in.size(); first += window)
+    {
+        LegacyAccumulated legacy = LegacyAccumulated();
+        AccumulatedData acc = AccumulatedData();
+        double sum[ACC_FIELDS] = {0}, magnitude[ACC_FIELDS] = {0};
+        float lo[ACC_FIELDS], hi[ACC_FIELDS];
+        for (size_t s = first; s < first + window; s++)
+        {
+            LEGACY_add(legacy, in[s]);
+            ACC_add(acc, in[s]);
+            float x[ACC_FIELDS];
+            ACC_gather(in[s], x);
+            for (size_t i = 0; i < ACC_FIELDS; i++)
+            {
+                sum[i] += x[i];
+                magnitude[i] += fabs(x[i]);
+                lo[i] = s == first || x[i] < lo[i] ? x[i] : lo[i];
+                hi[i] = s == first || x[i] > hi[i] ? x[i] : hi[i];
+            }
+        }
+
+        SensorData a = SensorData(), b = SensorData();
+        LEGACY_average(legacy, (int)window, a);
+        ACC_average(acc, b);
+        float ma[ACC_FIELDS], mb[ACC_FIELDS];
+        ACC_gather(a, ma);
+        ACC_gather(b, mb);
+        for (size_t i = 0; i < ACC_FIELDS; i++)
+        {
+            // Relative to the mean of |x|, so fields that average to about zero are not singled out
+            double ref = sum[i] / window;
+            double scale = magnitude[i] / window > 1e-9 ? magnitude[i] / window : 1e-9;
+            e.legacy = fmax(e.legacy, fabs(ma[i] - ref) / scale);
+            e.table = fmax(e.table, fabs(mb[i] - ref) / scale);
+            if (acc.minimum[i] != lo[i] || acc.maximum[i] != hi[i])
+                e.range_exact = false;
+        }
+    }
+    return e;
+}
+
+int main(int argc, char **argv)
+{
+    size_t samples = argc > 1 ? (size_t)atol(argv[1]) : 300000;
+    int failures = 0;
+    std::vector<SensorData> readings = makeReadings(samples, 1);
+    printf("%zu averaged fields (%zu gas channels), %zu bytes of state (legacy %zu)\n", ACC_FIELDS,
+           (size_t)GAS_MAX_CHANNELS, sizeof(AccumulatedData), sizeof(LegacyAccumulated));
+
+    // Cost per sample, records of SAMPLES_TO_AVERAGE samples included
+    std::vector<float> flat(samples * ACC_FIELDS);
+    for (size_t s = 0; s < samples; s++)
+        ACC_gather(readings[s], &flat[s * ACC_FIELDS]);
+    Timing legacy = measure(readings, legacyRecords);
+    Timing table = measure(readings, tableRecords);
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    flatSamples(flat, samples);
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+    printf("per sample:            ns    cycles\n");
+    printf("  legacy, float sums %7.2f %9.1f\n", legacy.ns, legacy.cycles);
+    printf("  field table, Kahan %7.2f %9.1f  (+ min/max)\n", table.ns, table.cycles);
+    printf("  flat add() only    %7.2f %9.1f\n", std::chrono::duration<double, std::nano>(t1 - t0).count() / samples,
+           (double)(c1 - c0) / samples);
+
+    // Accuracy of the means against double sums, from a record's worth to
+    // the longest window the server can set and beyond
+    static const size_t WINDOWS[] = {SAMPLES_TO_AVERAGE, 60, 600, 10000, 100000};
+    printf("window   legacy error   Kahan error   min/max\n");
+    for (size_t w = 0; w < sizeof(WINDOWS) / sizeof(WINDOWS[0]); w++)
+    {
+        if (WINDOWS[w] > samples)
+            continue;
+        WindowError e = compare(readings, WINDOWS[w]);
+        printf("%6zu %14.3g %13.3g   %s\n", WINDOWS[w], e.legacy, e.table, e.range_exact ? "exact" : "WRONG");
+        // The compensated sum is exact to float precision; the final division
+        // rounds once more, so the mean is within about one ulp
+        if (e.table > 2.5e-7 || !e.range_exact)
+        {
+            printf("FAIL: window %zu: mean off by %.3g relative or range wrong\n", WINDOWS[w], e.table);
+            failures++;
+        }
+    }
+
+    // Identical samples average to themselves within one ulp; R0 and timestamp are the caller's
+    AccumulatedData acc = AccumulatedData();
+    for (int i = 0; i < 600; i++)
+        ACC_add(acc, readings[0]);
+    SensorData out = SensorData();
+    out.mq2_r0 = 1.5f;
+    out.timestamp = 42;
+    ACC_average(acc, out);
+    SensorData expect = readings[0];
+    expect.mq2_r0 = 1.5f;
+    expect.timestamp = 42;
+    for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+        expect.gas[c].r0 = 0;
+    float x[ACC_FIELDS], y[ACC_FIELDS];
+    ACC_gather(out, x);
+    ACC_gather(expect, y);
+    bool same = out.mq2_r0 == expect.mq2_r0 && out.timestamp == expect.timestamp;
+    for (size_t i = 0; i < ACC_FIELDS; i++)
+        same = same && fabsf(x[i] - y[i]) <= 1.2e-7f * fabsf(y[i]);
+    for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+        same = same && out.gas[c].r0 == 0;
+    if (!same)
+    {
+        printf("FAIL: 600 identical samples do not average to the sample, or R0/timestamp changed\n");
+        failures++;
+    }
+    else
+    {
+        printf("600 identical samples average to the sample within one ulp; R0 and timestamp untouched\n");
+    }
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
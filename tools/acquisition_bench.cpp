@@ -0,0 +1,291 @@
+// Host build of lib/Acquisition with mock policies. Checks that the
+// templated pipeline costs the same as the hand-written sequence, next to
+// the same pipeline behind virtual interfaces for comparison.
+//
+// Build: g++ -std=c++11 -O2 -I../lib/Acquisition acquisition_bench.cpp -o acquisition_bench
+// Usage: acquisition_bench [samples]
+// Code size of each variant: nm -C -S --size-sort acquisition_bench | grep run
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+#else
+static uint64_t cycles() { return 0; }
+#endif
+
+// Adafruit_BME680 settings constants, as the mock has to provide them
+enum
+{
+    BME680_OS_2X = 2,
+    BME680_OS_4X = 3,
+    BME680_OS_8X = 4,
+    BME680_FILTER_SIZE_3 = 2,
+};
+
+#include "Acquisition.h"
+
+// Mock policies. The sensor values follow a cheap LCG so nothing folds away.
+
+struct MockClock
+{
+    uint32_t ms;
+    uint32_t now() { return ms++; }
+    uint32_t timestamp() { return ms; }
+    uint32_t cycles() { return 0; }  // The pipeline's own counter is not under test
+};
+
+struct MockBme
+{
+    MockClock *clock;
+    uint32_t state;
+    float temperature;
+    float humidity;
+    uint32_t pressure;
+    uint32_t gas_resistance;
+
+    bool begin(uint8_t) { return true; }
+    void setTemperatureOversampling(int) {}
+    void setHumidityOversampling(int) {}
+    void setPressureOversampling(int) {}
+    void setIIRFilterSize(int) {}
+    void setGasHeater(int, int) {}
+
+    uint32_t beginReading() { return clock->ms + 1; }
+    bool endReading()
+    {
+        state = state * 1664525u + 1013904223u;
+        temperature = 20 + (state >> 28);
+        humidity = 40 + ((state >> 24) & 15);
+        pressure = 101000 + ((state >> 16) & 255);
+        gas_resistance = 100000 + (state & 0xFFFF);
+        return true;
+    }
+};
+
+struct MockAdc
+{
+    uint32_t state;
+    float read()
+    {
+        state = state * 22695477u + 1;
+        return (float)(state >> 22);
+    }
+};
+
+struct MockStorage
+{
+    uint32_t checksum;
+    void store(const AcqSample &s)
+    {
+        uint32_t bits;
+        memcpy(&bits, &s.temperature, sizeof(bits));
+        checksum = checksum * 31 + s.timestamp + bits + s.pressure + s.gas_resistance + (uint32_t)s.mq2_raw;
+    }
+};
+
+struct MockTransport
+{
+    uint32_t sent;
+    void send(const AcqSample &) { sent++; }
+};
+
+struct Mocks
+{
+    MockClock clock;
+    MockBme bme;
+    MockAdc adc;
+    MockStorage storage;
+    MockTransport transport;
+
+    Mocks()
+    {
+        clock.ms = 0;
+        bme.clock = &clock;
+        bme.state = 1;
+        bme.temperature = bme.humidity = 0;
+        bme.pressure = bme.gas_resistance = 0;
+        adc.state = 7;
+        storage.checksum = 0;
+        transport.sent = 0;
+    }
+};
+
+// 1. The shared pipeline with the mocks as policies
+
+__attribute__((noinline)) static uint32_t runTemplated(Mocks &m, size_t n)
+{
+    Acquisition<MockBme, MockAdc, MockClock, MockStorage, MockTransport> acq(m.bme, m.adc, m.clock, m.storage,
+                                                                             m.transport);
+    acq.begin(0x77);
+    for (size_t i = 0; i < n; i++)
+        acq.acquire();
+    return m.storage.checksum ^ m.transport.sent;
+}
+
+// 2. The same sequence written out by hand, as each firmware had it
+
+__attribute__((noinline)) static uint32_t runDirect(Mocks &m, size_t n)
+{
+    ACQ_configureBme(m.bme);
+    AcqSample s = AcqSample();
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t ready = m.bme.beginReading();
+        if (ready == 0)
+            continue;
+        s.timestamp = m.clock.timestamp();
+        s.mq2_raw = m.adc.read();
+        while ((int32_t)(m.clock.now() - ready) < 0)
+        {
+        }
+        if (!m.bme.endReading())
+            continue;
+        s.temperature = m.bme.temperature;
+        s.humidity = m.bme.humidity;
+        s.pressure = m.bme.pressure;
+        s.gas_resistance = m.bme.gas_resistance;
+        m.storage.store(s);
+        m.transport.send(s);
+    }
+    return m.storage.checksum ^ m.transport.sent;
+}
+
+// 3. Virtual interfaces, the run-time alternative to policies
+
+struct IAdc
+{
+    virtual float read() = 0;
+};
+struct IClock
+{
+    virtual uint32_t now() = 0;
+    virtual uint32_t timestamp() = 0;
+};
+struct ISink
+{
+    virtual void store(const AcqSample &s) = 0;
+    virtual void send(const AcqSample &s) = 0;
+};
+
+struct VirtualAdc : IAdc
+{
+    MockAdc *adc;
+    float read() { return adc->read(); }
+};
+struct VirtualClock : IClock
+{
+    MockClock *clock;
+    uint32_t now() { return clock->now(); }
+    uint32_t timestamp() { return clock->timestamp(); }
+};
+struct VirtualSink : ISink
+{
+    MockStorage *storage;
+    MockTransport *transport;
+    void store(const AcqSample &s) { storage->store(s); }
+    void send(const AcqSample &s) { transport->send(s); }
+};
+
+// Opaque to the optimizer, so the calls stay indirect
+static IAdc *volatile virtual_adc;
+static IClock *volatile virtual_clock;
+static ISink *volatile virtual_sink;
+
+__attribute__((noinline)) static uint32_t runVirtual(Mocks &m, size_t n)
+{
+    IAdc *adc = virtual_adc;
+    IClock *clock = virtual_clock;
+    ISink *sink = virtual_sink;
+    ACQ_configureBme(m.bme);
+    AcqSample s = AcqSample();
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t ready = m.bme.beginReading();
+        if (ready == 0)
+            continue;
+        s.timestamp = clock->timestamp();
+        s.mq2_raw = adc->read();
+        while ((int32_t)(clock->now() - ready) < 0)
+        {
+        }
+        if (!m.bme.endReading())
+            continue;
+        s.temperature = m.bme.temperature;
+        s.humidity = m.bme.humidity;
+        s.pressure = m.bme.pressure;
+        s.gas_resistance = m.bme.gas_resistance;
+        sink->store(s);
+        sink->send(s);
+    }
+    return m.storage.checksum ^ m.transport.sent;
+}
+
+struct Result
+{
+    uint32_t check;
+    double ns;
+    double cycles;
+};
+
+template <typename Fn>
+static Result measure(Fn fn, size_t n, bool bind_virtual)
+{
+    Result r;
+    for (int pass = 0; pass < 2; pass++)  // First pass warms up
+    {
+        Mocks m;
+        VirtualAdc va;
+        VirtualClock vc;
+        VirtualSink vs;
+        va.adc = &m.adc;
+        vc.clock = &m.clock;
+        vs.storage = &m.storage;
+        vs.transport = &m.transport;
+        if (bind_virtual)
+        {
+            virtual_adc = &va;
+            virtual_clock = &vc;
+            virtual_sink = &vs;
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = cycles();
+        r.check = fn(m, n);
+        uint64_t c1 = cycles();
+        auto t1 = std::chrono::steady_clock::now();
+        r.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+        r.cycles = (double)(c1 - c0) / n;
+    }
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    Result t = measure(runTemplated, n, false);
+    Result d = measure(runDirect, n, false);
+    Result v = measure(runVirtual, n, true);
+
+    printf("per sample, %zu samples    ns    cycles\n", n);
+    printf("templated policies     %6.2f  %7.2f\n", t.ns, t.cycles);
+    printf("hand-written           %6.2f  %7.2f\n", d.ns, d.cycles);
+    printf("virtual interfaces     %6.2f  %7.2f\n", v.ns, v.cycles);
+    printf("sizeof(Acquisition<mocks>) = %zu bytes\n",
+           sizeof(Acquisition<MockBme, MockAdc, MockClock, MockStorage, MockTransport>));
+
+    if (t.check != d.check || t.check != v.check)
+    {
+        printf("FAIL: variants disagree (%08x %08x %08x)\n", t.check, d.check, v.check);
+        return 1;
+    }
+    printf("all variants produce the same samples\n");
+    return 0;
+}
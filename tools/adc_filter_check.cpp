@@ -0,0 +1,267 @@
+// Host check and benchmark of the MQ2 decimation filter and the ADC curve
+// interpolation (sensor-src-m5/include/AdcFilter.h). Feeds read-sized blocks
+// of a trace with isolated spikes through DecimationFilter and checks the
+// output against a reference decimation (sorted 3-tap medians, averaged in
+// double), that the spikes are rejected where a plain boxcar is pulled off by
+// them, and that ADC_rawToMillivolts() interpolates and clamps on a
+// nonlinear curve. Then times the filter against the plain boxcar.
+//
+// The trace is synthetic (a slow drift plus Gaussian noise, as from the ESP32
+// ADC at 20 kHz, with single-sample spikes to the rails) unless a file of
+// recorded 12-bit codes, one per line, is given.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include adc_filter_check.cpp -o adc_filter_check
+// Usage: adc_filter_check [trace.txt]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "AdcFilter.h"
+
+static const size_t BLOCK = 2000;       // MQ2_READ_SAMPLES in main.cpp: 100 ms at 20 kHz
+static const uint16_t MAX_CODE = 4095;
+
+/** The decimation spelled out: mean of the medians of every sorted 3-sample window */
+static double referenceDecimation(const uint16_t *xs, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 2; i < n; i++)
+    {
+        uint16_t w[3] = {xs[i - 2], xs[i - 1], xs[i]};
+        std::sort(w, w + 3);
+        sum += w[1];
+    }
+    return n > 2 ? sum / (n - 2) : 0;
+}
+
+static double boxcar(const uint16_t *xs, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += xs[i];
+    return n ? sum / n : 0;
+}
+
+/**
+ * Synthetic trace: clean[] is drift plus noise, spiky[] the same with every
+ * spike_every-th sample (jittered, never two adjacent) at a rail
+ */
+static void makeTrace(size_t n, size_t spike_every, std::vector<uint16_t> &clean, std::vector<uint16_t> &spiky)
+{
+    std::mt19937 rng(8);
+    std::normal_distribution<double> noise(0, 6);
+    clean.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = 1800 + 300 * sin(i * 2e-5) + noise(rng);
+        clean[i] = (uint16_t)std::min(std::max(lround(v), 0L), (long)MAX_CODE);
+    }
+    spiky = clean;
+    for (size_t i = spike_every / 2; i < n; i += spike_every)
+    {
+        size_t at = i + rng() % (spike_every / 2);
+        if (at < n)
+            spiky[at] = rng() % 2 ? MAX_CODE : 0;
+    }
+}
+
+static bool loadTrace(const char *path, std::vector<uint16_t> &trace)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    unsigned code;
+    while (fscanf(f, "%u", &code) == 1)
+        trace.push_back((uint16_t)(code & 0x0FFF));
+    fclose(f);
+    return !trace.empty();
+}
+
+static int checkMedian3()
+{
+    int failures = 0;
+    for (uint16_t a = 0; a < 4; a++)
+    {
+        for (uint16_t b = 0; b < 4; b++)
+        {
+            for (uint16_t c = 0; c < 4; c++)
+            {
+                uint16_t w[3] = {a, b, c};
+                std::sort(w, w + 3);
+                if (DecimationFilter::median3(a, b, c) != w[1])
+                {
+                    printf("FAIL: median3(%u, %u, %u) = %u\n", a, b, c, DecimationFilter::median3(a, b, c));
+                    failures++;
+                }
+            }
+        }
+    }
+
+    // Fewer than three samples are averaged as they are; from three on a spike
+    // among the first two is rejected like any other
+    DecimationFilter f;
+    f.add(100);
+    f.add(4000);
+    if (f.count() != 2 || f.output() != 2050)
+    {
+        printf("FAIL: two samples: count %u, output %.2f\n", f.count(), f.output());
+        failures++;
+    }
+    f.add(110);
+    f.add(120);
+    if (f.count() != 4 || f.output() != 115)
+    {
+        printf("FAIL: spike second in the block: count %u, output %.2f\n", f.count(), f.output());
+        failures++;
+    }
+    f.reset();
+    if (f.count() != 0 || f.output() != 0)
+    {
+        printf("FAIL: reset: count %u, output %.2f\n", f.count(), f.output());
+        failures++;
+    }
+    return failures;
+}
+
+/** Every block of the trace through the filter against the reference */
+static int checkBlocks(const char *what, const std::vector<uint16_t> &trace, const std::vector<uint16_t> *clean)
+{
+    int failures = 0;
+    double worst_ref = 0, worst_filtered = 0, worst_boxcar = 0;
+    size_t blocks = 0;
+    for (size_t at = 0; at + BLOCK <= trace.size(); at += BLOCK, blocks++)
+    {
+        const uint16_t *xs = &trace[at];
+        DecimationFilter f;
+        f.add(xs, BLOCK);
+        double ref = referenceDecimation(xs, BLOCK);
+        double err = fabs(f.output() - ref);
+        worst_ref = std::max(worst_ref, err);
+        if (err > 1e-3 * ref + 1e-3 && failures++ < 5)
+            printf("FAIL: %s: block %zu decimates to %.4f, reference %.4f\n", what, blocks, f.output(), ref);
+
+        if (clean)
+        {
+            double truth = referenceDecimation(&(*clean)[at], BLOCK);
+            worst_filtered = std::max(worst_filtered, fabs(f.output() - truth));
+            worst_boxcar = std::max(worst_boxcar, fabs(boxcar(xs, BLOCK) - boxcar(&(*clean)[at], BLOCK)));
+        }
+    }
+    if (blocks == 0)
+    {
+        printf("FAIL: %s: shorter than one block of %zu\n", what, BLOCK);
+        return failures + 1;
+    }
+    printf("%s: %zu blocks, worst difference from the reference %.5f counts\n", what, blocks, worst_ref);
+
+    if (clean)
+    {
+        // Spikes move the filtered value by a fraction of a count; the boxcar by tens
+        if (worst_filtered > 1.0 || worst_boxcar < 10 * worst_filtered)
+        {
+            printf("FAIL: %s: spikes move the output by %.3f counts, the boxcar by %.3f\n", what, worst_filtered,
+                   worst_boxcar);
+            failures++;
+        }
+        printf("%s: spikes move the output by at most %.3f counts, a plain boxcar by %.3f\n", what,
+               worst_filtered, worst_boxcar);
+    }
+    return failures;
+}
+
+// Nonlinear stand-in for esp_adc_cal_raw_to_voltage(): bends at both ends
+static uint32_t curveMv(uint16_t code)
+{
+    double x = code / (double)MAX_CODE;
+    return (uint32_t)lround(150 + 2900 * x - 250 * x * x * x);
+}
+
+static int checkInterpolation()
+{
+    int failures = 0;
+    float prev = -1;
+    for (uint32_t tenth = 0; tenth <= MAX_CODE * 10u; tenth++)
+    {
+        float raw = tenth / 10.0f;
+        float mv = ADC_rawToMillivolts(raw, curveMv, MAX_CODE);
+        uint16_t lo = (uint16_t)raw;
+        float expect = curveMv(lo);
+        if (tenth % 10 != 0)
+            expect += (raw - lo) * ((float)curveMv(lo + 1) - curveMv(lo));
+        if ((fabsf(mv - expect) > 1e-3f || mv < prev) && failures++ < 5)
+            printf("FAIL: %.1f counts interpolates to %.4f mV, expected %.4f\n", raw, mv, expect);
+        prev = mv;
+    }
+    if (ADC_rawToMillivolts(-3.0f, curveMv, MAX_CODE) != curveMv(0) ||
+        ADC_rawToMillivolts(MAX_CODE + 0.5f, curveMv, MAX_CODE) != curveMv(MAX_CODE))
+    {
+        printf("FAIL: readings outside the code range are not clamped\n");
+        failures++;
+    }
+    printf("interpolation: exact at codes, linear between, monotonic, clamped at 0 and %u\n", MAX_CODE);
+    return failures;
+}
+
+template <typename F>
+static double nsPerSample(const std::vector<uint16_t> &trace, F decimate, double &sink)
+{
+    const int reps = 200;
+    size_t blocks = trace.size() / BLOCK;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (size_t b = 0; b < blocks; b++)
+            sink += decimate(&trace[b * BLOCK]);
+    }
+    std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count() / (reps * blocks * BLOCK);
+}
+
+static double filterBlock(const uint16_t *xs)
+{
+    DecimationFilter f;
+    f.add(xs, BLOCK);
+    return f.output();
+}
+
+static double boxcarBlock(const uint16_t *xs) { return boxcar(xs, BLOCK); }
+static double referenceBlock(const uint16_t *xs) { return referenceDecimation(xs, BLOCK); }
+
+int main(int argc, char **argv)
+{
+    int failures = checkMedian3();
+
+    std::vector<uint16_t> clean, spiky;
+    makeTrace(BLOCK * 64, 97, clean, spiky);
+    failures += checkBlocks("synthetic trace", spiky, &clean);
+    if (argc > 1)
+    {
+        std::vector<uint16_t> recorded;
+        if (!loadTrace(argv[1], recorded))
+        {
+            printf("FAIL: cannot read a trace from %s\n", argv[1]);
+            return 1;
+        }
+        failures += checkBlocks(argv[1], recorded, NULL);
+    }
+    failures += checkInterpolation();
+
+    double sink = 0;
+    double filter_ns = nsPerSample(spiky, filterBlock, sink);
+    double boxcar_ns = nsPerSample(spiky, boxcarBlock, sink);
+    double reference_ns = nsPerSample(spiky, referenceBlock, sink);
+    printf("median3 + boxcar: %.2f ns/sample (%.0f Msamples/s), plain boxcar %.2f ns, sorted reference %.2f ns "
+           "(sink %.0f)\n", filter_ns, 1e3 / filter_ns, boxcar_ns, reference_ns, sink);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Converts sensor-v2 binary logs (LOGnnn.BIN) to the CSV the logger writes
+// in its default mode, byte for byte: same header, same number formatting.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-v2/include binlog2csv.cpp -o binlog2csv
+// Usage: binlog2csv LOG001.BIN [LOG002.BIN ...] > datalog.csv
+
+#include <stdio.h>
+#include <string>
+
+#include "BinLogFormat.h"
+
+static const char CSV_HEADER[] =
+  "Timestamp(ms),Temperature(C),Pressure(hPa),Humidity(%),Gas(Ohms),MQ2_Raw";
+
+// Arduino's Print::printFloat(), which the CSV mode uses. On the AVR
+// double is 32 bits, so the arithmetic is done in float to match.
+static void printFloat(std::string &out, float number, int digits) {
+  char buf[16];
+  if (number != number) {
+    out += "nan";
+    return;
+  }
+  if (number > 4294967040.0f || number < -4294967040.0f) {
+    out += "ovf";
+    return;
+  }
+  if (number < 0.0f) {
+    out += '-';
+    number = -number;
+  }
+
+  float rounding = 0.5f;
+  for (int i = 0; i < digits; i++) {
+    rounding /= 10.0f;
+  }
+  number += rounding;
+
+  unsigned long intPart = (unsigned long)number;
+  float remainder = number - (float)intPart;
+  snprintf(buf, sizeof(buf), "%lu", intPart);
+  out += buf;
+
+  if (digits > 0) {
+    out += '.';
+  }
+  while (digits-- > 0) {
+    remainder *= 10.0f;
+    unsigned int toPrint = (unsigned int)remainder;
+    out += (char)('0' + toPrint);
+    remainder -= toPrint;
+  }
+}
+
+static void printRecord(std::string &out, const BinLogRecord &r, uint8_t version) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%lu,", (unsigned long)r.timestamp);
+  out += buf;
+  printFloat(out, r.temperature, 2);
+  out += ',';
+  printFloat(out, r.pressure, 2);
+  out += ',';
+  printFloat(out, r.humidity, 2);
+  out += ',';
+  printFloat(out, r.gas, 2);
+  if (version == BINLOG_VERSION_WHOLE_MQ2) {
+    snprintf(buf, sizeof(buf), ",%u\r\n", (unsigned)r.mq2_raw);
+    out += buf;
+  } else {
+    // The logger prints the oversampled value with 4 decimals
+    out += ',';
+    printFloat(out, r.mq2_raw / (float)(1 << BINLOG_MQ2_FRACTION_BITS), 4);
+    out += "\r\n";
+  }
+}
+
+// Writes the records of one log file; returns the count or -1 on error
+static long convert(const char *path, FILE *csv) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return -1;
+  }
+
+  uint8_t sector[BINLOG_SECTOR_SIZE];
+  uint16_t file_no = 0;
+  long records = 0;
+  std::string out;
+  for (uint32_t index = 0; index <= 0xFFFF; index++) {
+    if (fread(sector, 1, sizeof(sector), in) != sizeof(sector)) {
+      break;
+    }
+    if (index == 0) {
+      file_no = BINLOG_get16(sector + 4);  // The first sector names the file
+    }
+    int count = BINLOG_checkHeader(sector, file_no, (uint16_t)index);
+    if (count < 0) {
+      break;  // Erased or stale: end of log
+    }
+
+    out.clear();
+    for (int i = 0; i < count; i++) {
+      BinLogRecord r;
+      BINLOG_getRecord(BINLOG_recordAt(sector, (uint8_t)i), r);
+      printRecord(out, r, sector[2]);
+    }
+    fwrite(out.data(), 1, out.size(), csv);
+    records += count;
+
+    if (count < BINLOG_RECORDS_PER_SECTOR) {
+      break;  // A partial sector is always the last one written
+    }
+  }
+  fclose(in);
+  return records;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s LOGnnn.BIN [...] > datalog.csv\n", argv[0]);
+    return 2;
+  }
+
+  fputs(CSV_HEADER, stdout);
+  fputs("\r\n", stdout);
+
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    long n = convert(argv[i], stdout);
+    if (n < 0) {
+      status = 1;
+      continue;
+    }
+    fprintf(stderr, "%s: %ld records\n", argv[i], n);
+  }
+  return status;
+}
@@ -0,0 +1,246 @@
+// Host benchmark and check of the gas channel registry
+// (sensor-src-m5/include/GasChannels.h): times one sample (a reading of
+// every channel, sample() and trackR0()) for 1 .. 16 channels and checks
+// the cost grows linearly, then checks every channel's features against a
+// brute-force window over its own history and that channels do not affect
+// each other (a channel run on its own gives bit-identical results).
+//
+// Build: g++ -std=c++11 -O2 -DGAS_MAX_CHANNELS=16 -I../sensor-src-m5/include -I../lib/GasMath gas_channels_bench.cpp -o gas_channels_bench
+// Usage: gas_channels_bench [samples]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "GasChannels.h"
+
+static const size_t MAX_CHANNELS = 16;
+static const size_t WINDOW = 50;        // BASELINE_WINDOW in SensorPipeline.h
+typedef GasChannels<MAX_CHANNELS, WINDOW> Registry;
+
+static const GasModel *const MODELS[] = {&GAS_MODEL_MQ2, &GAS_MODEL_MQ3, &GAS_MODEL_MQ4, &GAS_MODEL_MQ5,
+                                         &GAS_MODEL_MQ7, &GAS_MODEL_MQ8, &GAS_MODEL_MQ9, &GAS_MODEL_MQ135};
+static const char *const KEYS[MAX_CHANNELS] = {"g0", "g1", "g2", "g3", "g4", "g5", "g6", "g7",
+                                               "g8", "g9", "g10", "g11", "g12", "g13", "g14", "g15"};
+
+static GasChannelConfig configs[MAX_CHANNELS];
+
+// Keeps the optimizer from dropping the loops
+static volatile float sink_f;
+
+// A different model, load resistor, R0 and window per channel, windows
+// from 1 to WINDOW so growing, full and single-sample windows are covered
+static void makeConfigs()
+{
+    for (size_t c = 0; c < MAX_CHANNELS; c++)
+    {
+        GasChannelConfig &g = configs[c];
+        g.key = KEYS[c];
+        g.model = MODELS[c % (sizeof(MODELS) / sizeof(MODELS[0]))];
+        g.pin = 0;
+        g.rl_ohms = c % 3 == 0 ? 1000 : c % 3 == 1 ? 4700 : 10000;
+        g.r0 = 5.0f + c;
+        g.window = (uint16_t)(c == 0 ? WINDOW : 1 + (c * 7) % WINDOW);
+    }
+}
+
+// Load-resistor voltages of `samples` samples of every channel: slow
+// drift, noise and occasional gas events, independent per channel
+static std::vector<float> makeTrace(size_t samples, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 15);
+    std::uniform_real_distribution<float> u(0, 1);
+    std::vector<float> mv(samples * MAX_CHANNELS);
+    for (size_t c = 0; c < MAX_CHANNELS; c++)
+    {
+        float level = 300 + 150 * c;
+        for (size_t s = 0; s < samples; s++)
+        {
+            level += noise(rng) * 0.1f;
+            if (u(rng) < 0.01f)
+                level += 800 * u(rng);  // Event
+            level += (300 + 150 * c - level) * 0.02f;
+            float v = level + noise(rng);
+            mv[s * MAX_CHANNELS + c] = v < 1 ? 1 : v > 3299 ? 3299 : v;
+        }
+    }
+    return mv;
+}
+
+static double timePerSample(size_t channels, const std::vector<float> &mv, size_t samples)
+{
+    static Registry::State state;
+    Registry gas(configs, channels, state);
+    gas.reset();
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < samples; s++)
+    {
+        gas.add(&mv[s * MAX_CHANNELS]);
+        gas.sample();
+        gas.trackR0(0.05f, 0.0002f);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    sink_f = gas.r0(0);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / samples;
+}
+
+struct Features
+{
+    float ratio, ppm, delta, variance, baseline, r0;
+};
+
+// Features of every sample of every channel, [s * MAX_CHANNELS + c]
+static std::vector<Features> run(const GasChannelConfig *config, size_t channels, const float *mv, size_t stride,
+                                 size_t samples)
+{
+    static Registry::State state;
+    Registry gas(config, channels, state);
+    gas.reset();
+    std::vector<Features> out(samples * MAX_CHANNELS);
+    for (size_t s = 0; s < samples; s++)
+    {
+        gas.add(mv + s * stride);
+        gas.sample();
+        gas.trackR0(0.05f, 0.0002f);
+        for (size_t c = 0; c < channels; c++)
+        {
+            Features &f = out[s * MAX_CHANNELS + c];
+            f.ratio = state.ratio[c];
+            f.ppm = state.ppm[c];
+            f.delta = state.delta[c];
+            f.variance = state.variance[c];
+            f.baseline = state.baseline[c];
+            f.r0 = gas.r0(c);
+        }
+    }
+    return out;
+}
+
+// Population variance and minimum of the last w ratios, the slow way
+static void bruteForce(const std::vector<Features> &f, size_t c, size_t s, size_t w, double &variance,
+                       float &minimum)
+{
+    size_t first = s + 1 >= w ? s + 1 - w : 0;
+    size_t count = s + 1 - first;
+    double mean = 0;
+    minimum = f[first * MAX_CHANNELS + c].ratio;
+    for (size_t i = first; i <= s; i++)
+    {
+        float x = f[i * MAX_CHANNELS + c].ratio;
+        mean += x;
+        minimum = x < minimum ? x : minimum;
+    }
+    mean /= count;
+    variance = 0;
+    for (size_t i = first; i <= s; i++)
+    {
+        double d = f[i * MAX_CHANNELS + c].ratio - mean;
+        variance += d * d;
+    }
+    variance /= count;
+}
+
+static bool same(const Features &a, const Features &b)
+{
+    return a.ratio == b.ratio && a.ppm == b.ppm && a.delta == b.delta && a.variance == b.variance &&
+           a.baseline == b.baseline && a.r0 == b.r0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t samples = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+    int failures = 0;
+    makeConfigs();
+    std::vector<float> mv = makeTrace(samples, 1);
+
+    // Cost per sample against the channel count, best of 5 runs
+    printf("channels   ns/sample   ns/channel\n");
+    std::vector<double> xs, ys;
+    for (size_t n = 1; n <= MAX_CHANNELS; n++)
+    {
+        double best = INFINITY;
+        for (int r = 0; r < 5; r++)
+            best = fmin(best, timePerSample(n, mv, samples));
+        printf("%8zu %11.1f %12.1f\n", n, best, best / n);
+        xs.push_back((double)n);
+        ys.push_back(best);
+    }
+
+    // Least-squares line through the timings; linear scaling means a good fit
+    double mx = 0, my = 0;
+    for (size_t i = 0; i < xs.size(); i++)
+    {
+        mx += xs[i];
+        my += ys[i];
+    }
+    mx /= xs.size();
+    my /= ys.size();
+    double sxy = 0, sxx = 0, syy = 0;
+    for (size_t i = 0; i < xs.size(); i++)
+    {
+        sxy += (xs[i] - mx) * (ys[i] - my);
+        sxx += (xs[i] - mx) * (xs[i] - mx);
+        syy += (ys[i] - my) * (ys[i] - my);
+    }
+    double slope = sxy / sxx;
+    double r2 = syy > 0 ? sxy * sxy / (sxx * syy) : 1;
+    printf("fit: %.1f ns fixed + %.1f ns per channel, R^2 %.4f\n", my - slope * mx, slope, r2);
+    if (r2 < 0.95)
+    {
+        printf("FAIL: cost is not linear in the channel count\n");
+        failures++;
+    }
+
+    // Features of every channel against a brute-force window
+    size_t check = samples < 5000 ? samples : 5000;
+    std::vector<Features> all = run(configs, MAX_CHANNELS, &mv[0], MAX_CHANNELS, check);
+    double worst_var = 0;
+    for (size_t c = 0; c < MAX_CHANNELS; c++)
+    {
+        for (size_t s = 0; s < check; s++)
+        {
+            const Features &f = all[s * MAX_CHANNELS + c];
+            double variance;
+            float minimum;
+            bruteForce(all, c, s, configs[c].window, variance, minimum);
+            double err = fabs(f.variance - variance) / (variance > 1e-6 ? variance : 1e-6);
+            worst_var = fmax(worst_var, err);
+            float previous = s ? all[(s - 1) * MAX_CHANNELS + c].ratio : 0;
+            if (f.baseline != minimum || f.delta != f.ratio - previous || err > 1e-3)
+            {
+                printf("FAIL: channel %zu sample %zu: baseline %g (%g), variance %g (%g), delta %g\n", c, s,
+                       f.baseline, minimum, f.variance, variance, f.delta);
+                failures++;
+                break;
+            }
+        }
+    }
+    printf("windows 1..%zu: baselines exact, variance within %.2g relative\n", WINDOW, worst_var);
+
+    // Each channel on its own must give exactly what it gives among the others
+    for (size_t c = 0; c < MAX_CHANNELS; c++)
+    {
+        std::vector<Features> alone = run(&configs[c], 1, &mv[c], MAX_CHANNELS, check);
+        for (size_t s = 0; s < check; s++)
+        {
+            if (!same(alone[s * MAX_CHANNELS], all[s * MAX_CHANNELS + c]))
+            {
+                printf("FAIL: channel %zu differs from its solo run at sample %zu\n", c, s);
+                failures++;
+                break;
+            }
+        }
+    }
+    printf("%zu channels match their solo runs over %zu samples\n", MAX_CHANNELS, check);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
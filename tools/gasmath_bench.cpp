@@ -0,0 +1,147 @@
+// Host benchmark and accuracy check for lib/GasMath: compares the float MQ2
+// pipeline the M5 firmware used (float Rs, float ratio, double pow) with the
+// one it uses now (integer Rs, float ratio rounded to Q16.16, curve table),
+// per sample, and measures the curve table's error.
+//
+// Build: g++ -std=c++11 -O2 -I../lib/GasMath gasmath_bench.cpp -o gasmath_bench
+// Usage: gasmath_bench [samples]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "GasMath.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+#else
+static uint64_t cycles() { return 0; }
+#endif
+
+static const float RL_KOHM = 5.0f;
+static const float VCC_V = 3.3f;
+static const uint32_t VCC_MV_Q4 = 3300 * 16;   // Millivolts in 1/16 mV, as on the M5
+static const uint32_t RL_OHMS = 5000;
+static const float R0_KOHM = 9.5f;
+
+// Keeps the optimizer from dropping the loops
+static volatile float sink_f;
+static volatile uint32_t sink_u;
+
+struct Timing
+{
+    double ns;
+    double cycles;
+};
+
+template <typename T, typename Fn>
+static Timing measure(const std::vector<T> &in, Fn fn)
+{
+    fn(in);  // Warm up
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    fn(in);
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+    Timing t;
+    t.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / in.size();
+    t.cycles = (double)(c1 - c0) / in.size();
+    return t;
+}
+
+static void floatPipeline(const std::vector<float> &mv)
+{
+    float acc = 0;
+    for (float vrl : mv)
+    {
+        float rs = RL_KOHM * (VCC_V * 1000.0 / vrl - 1.0);
+        float ratio = rs / R0_KOHM;
+        acc += 605.0 * pow(ratio, -3.5);
+    }
+    sink_f = acc;
+}
+
+// As GAS_rsFromMillivolts() and GasChannels::sample() on the M5
+static void fixedPipeline(const std::vector<float> &mv)
+{
+    uint32_t acc = 0;
+    for (float vrl : mv)
+    {
+        float rs = GAS_rsOhms((uint32_t)(vrl * 16 + 0.5f), VCC_MV_Q4, RL_OHMS) / 1000.0f;
+        float ratio = rs / R0_KOHM;
+        acc += MQ2SmokePpm::ppm((uint32_t)(ratio * GAS_RATIO_ONE + 0.5f));
+    }
+    sink_u = acc;
+}
+
+static void powCurve(const std::vector<float> &ratios)
+{
+    float acc = 0;
+    for (float ratio : ratios)
+        acc += 605.0 * pow(ratio, -3.5);
+    sink_f = acc;
+}
+
+static void tableCurve(const std::vector<uint32_t> &ratios)
+{
+    uint32_t acc = 0;
+    for (uint32_t ratio : ratios)
+        acc += MQ2SmokePpm::ppm(ratio);
+    sink_u = acc;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    // Load-resistor voltages covering Rs/R0 of about 0.13 to 10
+    std::vector<float> mv(n);
+    srand(1);
+    for (size_t i = 0; i < n; i++)
+        mv[i] = 150.0f + 2700.0f * rand() / RAND_MAX;
+
+    std::vector<float> ratios(n);
+    std::vector<uint32_t> ratios_q16(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        ratios[i] = RL_KOHM * (VCC_V * 1000 / mv[i] - 1) / R0_KOHM;
+        ratios_q16[i] = (uint32_t)(ratios[i] * GAS_RATIO_ONE + 0.5f);
+    }
+
+    Timing tf = measure(mv, floatPipeline);
+    Timing tx = measure(mv, fixedPipeline);
+    Timing cf = measure(ratios, powCurve);
+    Timing cx = measure(ratios_q16, tableCurve);
+    printf("per sample, %zu samples       float      fixed\n", n);
+    printf("Rs + ratio + curve  ns     %7.1f    %7.1f\n", tf.ns, tx.ns);
+    printf("                    cycles %7.1f    %7.1f\n", tf.cycles, tx.cycles);
+    printf("curve only          ns     %7.1f    %7.1f\n", cf.ns, cx.ns);
+    printf("                    cycles %7.1f    %7.1f\n", cf.cycles, cx.cycles);
+
+    // Curve error against the double-precision reference
+    double worst = 0, sum = 0, worst_at = 0;
+    size_t count = 0;
+    for (double ratio = 0.125; ratio < 10; ratio *= 1.0001)
+    {
+        uint32_t q = (uint32_t)(ratio * GAS_RATIO_ONE + 0.5);
+        double exact = 605.0 * pow(q / 65536.0, -3.5);
+        double err = fabs(MQ2SmokePpm::ppmFloat(q) - exact) / exact;
+        sum += err;
+        count++;
+        if (err > worst)
+        {
+            worst = err;
+            worst_at = ratio;
+        }
+    }
+    printf("smoke curve, 0.125 <= Rs/R0 < 10: max error %.3f %% (at %.4f), mean %.3f %%\n",
+           worst * 100, worst_at, sum / count * 100);
+    printf("table: %u entries, %u bytes\n", MQ2SmokePpm::SIZE,
+           (unsigned)sizeof(MQ2SmokePpm::Table::values));
+    return 0;
+}
@@ -0,0 +1,339 @@
+// Host check of the keep-alive HTTP client the m5 uploads through
+// (sensor-src-m5/include/HttpSession.h). Runs HttpSession over BSD sockets
+// against a stub server on localhost whose reply to each request is set by
+// the check, with the session's clock offset by hand so DNS lifetimes and
+// backoff intervals pass without waiting for them.
+//
+// Build: g++ -std=c++11 -O2 -pthread -I../sensor-src-m5/include http_session_check.cpp -o http_session_check
+// Usage: http_session_check [--port 6770]
+//
+// Checks that one connection carries successive requests, that the session
+// reconnects after Connection: close, after the server drops an idle
+// connection (without failing the request) and after HTTP/1.0 close-framed
+// bodies, that chunked bodies are decoded and truncated to the buffer, that
+// the address is resolved again once dns_ttl_ms has passed or a connect
+// failed and not otherwise, that failures back off from backoff_min_ms
+// doubling to backoff_max_ms without touching the network in between and a
+// success clears it, and that a silent server times out.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "HttpSession.h"
+#include "PosixNet.h"
+
+/** PosixNet with a movable clock, counted lookups and a switch to fail them */
+struct CheckNet : PosixNet
+{
+    CheckNet() : offset_ms(0), resolves(0), fail_dns(false) {}
+
+    bool resolve(const char *host, Address &addr)
+    {
+        resolves++;
+        return !fail_dns && PosixNet::resolve(host, addr);
+    }
+
+    uint32_t now() { return PosixNet::now() + offset_ms; }
+
+    uint32_t offset_ms;
+    int resolves;
+    bool fail_dns;
+};
+
+typedef HttpSession<CheckNet> Session;
+
+// How the stub answers the next request
+enum Reply
+{
+    REPLY_OK,           // 200 with Content-Length, connection kept
+    REPLY_CLOSE,        // 200 with Connection: close, then closes
+    REPLY_DROP,         // 200 kept alive, but the server closes right after
+    REPLY_CHUNKED,      // 200 with a chunked body
+    REPLY_HTTP10,       // HTTP/1.0 body framed by the close
+    REPLY_ERROR,        // 500, connection kept
+    REPLY_SILENT        // Reads the request and never answers
+};
+
+static std::atomic<int> reply(REPLY_OK);
+static std::atomic<int> connections(0);
+static std::atomic<int> requests(0);
+
+static void stubServer(int listener)
+{
+    for (;;)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            return;
+        connections++;
+        std::string in;
+        char buf[1024];
+        bool open = true;
+        while (open)
+        {
+            size_t head = in.find("\r\n\r\n");
+            if (head != std::string::npos)
+            {
+                size_t length = 0;
+                size_t cl = in.find("Content-Length:");
+                if (cl != std::string::npos && cl < head)
+                    length = strtoul(in.c_str() + cl + 15, NULL, 10);
+                if (in.size() >= head + 4 + length)
+                {
+                    in.erase(0, head + 4 + length);
+                    int n = ++requests;
+                    char body[32];
+                    int len = snprintf(body, sizeof(body), "{\"request\":%d}", n);
+                    char resp[256];
+                    int mode = reply.load();
+                    switch (mode)
+                    {
+                    case REPLY_CLOSE:
+                        snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: %d"
+                                 "\r\n\r\n%s", len, body);
+                        break;
+                    case REPLY_CHUNKED:
+                        snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                 "5\r\nhello\r\n1a\r\n, chunked world of bodies!\r\n0\r\n\r\n");
+                        break;
+                    case REPLY_HTTP10:
+                        snprintf(resp, sizeof(resp), "HTTP/1.0 200 OK\r\n\r\n%s", body);
+                        break;
+                    case REPLY_ERROR:
+                        snprintf(resp, sizeof(resp), "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 2"
+                                 "\r\n\r\n{}");
+                        break;
+                    case REPLY_SILENT:
+                        resp[0] = '\0';
+                        break;
+                    default:
+                        snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", len, body);
+                        break;
+                    }
+                    send(fd, resp, strlen(resp), MSG_NOSIGNAL);
+                    if (mode == REPLY_CLOSE || mode == REPLY_DROP || mode == REPLY_HTTP10)
+                        break;
+                    continue;
+                }
+            }
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            open = n > 0;
+            if (open)
+                in.append(buf, n);
+        }
+        close(fd);
+    }
+}
+
+static const uint8_t BODY[] = "{\"name\":\"sensor_01\"}";
+
+static int post(Session &http, char *resp = NULL, size_t cap = 0)
+{
+    return http.post("/update", "application/json", BODY, sizeof(BODY) - 1, resp, cap);
+}
+
+/** Posts once with the stub answering as given; checks the status and whether the connection was reused */
+static int expect(const char *what, Session &http, Reply r, int status, bool reused, int new_connections)
+{
+    reply = r;
+    int before = connections.load();
+    char resp[64];
+    int got = post(http, resp, sizeof(resp));
+    usleep(2000);   // Lets the stub count a connection it accepted after answering
+    int opened = connections.load() - before;
+    if (got != status || http.lastTiming().reused != reused || opened != new_connections)
+    {
+        printf("FAIL: %s: status %d (expected %d), reused %d (expected %d), %d new connections (expected %d)\n",
+               what, got, status, http.lastTiming().reused, reused, opened, new_connections);
+        return 1;
+    }
+    return 0;
+}
+
+static int checkKeepAlive(int port)
+{
+    CheckNet net;
+    Session::Config config = {"127.0.0.1", (uint16_t)port, 60000, 1000, 1000, 100, 800};
+    Session http(net, config);
+    int failures = 0;
+
+    failures += expect("first request", http, REPLY_OK, 200, false, 1);
+    for (int i = 0; i < 20; i++)
+        failures += expect("keep-alive", http, REPLY_OK, 200, true, 0);
+    char resp[64];
+    reply = REPLY_OK;
+    int n = requests.load();
+    if (post(http, resp, sizeof(resp)) != 200 || atoi(resp + strlen("{\"request\":")) != n + 1)
+    {
+        printf("FAIL: keep-alive: response body \"%s\", expected request %d\n", resp, n + 1);
+        failures++;
+    }
+
+    // Errors from the server are answers: the connection stays and nothing backs off
+    failures += expect("500", http, REPLY_ERROR, 500, true, 0);
+    if (http.backoff())
+    {
+        printf("FAIL: a 500 backs off %u ms\n", http.backoff());
+        failures++;
+    }
+    failures += expect("after 500", http, REPLY_OK, 200, true, 0);
+
+    // The server ends the connection: announced, silently after answering, or as the end of the body
+    failures += expect("Connection: close", http, REPLY_CLOSE, 200, true, 0);
+    failures += expect("after Connection: close", http, REPLY_DROP, 200, false, 1);
+    failures += expect("after a dropped idle connection", http, REPLY_OK, 200, false, 1);
+    failures += expect("HTTP/1.0", http, REPLY_HTTP10, 200, true, 0);
+    failures += expect("after HTTP/1.0", http, REPLY_OK, 200, false, 1);
+
+    // Chunked, into a buffer shorter than the body
+    reply = REPLY_CHUNKED;
+    char small[12];
+    int status = post(http, small, sizeof(small));
+    if (status != 200 || strcmp(small, "hello, chun") != 0)
+    {
+        printf("FAIL: chunked: status %d, body \"%s\"\n", status, small);
+        failures++;
+    }
+    failures += expect("after chunked", http, REPLY_OK, 200, true, 0);
+    if (http.backoff() || net.resolves != 1)
+    {
+        printf("FAIL: keep-alive: backoff %u ms, %d lookups\n", http.backoff(), net.resolves);
+        failures++;
+    }
+    printf("keep-alive: %d requests over %d connections, reconnecting only when the server closed\n",
+           requests.load(), connections.load());
+    return failures;
+}
+
+static int checkDnsTtl(int port)
+{
+    CheckNet net;
+    Session::Config config = {"127.0.0.1", (uint16_t)port, 60000, 1000, 1000, 100, 800};
+    Session http(net, config);
+    int failures = 0;
+
+    // Every request on a new connection; only those past the lifetime look the host up again
+    static const uint32_t at_s[] = {0, 1, 30, 59, 60, 61, 119, 120, 500};
+    static const int lookups[] = {1, 1, 1, 1, 2, 2, 2, 3, 4};
+    reply = REPLY_CLOSE;
+    for (size_t i = 0; i < sizeof(at_s) / sizeof(at_s[0]); i++)
+    {
+        net.offset_ms = at_s[i] * 1000;
+        int status = post(http);
+        if (status != 200 || net.resolves != lookups[i])
+        {
+            printf("FAIL: dns: request at %u s: status %d, %d lookups (expected %d)\n", at_s[i], status,
+                   net.resolves, lookups[i]);
+            failures++;
+        }
+    }
+
+    // A failed connect forgets the address, so the next attempt looks it up within the lifetime
+    CheckNet dead;
+    Session::Config dead_config = {"127.0.0.1", (uint16_t)(port + 1), 60000, 1000, 1000, 1, 1};
+    Session nowhere(dead, dead_config);
+    for (int i = 0; i < 3; i++)
+    {
+        int status = post(nowhere);
+        if (status != HTTP_SESSION_CONNECT || dead.resolves != i + 1)
+        {
+            printf("FAIL: dns: connect %d failed with %d, %d lookups\n", i, status, dead.resolves);
+            failures++;
+        }
+        dead.offset_ms += 10;   // Past the 1 ms backoff
+    }
+    printf("dns: %d lookups over 500 s at a 60 s lifetime; a failed connect looks up again\n", net.resolves);
+    return failures;
+}
+
+static int checkBackoff(int port)
+{
+    CheckNet net;
+    Session::Config config = {"127.0.0.1", (uint16_t)port, 60000, 1000, 1000, 100, 800};
+    Session http(net, config);
+    int failures = 0;
+
+    // The host does not resolve: 100, 200, 400, 800, then 800 ms until it does
+    static const uint32_t schedule[] = {100, 200, 400, 800, 800, 800};
+    net.fail_dns = true;
+    for (size_t i = 0; i < sizeof(schedule) / sizeof(schedule[0]); i++)
+    {
+        int resolves = net.resolves;
+        int status = post(http);
+        if (status != HTTP_SESSION_DNS || http.backoff() != schedule[i] || net.resolves != resolves + 1)
+        {
+            printf("FAIL: backoff: failure %zu returned %d, backs off %u ms (expected %u)\n", i, status,
+                   http.backoff(), schedule[i]);
+            failures++;
+        }
+
+        // Refused without a lookup until the interval has passed
+        net.offset_ms += schedule[i] - 1;
+        if (post(http) != HTTP_SESSION_BACKOFF || net.resolves != resolves + 1)
+        {
+            printf("FAIL: backoff: not refused %u ms into a %u ms backoff\n", schedule[i] - 1, schedule[i]);
+            failures++;
+        }
+        net.offset_ms += 1;
+    }
+
+    // Recovery clears it
+    net.fail_dns = false;
+    failures += expect("recovered", http, REPLY_OK, 200, false, 1);
+    if (http.backoff())
+    {
+        printf("FAIL: backoff: %u ms left after a success\n", http.backoff());
+        failures++;
+    }
+
+    // A silent server times out after response_timeout_ms, closes and backs off
+    Session::Config quick = {"127.0.0.1", (uint16_t)port, 60000, 1000, 200, 100, 800};
+    CheckNet quick_net;
+    Session impatient(quick_net, quick);
+    reply = REPLY_SILENT;
+    uint32_t t0 = quick_net.now();
+    int status = post(impatient);
+    uint32_t took = quick_net.now() - t0;
+    if (status != HTTP_SESSION_TIMEOUT || took < 200 || took > 1000 || impatient.backoff() != 100 ||
+        quick_net.connected())
+    {
+        printf("FAIL: timeout: status %d after %u ms, backoff %u ms\n", status, took, impatient.backoff());
+        failures++;
+    }
+    printf("backoff: 100 ms doubling to 800 ms, nothing sent while backing off; a silent server times out "
+           "after %u ms\n", took);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 6770;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+    }
+
+    int listener = POSIX_listen(port);
+    if (listener < 0)
+    {
+        fprintf(stderr, "cannot listen on port %d\n", port);
+        return 1;
+    }
+    std::thread(stubServer, listener).detach();
+
+    int failures = checkKeepAlive(port);
+    failures += checkDnsTtl(port);
+    failures += checkBackoff(port);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,449 @@
+// Host check and benchmark of the uplink JSON serializer
+// (sensor-src-m5/include/JsonWriter.h, SensorJson.h). Checks string
+// escaping, the fixed-decimal float formatting against printf (NaN and
+// infinities become null), nesting and commas, and that output cut short
+// by a small buffer is a NUL-terminated prefix of the full output with ok()
+// false. The benchmark serializes /update batches with JsonWriter and with
+// the Arduino String concatenation it replaced, counting bytes per
+// microsecond and heap allocations per batch.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include json_writer_bench.cpp -o json_writer_bench
+// Usage: json_writer_bench [batches]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SensorJson.h"
+
+// Heap allocations made through new or the String stand-in below
+static size_t allocations = 0;
+
+void *operator new(size_t n)
+{
+    allocations++;
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * Host stand-in for the Arduino String of the old serializer (WString.cpp):
+ * concatenation grows the heap buffer to the exact new length, a + chain
+ * builds into one StringSumHelper temporary and String(float, decimals)
+ * formats with dtostrf.
+ */
+class String
+{
+public:
+    String(const char *s = "") : buf(NULL), cap(0), len(0) { concat(s, strlen(s)); }
+    String(const String &s) : buf(NULL), cap(0), len(0) { concat(s.buf, s.len); }
+    explicit String(unsigned long v) : buf(NULL), cap(0), len(0)
+    {
+        char tmp[24];
+        concat(tmp, snprintf(tmp, sizeof(tmp), "%lu", v));
+    }
+    String(float v, unsigned char decimals) : buf(NULL), cap(0), len(0)
+    {
+        char tmp[33];
+        concat(tmp, snprintf(tmp, sizeof(tmp), "%.*f", decimals, v));
+    }
+    ~String() { free(buf); }
+
+    bool reserve(size_t n)
+    {
+        if (buf && cap >= n)
+            return true;
+        char *p = (char *)realloc(buf, n + 1);
+        if (!p)
+            return false;
+        allocations++;
+        if (!buf)
+            p[0] = '\0';
+        buf = p;
+        cap = n;
+        return true;
+    }
+
+    void concat(const char *s, size_t n)
+    {
+        if (!reserve(len + n))
+            return;
+        memcpy(buf + len, s, n);
+        len += n;
+        buf[len] = '\0';
+    }
+
+    String &operator+=(const String &s)
+    {
+        concat(s.buf, s.len);
+        return *this;
+    }
+    String &operator+=(const char *s)
+    {
+        concat(s, strlen(s));
+        return *this;
+    }
+
+    const char *c_str() const { return buf; }
+    size_t length() const { return len; }
+
+private:
+    String &operator=(const String &);
+
+    char *buf;
+    size_t cap;
+    size_t len;
+};
+
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char *s) : String(s) {}
+};
+
+static StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    a += rhs;
+    return a;
+}
+
+static StringSumHelper &operator+(const StringSumHelper &lhs, const char *rhs)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    a += rhs;
+    return a;
+}
+
+// Identity and record layout of the old firmware
+static const String dev_name = "plant_003";
+static const String plant_id = "plant_003";
+static const String disease_status = "healthy";
+static const DeviceIdentity device = {"plant_003", "39.042388, -77.550108", "plant_003", "healthy"};
+
+// The serializer JsonWriter replaced, as API_appendRecord() in the old main.cpp
+static void appendRecord(String &postData, const SensorData &data)
+{
+    postData += "{\"name\":\"" + dev_name +
+                "\", \"timestamp\":" + String(data.timestamp) +
+                ", \"plant_id\":\"" + plant_id + "\"" +
+                ", \"disease_status\":\"" + disease_status + "\"" +
+                ", \"temperature\":" + String(data.temperature, 2) +
+                ", \"humidity\":" + String(data.humidity, 2) +
+                ", \"pressure\":" + String(data.pressure, 3) +
+                ", \"gasResistance\":" + String(data.gasResistance, 2) +
+                ", \"mq2_rs\":" + String(data.mq2_rs, 2) +
+                ", \"mq2_ratio\":" + String(data.mq2_ratio, 4) +
+                ", \"mq2_r0\":" + String(data.mq2_r0, 2) +
+                ", \"mq2_delta\":" + String(data.mq2_delta, 4) +
+                ", \"mq2_variance\":" + String(data.mq2_variance, 6) +
+                ", \"mq2_baseline\":" + String(data.mq2_baseline, 4) + "}";
+}
+
+static const int MAX_BATCH = 20;        // main.cpp
+
+// Keeps the optimizer from dropping the loops
+static volatile size_t sink_n;
+
+static size_t stringBatch(const SensorData *records)
+{
+    String postData = "[";
+    postData.reserve(MAX_BATCH * 420);
+    for (int i = 0; i < MAX_BATCH; i++)
+    {
+        if (i > 0)
+            postData += ",";
+        appendRecord(postData, records[i]);
+    }
+    postData += "]";
+    return postData.length();
+}
+
+static char payload[MAX_BATCH * SENSOR_JSON_MAX_LEN + 2];
+
+static size_t writerBatch(const SensorData *records)
+{
+    JsonWriter json(payload, sizeof(payload));
+    json.beginArray();
+    for (int i = 0; i < MAX_BATCH; i++)
+        JSON_writeSensorData(json, device, records[i]);
+    json.endArray();
+    return json.ok() ? json.length() : 0;
+}
+
+struct Result
+{
+    double bytes_per_us;
+    double allocations;     // Per batch
+    size_t bytes;           // Per batch
+};
+
+static Result bench(size_t (*fn)(const SensorData *), const std::vector<SensorData> &records)
+{
+    size_t batches = records.size() / MAX_BATCH;
+    Result r = {0, 0, 0};
+    double best_ns = INFINITY;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        size_t bytes = 0;
+        size_t a0 = allocations;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < batches; b++)
+            bytes += fn(&records[b * MAX_BATCH]);
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        r.allocations = (double)(allocations - a0) / batches;
+        r.bytes = bytes / batches;
+        sink_n = bytes;
+        if (ns < best_ns)
+        {
+            best_ns = ns;
+            r.bytes_per_us = bytes / (ns / 1000);
+        }
+    }
+    return r;
+}
+
+// One document written into buf[cap]
+static size_t writeDocument(char *buf, size_t cap, bool &ok)
+{
+    JsonWriter w(buf, cap);
+    w.beginArray();
+    w.beginObject();
+    w.key("name");
+    w.value("a \"quoted\"\\name\n");
+    w.key("n");
+    w.value(4294967295UL);
+    w.key("list");
+    w.beginArray();
+    w.value(1.5f, 1);
+    w.beginObject();
+    w.endObject();
+    w.beginArray();
+    w.endArray();
+    w.value(NAN, 2);
+    w.endArray();
+    w.endObject();
+    w.value(-0.125f, 3);
+    w.endArray();
+    ok = w.ok();
+    return w.length();
+}
+
+static int checkStrings()
+{
+    static const struct
+    {
+        const char *in;
+        const char *out;
+    } CASES[] = {
+        {"plain", "\"plain\""},
+        {"", "\"\""},
+        {"say \"hi\"", "\"say \\\"hi\\\"\""},
+        {"C:\\dir\\", "\"C:\\\\dir\\\\\""},
+        {"tab\there\nline\r", "\"tab\\u0009here\\u000aline\\u000d\""},
+        {"\x01\x1f\x20\x7f", "\"\\u0001\\u001f \x7f\""},
+        {"39.04\xc2\xb0 N", "\"39.04\xc2\xb0 N\""},     // UTF-8 passes through
+    };
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+    {
+        char buf[64];
+        JsonWriter w(buf, sizeof(buf));
+        w.value(CASES[i].in);
+        if (!w.ok() || strcmp(buf, CASES[i].out) != 0 || w.length() != strlen(CASES[i].out))
+        {
+            printf("FAIL: string %zu is written as %s, expected %s\n", i, buf, CASES[i].out);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int checkFloats()
+{
+    static const struct
+    {
+        float v;
+        uint8_t decimals;
+        const char *out;
+    } CASES[] = {
+        {NAN, 2, "null"},
+        {-NAN, 2, "null"},
+        {INFINITY, 2, "null"},
+        {-INFINITY, 0, "null"},
+        {1e19f, 0, "null"},                 // Does not fit the scaled integer
+        {1e10f, 9, "null"},
+        {3.4e38f, 2, "null"},
+        {0.0f, 2, "0.00"},
+        {-0.0f, 2, "0.00"},
+        {-0.004f, 2, "0.00"},               // No "-0.00"
+        {-0.006f, 2, "-0.01"},
+        {0.125f, 2, "0.13"},                // Halfway rounds up, printf would give 0.12
+        {-2.5f, 0, "-3"},
+        {1013.25f, 3, "1013.250"},
+        {42.0f, 0, "42"},
+        {1.0f / 3, 12, "0.333333343"},      // Decimals are capped at 9
+        {1.5e-10f, 9, "0.000000000"},
+    };
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+    {
+        char buf[64];
+        JsonWriter w(buf, sizeof(buf));
+        w.value(CASES[i].v, CASES[i].decimals);
+        if (!w.ok() || strcmp(buf, CASES[i].out) != 0)
+        {
+            printf("FAIL: %g with %u decimals is written as %s, expected %s\n", CASES[i].v, CASES[i].decimals, buf,
+                   CASES[i].out);
+            failures++;
+        }
+    }
+
+    // Random values against printf, away from halfway cases where the rounding differs by design
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> exponent(-6, 9);
+    size_t compared = 0;
+    for (int i = 0; i < 200000 && failures < 5; i++)
+    {
+        float v = (float)pow(10, exponent(rng)) * (rng() & 1 ? 1 : -1);
+        uint8_t decimals = rng() % 7;
+        double scaled = fabs((double)v) * pow(10, decimals);
+        if (scaled >= 1e15 || fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+            continue;
+        char expect[64], buf[64];
+        snprintf(expect, sizeof(expect), "%.*f", decimals, v);
+        if (!strncmp(expect, "-0", 2) && strspn(expect + 1, "0.") == strlen(expect + 1))
+            memmove(expect, expect + 1, strlen(expect));    // JsonWriter drops the sign of a zero
+        JsonWriter w(buf, sizeof(buf));
+        w.value(v, decimals);
+        compared++;
+        if (strcmp(buf, expect) != 0)
+        {
+            printf("FAIL: %.9g with %u decimals is written as %s, printf gives %s\n", v, decimals, buf, expect);
+            failures++;
+        }
+    }
+    printf("floats: %zu random values match printf\n", compared);
+    return failures;
+}
+
+static int checkStructure()
+{
+    char buf[256];
+    bool ok;
+    writeDocument(buf, sizeof(buf), ok);
+    const char *expect =
+        "[{\"name\":\"a \\\"quoted\\\"\\\\name\\u000a\",\"n\":4294967295,\"list\":[1.5,{},[],null]},-0.125]";
+    if (!ok || strcmp(buf, expect) != 0)
+    {
+        printf("FAIL: document is %s, expected %s\n", buf, expect);
+        return 1;
+    }
+    return 0;
+}
+
+// Every buffer size up to the full length: a prefix, NUL-terminated, not ok
+static int checkOverflow()
+{
+    char full[256];
+    bool ok;
+    size_t length = writeDocument(full, sizeof(full), ok);
+    int failures = 0;
+    for (size_t cap = 0; cap <= length + 1 && failures < 5; cap++)
+    {
+        char buf[258];
+        memset(buf, '#', sizeof(buf));
+        size_t n = writeDocument(buf, cap, ok);
+        bool fits = cap > length;
+        bool prefix = cap == 0 ? buf[0] == '#' : n == (fits ? length : cap - 1) && buf[n] == '\0' &&
+                                                 !memcmp(buf, full, n);
+        if (ok != fits || !prefix || buf[cap] != '#')
+        {
+            printf("FAIL: buffer of %zu bytes: ok %d, %zu bytes \"%.*s\"\n", cap, ok, n, (int)n, buf);
+            failures++;
+        }
+    }
+
+    // A batch that outgrows the payload buffer is reported, not sent cut off
+    SensorData record = SensorData();
+    char small[SENSOR_JSON_MAX_LEN];
+    JsonWriter w(small, sizeof(small));
+    w.beginArray();
+    for (int i = 0; i < 4; i++)
+        JSON_writeSensorData(w, device, record);
+    w.endArray();
+    if (w.ok() || w.length() != sizeof(small) - 1)
+    {
+        printf("FAIL: four records fit into %zu bytes\n", sizeof(small));
+        failures++;
+    }
+    printf("overflow: every buffer of 0..%zu bytes holds a NUL-terminated prefix\n", length + 1);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    size_t batches = argc > 1 ? (size_t)atol(argv[1]) : 2000;
+    int failures = checkStrings();
+    failures += checkFloats();
+    failures += checkStructure();
+    failures += checkOverflow();
+
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0, 1);
+    std::vector<SensorData> records(batches * MAX_BATCH);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        SensorData &d = records[i];
+        d = SensorData();
+        d.timestamp = 1700000000UL + i * 15;
+        d.temperature = 22 + noise(rng);
+        d.humidity = 45 + 5 * noise(rng);
+        d.pressure = 1013 + noise(rng);
+        d.gasResistance = 50000 + 2000 * noise(rng);
+        d.mq2_rs = 9 + noise(rng);
+        d.mq2_r0 = 9.5f;
+        d.mq2_ratio = d.mq2_rs / d.mq2_r0;
+        d.mq2_delta = 0.01f * noise(rng);
+        d.mq2_variance = 0.0001f * fabsf(noise(rng));
+        d.mq2_baseline = d.mq2_ratio - 0.05f;
+    }
+
+    Result old_path = bench(stringBatch, records);
+    Result writer = bench(writerBatch, records);
+    printf("batch of %d records   bytes   bytes/us   allocations\n", MAX_BATCH);
+    printf("String concatenation %7zu %10.1f %13.1f\n", old_path.bytes, old_path.bytes_per_us, old_path.allocations);
+    printf("JsonWriter           %7zu %10.1f %13.1f\n", writer.bytes, writer.bytes_per_us, writer.allocations);
+    if (writer.allocations != 0 || writer.bytes == 0)
+    {
+        printf("FAIL: JsonWriter allocated or overflowed\n");
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
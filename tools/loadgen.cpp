@@ -0,0 +1,581 @@
+// Load generator for the server's ingest API. Emulates N devices that
+// register and then upload batches to /update on their own schedule, with
+// the payloads the firmware sends (sensor-src-m5/include/SensorJson.h), and
+// reports latency percentiles, throughput and error rates per endpoint.
+//
+// Run it against a locally started server; every device appends to its
+// own data/data_<prefix><n>.csv there, so start the server from a scratch
+// copy of server-src.
+//
+// Build: g++ -std=c++11 -O2 -pthread -I../sensor-src-m5/include loadgen.cpp -o loadgen
+// Usage: loadgen [--host 127.0.0.1] [--port 5000] [--devices 100] [--threads 8]
+//                [--interval-ms 15000] [--jitter 0.1] [--batch 1] [--duration 60]
+//                [--fail 0] [--timeout-ms 5000] [--prefix load_] [--seed 1]
+//
+// --interval-ms is each device's upload period (the m5 uploads one averaged
+// record every 15 s), --jitter the +- fraction it varies by, --batch the
+// records per /update. --fail is the fraction of updates that are broken on
+// purpose, in turn: a record without mq2_baseline (expect 400), a truncated
+// JSON body (expect 400) and a connection dropped halfway through the body.
+//
+// Latency is measured from sending the request to the end of the response.
+// "Lag" is how late a request went out against its schedule; when it grows
+// the generator could not keep up and the offered rate was not reached.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SensorJson.h>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+    std::string host;
+    int port;
+    int devices;
+    int threads;
+    double interval_ms;
+    double jitter;
+    int batch;
+    double duration_s;
+    double fail;
+    int timeout_ms;
+    std::string prefix;
+    unsigned seed;
+
+    Options()
+        : host("127.0.0.1"), port(5000), devices(100), threads(8), interval_ms(15000), jitter(0.1), batch(1),
+          duration_s(60), fail(0), timeout_ms(5000), prefix("load_"), seed(1)
+    {
+    }
+};
+
+enum Outcome
+{
+    OUT_OK,             // 2xx
+    OUT_REJECTED,       // 4xx
+    OUT_SERVER_ERROR,   // 5xx
+    OUT_CONNECT,        // Could not connect
+    OUT_TIMEOUT,        // No complete response in time
+    OUT_IO,             // Connection reset or malformed response
+    OUT_COUNT
+};
+
+static const char *const OUTCOME_NAMES[OUT_COUNT] = {"2xx", "4xx", "5xx", "connect", "timeout", "io"};
+
+enum Fault
+{
+    FAULT_NONE,
+    FAULT_MISSING_FIELD,
+    FAULT_TRUNCATED,
+    FAULT_ABORT,
+};
+
+/** Results of one endpoint */
+struct Stats
+{
+    std::vector<double> latency_ms;     // Requests that got a response
+    std::vector<double> lag_ms;
+    uint64_t outcomes[OUT_COUNT];
+    uint64_t injected;                  // Requests broken on purpose, excluding aborts
+    uint64_t injected_rejected;         // ... that the server answered with 4xx, as it should
+    uint64_t aborted;                   // Connections dropped on purpose halfway through the body
+    uint64_t records;                   // Records in requests answered with 2xx
+    uint64_t bytes;
+
+    Stats() : injected(0), injected_rejected(0), aborted(0), records(0), bytes(0)
+    {
+        memset(outcomes, 0, sizeof(outcomes));
+    }
+
+    void merge(const Stats &o)
+    {
+        latency_ms.insert(latency_ms.end(), o.latency_ms.begin(), o.latency_ms.end());
+        lag_ms.insert(lag_ms.end(), o.lag_ms.begin(), o.lag_ms.end());
+        for (int i = 0; i < OUT_COUNT; i++)
+            outcomes[i] += o.outcomes[i];
+        injected += o.injected;
+        injected_rejected += o.injected_rejected;
+        aborted += o.aborted;
+        records += o.records;
+        bytes += o.bytes;
+    }
+};
+
+// xorshift32, one per thread so runs are repeatable for a given seed and thread count
+struct Rng
+{
+    uint32_t state;
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    /** Uniform in [0, 1) */
+    double uniform() { return (next() >> 8) * (1.0 / 16777216.0); }
+};
+
+// HTTP/1.1 with one connection per request, as the device's uplink uses it
+// after an error and as the Flask development server handles it anyway
+
+static double msSince(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static int connectTo(const Options &opt, const sockaddr_in &addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    timeval tv;
+    tv.tv_sec = opt.timeout_ms / 1000;
+    tv.tv_usec = (opt.timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const char *data, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * POSTs a JSON body and waits for the complete response. With abort set,
+ * only half the body is sent before the connection is closed.
+ */
+static Outcome post(const Options &opt, const sockaddr_in &addr, const char *path, const std::string &body,
+                    bool abort)
+{
+    int fd = connectTo(opt, addr);
+    if (fd < 0)
+        return OUT_CONNECT;
+
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "POST %s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: application/json\r\n"
+                            "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                            path, opt.host.c_str(), opt.port, body.size());
+    std::string request(head, head_len);
+    request += body;
+
+    if (abort)
+    {
+        sendAll(fd, request.data(), head_len + body.size() / 2);
+        close(fd);
+        return OUT_IO;
+    }
+    if (!sendAll(fd, request.data(), request.size()))
+    {
+        close(fd);
+        return OUT_IO;
+    }
+
+    // Read until the server closes, then check the status line
+    std::string resp;
+    char buf[4096];
+    Outcome out = OUT_IO;
+    for (;;)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            resp.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            out = OUT_TIMEOUT;
+        break;
+    }
+    close(fd);
+
+    int status = 0;
+    if (sscanf(resp.c_str(), "HTTP/%*d.%*d %d", &status) != 1)
+        return out;
+    if (status >= 200 && status < 300)
+        return OUT_OK;
+    if (status >= 400 && status < 500)
+        return OUT_REJECTED;
+    return status >= 500 ? OUT_SERVER_ERROR : OUT_IO;
+}
+
+// Emulated devices
+
+struct Device
+{
+    std::string name;
+    std::string location;
+    std::string plant_id;
+    SensorData data;            // Last record, random-walked between uploads
+    bool registered;
+    Clock::time_point next;
+    unsigned long uptime_ms;    // Device-side timestamp of the next record
+};
+
+static void DEVICE_init(Device &d, const Options &opt, int index, Rng &rng)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s%d", opt.prefix.c_str(), index);
+    d.name = buf;
+    snprintf(buf, sizeof(buf), "bench-%d", index % 10);
+    d.location = buf;
+    snprintf(buf, sizeof(buf), "plant_%03d", index + 1);
+    d.plant_id = buf;
+
+    memset(&d.data, 0, sizeof(d.data));
+    d.data.temperature = 21 + 4 * rng.uniform();
+    d.data.humidity = 40 + 20 * rng.uniform();
+    d.data.pressure = 100.5f + rng.uniform();
+    d.data.gasResistance = 80 + 80 * rng.uniform();
+    d.data.mq2_r0 = 9000 + 2000 * rng.uniform();
+    d.data.mq2_rs = d.data.mq2_r0 * 9.83f;
+    d.registered = false;
+    d.uptime_ms = 2000;
+}
+
+/** Advances the device's record like a slowly drifting, noisy sensor */
+static void DEVICE_step(Device &d, const Options &opt, Rng &rng)
+{
+    SensorData &s = d.data;
+    float prev_ratio = s.mq2_ratio;
+    s.temperature += 0.05f * (rng.uniform() - 0.5);
+    s.humidity += 0.2f * (rng.uniform() - 0.5);
+    s.pressure += 0.01f * (rng.uniform() - 0.5);
+    s.gasResistance *= 1 + 0.01f * (rng.uniform() - 0.5);
+    s.mq2_rs *= 1 + 0.02f * (rng.uniform() - 0.5);
+    s.mq2_ratio = s.mq2_rs / s.mq2_r0;
+    s.mq2_delta = s.mq2_ratio - prev_ratio;
+    s.mq2_variance = 0.0001f * rng.uniform();
+    s.mq2_baseline = s.mq2_ratio * 0.98f;
+    s.timestamp = d.uptime_ms;
+    d.uptime_ms += (unsigned long)(opt.interval_ms / opt.batch);
+}
+
+static std::string DEVICE_registration(const Device &d)
+{
+    DeviceIdentity id = {d.name.c_str(), d.location.c_str(), d.plant_id.c_str(), "healthy"};
+    char buf[SENSOR_JSON_MAX_LEN];
+    JsonWriter w(buf, sizeof(buf));
+    JSON_writeRegistration(w, id, false, d.uptime_ms);
+    return std::string(buf, w.length());
+}
+
+static std::string DEVICE_update(Device &d, const Options &opt, Rng &rng, Fault fault)
+{
+    DeviceIdentity id = {d.name.c_str(), d.location.c_str(), d.plant_id.c_str(), "healthy"};
+    std::vector<char> buf(opt.batch * SENSOR_JSON_MAX_LEN + 2);
+    JsonWriter w(&buf[0], buf.size());
+
+    if (fault == FAULT_MISSING_FIELD)
+    {
+        // A single record rather than a batch, which the server would only drop it from.
+        // mq2_baseline is the last field, so it runs up to the closing brace.
+        DEVICE_step(d, opt, rng);
+        JSON_writeSensorData(w, id, d.data);
+        std::string body(&buf[0], w.length());
+        body.erase(body.find(",\"mq2_baseline\":"), std::string::npos);
+        return body + "}";
+    }
+
+    w.beginArray();
+    for (int i = 0; i < opt.batch; i++)
+    {
+        DEVICE_step(d, opt, rng);
+        JSON_writeSensorData(w, id, d.data);
+    }
+    w.endArray();
+    std::string body(&buf[0], w.length());
+
+    if (fault == FAULT_TRUNCATED)
+    {
+        body.resize(body.size() / 2);
+    }
+    return body;
+}
+
+// Worker: owns every threads-th device and sends each one's requests when due
+
+struct Worker
+{
+    const Options *opt;
+    sockaddr_in addr;
+    int first;
+    Rng rng;
+    Clock::time_point start;
+    Clock::time_point stop;
+    Stats reg;
+    Stats upd;
+    std::thread thread;
+};
+
+static double WORKER_period(Worker &w)
+{
+    return w.opt->interval_ms * (1 + w.opt->jitter * (2 * w.rng.uniform() - 1));
+}
+
+static void WORKER_record(Stats &s, Outcome out, double lag, double latency, size_t bytes, int records)
+{
+    s.outcomes[out]++;
+    s.lag_ms.push_back(lag);
+    s.bytes += bytes;
+    if (out == OUT_OK || out == OUT_REJECTED || out == OUT_SERVER_ERROR)
+        s.latency_ms.push_back(latency);
+    if (out == OUT_OK)
+        s.records += records;
+}
+
+static void WORKER_run(Worker *w)
+{
+    const Options &opt = *w->opt;
+    std::vector<Device> devices;
+    for (int i = w->first; i < opt.devices; i += opt.threads)
+    {
+        devices.push_back(Device());
+        DEVICE_init(devices.back(), opt, i, w->rng);
+        // Spread the first uploads over one period, as devices that booted at different times
+        devices.back().next = w->start + std::chrono::microseconds((long)(opt.interval_ms * 1000 * w->rng.uniform()));
+    }
+    if (devices.empty())
+        return;
+
+    uint32_t fault_turn = 0;
+    for (;;)
+    {
+        Device *d = &devices[0];
+        for (size_t i = 1; i < devices.size(); i++)
+        {
+            if (devices[i].next < d->next)
+                d = &devices[i];
+        }
+        if (d->next >= w->stop)
+            break;
+        std::this_thread::sleep_until(d->next);
+
+        Clock::time_point t0 = Clock::now();
+        double lag = std::chrono::duration<double, std::milli>(t0 - d->next).count();
+
+        if (!d->registered)
+        {
+            std::string body = DEVICE_registration(*d);
+            Outcome out = post(opt, w->addr, "/register", body, false);
+            WORKER_record(w->reg, out, lag, msSince(t0), body.size(), 0);
+            d->registered = out == OUT_OK;
+            // Retry a failed registration after a second, like the firmware's reconnect
+            d->next += d->registered ? std::chrono::microseconds((long)(WORKER_period(*w) * 1000))
+                                     : std::chrono::microseconds(1000000);
+            continue;
+        }
+
+        Fault fault = FAULT_NONE;
+        if (opt.fail > 0 && w->rng.uniform() < opt.fail)
+            fault = (Fault)(FAULT_MISSING_FIELD + fault_turn++ % 3);
+
+        std::string body = DEVICE_update(*d, opt, w->rng, fault);
+        Outcome out = post(opt, w->addr, "/update", body, fault == FAULT_ABORT);
+        if (fault == FAULT_ABORT)
+        {
+            w->upd.aborted++;  // There is no response to measure
+        }
+        else
+        {
+            WORKER_record(w->upd, out, lag, msSince(t0), body.size(), opt.batch);
+        }
+        if (fault != FAULT_NONE && fault != FAULT_ABORT)
+        {
+            w->upd.injected++;
+            if (out == OUT_REJECTED)
+                w->upd.injected_rejected++;
+        }
+        d->next += std::chrono::microseconds((long)(WORKER_period(*w) * 1000));
+    }
+
+    // Leave the server's live table as it was
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        if (devices[i].registered)
+            post(opt, w->addr, "/unregister", "{\"name\":\"" + devices[i].name + "\"}", false);
+    }
+}
+
+// Report
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static void report(const char *name, Stats &s, double elapsed_s)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < OUT_COUNT; i++)
+        total += s.outcomes[i];
+    if (total == 0)
+        return;
+
+    std::sort(s.latency_ms.begin(), s.latency_ms.end());
+    std::sort(s.lag_ms.begin(), s.lag_ms.end());
+
+    printf("%s: %llu requests, %.1f req/s, %.1f records/s, %.1f KiB/s sent\n", name, (unsigned long long)total,
+           total / elapsed_s, s.records / elapsed_s, s.bytes / 1024.0 / elapsed_s);
+    printf("  latency ms  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n", percentile(s.latency_ms, 50),
+           percentile(s.latency_ms, 90), percentile(s.latency_ms, 99), percentile(s.latency_ms, 99.9),
+           s.latency_ms.empty() ? 0 : s.latency_ms.back());
+    printf("  lag ms      p50 %.2f  p99 %.2f  max %.2f\n", percentile(s.lag_ms, 50), percentile(s.lag_ms, 99),
+           s.lag_ms.empty() ? 0 : s.lag_ms.back());
+    printf("  outcomes   ");
+    for (int i = 0; i < OUT_COUNT; i++)
+        printf(" %s %llu (%.2f%%)", OUTCOME_NAMES[i], (unsigned long long)s.outcomes[i], 100.0 * s.outcomes[i] / total);
+    printf("\n");
+    if (s.injected || s.aborted)
+    {
+        printf("  injected faults %llu, rejected with 4xx %llu; dropped connections %llu\n",
+               (unsigned long long)s.injected, (unsigned long long)s.injected_rejected,
+               (unsigned long long)s.aborted);
+    }
+}
+
+static bool parseArgs(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *v = argv[++i];
+        if (a == "--host")
+            opt.host = v;
+        else if (a == "--port")
+            opt.port = atoi(v);
+        else if (a == "--devices")
+            opt.devices = atoi(v);
+        else if (a == "--threads")
+            opt.threads = atoi(v);
+        else if (a == "--interval-ms")
+            opt.interval_ms = atof(v);
+        else if (a == "--jitter")
+            opt.jitter = atof(v);
+        else if (a == "--batch")
+            opt.batch = atoi(v);
+        else if (a == "--duration")
+            opt.duration_s = atof(v);
+        else if (a == "--fail")
+            opt.fail = atof(v);
+        else if (a == "--timeout-ms")
+            opt.timeout_ms = atoi(v);
+        else if (a == "--prefix")
+            opt.prefix = v;
+        else if (a == "--seed")
+            opt.seed = strtoul(v, NULL, 10);
+        else
+            return false;
+    }
+    return opt.devices > 0 && opt.threads > 0 && opt.interval_ms > 0 && opt.batch > 0 && opt.jitter >= 0 &&
+           opt.jitter < 1 && opt.duration_s > 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parseArgs(argc, argv, opt))
+    {
+        fprintf(stderr, "usage: see the comment at the top of tools/loadgen.cpp\n");
+        return 2;
+    }
+    if (opt.threads > opt.devices)
+        opt.threads = opt.devices;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    hostent *he = gethostbyname(opt.host.c_str());
+    if (!he || he->h_addrtype != AF_INET)
+    {
+        fprintf(stderr, "unknown host %s\n", opt.host.c_str());
+        return 2;
+    }
+    memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+
+    printf("%d devices on %d threads, one /update of %d record(s) per %.0f ms +-%.0f%%, %.0f s, %.1f%% faults\n",
+           opt.devices, opt.threads, opt.batch, opt.interval_ms, opt.jitter * 100, opt.duration_s, opt.fail * 100);
+    printf("offered load %.1f updates/s against %s:%d\n", opt.devices * 1000.0 / opt.interval_ms, opt.host.c_str(),
+           opt.port);
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point stop = start + std::chrono::microseconds((long long)(opt.duration_s * 1e6));
+    std::vector<Worker> workers(opt.threads);
+    for (int t = 0; t < opt.threads; t++)
+    {
+        Worker &w = workers[t];
+        w.opt = &opt;
+        w.addr = addr;
+        w.first = t;
+        w.rng.state = opt.seed * 2654435761u + t + 1;
+        w.start = start;
+        w.stop = stop;
+        w.thread = std::thread(WORKER_run, &w);
+    }
+
+    Stats reg, upd;
+    for (int t = 0; t < opt.threads; t++)
+    {
+        workers[t].thread.join();
+        reg.merge(workers[t].reg);
+        upd.merge(workers[t].upd);
+    }
+    double elapsed_s = std::chrono::duration<double>(stop - start).count();
+
+    report("/register", reg, elapsed_s);
+    report("/update", upd, elapsed_s);
+
+    // Non-zero when the server failed requests that were not broken on purpose,
+    // or accepted ones that were
+    uint64_t unexpected = upd.injected - upd.injected_rejected;
+    for (int i = OUT_REJECTED; i < OUT_COUNT; i++)
+        unexpected += reg.outcomes[i] + upd.outcomes[i];
+    unexpected -= upd.injected_rejected;
+    printf("unexpected errors: %llu\n", (unsigned long long)unexpected);
+    return unexpected ? 1 : 0;
+}
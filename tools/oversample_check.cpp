@@ -0,0 +1,120 @@
+// Host check of the sensor-v2 MQ2 oversampler (sensor-v2/include/Oversampler.h)
+// with synthetic input: an ideal 10-bit ADC model fed with a known voltage
+// plus Gaussian noise, driven through start()/add() as the ADC interrupt
+// does. Reports the effective resolution of single conversions against
+// decimated readings, and checks the block and discard handling.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-v2/include oversample_check.cpp -o oversample_check
+// Usage: oversample_check [readings]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+
+#include "Oversampler.h"
+
+static const int EXTRA_BITS = 4;    // As in sensor-v2/src/main.cpp
+static const int DISCARD = 2;
+typedef Oversampler<EXTRA_BITS> Mq2Oversampler;
+
+static std::mt19937 rng(1);
+
+// Ideal 10-bit ADC: rounds to the nearest code and clips to the range
+static uint16_t convert(double v) {
+  long code = lround(v);
+  return (uint16_t)(code < 0 ? 0 : code > 1023 ? 1023 : code);
+}
+
+// One decimated reading of voltage v (in LSB) with the given RMS noise
+static double readOversampled(Mq2Oversampler &os, double v, double noise) {
+  std::normal_distribution<double> n(0, noise);
+  os.start(DISCARD);
+  for (int i = 0; i < DISCARD; i++) {
+    os.add(0);  // Garbage the oversampler must drop
+  }
+  while (!os.add(convert(v + n(rng)))) {
+  }
+  return os.counts();
+}
+
+// Effective bits of a 10-bit full scale from an RMS error in LSB
+static double effectiveBits(double rms) {
+  return log2(1024.0 / (rms * sqrt(12.0)));
+}
+
+struct Errors {
+  double single_rms;
+  double oversampled_rms;
+  double oversampled_max;
+};
+
+static Errors measure(int readings, double noise) {
+  Mq2Oversampler os;
+  std::uniform_real_distribution<double> level(100, 900);
+  std::normal_distribution<double> n(0, noise);
+  double single_sq = 0, os_sq = 0, os_max = 0;
+  for (int i = 0; i < readings; i++) {
+    double v = level(rng);
+    double e1 = convert(v + n(rng)) - v;
+    double e2 = readOversampled(os, v, noise) - v;
+    single_sq += e1 * e1;
+    os_sq += e2 * e2;
+    os_max = fmax(os_max, fabs(e2));
+  }
+  Errors e = {sqrt(single_sq / readings), sqrt(os_sq / readings), os_max};
+  return e;
+}
+
+int main(int argc, char **argv) {
+  int readings = argc > 1 ? atoi(argv[1]) : 2000;
+  int failures = 0;
+
+  // Block handling: exactly CONVERSIONS samples after the discarded ones
+  Mq2Oversampler os;
+  os.start(DISCARD);
+  int adds = 0;
+  while (!os.add(adds < DISCARD ? 1023 : 512)) {
+    adds++;
+  }
+  adds++;
+  os.add(0);  // After the block: ignored
+  if (adds != DISCARD + Mq2Oversampler::CONVERSIONS || os.value() != (512 << EXTRA_BITS)) {
+    printf("FAIL: block of %d conversions, value %u\n", adds, os.value());
+    failures++;
+  }
+
+  // Full scale must not overflow the 16-bit value
+  os.start(0);
+  while (!os.add(1023)) {
+  }
+  if (os.value() != (1023 << EXTRA_BITS)) {
+    printf("FAIL: full scale reads %u\n", os.value());
+    failures++;
+  }
+
+  printf("%u conversions per reading, %d-bit output, %d readings per noise level\n",
+         Mq2Oversampler::CONVERSIONS, 10 + EXTRA_BITS, readings);
+  printf("noise LSB   single: rms LSB  bits   oversampled: rms LSB  bits  max LSB\n");
+  const double noises[] = {0.0, 0.3, 0.5, 1.0, 2.0};
+  for (size_t i = 0; i < sizeof(noises) / sizeof(noises[0]); i++) {
+    Errors e = measure(readings, noises[i]);
+    printf("%9.1f   %15.4f %5.2f   %20.4f %5.2f %8.4f\n", noises[i], e.single_rms, effectiveBits(e.single_rms),
+           e.oversampled_rms, effectiveBits(e.oversampled_rms), e.oversampled_max);
+
+    // With about 1 LSB of dither the readings must reach at least 12 bits
+    if (noises[i] >= 0.3 && noises[i] <= 1.0 && effectiveBits(e.oversampled_rms) < 12) {
+      printf("FAIL: %.2f effective bits at %.1f LSB noise\n", effectiveBits(e.oversampled_rms), noises[i]);
+      failures++;
+    }
+  }
+  printf("(without noise every conversion is the same code and oversampling gains nothing)\n");
+
+  if (failures) {
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,367 @@
+// Host check of server-driven rates (sensor-src-m5/include/RateControl.h).
+// Runs the m5 control loop on a simulated clock: the scheduler's sample
+// task, the gas channels, the averaging into records and the report
+// interval, with the same handoff as the firmware (responses are parsed on
+// the network side and applied between samples). Uploads go to a stub HTTP
+// server on localhost whose /update responses change the rates mid-run.
+//
+// Build: g++ -std=c++11 -O2 -pthread -I../sensor-src-m5/include -I../lib/GasMath rate_control_check.cpp -o rate_control_check
+// Usage: rate_control_check [--port 6768]
+//
+// Checks that each change takes effect from the next sample on: the sample
+// spacing, the samples per record, the spacing of uploads and the rolling
+// window (against a brute-force window over the ratios), and that values
+// out of bounds and cut-off numbers are ignored.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <HttpSession.h>
+#include <RateControl.h>
+#include <Scheduler.h>
+#include <SensorJson.h>
+#include <SensorPipeline.h>
+#include <SpscQueue.h>
+
+#include "PosixNet.h"
+
+// Control fields the stub server adds from the nth /update on; they stay
+// in every later response, like the per-device controls of app.py
+struct Phase
+{
+    int from_update;
+    const char *fields;
+};
+
+static const Phase PHASES[] = {
+    {4, "\"sample_period_ms\":2000,\"samples_to_average\":5"},
+    {8, "\"baseline_window\":20"},
+    {10, "\"report_interval_ms\":60000"},
+    {14, "\"sample_period_ms\":10"},                // Out of bounds
+    {15, "\"samples_to_average\":7.5"},             // Not an integer
+};
+static const size_t PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+static const int UPDATES = 18;
+
+static std::string stubResponse(int update)
+{
+    // A later phase replaces the value of a key set before
+    std::vector<std::string> fields;
+    for (size_t i = 0; i < PHASE_COUNT; i++)
+    {
+        if (update < PHASES[i].from_update)
+            continue;
+        std::string list = PHASES[i].fields;
+        for (size_t start = 0; start < list.size();)
+        {
+            size_t end = list.find(',', start);
+            end = end == std::string::npos ? list.size() : end;
+            std::string field = list.substr(start, end - start);
+            std::string key = field.substr(0, field.find(':'));
+            for (size_t j = 0; j < fields.size(); j++)
+            {
+                if (fields[j].compare(0, key.size() + 1, key + ":") == 0)
+                    fields.erase(fields.begin() + j--);
+            }
+            fields.push_back(field);
+            start = end + 1;
+        }
+    }
+    std::string body = "{\"message\":\"Data updated successfully\",\"stored\":1";
+    for (size_t i = 0; i < fields.size(); i++)
+        body += "," + fields[i];
+    return body + "}";
+}
+
+// Stub server: answers every request on keep-alive connections
+static void stubServer(int listener)
+{
+    int update = 0;
+    for (;;)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            return;
+        std::string in;
+        char buf[2048];
+        for (;;)
+        {
+            size_t head = in.find("\r\n\r\n");
+            if (head != std::string::npos)
+            {
+                size_t length = 0;
+                size_t cl = in.find("Content-Length:");
+                if (cl != std::string::npos && cl < head)
+                    length = strtoul(in.c_str() + cl + 15, NULL, 10);
+                if (in.size() >= head + 4 + length)
+                {
+                    bool is_update = in.compare(0, 12, "POST /update") == 0;
+                    in.erase(0, head + 4 + length);
+                    std::string body = is_update ? stubResponse(++update) : "{}";
+                    std::string resp = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                                       std::to_string(body.size()) + "\r\n\r\n" + body;
+                    send(fd, resp.data(), resp.size(), MSG_NOSIGNAL);
+                    continue;
+                }
+            }
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            in.append(buf, n);
+        }
+        close(fd);
+    }
+}
+
+// Simulated device clock
+static unsigned long sim_ms = 0;
+static unsigned long simClock() { return sim_ms; }
+
+static const uint16_t MAX_WINDOW = BASELINE_WINDOW_MAX;
+static const GasChannelConfig sim_gas[] = {{"mq2", &GAS_MODEL_MQ2, 0, GAS_RL_OHMS, 10.0f, BASELINE_WINDOW}};
+static GasChannelState<1, MAX_WINDOW> gas_state;
+static GasChannels<1, MAX_WINDOW> gas(sim_gas, 1, gas_state);
+
+static Scheduler<2> scheduler(simClock);
+static int sample_task = -1;
+static RateConfig rates = {1000, SAMPLES_TO_AVERAGE, 0, BASELINE_WINDOW};
+static RateConfig net_rates;
+static SpscQueue<RateConfig, 2> rate_queue;
+
+static AccumulatedData accumulated;
+static std::vector<SensorData> queue;
+static unsigned long last_report_ms = 0;
+
+// What the checks look at
+struct SampleLog
+{
+    unsigned long due;
+    RateConfig rates;   // In effect for this sample
+    float ratio;
+    float variance;
+    float baseline;
+};
+struct RecordLog
+{
+    unsigned long at;
+    int samples;
+    uint32_t expected;
+};
+static std::vector<SampleLog> samples;
+static std::vector<RecordLog> records;
+static std::vector<unsigned long> uploads;
+static int rejected_fields = 0;
+
+// Network side, as RATE_receive() in the firmware
+static void receiveRates(const char *resp)
+{
+    uint8_t rejected;
+    uint8_t changed = RATE_parse(resp, net_rates, MAX_WINDOW, rejected);
+    if (rejected)
+    {
+        rejected_fields |= rejected;
+        printf("%8lu ms  ignored fields 0x%02x\n", sim_ms, rejected);
+    }
+    if (changed)
+    {
+        printf("%8lu ms  server sets sample %u ms, %u per record, report %u ms, window %u\n", sim_ms,
+               net_rates.sample_period_ms, net_rates.samples_to_average, net_rates.report_interval_ms,
+               net_rates.baseline_window);
+        rate_queue.push(net_rates);
+    }
+}
+
+// Sampling side, as RATE_apply() in the firmware
+static void applyRates()
+{
+    RateConfig next;
+    bool changed = false;
+    while (rate_queue.pop(next))
+        changed = true;
+    if (!changed)
+        return;
+    if (next.sample_period_ms != rates.sample_period_ms)
+        scheduler.setPeriod(sample_task, next.sample_period_ms);
+    if (next.baseline_window != rates.baseline_window)
+        gas.setWindow((uint16_t)next.baseline_window);
+    rates = next;
+}
+
+static void sampleTask(unsigned long due)
+{
+    applyRates();
+
+    // A slow square wave plus a ramp, so the window minimum and variance move
+    float mv = 600 + 200 * ((due / 7000) % 2) + (due % 13000) / 50.0f;
+    gas.add(&mv);
+    gas.sample();
+    SensorData reading = SensorData();
+    reading.timestamp = due;
+    gas.store(reading);
+    SampleLog s = {due, rates, reading.mq2_ratio, reading.mq2_variance, reading.mq2_baseline};
+    samples.push_back(s);
+
+    ACC_add(accumulated, reading);
+    if (accumulated.count >= rates.samples_to_average)
+    {
+        SensorData record = SensorData();
+        ACC_average(accumulated, record);
+        record.timestamp = due;
+        queue.push_back(record);
+        RecordLog r = {due, (int)accumulated.count, rates.samples_to_average};
+        records.push_back(r);
+        ACC_reset(accumulated);
+    }
+}
+
+static const DeviceIdentity device = {"rate_check", "host", "plant_000", "unknown"};
+static char payload[64 * SENSOR_JSON_MAX_LEN + 2];
+
+static bool upload(HttpSession<PosixNet> &http)
+{
+    JsonWriter json(payload, sizeof(payload));
+    json.beginArray();
+    for (size_t i = 0; i < queue.size() && i < 64; i++)
+        JSON_writeSensorData(json, device, queue[i]);
+    json.endArray();
+
+    char resp[256];
+    int code = http.post("/update", "application/json", (const uint8_t *)payload, json.length(), resp, sizeof(resp));
+    if (code != 200)
+    {
+        printf("FAIL: /update returned %d\n", code);
+        return false;
+    }
+    queue.clear();
+    last_report_ms = sim_ms;
+    uploads.push_back(sim_ms);
+    receiveRates(resp);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 6768;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+    }
+
+    int listener = POSIX_listen(port);
+    if (listener < 0)
+    {
+        fprintf(stderr, "cannot listen on port %d\n", port);
+        return 2;
+    }
+    std::thread(stubServer, listener).detach();
+
+    PosixNet net;
+    HttpSession<PosixNet>::Config config = {"127.0.0.1", (uint16_t)port, 600000, 2000, 2000, 1000, 1000};
+    HttpSession<PosixNet> http(net, config);
+
+    gas.reset();
+    gas.setR0(0, 10.0f);
+    net_rates = rates;
+    sample_task = scheduler.every(rates.sample_period_ms, sampleTask, rates.sample_period_ms);
+
+    // The network side runs after every sample; it uploads once a report is due
+    while ((int)uploads.size() < UPDATES && sim_ms < 24 * 3600000UL)
+    {
+        sim_ms += scheduler.untilNext(60000);
+        size_t before = records.size();
+        scheduler.runDue();
+        bool due = net_rates.report_interval_ms == 0 || sim_ms - last_report_ms >= net_rates.report_interval_ms;
+        if (records.size() > before && due && !upload(http))
+            return 1;
+    }
+    http.close();
+
+    int failures = 0;
+
+    // Sample spacing follows the period in effect for the later sample
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        unsigned long gap = samples[i].due - samples[i - 1].due;
+        if (gap != samples[i - 1].rates.sample_period_ms && gap != samples[i].rates.sample_period_ms)
+        {
+            printf("FAIL: samples %zu..%zu are %lu ms apart\n", i - 1, i, gap);
+            failures++;
+            break;
+        }
+    }
+
+    // Every record closes at the count in effect; one that was started
+    // under a longer count closes at the first sample of the new one
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        bool changed = i > 0 && records[i - 1].expected != records[i].expected;
+        if (changed ? records[i].samples < (int)records[i].expected : records[i].samples != (int)records[i].expected)
+        {
+            printf("FAIL: record %zu has %d samples, expected %u\n", i, records[i].samples, records[i].expected);
+            failures++;
+        }
+    }
+
+    // Uploads keep the report interval from the response that set it on
+    for (size_t i = PHASES[2].from_update; i < uploads.size(); i++)
+    {
+        if (uploads[i] - uploads[i - 1] < 60000)
+        {
+            printf("FAIL: uploads %zu and %zu are %lu ms apart\n", i - 1, i, uploads[i] - uploads[i - 1]);
+            failures++;
+        }
+    }
+
+    // Rolling window against brute force over the ratios, any window length
+    size_t window_checked = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        uint32_t w = samples[i].rates.baseline_window;
+        size_t first = i + 1 >= w ? i + 1 - w : 0;
+        double mean = 0, var = 0;
+        float minimum = samples[first].ratio;
+        for (size_t j = first; j <= i; j++)
+        {
+            mean += samples[j].ratio;
+            minimum = samples[j].ratio < minimum ? samples[j].ratio : minimum;
+        }
+        mean /= i + 1 - first;
+        for (size_t j = first; j <= i; j++)
+            var += (samples[j].ratio - mean) * (samples[j].ratio - mean);
+        var /= i + 1 - first;
+        if (samples[i].baseline != minimum || fabs(samples[i].variance - var) > 1e-6 + 1e-4 * var)
+        {
+            printf("FAIL: sample %zu (window %u): baseline %g (%g), variance %g (%g)\n", i, w,
+                   samples[i].baseline, minimum, samples[i].variance, var);
+            failures++;
+            break;
+        }
+        window_checked += w != BASELINE_WINDOW;
+    }
+
+    // Bad values are reported and change nothing
+    if (rejected_fields != (RATE_SAMPLE_PERIOD | RATE_SAMPLES_TO_AVERAGE) || rates.sample_period_ms != 2000 ||
+        rates.samples_to_average != 5)
+    {
+        printf("FAIL: rejected 0x%02x, rates %u ms / %u per record after bad values\n", rejected_fields,
+               rates.sample_period_ms, rates.samples_to_average);
+        failures++;
+    }
+
+    printf("%zu samples, %zu records, %zu uploads over %.1f simulated minutes; %zu samples with a resized window\n",
+           samples.size(), records.size(), uploads.size(), sim_ms / 60000.0, window_checked);
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
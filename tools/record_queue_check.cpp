@@ -0,0 +1,575 @@
+// Host check of the store-and-forward queue (sensor-src-m5/include/RecordQueue.h).
+// Runs RecordQueue over a POSIX file with the contract of LittleFSStorage
+// (reads past the end fail) and checks it against an in-memory model:
+// push/peek/pop across wraparound, overwrite of the oldest record when full,
+// reopening the file as after a reset, and recovery after a power cut at
+// every byte of every write a push or pop makes. The drain then sends the
+// queue to a stub /update server in batches, as API_update() in the
+// firmware, while the server fails some requests and a power cut hits a pop.
+//
+// Build: g++ -std=c++11 -O2 -pthread -I../sensor-src-m5/include -I../lib/GasMath record_queue_check.cpp -o record_queue_check
+// Usage: record_queue_check [--port 6769] [--file /tmp/record_queue_check.q]
+//
+// A power cut may lose the push or pop in progress but nothing before it;
+// after a cut in a pop the batch is sent again, never lost.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <HttpSession.h>
+#include <RecordQueue.h>
+#include <SensorJson.h>
+
+#include "PosixNet.h"
+
+static const uint32_t CAPACITY = 8;     // Small, so the tests wrap often
+typedef RecordQueue<SensorData, CAPACITY> Queue;
+
+// RecordStorage on a host file, with the LittleFSStorage contract
+class FileStorage : public RecordStorage
+{
+public:
+    explicit FileStorage(const char *path) : fd(open(path, O_RDWR | O_CREAT, 0644)) {}
+    ~FileStorage()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool read(uint32_t offset, void *buf, size_t len) override
+    {
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || offset + len > (size_t)st.st_size)
+            return false;
+        return pread(fd, buf, len, offset) == (ssize_t)len;
+    }
+
+    bool write(uint32_t offset, const void *buf, size_t len) override
+    {
+        return fd >= 0 && pwrite(fd, buf, len, offset) == (ssize_t)len;
+    }
+
+    bool flush() override
+    {
+        return fd >= 0;     // A power cut is simulated below, the page cache is as good as the disk
+    }
+
+private:
+    int fd;
+};
+
+/**
+ * Passes writes through until budget bytes have been written, then cuts the
+ * power: the write in progress keeps the bytes before the cut and nothing
+ * after it reaches the store. budget < 0 never cuts.
+ */
+class PowerCutStorage : public RecordStorage
+{
+public:
+    PowerCutStorage(RecordStorage &store, long budget) : store(store), budget(budget), written(0), cut(false) {}
+
+    bool read(uint32_t offset, void *buf, size_t len) override
+    {
+        return !cut && store.read(offset, buf, len);
+    }
+
+    bool write(uint32_t offset, const void *buf, size_t len) override
+    {
+        if (cut)
+            return false;
+        if (budget >= 0 && written + (long)len > budget)
+        {
+            cut = true;
+            if (budget > written)
+                store.write(offset, buf, budget - written);
+            return false;
+        }
+        written += len;
+        return store.write(offset, buf, len);
+    }
+
+    bool flush() override
+    {
+        return !cut && store.flush();
+    }
+
+    RecordStorage &store;
+    long budget;
+    long written;
+    bool cut;
+};
+
+// Every field of record n is distinct, so a torn record does not pass for another
+static SensorData makeRecord(uint32_t n)
+{
+    SensorData r;
+    memset(&r, 0, sizeof(r));
+    float *fields = (float *)&r;
+    for (size_t i = 0; i < offsetof(SensorData, timestamp) / sizeof(float); i++)
+        fields[i] = n + i / 64.0f;
+    r.timestamp = n;
+    return r;
+}
+
+struct Model
+{
+    std::deque<uint32_t> records;
+    uint32_t dropped;
+};
+
+/** Whether the queue holds exactly the model's records; prints the first difference */
+static bool matches(Queue &queue, const Model &model, const char *what)
+{
+    if (queue.size() != model.records.size() || queue.dropped() != model.dropped)
+    {
+        printf("FAIL: %s: %u records, %u dropped; expected %zu, %u\n", what, queue.size(), queue.dropped(),
+               model.records.size(), model.dropped);
+        return false;
+    }
+    for (uint32_t i = 0; i < queue.size(); i++)
+    {
+        SensorData r, expect = makeRecord(model.records[i]);
+        if (!queue.peek(i, r) || memcmp(&r, &expect, sizeof(r)) != 0)
+        {
+            printf("FAIL: %s: record %u is not %u\n", what, i, model.records[i]);
+            return false;
+        }
+    }
+    SensorData r;
+    if (queue.peek(queue.size(), r))
+    {
+        printf("FAIL: %s: peek past the end succeeded\n", what);
+        return false;
+    }
+    return true;
+}
+
+static void pushModel(Model &model, uint32_t n)
+{
+    if (model.records.size() == CAPACITY)
+    {
+        model.records.pop_front();
+        model.dropped++;
+    }
+    model.records.push_back(n);
+}
+
+static void popModel(Model &model, uint32_t n)
+{
+    for (uint32_t i = 0; i < n && !model.records.empty(); i++)
+        model.records.pop_front();
+}
+
+// Random pushes and pops against the model, reopening the file now and then
+static int checkOperations(const char *path)
+{
+    unlink(path);
+    std::mt19937 rng(7);
+    Model model = {std::deque<uint32_t>(), 0};
+    uint32_t next = 0;
+    FileStorage *store = new FileStorage(path);
+    Queue *queue = new Queue(*store);
+    if (!queue->begin() || !matches(*queue, model, "new file"))
+        return 1;
+
+    int failures = 0;
+    uint32_t wraps = 0, overwrites = 0, reopens = 0;
+    for (int op = 0; op < 5000 && failures < 5; op++)
+    {
+        uint32_t r = rng() % 100;
+        if (r < 55)
+        {
+            uint32_t before = queue->dropped();
+            if (!queue->push(makeRecord(next)))
+            {
+                printf("FAIL: push %u failed\n", next);
+                failures++;
+            }
+            pushModel(model, next++);
+            overwrites += queue->dropped() - before;
+            wraps += next % CAPACITY == 0;
+        }
+        else if (r < 90)
+        {
+            uint32_t n = rng() % (CAPACITY + 2);   // Sometimes more than are queued
+            queue->pop(n);
+            popModel(model, n);
+        }
+        else
+        {
+            // Reset: the RAM state is gone, the file is what is left
+            delete queue;
+            delete store;
+            store = new FileStorage(path);
+            queue = new Queue(*store);
+            queue->begin();
+            reopens++;
+        }
+        char what[48];
+        snprintf(what, sizeof(what), "operation %d", op);
+        failures += !matches(*queue, model, what);
+    }
+    delete queue;
+    delete store;
+    printf("operations: 5000, %u wraps of the ring, %u overwrites when full, %u reopens\n", wraps, overwrites,
+           reopens);
+
+    // A store of another layout is formatted, not misread
+    {
+        FileStorage other(path);
+        RecordQueue<SensorData, CAPACITY + 1> bigger(other);
+        if (!bigger.begin() || bigger.size() != 0 || bigger.dropped() != 0)
+        {
+            printf("FAIL: a queue of another capacity was not formatted\n");
+            failures++;
+        }
+    }
+    return failures;
+}
+
+enum Operation
+{
+    OP_PUSH,
+    OP_POP
+};
+
+/**
+ * From every state of a scripted run (empty, partly full, full and
+ * wrapped), cuts the power at each byte of the next push or pop and
+ * reopens: the queue must be the state before or after the operation (or,
+ * for a push into a full queue, the state with only the oldest record
+ * dropped), and a push after it must work.
+ */
+static int checkPowerCuts(const char *path)
+{
+    // Fill past capacity, drain some, fill again: every kind of state
+    std::vector<Operation> script;
+    std::vector<uint32_t> pops;
+    for (uint32_t i = 0; i < CAPACITY + 3; i++)
+        script.push_back(OP_PUSH);
+    script.push_back(OP_POP);
+    script.push_back(OP_POP);
+    for (uint32_t i = 0; i < CAPACITY; i++)
+        script.push_back(OP_PUSH);
+    script.push_back(OP_POP);
+
+    int failures = 0;
+    long cuts = 0;
+    for (size_t step = 0; step < script.size() && failures < 5; step++)
+    {
+        // Replay the script up to the step on a fresh file
+        unlink(path);
+        Model model = {std::deque<uint32_t>(), 0};
+        uint32_t next = 0;
+        {
+            FileStorage store(path);
+            Queue queue(store);
+            queue.begin();
+            for (size_t s = 0; s < step; s++)
+            {
+                if (script[s] == OP_PUSH)
+                {
+                    queue.push(makeRecord(next));
+                    pushModel(model, next++);
+                }
+                else
+                {
+                    queue.pop(3);
+                    popModel(model, 3);
+                }
+            }
+        }
+        std::vector<Model> states(1, model);
+        states.push_back(model);
+        if (script[step] == OP_PUSH)
+            pushModel(states[1], next);
+        else
+            popModel(states[1], 3);
+        if (script[step] == OP_PUSH && model.records.size() == CAPACITY)
+        {
+            states.push_back(model);
+            states[2].records.pop_front();
+            states[2].dropped++;
+        }
+
+        std::string image;
+        {
+            FILE *f = fopen(path, "rb");
+            char buf[4096];
+            size_t n;
+            while (f && (n = fread(buf, 1, sizeof(buf), f)) > 0)
+                image.append(buf, n);
+            if (f)
+                fclose(f);
+        }
+
+        // Cut after each byte of the operation's writes, until it completes
+        for (long budget = 0; failures < 5; budget++)
+        {
+            FILE *f = fopen(path, "wb");
+            fwrite(image.data(), 1, image.size(), f);
+            fclose(f);
+
+            bool done;
+            {
+                FileStorage file(path);
+                PowerCutStorage cut(file, budget);
+                Queue queue(cut);
+                queue.begin();
+                done = script[step] == OP_PUSH ? queue.push(makeRecord(next)) : queue.pop(3);
+                done = done && !cut.cut;
+            }
+            cuts++;
+
+            FileStorage file(path);
+            Queue queue(file);
+            queue.begin();
+            size_t state = done ? 1 : 0;
+            while (!done && state < states.size() &&
+                   (queue.size() != states[state].records.size() || queue.dropped() != states[state].dropped))
+                state++;
+            const Model &expect = states[state < states.size() ? state : 1];
+            char what[64];
+            snprintf(what, sizeof(what), "cut at byte %ld of %s %zu", budget,
+                     script[step] == OP_PUSH ? "push" : "pop", step);
+            if (!matches(queue, expect, what))
+            {
+                failures++;
+                continue;
+            }
+            Model later = expect;
+            pushModel(later, 1000);
+            if (!queue.push(makeRecord(1000)) || !matches(queue, later, what))
+                failures++;
+            if (done)
+                break;
+        }
+    }
+    printf("power cuts: %ld, at every byte of %zu pushes and pops\n", cuts, script.size());
+    return failures;
+}
+
+// Drain, as API_update() in the firmware (main.cpp)
+static const int MAX_BATCH = 20;
+static const int MAX_BATCHES_PER_DRAIN = 5;
+static const DeviceIdentity device = {"queue_check", "host", "plant_000", "unknown"};
+static char payload[MAX_BATCH * SENSOR_JSON_MAX_LEN + 2];
+
+/** Returns the number of records sent, or -1 when the drain stopped on a failure */
+template <typename Q>
+static int drain(Q &queue, HttpSession<PosixNet> &http)
+{
+    int sent = 0;
+    for (int n = 0; n < MAX_BATCHES_PER_DRAIN && !queue.empty(); n++)
+    {
+        int batch = 0;
+        JsonWriter json(payload, sizeof(payload));
+        json.beginArray();
+        SensorData record;
+        while (batch < MAX_BATCH && queue.peek(batch, record))
+        {
+            JSON_writeSensorData(json, device, record);
+            batch++;
+        }
+        json.endArray();
+        if (batch == 0 || !json.ok())
+            return -1;
+
+        char resp[256];
+        int code = http.post("/update", "application/json", (const uint8_t *)payload, json.length(), resp,
+                             sizeof(resp));
+        if (code != 200)
+            return -1;
+        queue.pop(batch);
+        sent += batch;
+    }
+    return sent;
+}
+
+// Stub /update: stores the timestamps of the records it accepts. Every 4th
+// request gets a 500 and every 7th has its connection dropped unanswered;
+// neither stores anything.
+static std::mutex stored_lock;
+static std::vector<unsigned long> stored;
+static int requests = 0;
+
+static void stubServer(int listener)
+{
+    for (;;)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            return;
+        std::string in;
+        char buf[4096];
+        bool open = true;
+        while (open)
+        {
+            size_t head = in.find("\r\n\r\n");
+            if (head != std::string::npos)
+            {
+                size_t length = 0;
+                size_t cl = in.find("Content-Length:");
+                if (cl != std::string::npos && cl < head)
+                    length = strtoul(in.c_str() + cl + 15, NULL, 10);
+                if (in.size() >= head + 4 + length)
+                {
+                    std::string body = in.substr(head + 4, length);
+                    in.erase(0, head + 4 + length);
+                    std::lock_guard<std::mutex> guard(stored_lock);
+                    int n = ++requests;
+                    if (n % 7 == 0)
+                        break;
+                    int code = n % 4 == 0 ? 500 : 200;
+                    if (code == 200)
+                    {
+                        for (size_t at = body.find("\"timestamp\":"); at != std::string::npos;
+                             at = body.find("\"timestamp\":", at + 1))
+                            stored.push_back(strtoul(body.c_str() + at + 12, NULL, 10));
+                    }
+                    std::string reply = code == 200 ? "{\"message\":\"Data updated successfully\"}" : "{}";
+                    std::string resp = std::string(code == 200 ? "HTTP/1.1 200 OK" : "HTTP/1.1 500 Error") +
+                                       "\r\nContent-Type: application/json\r\nContent-Length: " +
+                                       std::to_string(reply.size()) + "\r\n\r\n" + reply;
+                    send(fd, resp.data(), resp.size(), MSG_NOSIGNAL);
+                    continue;
+                }
+            }
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            open = n > 0;
+            if (open)
+                in.append(buf, n);
+        }
+        close(fd);
+    }
+}
+
+// Queues records while the link is down, then drains to the stub server
+static int checkDrain(const char *path, int port)
+{
+    static const uint32_t QUEUED = 137;     // Not a multiple of the batch
+    typedef RecordQueue<SensorData, 256> DrainQueue;
+
+    int listener = POSIX_listen(port);
+    if (listener < 0)
+    {
+        fprintf(stderr, "cannot listen on port %d\n", port);
+        return 1;
+    }
+    std::thread(stubServer, listener).detach();
+
+    unlink(path);
+    {
+        FileStorage store(path);
+        DrainQueue queue(store);
+        queue.begin();
+        for (uint32_t i = 0; i < QUEUED; i++)
+            queue.push(makeRecord(i));
+    }
+
+    PosixNet net;
+    HttpSession<PosixNet>::Config config = {"127.0.0.1", (uint16_t)port, 600000, 2000, 2000, 1, 8};
+    HttpSession<PosixNet> http(net, config);
+    int failures = 0, drains = 0, failed = 0;
+    bool power_cut = false;
+    for (;;)
+    {
+        // A reset before every drain, as after deep sleep; one pop is cut by a power loss
+        FileStorage file(path);
+        PowerCutStorage store(file, -1);
+        DrainQueue queue(store);
+        queue.begin();
+        if (queue.empty())
+            break;
+        if (++drains > 100)
+        {
+            printf("FAIL: the queue did not drain, %u records left\n", queue.size());
+            return failures + 1;
+        }
+        size_t before;
+        {
+            std::lock_guard<std::mutex> guard(stored_lock);
+            before = stored.size();
+        }
+        if (!power_cut && before >= 60)
+            store.budget = 14;  // Inside the header write of the pop that follows the next 200
+        failed += drain(queue, http) < 0;
+        power_cut = power_cut || store.cut;
+        usleep(10000);     // Past the backoff of a dropped connection
+    }
+    http.close();
+
+    // Every record in order; only the batch whose pop was cut arrives twice
+    std::vector<unsigned long> got;
+    int sent_requests;
+    {
+        std::lock_guard<std::mutex> guard(stored_lock);
+        got = stored;
+        sent_requests = requests;
+    }
+    std::vector<unsigned long> unique;
+    size_t resent = 0;
+    for (size_t i = 0; i < got.size(); i++)
+    {
+        if (!unique.empty() && got[i] <= unique.back())
+            resent++;
+        else
+            unique.push_back(got[i]);
+    }
+    bool in_order = unique.size() == QUEUED;
+    for (size_t i = 0; in_order && i < unique.size(); i++)
+        in_order = unique[i] == i;
+    if (!in_order)
+    {
+        printf("FAIL: the server has %zu distinct records, expected 0..%u in order\n", unique.size(), QUEUED - 1);
+        failures++;
+    }
+    if (resent > (size_t)MAX_BATCH)
+    {
+        printf("FAIL: %zu records were sent twice, more than the batch whose pop was cut\n", resent);
+        failures++;
+    }
+    printf("drain: %u records in %d drains, %d requests (%d failed), %zu resent after the cut pop\n", QUEUED,
+           drains, sent_requests, failed, resent);
+    if (!power_cut)
+    {
+        printf("FAIL: no pop was cut\n");
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 6769;
+    const char *path = "/tmp/record_queue_check.q";
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--file") && i + 1 < argc)
+            path = argv[++i];
+    }
+
+    int failures = checkOperations(path);
+    failures += checkPowerCuts(path);
+    failures += checkDrain(path, port);
+    unlink(path);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+// Host check and benchmark of the rolling statistics of the gas channels
+// (Welford add/evict and the monotonic-deque minimum in
+// sensor-src-m5/include/GasChannels.h). Every sample's mean, variance and
+// minimum are compared with a two-pass double reference over the same
+// window, for random, large-offset, monotonic, constant and spiky streams,
+// with windows from 1 to the ring size and a window change mid-stream. The
+// benchmark times a sample against the two-pass scan it replaced for
+// growing windows.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include -I../lib/GasMath rolling_stats_bench.cpp -o rolling_stats_bench
+// Usage: rolling_stats_bench [samples]
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "GasChannels.h"
+
+static const size_t KINDS = 6;
+static const size_t WINDOW = 120;       // BASELINE_WINDOW_MAX in SensorPipeline.h
+typedef GasChannels<KINDS, WINDOW> Registry;
+
+static const char *const KIND_NAMES[KINDS] = {"random", "large offset", "rising", "falling", "constant", "spikes"};
+static const char *const KEYS[KINDS] = {"k0", "k1", "k2", "k3", "k4", "k5"};
+
+// Keeps the optimizer from dropping the loops
+static volatile float sink_f;
+
+/** Load-resistor voltage in mV that gives Rs (K ohms) on rl_ohms */
+static float millivolts(double rs_kohm, uint32_t rl_ohms)
+{
+    return (float)(VCC * 1000 * rl_ohms / (rs_kohm * 1000 + rl_ohms));
+}
+
+// One stream per kind, as Rs in K ohms: [s * KINDS + k]
+static std::vector<double> makeStreams(size_t samples, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0, 1);
+    std::uniform_real_distribution<double> u(0, 1);
+    std::vector<double> rs(samples * KINDS);
+    double walk = 10;
+    for (size_t s = 0; s < samples; s++)
+    {
+        walk += 0.05 * noise(rng) + (10 - walk) * 0.01;
+        if (u(rng) < 0.01)
+            walk *= 0.3 + 0.5 * u(rng);  // Gas event
+        double *r = &rs[s * KINDS];
+        r[0] = walk;
+        r[1] = 50 + 0.02 * noise(rng);              // Ratio ~5e4 with a variance of a few hundred
+        r[2] = 2 + 8.0 * (s % 1000) / 1000;         // Deque fills to the whole window
+        r[3] = 10 - 8.0 * (s % 1000) / 1000;        // Deque holds one entry
+        r[4] = 12.5;
+        r[5] = s % 37 == 0 ? 5 : s % 500 < 250 ? 20 : 40;  // Isolated minima that must expire on time
+    }
+    return rs;
+}
+
+struct Reference
+{
+    double mean;
+    double variance;
+    float minimum;
+    double floor;       // Square of one float ulp of the largest |x|: any spread below it is zero
+};
+
+// Two passes over the last w ratios, in double
+static Reference twoPass(const std::vector<float> &ratios, size_t k, size_t s, size_t w)
+{
+    size_t first = s + 1 >= w ? s + 1 - w : 0;
+    size_t count = s + 1 - first;
+    Reference r = {0, 0, ratios[first * KINDS + k], 0};
+    for (size_t i = first; i <= s; i++)
+    {
+        float x = ratios[i * KINDS + k];
+        r.mean += x;
+        r.minimum = x < r.minimum ? x : r.minimum;
+        r.floor = fmax(r.floor, (double)FLT_EPSILON * FLT_EPSILON * x * x);
+    }
+    r.mean /= count;
+    for (size_t i = first; i <= s; i++)
+    {
+        double d = ratios[i * KINDS + k] - r.mean;
+        r.variance += d * d;
+    }
+    r.variance /= count;
+    return r;
+}
+
+struct Worst
+{
+    double mean;        // Relative to |mean|
+    double variance;    // Relative, where the variance is well above its floor
+    size_t minimum_misses;
+};
+
+/**
+ * Runs every stream through a registry with the given window, switching to
+ * window2 halfway (0 keeps it), and checks every sample. The ratios pushed
+ * are left in ratios, [s * KINDS + k]. Returns failures.
+ */
+static int check(const std::vector<double> &rs, size_t samples, uint16_t window, uint16_t window2, Worst *worst,
+                 std::vector<float> &ratios)
+{
+    GasChannelConfig config[KINDS];
+    for (size_t k = 0; k < KINDS; k++)
+    {
+        config[k].key = KEYS[k];
+        config[k].model = &GAS_MODEL_MQ2;
+        config[k].pin = 0;
+        config[k].rl_ohms = GAS_RL_OHMS;
+        config[k].r0 = k == 1 ? 0.001f : 1.0f;
+        config[k].window = window;
+    }
+    static Registry::State state;
+    Registry gas(config, KINDS, state);
+    gas.reset();
+
+    ratios.assign(samples * KINDS, 0);
+    uint16_t w = window;
+    int failures = 0;
+    for (size_t s = 0; s < samples; s++)
+    {
+        if (window2 && s == samples / 2)
+        {
+            gas.setWindow(window2);
+            w = window2;
+        }
+        float mv[KINDS];
+        for (size_t k = 0; k < KINDS; k++)
+            mv[k] = millivolts(rs[s * KINDS + k], GAS_RL_OHMS);
+        gas.add(mv);
+        gas.sample();
+
+        for (size_t k = 0; k < KINDS; k++)
+        {
+            ratios[s * KINDS + k] = state.ratio[k];
+            Reference ref = twoPass(ratios, k, s, w);
+            double mean_err = fabs(state.mean[k] - ref.mean) / fmax(fabs(ref.mean), 1e-30);
+            double var_err = fabs(state.variance[k] - ref.variance);
+            worst[k].mean = fmax(worst[k].mean, mean_err);
+            if (ref.variance > 1000 * ref.floor)
+                worst[k].variance = fmax(worst[k].variance, var_err / ref.variance);
+            if (state.baseline[k] != ref.minimum)
+                worst[k].minimum_misses++;
+            bool ok = state.baseline[k] == ref.minimum && mean_err < 1e-9 &&
+                      var_err <= 1e-5 * ref.variance + ref.floor &&
+                      state.variance[k] >= 0 && (k != 4 || state.variance[k] == 0);
+            if (!ok && failures++ < 5)
+            {
+                printf("FAIL: %s, window %u->%u, sample %zu: mean %.9g (%.9g), variance %.9g (%.9g), "
+                       "minimum %.9g (%.9g)\n",
+                       KIND_NAMES[k], window, window2, s, state.mean[k], ref.mean, state.variance[k],
+                       ref.variance, state.baseline[k], ref.minimum);
+            }
+        }
+    }
+    return failures;
+}
+
+// The scan the Welford update replaced: the whole window, twice, per sample
+template <size_t N>
+struct TwoPassWindow
+{
+    float values[N];
+    size_t index;
+    bool full;
+
+    void push(float x, float &minimum, float &variance)
+    {
+        values[index] = x;
+        index = (index + 1) % N;
+        if (index == 0)
+            full = true;
+        size_t count = full ? N : index;
+        float min_x = values[0];
+        float sum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            min_x = values[i] < min_x ? values[i] : min_x;
+            sum += values[i];
+        }
+        float mean = sum / count;
+        float var_sum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            float d = values[i] - mean;
+            var_sum += d * d;
+        }
+        minimum = min_x;
+        variance = var_sum / count;
+    }
+};
+
+template <size_t N>
+static double timeTwoPass(const std::vector<float> &ratios)
+{
+    static TwoPassWindow<N> window;
+    window = TwoPassWindow<N>();
+    float minimum = 0, variance = 0, acc = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ratios.size(); i++)
+    {
+        window.push(ratios[i], minimum, variance);
+        acc += minimum + variance;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    sink_f = acc;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ratios.size();
+}
+
+// A whole sample of one channel: Rs, ratio, ppm and the rolling statistics
+template <size_t N>
+static double timeChannels(const std::vector<float> &mv)
+{
+    GasChannelConfig config = {"mq2", &GAS_MODEL_MQ2, 0, GAS_RL_OHMS, 10.0f, (uint16_t)N};
+    static GasChannelState<1, N> state;
+    GasChannels<1, N> gas(&config, 1, state);
+    gas.reset();
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < mv.size(); i++)
+    {
+        gas.add(&mv[i]);
+        gas.sample();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    sink_f = state.variance[0] + state.baseline[0];
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / mv.size();
+}
+
+// Variance error of the old float scan on the large-offset stream
+template <size_t N>
+static double twoPassError(const std::vector<float> &ratios)
+{
+    static TwoPassWindow<N> window;
+    window = TwoPassWindow<N>();
+    double worst = 0;
+    for (size_t s = 0; s < ratios.size() / KINDS; s++)
+    {
+        float minimum, variance;
+        window.push(ratios[s * KINDS + 1], minimum, variance);
+        Reference ref = twoPass(ratios, 1, s, N);
+        if (ref.variance > 1000 * ref.floor)
+            worst = fmax(worst, fabs(variance - ref.variance) / ref.variance);
+    }
+    return worst;
+}
+
+/** Prints the cost of a sample with both at window N; returns the GasChannels one */
+template <size_t N>
+static double benchWindow(const std::vector<float> &mv, const std::vector<float> &ratios)
+{
+    double old_ns = INFINITY, new_ns = INFINITY;
+    for (int r = 0; r < 5; r++)
+    {
+        old_ns = fmin(old_ns, timeTwoPass<N>(ratios));
+        new_ns = fmin(new_ns, timeChannels<N>(mv));
+    }
+    printf("%6zu %14.1f %16.1f\n", N, old_ns, new_ns);
+    return new_ns;
+}
+
+int main(int argc, char **argv)
+{
+    size_t samples = argc > 1 ? (size_t)atol(argv[1]) : 20000;
+    int failures = 0;
+    std::vector<double> rs = makeStreams(samples, 1);
+
+    // Every sample against the reference, across eviction and window changes
+    static const uint16_t WINDOWS[][2] = {{1, 0}, {2, 0}, {7, 0}, {50, 0}, {WINDOW, 0}, {50, WINDOW}, {WINDOW, 7}};
+    Worst worst[KINDS] = {};
+    std::vector<float> ratios, window50;
+    for (size_t i = 0; i < sizeof(WINDOWS) / sizeof(WINDOWS[0]); i++)
+    {
+        failures += check(rs, samples, WINDOWS[i][0], WINDOWS[i][1], worst, ratios);
+        if (WINDOWS[i][0] == 50 && WINDOWS[i][1] == 0)
+            window50 = ratios;
+    }
+    printf("stream          mean rel err   variance rel err   minimum misses\n");
+    for (size_t k = 0; k < KINDS; k++)
+        printf("%-14s %13.2g %18.2g   %zu\n", KIND_NAMES[k], worst[k].mean, worst[k].variance, worst[k].minimum_misses);
+
+    // The old float scan on the same large-offset stream, for comparison
+    printf("large offset, window 50: old float two-pass variance rel err %.2g\n", twoPassError<50>(window50));
+
+    // Cost per sample against the window length
+    std::vector<float> mv(samples), stream(samples);
+    for (size_t s = 0; s < samples; s++)
+    {
+        mv[s] = millivolts(rs[s * KINDS], GAS_RL_OHMS);
+        stream[s] = window50[s * KINDS];
+    }
+    printf("window  two-pass ns  GasChannels ns (whole sample)\n");
+    double at50 = benchWindow<50>(mv, stream);
+    benchWindow<120>(mv, stream);
+    benchWindow<500>(mv, stream);
+    double at2000 = benchWindow<2000>(mv, stream);
+    if (at2000 > 2 * at50)
+    {
+        printf("FAIL: a sample costs %.1f ns at window 2000 and %.1f ns at 50; it should not grow\n", at2000,
+               at50);
+        failures++;
+    }
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,250 @@
+// Host check of the deadline scheduler (sensor-src-m5/include/Scheduler.h)
+// on an injected clock. Checks that releases stay on the fixed grid over
+// many periods of random lateness, that an overrun skips the missed
+// releases instead of running them back to back, that deadlines and their
+// order survive the clock wrapping around, and that setPeriod() mid-run
+// moves the next release to one new period after the last.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include scheduler_check.cpp -o scheduler_check
+// Usage: scheduler_check [periods]
+//
+// unsigned long is 64 bits here and 32 on the ESP32; the wrap-around cases
+// start the clock just below ULONG_MAX, which is the same arithmetic as
+// millis() just below 2^32.
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "Scheduler.h"
+
+static unsigned long sim_now = 0;
+static unsigned long simClock() { return sim_now; }
+
+struct Run
+{
+    int task;
+    unsigned long due;
+    unsigned long at;
+};
+static std::vector<Run> log_runs;
+static unsigned long work_ms = 0;     // Time each run takes
+
+template <int ID>
+static void task(unsigned long due)
+{
+    Run r = {ID, due, sim_now};
+    log_runs.push_back(r);
+    sim_now += work_ms;
+}
+
+/** Sleeps until the next deadline plus late ms, as the main loop's delay() */
+template <size_t N>
+static void step(Scheduler<N> &s, unsigned long late)
+{
+    sim_now += s.untilNext(60000) + late;
+    s.runDue();
+}
+
+// Releases of task id in the log must be start + k * period for k = 0, 1, ...
+// except the skipped ones; returns the first that is off the grid, or -1
+static long offGrid(int id, unsigned long start, unsigned long period)
+{
+    for (size_t i = 0; i < log_runs.size(); i++)
+    {
+        const Run &r = log_runs[i];
+        if (r.task == id && (r.due - start) % period != 0)
+            return (long)i;
+    }
+    return -1;
+}
+
+static int checkNoDrift(long periods)
+{
+    sim_now = 12345;
+    log_runs.clear();
+    work_ms = 3;
+    Scheduler<2> s(simClock);
+    int a = s.every(1000, task<0>, 1000);
+    int b = s.every(250, task<1>);
+    unsigned long start_a = 12345 + 1000, start_b = 12345;
+
+    // Random lateness under a period, as from other work or a slow loop
+    std::mt19937 rng(5);
+    while (s.runs(a) < (uint32_t)periods)
+        step(s, rng() % 200);
+
+    int failures = 0;
+    long at = offGrid(0, start_a, 1000);
+    if (at < 0)
+        at = offGrid(1, start_b, 250);
+    if (at >= 0)
+    {
+        printf("FAIL: drift: run %ld of task %d was released at %lu\n", at, log_runs[at].task, log_runs[at].due);
+        failures++;
+    }
+    unsigned long last_due = 0;
+    for (size_t i = 0; i < log_runs.size(); i++)
+    {
+        if (log_runs[i].task == 0)
+            last_due = log_runs[i].due;
+    }
+    if (last_due != start_a + (periods - 1) * 1000 || s.overruns(a) || s.overruns(b) || s.maxLateness(a) >= 1000)
+    {
+        printf("FAIL: drift: release %ld at %lu, expected %lu; %u overruns, worst lateness %lu\n", periods,
+               last_due, start_a + (periods - 1) * 1000, s.overruns(a), s.maxLateness(a));
+        failures++;
+    }
+    printf("no drift: %ld periods, last release exactly on the grid, worst lateness %lu ms\n", periods,
+           s.maxLateness(a));
+    return failures;
+}
+
+static int checkOverrun()
+{
+    sim_now = 0;
+    log_runs.clear();
+    work_ms = 0;
+    Scheduler<1> s(simClock);
+    int a = s.every(1000, task<0>);
+    for (int i = 0; i < 5; i++)
+        step(s, 0);     // Releases 0 .. 4000
+
+    // The loop stalls for 3.5 periods: releases 5000, 6000 and 7000 are missed
+    sim_now = 4000 + 3500 + 1000;
+    s.runDue();
+    for (int i = 0; i < 3; i++)
+        step(s, 0);
+
+    static const unsigned long expect_due[] = {0, 1000, 2000, 3000, 4000, 5000, 9000, 10000, 11000};
+    static const unsigned long expect_at[] = {0, 1000, 2000, 3000, 4000, 8500, 9000, 10000, 11000};
+    const size_t n = sizeof(expect_due) / sizeof(expect_due[0]);
+    bool ok = log_runs.size() == n && s.overruns(a) == 3 && s.maxLateness(a) == 3500;
+    for (size_t i = 0; ok && i < n; i++)
+        ok = log_runs[i].due == expect_due[i] && log_runs[i].at == expect_at[i];
+    if (!ok)
+    {
+        printf("FAIL: overrun: %zu runs, %u overruns, worst lateness %lu:", log_runs.size(), s.overruns(a),
+               s.maxLateness(a));
+        for (size_t i = 0; i < log_runs.size(); i++)
+            printf(" %lu@%lu", log_runs[i].due, log_runs[i].at);
+        printf("\n");
+        return 1;
+    }
+    printf("overrun: a 3.5 period stall runs the late release once, skips 3 and returns to the grid\n");
+    return 0;
+}
+
+static int checkWrap()
+{
+    int failures = 0;
+    sim_now = ULONG_MAX - 2500;
+    log_runs.clear();
+    work_ms = 0;
+    Scheduler<3> s(simClock);
+    unsigned long start = sim_now;
+    int a = s.every(1000, task<0>);
+    int b = s.oneShot(task<1>);
+    int c = s.every(700, task<2>, 300);
+    s.at(b, start + 4000);      // Past the wrap
+
+    // The one-shot is due after the wrap, the periodic tasks on both sides
+    if (s.untilNext(60000) != 0)
+    {
+        printf("FAIL: wrap: a task due now waits %lu\n", s.untilNext(60000));
+        failures++;
+    }
+    while (sim_now - start < 6000)
+        step(s, 0);
+
+    // Deadlines in order, each task on its grid, the one-shot once
+    for (size_t i = 1; i < log_runs.size(); i++)
+    {
+        if ((long)(log_runs[i].due - log_runs[i - 1].due) < 0)
+        {
+            printf("FAIL: wrap: release %lu ran after %lu\n", log_runs[i].due, log_runs[i - 1].due);
+            failures++;
+            break;
+        }
+    }
+    if (offGrid(0, start, 1000) >= 0 || offGrid(2, start + 300, 700) >= 0 || s.runs(b) != 1 || s.overruns(a) ||
+        s.overruns(c) || s.maxLateness(a) || s.maxLateness(b) || s.maxLateness(c))
+    {
+        printf("FAIL: wrap: %u, %u and %u runs, off the grid or late\n", s.runs(a), s.runs(b), s.runs(c));
+        failures++;
+    }
+
+    // Waiting across the wrap
+    sim_now = ULONG_MAX - 10;
+    s.at(b, sim_now + 100);
+    unsigned long wait = s.untilNext(60000);
+    if (wait != 100)
+    {
+        printf("FAIL: wrap: waits %lu for a deadline 100 ahead\n", wait);
+        failures++;
+    }
+    printf("wrap: %zu runs across the clock wrap in deadline order, on the grid\n", log_runs.size());
+    return failures;
+}
+
+static int checkSetPeriod()
+{
+    sim_now = 0;
+    log_runs.clear();
+    work_ms = 0;
+    Scheduler<1> s(simClock);
+    int a = s.every(1000, task<0>);
+    step(s, 0);                 // 0
+    step(s, 0);                 // 1000
+
+    // Shorter, between runs: the next release is 500 after the last
+    sim_now = 1200;
+    s.setPeriod(a, 500);
+    step(s, 0);                 // 1500
+    step(s, 0);                 // 2000
+
+    // Longer
+    s.setPeriod(a, 3000);
+    step(s, 0);                 // 5000
+    step(s, 0);                 // 8000
+
+    // Shorter than the time since the last run: the release is already due and runs at once
+    sim_now = 9000;
+    s.setPeriod(a, 200);
+    step(s, 0);                 // 8200 runs at 9000; 8400 .. 9000 are skipped
+    step(s, 0);                 // 9200
+
+    static const unsigned long expect_due[] = {0, 1000, 1500, 2000, 5000, 8000, 8200, 9200};
+    const size_t n = sizeof(expect_due) / sizeof(expect_due[0]);
+    bool ok = log_runs.size() == n && s.overruns(a) == 4;
+    for (size_t i = 0; ok && i < n; i++)
+        ok = log_runs[i].due == expect_due[i];
+    if (!ok)
+    {
+        printf("FAIL: setPeriod: %zu runs, %u overruns:", log_runs.size(), s.overruns(a));
+        for (size_t i = 0; i < log_runs.size(); i++)
+            printf(" %lu@%lu", log_runs[i].due, log_runs[i].at);
+        printf("\n");
+        return 1;
+    }
+    printf("setPeriod: the next release is one new period after the last one\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long periods = argc > 1 ? atol(argv[1]) : 100000;
+    int failures = checkNoDrift(periods);
+    failures += checkOverrun();
+    failures += checkWrap();
+    failures += checkSetPeriod();
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Builds every firmware environment and prints its flash and RAM use, as
+# reported by PlatformIO, one line per target. Run from the repository root
+# with PlatformIO (pio) on the PATH.
+#
+# Usage: tools/size_report.sh [project ...]    (default: sensor-src-m5 sensor-v2)
+
+set -u
+
+projects=${*:-"sensor-src-m5 sensor-v2"}
+status=0
+
+for project in $projects; do
+  envs=$(sed -n 's/^\[env:\(.*\)\].*/\1/p' "$project/platformio.ini" | tr -d '\r')
+  for env in $envs; do
+    [ "$env" = native ] && continue   # Host build, no flash
+    out=$(pio run -d "$project" -e "$env" 2>&1)
+    if [ $? -ne 0 ]; then
+      echo "$project/$env: build failed"
+      status=1
+      continue
+    fi
+    ram=$(echo "$out" | sed -n 's/^RAM: *\[.*\] *\(.*\)$/\1/p')
+    flash=$(echo "$out" | sed -n 's/^Flash: *\[.*\] *\(.*\)$/\1/p')
+    printf '%s/%s\n  flash %s\n  RAM   %s\n' "$project" "$env" "$flash" "$ram"
+  done
+done
+exit $status
@@ -0,0 +1,196 @@
+// Host check of the lock-free queue between the sampling and network tasks
+// (sensor-src-m5/include/SpscQueue.h). Single-threaded: empty and full
+// behaviour, overflow counting and FIFO order while the free-running
+// indices wrap (with 8-bit indices, which wrap every 256 items). Then a
+// std::thread producer and consumer run millions of items through queues of
+// a few slots, checking that every item arrives once, in order and whole,
+// both when the producer retries a full queue and when it drops items
+// there as the sampling task does. Build it with ThreadSanitizer; a data
+// race on the slots or the indices is reported and fails the run.
+//
+// Build: g++ -std=c++11 -O1 -g -fsanitize=thread -pthread -I../sensor-src-m5/include spsc_queue_check.cpp -o spsc_queue_check
+// Usage: spsc_queue_check [items]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+
+// Large enough that a torn copy would show, like a SensorData
+struct Item
+{
+    uint32_t seq;
+    uint32_t words[15];     // All seq * 2654435761 + i
+};
+
+static Item makeItem(uint32_t seq)
+{
+    Item it;
+    it.seq = seq;
+    for (uint32_t i = 0; i < 15; i++)
+        it.words[i] = seq * 2654435761u + i;
+    return it;
+}
+
+static bool whole(const Item &it)
+{
+    for (uint32_t i = 0; i < 15; i++)
+    {
+        if (it.words[i] != it.seq * 2654435761u + i)
+            return false;
+    }
+    return true;
+}
+
+template <typename Index>
+static int checkSingleThread(const char *what)
+{
+    const size_t N = 16;
+    static SpscQueue<Item, N, Index> q;     // One per instantiation, zeroed like the firmware's globals
+    Item it;
+    int failures = 0;
+    if (q.pop(it) || q.size() != 0)
+    {
+        printf("FAIL: %s: an empty queue pops\n", what);
+        failures++;
+    }
+
+    // Fill levels from empty to full and back, 2000 times round the ring
+    uint32_t pushed = 0, popped = 0, rejected = 0;
+    for (int round = 0; round < 2000 && failures < 5; round++)
+    {
+        size_t fill = (round * 7) % (N + 3);    // Sometimes more than fit
+        for (size_t i = 0; i < fill; i++)
+        {
+            bool full = q.size() == N;
+            if (q.push(makeItem(pushed)) == full)
+            {
+                printf("FAIL: %s: push into a queue of %zu returned %d\n", what, q.size(), !full);
+                failures++;
+            }
+            if (full)
+                rejected++;
+            else
+                pushed++;
+        }
+        if (q.overflows() != rejected)
+        {
+            printf("FAIL: %s: %u overflows counted, %u pushes rejected\n", what, q.overflows(), rejected);
+            failures++;
+        }
+        while (q.pop(it))
+        {
+            if (it.seq != popped++ || !whole(it))
+            {
+                printf("FAIL: %s: popped %u, expected %u\n", what, it.seq, popped - 1);
+                failures++;
+            }
+        }
+        if (popped != pushed || q.size() != 0)
+        {
+            printf("FAIL: %s: %u pushed, %u popped\n", what, pushed, popped);
+            failures++;
+        }
+    }
+    if (q.highWater() != N)
+    {
+        printf("FAIL: %s: high water %zu, capacity %zu\n", what, q.highWater(), N);
+        failures++;
+    }
+    uint32_t wraps = sizeof(Index) < sizeof(pushed) ? pushed >> (8 * (sizeof(Index) % sizeof(pushed))) : 0;
+    printf("%s: %u items through 16 slots (indices wrapped %u times), %u rejected when full\n", what, pushed, wraps,
+           rejected);
+    return failures;
+}
+
+/**
+ * Producer and consumer threads. With retry the producer spins on a full
+ * queue and every item must arrive; without, it pushes in bursts and drops
+ * what does not fit, and what arrives must still be in order. Every failed
+ * push is an overflow either way.
+ */
+template <size_t N, typename Index>
+static int checkThreads(const char *what, uint32_t items, bool retry)
+{
+    static SpscQueue<Item, N, Index> q;     // One per instantiation, zeroed like the firmware's globals
+    std::atomic<bool> done(false);
+    uint32_t dropped = 0, full = 0;
+
+    std::thread producer([&]() {
+        for (uint32_t seq = 0; seq < items; seq++)
+        {
+            Item it = makeItem(seq);
+            while (!q.push(it))
+            {
+                full++;
+                if (!retry)
+                {
+                    dropped++;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            if (!retry && seq % 4 == 3)
+                std::this_thread::yield();
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    int failures = 0;
+    uint32_t received = 0;
+    int64_t last = -1;
+    for (;;)
+    {
+        Item it;
+        if (q.pop(it))
+        {
+            if ((int64_t)it.seq <= last || (retry && it.seq != last + 1) || !whole(it))
+            {
+                if (failures++ < 5)
+                    printf("FAIL: %s: got item %u%s after %lld\n", what, it.seq, whole(it) ? "" : " (torn)",
+                           (long long)last);
+            }
+            last = it.seq;
+            received++;
+        }
+        else if (done.load(std::memory_order_acquire) && q.size() == 0)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    if (received + dropped != items || q.overflows() != full || (!retry && received < items / 100))
+    {
+        printf("FAIL: %s: %u received + %u dropped of %u, %u overflows counted for %u full pushes\n", what,
+               received, dropped, items, q.overflows(), full);
+        failures++;
+    }
+    printf("%s: %u items in order, %u full pushes, %u dropped, high water %zu of %zu\n", what, received, full,
+           dropped, q.highWater(), N);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t items = argc > 1 ? (uint32_t)atol(argv[1]) : 1000000;
+    int failures = checkSingleThread<size_t>("single thread");
+    failures += checkSingleThread<uint8_t>("single thread, 8-bit indices");
+    failures += checkThreads<4, size_t>("threads, retry when full", items, true);
+    failures += checkThreads<16, uint8_t>("threads, 8-bit indices", items, true);
+    failures += checkThreads<2, size_t>("threads, drop when full", items, false);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,329 @@
+// Server side of the UDP uplink (sensor-src-m5/include/UdpUplink.h).
+// Answers registrations and data frames with acks and appends every record
+// to data/data_<name>.csv in the layout server-src/app.py writes, so the
+// rest of the tooling reads it unchanged.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include udp_receiver.cpp -o udp_receiver
+// Usage: udp_receiver [--port 6767] [--data-dir data]
+//
+// Sessions live in memory only. After a restart devices get "unknown
+// session" acks and register again, like after a restart of the Flask server.
+//
+// Devices with extra gas channels (GasChannels.h) announce their keys at
+// registration; up to GAS_MAX_CHANNELS - 1 are accepted.
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define GAS_MAX_CHANNELS 16
+#include <UdpUplink.h>
+
+struct Session
+{
+    std::string name;
+    std::string plant_id;
+    std::string disease_status;
+    std::vector<std::string> gas_channels;
+    uint32_t seq;       // Last record received without a gap
+};
+
+static std::map<uint32_t, Session> sessions;
+static uint32_t next_session = 1;
+static std::string data_dir = "data";
+
+static std::string now()
+{
+    char buf[32];
+    time_t t = time(NULL);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    return buf;
+}
+
+#define LOG(...)                                  \
+    do                                            \
+    {                                             \
+        printf("[%s] ", now().c_str());           \
+        printf(__VA_ARGS__);                      \
+        printf("\n");                             \
+        fflush(stdout);                           \
+    } while (0)
+
+/**
+ * Value of a string member of a flat JSON object, as the firmware writes
+ * it (no escapes in the identity strings); def if it is missing
+ */
+static std::string jsonString(const std::string &json, const char *key, const char *def)
+{
+    std::string pattern = std::string("\"") + key + "\":\"";
+    size_t start = json.find(pattern);
+    if (start == std::string::npos)
+        return def;
+    start += pattern.size();
+    size_t end = json.find('"', start);
+    return end == std::string::npos ? def : json.substr(start, end - start);
+}
+
+/** Strings of a flat array member of a JSON object; empty if it is missing */
+static std::vector<std::string> jsonStringArray(const std::string &json, const char *key)
+{
+    std::vector<std::string> out;
+    std::string pattern = std::string("\"") + key + "\":[";
+    size_t pos = json.find(pattern);
+    if (pos == std::string::npos)
+        return out;
+    size_t end = json.find(']', pos);
+    if (end == std::string::npos)
+        return out;
+    for (pos += pattern.size(); (pos = json.find('"', pos)) < end;)
+    {
+        size_t close = json.find('"', pos + 1);
+        if (close == std::string::npos || close > end)
+            break;
+        out.push_back(json.substr(pos + 1, close - pos - 1));
+        pos = close + 1;
+    }
+    return out;
+}
+
+/**
+ * Formats a fixed-point value like Python's repr(round(n / 10**decimals,
+ * decimals)), which is what app.py writes for bin1 records: shortest form,
+ * at least one decimal, and scientific notation below 1e-4.
+ */
+static std::string pyFloat(int64_t n, uint8_t decimals)
+{
+    std::string sign = n < 0 ? "-" : "";
+    uint64_t mag = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    std::string digits = std::to_string((unsigned long long)mag);
+    int exponent = (int)digits.size() - 1 - decimals;  // Of the leading digit
+    if (mag != 0 && exponent < -4)
+    {
+        std::string mantissa = digits.substr(0, 1);
+        std::string rest = digits.substr(1);
+        while (!rest.empty() && rest[rest.size() - 1] == '0')
+            rest.erase(rest.size() - 1);
+        if (!rest.empty())
+            mantissa += "." + rest;
+        char exp[16];
+        snprintf(exp, sizeof(exp), "e-%02d", -exponent);
+        return sign + mantissa + exp;
+    }
+
+    if (digits.size() <= decimals)
+        digits.insert(0, decimals + 1 - digits.size(), '0');
+    std::string whole = digits.substr(0, digits.size() - decimals);
+    std::string frac = digits.substr(digits.size() - decimals);
+    while (frac.size() > 1 && frac[frac.size() - 1] == '0')
+        frac.erase(frac.size() - 1);
+    return sign + whole + "." + (frac.empty() ? "0" : frac);
+}
+
+/** Python's csv module quotes fields with separators, quotes or line breaks */
+static std::string csvField(const std::string &s)
+{
+    if (s.find_first_of(",\"\r\n") == std::string::npos)
+        return s;
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '"')
+            out += '"';
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+static void storeRecord(const Session &session, const WireValues &values, size_t fields)
+{
+    std::string path = data_dir + "/data_" + session.name + ".csv";
+    bool present = access(path.c_str(), F_OK) == 0;
+    FILE *f = fopen(path.c_str(), "ab");
+    if (!f)
+    {
+        LOG("Cannot open %s", path.c_str());
+        return;
+    }
+
+    // Same header, columns and \r\n line ends as csv.writer in app.py
+    if (!present)
+    {
+        fputs("Timestamp,Sensor Timestamp,Plant ID,Disease Status", f);
+        for (size_t i = 1; i < WIRE_FIELD_COUNT; i++)
+            fprintf(f, ",%s", csvField(SENSOR_JSON_FIELDS[i - 1].header).c_str());
+        for (size_t c = 0; c < session.gas_channels.size(); c++)
+        {
+            std::string key = session.gas_channels[c];
+            for (size_t i = 0; i < key.size(); i++)
+                key[i] = toupper((unsigned char)key[i]);
+            for (size_t i = 0; i < GAS_FEATURE_FIELD_COUNT; i++)
+                fprintf(f, ",%s", csvField(key + " " + GAS_FEATURE_FIELDS[i].header).c_str());
+        }
+        fputs("\r\n", f);
+    }
+    std::string row = now() + "," + std::to_string((long long)values.v[0]) + "," + csvField(session.plant_id) +
+                      "," + csvField(session.disease_status);
+    for (size_t i = 1; i < fields; i++)
+        row += "," + pyFloat(values.v[i], WIRE_decimals(i));
+    row += "\r\n";
+    fputs(row.c_str(), f);
+    fclose(f);
+}
+
+static void sendAck(int fd, const sockaddr_in &peer, uint32_t session, uint32_t seq)
+{
+    uint8_t buf[UDP_MAX_ACK];
+    size_t len = UDP_encodeAck(buf, session, seq);
+    sendto(fd, buf, len, 0, (const sockaddr *)&peer, sizeof(peer));
+}
+
+static void handleRegistration(int fd, const sockaddr_in &peer, const std::string &json)
+{
+    Session s;
+    s.name = jsonString(json, "name", "");
+    s.plant_id = jsonString(json, "plant_id", "unknown");
+    s.disease_status = jsonString(json, "disease_status", "unknown");
+    s.gas_channels = jsonStringArray(json, "gas_channels");
+    s.seq = 0;
+    if (s.name.empty() || s.name.find_first_of("/\\") != std::string::npos)
+    {
+        LOG("Rejected registration without a usable name");
+        return;
+    }
+    if (s.gas_channels.size() > GAS_EXTRA_CHANNELS)
+    {
+        LOG("Rejected registration of %s with %zu gas channels", s.name.c_str(), s.gas_channels.size());
+        return;
+    }
+
+    // A device that registers again starts a new session and its old ones
+    // are dropped, unless this is a resend whose ack got lost
+    for (std::map<uint32_t, Session>::iterator it = sessions.begin(); it != sessions.end();)
+    {
+        if (it->second.name == s.name && it->second.seq == 0)
+        {
+            sendAck(fd, peer, it->first, 0);
+            return;
+        }
+        if (it->second.name == s.name)
+            sessions.erase(it++);
+        else
+            ++it;
+    }
+    uint32_t id = next_session++;
+    sessions[id] = s;
+    LOG("%s registered, session %u", s.name.c_str(), id);
+    sendAck(fd, peer, id, 0);
+}
+
+static void handleFrame(int fd, const sockaddr_in &peer, const uint8_t *buf, size_t len)
+{
+    WireDecoder wire(buf, len);
+    uint32_t session_id, base_seq;
+    bool absolute;
+    if (!wire.begin(session_id, base_seq, absolute) || !absolute)
+    {
+        LOG("Dropped malformed frame (%zu bytes)", len);
+        return;
+    }
+
+    std::map<uint32_t, Session>::iterator it = sessions.find(session_id);
+    if (it == sessions.end())
+    {
+        sendAck(fd, peer, 0, 0);  // Unknown session: register again
+        return;
+    }
+    Session &s = it->second;
+    if (wire.gasChannels() != s.gas_channels.size())
+    {
+        LOG("%s: dropped frame with %zu gas channels, registered %zu", s.name.c_str(), wire.gasChannels(),
+            s.gas_channels.size());
+        return;
+    }
+
+    // Frames past a gap are dropped; the repeated ack makes the device resend
+    // from the gap. Records up to s.seq in a resent frame are duplicates.
+    if ((int32_t)(base_seq - s.seq) > 0)
+    {
+        LOG("%s: gap, expected record %u, frame starts at %u", s.name.c_str(), s.seq + 1, base_seq + 1);
+        sendAck(fd, peer, session_id, s.seq);
+        return;
+    }
+
+    wire.setBase(NULL);
+    SensorData record;
+    uint32_t seq = base_seq;
+    int stored = 0;
+    while (wire.next(record))
+    {
+        seq++;
+        if ((int32_t)(seq - s.seq) > 0)
+        {
+            storeRecord(s, wire.last(), wire.fieldCount());
+            s.seq = seq;
+            stored++;
+        }
+    }
+    if (wire.failed())
+        LOG("%s: truncated frame after record %u", s.name.c_str(), seq);
+    if (stored)
+        LOG("%s: stored %d records, up to %u", s.name.c_str(), stored, s.seq);
+    sendAck(fd, peer, session_id, s.seq);
+}
+
+int main(int argc, char **argv)
+{
+    int port = 6767;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--port") == 0)
+            port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--data-dir") == 0)
+            data_dir = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "usage: udp_receiver [--port 6767] [--data-dir data]\n");
+            return 2;
+        }
+    }
+    mkdir(data_dir.c_str(), 0755);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (fd < 0 || bind(fd, (const sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("bind");
+        return 1;
+    }
+    LOG("Listening on UDP port %d, writing to %s/", port, data_dir.c_str());
+
+    uint8_t buf[UDP_MAX_DATAGRAM + 1];
+    for (;;)
+    {
+        sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (sockaddr *)&peer, &peer_len);
+        if (n <= 0)
+            continue;
+        if (buf[0] == '{')
+            handleRegistration(fd, peer, std::string((const char *)buf, n));
+        else if (buf[0] == WIRE_MAGIC)
+            handleFrame(fd, peer, buf, n);
+    }
+}
@@ -0,0 +1,223 @@
+// Host device for the UDP uplink: runs the firmware's UdpUplink over BSD
+// sockets, with datagram loss injected in both directions, and sends a run
+// of synthetic records to udp_receiver over loopback.
+//
+// Build: g++ -std=c++11 -O2 -I../sensor-src-m5/include udp_sender.cpp -o udp_sender
+// Usage: udp_sender [--host 127.0.0.1] [--port 6767] [--records 1000]
+//                   [--loss 0] [--name udp_test] [--seed 1]
+//
+// Every record carries its index as the sensor timestamp, so the receiver's
+// CSV must end up with timestamps 0 .. records-1, each exactly once.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include <SensorJson.h>
+#include <UdpUplink.h>
+
+static uint32_t rng_state = 1;
+
+static double uniform()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state >> 8) * (1.0 / 16777216.0);
+}
+
+/** UdpUplink socket policy over BSD sockets, dropping datagrams at random */
+class PosixUdp
+{
+public:
+    typedef sockaddr_in Address;
+
+    explicit PosixUdp(double loss) : loss(loss), sent(0), dropped(0)
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+
+    ~PosixUdp() { close(fd); }
+
+    bool resolve(const char *host, Address &addr)
+    {
+        hostent *he = gethostbyname(host);
+        if (!he || he->h_addrtype != AF_INET)
+            return false;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+        return true;
+    }
+
+    bool send(const Address &addr, uint16_t port, const uint8_t *data, size_t len)
+    {
+        sent++;
+        if (uniform() < loss)
+        {
+            dropped++;
+            return true;  // Lost on the way
+        }
+        Address to = addr;
+        to.sin_port = htons(port);
+        return sendto(fd, data, len, 0, (const sockaddr *)&to, sizeof(to)) == (ssize_t)len;
+    }
+
+    int receive(uint8_t *buf, size_t len, uint32_t timeout_ms)
+    {
+        for (;;)
+        {
+            timeval tv;
+            tv.tv_sec = timeout_ms / 1000;
+            tv.tv_usec = (timeout_ms % 1000) * 1000;
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            ssize_t n = recv(fd, buf, len, 0);
+            if (n <= 0)
+                return 0;
+            if (uniform() >= loss)
+                return (int)n;
+            dropped++;  // The ack was lost; wait for the next one within the same timeout
+            timeout_ms = 1;
+        }
+    }
+
+    uint32_t now()
+    {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double loss;
+    uint32_t sent;
+    uint32_t dropped;
+
+private:
+    int fd;
+};
+
+/** In-memory stand-in for the firmware's flash RecordQueue */
+struct MemoryQueue
+{
+    std::deque<SensorData> records;
+
+    bool peek(uint32_t i, SensorData &rec)
+    {
+        if (i >= records.size())
+            return false;
+        rec = records[i];
+        return true;
+    }
+
+    bool pop(uint32_t n)
+    {
+        for (uint32_t i = 0; i < n && !records.empty(); i++)
+            records.pop_front();
+        return true;
+    }
+
+    uint32_t size() const { return records.size(); }
+};
+
+int main(int argc, char **argv)
+{
+    std::string host = "127.0.0.1";
+    int port = 6767;
+    int records = 1000;
+    double loss = 0;
+    std::string name = "udp_test";
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string a = argv[i];
+        if (a == "--host")
+            host = argv[i + 1];
+        else if (a == "--port")
+            port = atoi(argv[i + 1]);
+        else if (a == "--records")
+            records = atoi(argv[i + 1]);
+        else if (a == "--loss")
+            loss = atof(argv[i + 1]);
+        else if (a == "--name")
+            name = argv[i + 1];
+        else if (a == "--seed")
+            rng_state = strtoul(argv[i + 1], NULL, 10) | 1;
+        else
+        {
+            fprintf(stderr, "usage: see the comment at the top of tools/udp_sender.cpp\n");
+            return 2;
+        }
+    }
+
+    // The m5 firmware's configuration, on the loopback host; the records carry only the MQ2
+    PosixUdp udp(loss);
+    UdpUplink<PosixUdp>::Config config = {host.c_str(), (uint16_t)port, 600000, 300, 4, 5, 20, 0};
+    UdpUplink<PosixUdp> uplink(udp, config);
+
+    MemoryQueue queue;
+    for (int i = 0; i < records; i++)
+    {
+        SensorData d = SensorData();
+        d.timestamp = i;
+        d.temperature = 20 + (i % 100) * 0.01f;
+        d.humidity = 45.5f;
+        d.pressure = 101.325f;
+        d.gasResistance = 120.25f;
+        d.mq2_rs = 98300 - i;
+        d.mq2_r0 = 10000;
+        d.mq2_ratio = d.mq2_rs / d.mq2_r0;
+        d.mq2_delta = (i % 7 - 3) * 0.001f;
+        d.mq2_variance = 0.000012f;
+        d.mq2_baseline = 9.5f;
+        queue.records.push_back(d);
+    }
+
+    const DeviceIdentity id = {name.c_str(), "loopback", name.c_str(), "healthy"};
+    char json[SENSOR_JSON_MAX_LEN];
+    uint32_t session = 0, seq = 0;
+    uint32_t calls = 0, datagrams = 0, resent = 0, failures = 0;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    while (queue.size() > 0 && failures < 20)
+    {
+        if (session == 0)
+        {
+            JsonWriter w(json, sizeof(json));
+            JSON_writeRegistration(w, id, true, 0);
+            if (uplink.registerDevice(json, w.length(), session) != UDP_UPLINK_OK)
+            {
+                failures++;
+                continue;
+            }
+            seq = 0;
+        }
+
+        int result = uplink.send(queue, session, seq);
+        calls++;
+        datagrams += uplink.lastStats().datagrams;
+        resent += uplink.lastStats().resent;
+        if (result == UDP_UPLINK_SESSION)
+            session = 0;
+        else if (result != UDP_UPLINK_OK)
+            failures++;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%d records in %u sends, %u data datagrams (%u resent), %u datagrams or acks dropped, %.2f s\n",
+           records - (int)queue.size(), calls, datagrams, resent, udp.dropped, elapsed);
+    if (queue.size())
+    {
+        printf("FAIL: %u records not acknowledged\n", queue.size());
+        return 1;
+    }
+    return 0;
+}
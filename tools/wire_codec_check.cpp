@@ -0,0 +1,456 @@
+// Host check of the bin1 uplink codec (sensor-src-m5/include/WireCodec.h).
+// Round-trips records with zero, negative and large deltas (and every extra
+// gas channel field) through WireEncoder and WireDecoder, runs the device's
+// delta-base handshake against a model of /update_bin in server-src/app.py
+// across base_seq and session rollover, the 409 resend after a lost
+// response and the 410 re-registration after a server restart, and compares the size of a recorded trace as bin1 frames and as
+// JSON batches.
+//
+// Build: g++ -std=c++11 -O2 -DGAS_MAX_CHANNELS=3 -I../sensor-src-m5/include wire_codec_check.cpp -o wire_codec_check
+// Usage: wire_codec_check [trace.csv]   (default ../server-src/data/data_plant_001.csv)
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "WireCodec.h"
+
+static const int MAX_BATCH = 20;        // main.cpp
+static uint8_t frame[MAX_BATCH * WIRE_MAX_FIELDS * 10 + 32];
+
+/** A record whose value fields are x + i / 8 (the timestamp is t) */
+static SensorData makeRecord(unsigned long t, float x)
+{
+    SensorData r = SensorData();
+    float *fields = (float *)&r;
+    for (size_t i = 0; i < offsetof(SensorData, timestamp) / sizeof(float); i++)
+        fields[i] = x + i / 8.0f;
+    r.timestamp = t;
+    return r;
+}
+
+/** Whether every sent field of b is a at its wire precision */
+static bool sameOnWire(const SensorData &a, const SensorData &b, size_t channels)
+{
+    WireValues va, vb;
+    WIRE_toValues(a, va, channels);
+    WIRE_toValues(b, vb, channels);
+    return memcmp(va.v, vb.v, WIRE_fieldCount(channels) * sizeof(int64_t)) == 0;
+}
+
+// Encodes records as one frame, decodes it and compares
+static int roundTrip(const char *what, const std::vector<SensorData> &records, size_t channels, const WireValues *base)
+{
+    WireEncoder enc(frame, sizeof(frame));
+    enc.begin(0xFFFFFFFFu, 0xFFFFFFFEu, base, channels);
+    for (size_t i = 0; i < records.size(); i++)
+        enc.add(records[i]);
+    if (!enc.ok())
+    {
+        printf("FAIL: %s: frame overflow\n", what);
+        return 1;
+    }
+
+    WireDecoder dec(frame, enc.length());
+    uint32_t session, base_seq;
+    bool absolute;
+    if (!dec.begin(session, base_seq, absolute) || session != 0xFFFFFFFFu || base_seq != 0xFFFFFFFEu ||
+        absolute != (base == NULL) || dec.gasChannels() != channels)
+    {
+        printf("FAIL: %s: header decodes as session %u, base_seq %u, absolute %d, %zu channels\n", what, session,
+               base_seq, absolute, dec.gasChannels());
+        return 1;
+    }
+    dec.setBase(base);
+    SensorData out;
+    size_t n = 0;
+    for (; dec.next(out); n++)
+    {
+        WireValues expect;
+        WIRE_toValues(records[n], expect, channels);
+        if (n >= records.size() || !sameOnWire(records[n], out, channels) ||
+            memcmp(dec.last().v, expect.v, WIRE_fieldCount(channels) * sizeof(int64_t)) != 0)
+        {
+            printf("FAIL: %s: record %zu does not round-trip\n", what, n);
+            return 1;
+        }
+    }
+    if (dec.failed() || n != records.size())
+    {
+        printf("FAIL: %s: %zu of %zu records decoded%s\n", what, n, records.size(), dec.failed() ? ", error" : "");
+        return 1;
+    }
+
+    // Every cut of the frame is an error or ends on a record boundary, never a wrong record
+    for (size_t cut = 3; cut < enc.length(); cut++)
+    {
+        WireDecoder part(frame, cut);
+        if (!part.begin(session, base_seq, absolute))
+            continue;
+        part.setBase(base);
+        size_t m = 0;
+        bool wrong = false;
+        while (!wrong && part.next(out))
+            wrong = m >= records.size() || !sameOnWire(records[m++], out, channels);
+        if (wrong)
+        {
+            printf("FAIL: %s: frame cut at %zu bytes decodes a wrong record %zu\n", what, cut, m);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int checkRoundTrip()
+{
+    int failures = 0;
+    for (size_t channels = 0; channels <= GAS_EXTRA_CHANNELS; channels++)
+    {
+        std::vector<SensorData> records;
+        records.push_back(makeRecord(1000, 20));
+        records.push_back(makeRecord(1000, 20));            // Zero deltas
+        records.push_back(makeRecord(999, -20));            // Negative values and deltas
+        records.push_back(makeRecord(4294967295UL, 1e6f));  // Large positive deltas
+        records.push_back(makeRecord(0, -1e6f));            // Large negative deltas
+        records.push_back(makeRecord(17, 0));
+        SensorData odd = makeRecord(18, 0.5f);
+        odd.temperature = NAN;                              // Sent as 0
+        odd.mq2_variance = 1e-7f;                           // Below the precision
+        records.push_back(odd);
+        for (size_t c = 0; c < GAS_EXTRA_CHANNELS; c++)
+        {
+            records.back().gas[c].rs = -3.25f * (c + 1);
+            records.back().gas[c].variance = 123456.789f;
+        }
+
+        char what[48];
+        snprintf(what, sizeof(what), "absolute, %zu gas channels", channels);
+        failures += roundTrip(what, records, channels, NULL);
+
+        WireValues base;
+        WIRE_toValues(makeRecord(123456, -7), base, channels);
+        snprintf(what, sizeof(what), "delta, %zu gas channels", channels);
+        failures += roundTrip(what, records, channels, &base);
+    }
+
+    // A zero delta is one byte per field
+    WireEncoder enc(frame, sizeof(frame));
+    WireValues base;
+    WIRE_toValues(makeRecord(1000, 20), base);
+    enc.begin(1, 0, &base);
+    size_t header = enc.length();
+    enc.add(makeRecord(1000, 20));
+    if (enc.length() - header != WIRE_FIELD_COUNT)
+    {
+        printf("FAIL: an unchanged record takes %zu bytes\n", enc.length() - header);
+        failures++;
+    }
+    printf("round trip: zero, negative and large deltas, 0..%zu gas channels\n", GAS_EXTRA_CHANNELS);
+    return failures;
+}
+
+/**
+ * /update_bin as in server-src/app.py: a frame of an unknown session gets
+ * 410, a delta frame must start from the last record the session stored,
+ * else 409; sequence numbers are uint32.
+ */
+struct ServerModel
+{
+    struct Session
+    {
+        bool have_last;
+        uint32_t last_seq;
+        WireValues last;
+    };
+    std::map<uint32_t, Session> sessions;
+    uint32_t next_session;
+    std::vector<SensorData> stored;
+
+    uint32_t registerDevice()
+    {
+        uint32_t id = next_session;
+        next_session = next_session == 0xFFFFFFFFu ? 1 : next_session + 1;
+        Session s = Session();
+        sessions[id] = s;
+        return id;
+    }
+
+    int update(const uint8_t *buf, size_t len)
+    {
+        WireDecoder dec(buf, len);
+        uint32_t session, base_seq;
+        bool absolute;
+        if (!dec.begin(session, base_seq, absolute))
+            return 400;
+        if (!sessions.count(session))
+            return 410;
+        Session &s = sessions[session];
+        if (!absolute && (!s.have_last || s.last_seq != base_seq))
+            return 409;
+        dec.setBase(absolute ? NULL : &s.last);
+        std::vector<SensorData> records;
+        SensorData r;
+        while (dec.next(r))
+            records.push_back(r);
+        if (dec.failed())
+            return 400;
+        stored.insert(stored.end(), records.begin(), records.end());
+        s.last_seq = base_seq + (uint32_t)records.size();
+        s.last = dec.last();
+        s.have_last = true;
+        return 200;
+    }
+};
+
+// The device side of API_update() in main.cpp
+struct DeviceModel
+{
+    uint32_t wire_session;
+    uint32_t wire_seq;
+    bool wire_have_base;
+    WireValues wire_base;
+    std::vector<SensorData> queue;
+    int conflicts;
+    int registrations;
+    int lose_responses;     // 200s that do not reach the device, as on a dropped connection
+
+    void registerWith(ServerModel &server)
+    {
+        wire_session = server.registerDevice();
+        registrations++;
+        wire_seq = 0;
+        wire_have_base = false;
+    }
+
+    /** Sends everything queued; returns false on an error other than 409 and 410 */
+    bool drain(ServerModel &server)
+    {
+        while (!queue.empty())
+        {
+            int batch = queue.size() < (size_t)MAX_BATCH ? (int)queue.size() : MAX_BATCH;
+            WireEncoder wire(frame, sizeof(frame));
+            wire.begin(wire_session, wire_seq, wire_have_base ? &wire_base : NULL);
+            for (int i = 0; i < batch; i++)
+                wire.add(queue[i]);
+            int code = server.update(frame, wire.length());
+            if (code == 409)
+            {
+                conflicts++;
+                wire_have_base = false;
+                continue;
+            }
+            if (code == 410)
+            {
+                registerWith(server);
+                continue;
+            }
+            if (code == 200 && lose_responses > 0)
+            {
+                lose_responses--;
+                return false;
+            }
+            if (code != 200)
+                return false;
+            wire_seq += batch;
+            wire_base = wire.last();
+            wire_have_base = true;
+            queue.erase(queue.begin(), queue.begin() + batch);
+        }
+        return true;
+    }
+};
+
+/**
+ * Queues a few batches and drains them, losing lost_responses 200s on the
+ * way. Each lost one makes the device send that batch again, which the
+ * server answers with 409 and then stores a second time: delivery is at
+ * least once. Everything else must arrive once, in order, as sent.
+ */
+static int checkSession(const char *what, ServerModel &server, DeviceModel &device, unsigned long &t, int batches,
+                        int lost_responses)
+{
+    size_t before = server.stored.size();
+    device.conflicts = 0;
+    device.lose_responses = lost_responses;
+    for (int i = 0; i < batches * MAX_BATCH + 7; i++, t += 15000)
+        device.queue.push_back(makeRecord(t, sinf(t * 1e-5f) * 50));
+    std::vector<SensorData> sent = device.queue;
+    int drains = 0;
+    while (!device.drain(server) && ++drains <= lost_responses)
+        ;
+    if (!device.queue.empty())
+    {
+        printf("FAIL: %s: the drain failed\n", what);
+        return 1;
+    }
+
+    // Timestamps rise, so a record at or below the last one is a resend
+    std::vector<SensorData> unique;
+    size_t resent = 0;
+    for (size_t i = before; i < server.stored.size(); i++)
+    {
+        if (!unique.empty() && server.stored[i].timestamp <= unique.back().timestamp)
+            resent++;
+        else
+            unique.push_back(server.stored[i]);
+    }
+    bool same = unique.size() == sent.size();
+    for (size_t i = 0; same && i < sent.size(); i++)
+        same = sameOnWire(sent[i], unique[i], 0);
+    if (!same || device.conflicts != lost_responses || resent != (size_t)lost_responses * MAX_BATCH)
+    {
+        printf("FAIL: %s: %zu of %zu records stored as sent, %zu resent, %d conflicts (expected %d)\n", what,
+               unique.size(), sent.size(), resent, device.conflicts, lost_responses);
+        return 1;
+    }
+    printf("%s: %zu records, %d resent absolute after a 409\n", what, sent.size(), device.conflicts);
+    return 0;
+}
+
+static int checkHandshake()
+{
+    ServerModel server;
+    server.next_session = 1;
+    DeviceModel device = DeviceModel();
+    unsigned long t = 1000;
+    int failures = 0;
+
+    device.registerWith(server);
+    failures += checkSession("handshake", server, device, t, 4, 0);
+
+    // base_seq wraps past 2^32 mid-session
+    device.wire_seq = 0xFFFFFFFFu - 30;
+    server.sessions[device.wire_session].last_seq = device.wire_seq;
+    failures += checkSession("base_seq rollover", server, device, t, 3, 0);
+
+    // The server stored a batch but its 200 was lost: the resend starts
+    // from a base the server has moved past
+    failures += checkSession("lost response, 409 and resend", server, device, t, 3, 1);
+
+    // Session ids wrap past 2^32 - 1 to 1, never to 0 (JSON uplink on the device)
+    server.next_session = 0xFFFFFFFFu;
+    device.registerWith(server);
+    failures += checkSession("session 2^32 - 1", server, device, t, 2, 0);
+    device.registerWith(server);
+    if (device.wire_session != 1)
+    {
+        printf("FAIL: the session after 2^32 - 1 is %u\n", device.wire_session);
+        failures++;
+    }
+    failures += checkSession("session rollover", server, device, t, 2, 0);
+
+    // The server restarts and forgets every session: the next frame gets
+    // 410 and the device registers again at once, then sends the batch
+    server.sessions.clear();
+    int registrations = device.registrations;
+    failures += checkSession("server restart, 410 and re-registration", server, device, t, 2, 0);
+    if (device.registrations != registrations + 1 || !server.sessions.count(device.wire_session))
+    {
+        printf("FAIL: server restart: %d registrations\n", device.registrations - registrations);
+        failures++;
+    }
+    return failures;
+}
+
+// The trace as records, from a CSV in the layout app.py writes (not the
+// older five-column logs)
+static std::vector<SensorData> loadTrace(const char *path)
+{
+    std::vector<SensorData> records;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return records;
+    char line[1024];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, "Timestamp,Sensor Timestamp,", 27) != 0)
+    {
+        fclose(f);
+        return records;
+    }
+    const size_t fields = sizeof(SENSOR_JSON_FIELDS) / sizeof(SENSOR_JSON_FIELDS[0]);
+    while (fgets(line, sizeof(line), f))
+    {
+        SensorData r = SensorData();
+        char *p = strchr(line, ',');       // Server timestamp
+        if (!p)
+            continue;
+        r.timestamp = strtoul(p + 1, &p, 10);
+        p = strchr(p + 1, ',');             // Plant ID
+        p = p ? strchr(p + 1, ',') : NULL;  // Disease status
+        size_t i = 0;
+        for (; p && i < fields; i++)
+        {
+            r.*SENSOR_JSON_FIELDS[i].member = strtof(p + 1, &p);
+            p = strchr(p, ',');
+        }
+        if (i == fields)
+            records.push_back(r);
+    }
+    fclose(f);
+    return records;
+}
+
+static int checkSize(const char *path)
+{
+    std::vector<SensorData> trace = loadTrace(path);
+    if (trace.size() < (size_t)MAX_BATCH)
+    {
+        printf("FAIL: no records in %s, or not in the layout of app.py\n", path);
+        return 1;
+    }
+    static const DeviceIdentity device = {"plant_001", "39.042388, -77.550108", "plant_001", "healthy"};
+    static char json_buf[MAX_BATCH * SENSOR_JSON_MAX_LEN + 2];
+    size_t json_bytes = 0, wire_bytes = 0, first_frame = 0;
+    WireValues base;
+    for (size_t start = 0; start + MAX_BATCH <= trace.size(); start += MAX_BATCH)
+    {
+        JsonWriter json(json_buf, sizeof(json_buf));
+        json.beginArray();
+        WireEncoder wire(frame, sizeof(frame));
+        wire.begin(1, (uint32_t)start, start ? &base : NULL);
+        for (int i = 0; i < MAX_BATCH; i++)
+        {
+            JSON_writeSensorData(json, device, trace[start + i]);
+            wire.add(trace[start + i]);
+        }
+        json.endArray();
+        if (!json.ok() || !wire.ok())
+        {
+            printf("FAIL: batch at record %zu overflows\n", start);
+            return 1;
+        }
+        base = wire.last();
+        json_bytes += json.length();
+        wire_bytes += wire.length();
+        if (!start)
+            first_frame = wire.length();
+    }
+    size_t records = trace.size() / MAX_BATCH * MAX_BATCH;
+    printf("%s, %zu records in batches of %d:\n", path, records, MAX_BATCH);
+    printf("  JSON %7zu bytes (%.1f per record)\n", json_bytes, (double)json_bytes / records);
+    printf("  bin1 %7zu bytes (%.1f per record, %zu for the absolute first frame), %.1fx smaller\n", wire_bytes,
+           (double)wire_bytes / records, first_frame, (double)json_bytes / wire_bytes);
+    if (wire_bytes * 5 > json_bytes)
+    {
+        printf("FAIL: bin1 is less than 5x smaller than JSON\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace = argc > 1 ? argv[1] : "../server-src/data/data_plant_001.csv";
+    int failures = checkRoundTrip();
+    failures += checkHandshake();
+    failures += checkSize(trace);
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}